@@ -20,6 +20,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <gst/rtp/gstrtpbuffer.h>
+
 #include "rtsp-client.h"
 #include "rtsp-sdp.h"
 #include "rtsp-params.h"
@@ -32,6 +34,11 @@ enum
   PROP_0,
   PROP_SESSION_POOL,
   PROP_MEDIA_MAPPING,
+  PROP_SEND_LATENCY,
+  PROP_SEND_MAX_BYTES,
+  PROP_SEND_MAX_TIME,
+  PROP_DROP_POLICY,
+  PROP_SEND_STATS,
   PROP_LAST
 };
 
@@ -55,6 +62,17 @@ GST_DEBUG_CATEGORY_STATIC (rtsp_client_debug);
 
 static guint gst_rtsp_client_signals[SIGNAL_LAST] = { 0 };
 
+#define DEFAULT_SEND_LATENCY    0
+#define DEFAULT_SEND_MAX_BYTES  0
+#define DEFAULT_SEND_MAX_TIME   0
+#define DEFAULT_DROP_POLICY     GST_RTSP_CLIENT_DROP_POLICY_GOP
+
+/* maximum number of vectors we write in one go */
+#define MAX_SEND_VECTORS        64
+/* queued data frames are written as soon as this many bytes are queued,
+ * regardless of the send latency */
+#define SEND_COALESCE_BYTES     (32 * 1024)
+
 static void gst_rtsp_client_get_property (GObject * object, guint propid,
     GValue * value, GParamSpec * pspec);
 static void gst_rtsp_client_set_property (GObject * object, guint propid,
@@ -64,11 +82,39 @@ static void gst_rtsp_client_finalize (GObject * obj);
 static GstSDPMessage *create_sdp (GstRTSPClient * client, GstRTSPMedia * media);
 static void client_session_finalized (GstRTSPClient * client,
     GstRTSPSession * session);
+static void handle_request (GstRTSPClient * client, GstRTSPMessage * request);
 static void unlink_session_streams (GstRTSPClient * client,
     GstRTSPSession * session, GstRTSPSessionMedia * media);
+static void clear_send_queue (GstRTSPClient * client);
+static gchar *render_sdp (GstRTSPClient * client, GstRTSPMedia * media,
+    GBytes * cache, const gchar * range);
+static void send_describe_response (GstRTSPClient * client,
+    GstRTSPClientState * state, gchar * sdp);
+static gboolean do_close (GstRTSPClient * client);
 
 G_DEFINE_TYPE (GstRTSPClient, gst_rtsp_client, G_TYPE_OBJECT);
 
+GType
+gst_rtsp_client_drop_policy_get_type (void)
+{
+  static volatile gsize id = 0;
+  static const GEnumValue values[] = {
+    {GST_RTSP_CLIENT_DROP_POLICY_GOP,
+        "GST_RTSP_CLIENT_DROP_POLICY_GOP", "gop"},
+    {GST_RTSP_CLIENT_DROP_POLICY_DROPPABLE,
+        "GST_RTSP_CLIENT_DROP_POLICY_DROPPABLE", "droppable"},
+    {GST_RTSP_CLIENT_DROP_POLICY_DISCONNECT,
+        "GST_RTSP_CLIENT_DROP_POLICY_DISCONNECT", "disconnect"},
+    {0, NULL, NULL}
+  };
+
+  if (g_once_init_enter (&id)) {
+    GType tmp = g_enum_register_static ("GstRTSPClientDropPolicy", values);
+    g_once_init_leave (&id, tmp);
+  }
+  return (GType) id;
+}
+
 static void
 gst_rtsp_client_class_init (GstRTSPClientClass * klass)
 {
@@ -94,6 +140,38 @@ gst_rtsp_client_class_init (GstRTSPClientClass * klass)
           GST_TYPE_RTSP_MEDIA_MAPPING,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_SEND_LATENCY,
+      g_param_spec_uint ("send-latency", "Send Latency",
+          "Maximum time in milliseconds interleaved data is held back so that "
+          "it can be written together with other data (0 = no coalescing)",
+          0, G_MAXUINT, DEFAULT_SEND_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SEND_MAX_BYTES,
+      g_param_spec_uint ("send-max-bytes", "Send Max Bytes",
+          "Maximum amount of interleaved data in bytes queued for the client "
+          "before data is dropped (0 = unlimited)",
+          0, G_MAXUINT, DEFAULT_SEND_MAX_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SEND_MAX_TIME,
+      g_param_spec_uint ("send-max-time", "Send Max Time",
+          "Maximum duration in milliseconds of interleaved data queued for "
+          "the client before data is dropped (0 = unlimited)",
+          0, G_MAXUINT, DEFAULT_SEND_MAX_TIME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DROP_POLICY,
+      g_param_spec_enum ("drop-policy", "Drop Policy",
+          "What to do when the queued data exceeds the send limits",
+          GST_TYPE_RTSP_CLIENT_DROP_POLICY, DEFAULT_DROP_POLICY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SEND_STATS,
+      g_param_spec_boxed ("send-stats", "Send Stats",
+          "Statistics about the interleaved data of the client",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   gst_rtsp_client_signals[SIGNAL_CLOSED] =
       g_signal_new ("closed", G_TYPE_FROM_CLASS (klass), G_SIGNAL_RUN_LAST,
       G_STRUCT_OFFSET (GstRTSPClientClass, closed), NULL, NULL,
@@ -162,6 +240,13 @@ gst_rtsp_client_class_init (GstRTSPClientClass * klass)
 static void
 gst_rtsp_client_init (GstRTSPClient * client)
 {
+  g_mutex_init (&client->send_lock);
+  g_queue_init (&client->send_queue);
+  g_queue_init (&client->send_control);
+  client->send_latency = DEFAULT_SEND_LATENCY;
+  client->send_max_bytes = DEFAULT_SEND_MAX_BYTES;
+  client->send_max_time = DEFAULT_SEND_MAX_TIME;
+  client->drop_policy = DEFAULT_DROP_POLICY;
 }
 
 static void
@@ -211,14 +296,29 @@ gst_rtsp_client_finalize (GObject * obj)
     g_object_unref (client->media_mapping);
   if (client->auth)
     g_object_unref (client->auth);
+  if (client->port_pool)
+    g_object_unref (client->port_pool);
 
   if (client->uri)
     gst_rtsp_url_free (client->uri);
   if (client->media)
     g_object_unref (client->media);
+  if (client->factory)
+    g_object_unref (client->factory);
+
+  if (client->parked)
+    gst_rtsp_message_free (client->parked);
+  g_list_foreach (client->pending, (GFunc) gst_rtsp_message_free, NULL);
+  g_list_free (client->pending);
 
   g_free (client->server_ip);
 
+  clear_send_queue (client);
+  g_mutex_clear (&client->send_lock);
+
+  if (client->context)
+    g_main_context_unref (client->context);
+
   G_OBJECT_CLASS (gst_rtsp_client_parent_class)->finalize (obj);
 }
 
@@ -235,6 +335,25 @@ gst_rtsp_client_get_property (GObject * object, guint propid,
     case PROP_MEDIA_MAPPING:
       g_value_take_object (value, gst_rtsp_client_get_media_mapping (client));
       break;
+    case PROP_SEND_LATENCY:
+      g_value_set_uint (value, gst_rtsp_client_get_send_latency (client));
+      break;
+    case PROP_SEND_MAX_BYTES:
+      g_mutex_lock (&client->send_lock);
+      g_value_set_uint (value, client->send_max_bytes);
+      g_mutex_unlock (&client->send_lock);
+      break;
+    case PROP_SEND_MAX_TIME:
+      g_mutex_lock (&client->send_lock);
+      g_value_set_uint (value, client->send_max_time);
+      g_mutex_unlock (&client->send_lock);
+      break;
+    case PROP_DROP_POLICY:
+      g_value_set_enum (value, gst_rtsp_client_get_drop_policy (client));
+      break;
+    case PROP_SEND_STATS:
+      g_value_take_boxed (value, gst_rtsp_client_get_send_stats (client));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -253,6 +372,22 @@ gst_rtsp_client_set_property (GObject * object, guint propid,
     case PROP_MEDIA_MAPPING:
       gst_rtsp_client_set_media_mapping (client, g_value_get_object (value));
       break;
+    case PROP_SEND_LATENCY:
+      gst_rtsp_client_set_send_latency (client, g_value_get_uint (value));
+      break;
+    case PROP_SEND_MAX_BYTES:
+      g_mutex_lock (&client->send_lock);
+      client->send_max_bytes = g_value_get_uint (value);
+      g_mutex_unlock (&client->send_lock);
+      break;
+    case PROP_SEND_MAX_TIME:
+      g_mutex_lock (&client->send_lock);
+      client->send_max_time = g_value_get_uint (value);
+      g_mutex_unlock (&client->send_lock);
+      break;
+    case PROP_DROP_POLICY:
+      gst_rtsp_client_set_drop_policy (client, g_value_get_enum (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -275,6 +410,356 @@ gst_rtsp_client_new (void)
   return result;
 }
 
+static void
+copy_headers_and_body (GstRTSPMessage * src, GstRTSPMessage * dest)
+{
+  GstRTSPHeaderField field;
+  guint8 *data;
+  guint size;
+
+  for (field = GST_RTSP_HDR_INVALID + 1; field < GST_RTSP_HDR_LAST; field++) {
+    gchar *value;
+    gint i;
+
+    for (i = 0; gst_rtsp_message_get_header (src, field, &value,
+            i) == GST_RTSP_OK; i++)
+      gst_rtsp_message_add_header (dest, field, value);
+  }
+
+  gst_rtsp_message_get_body (src, &data, &size);
+  if (data)
+    gst_rtsp_message_set_body (dest, data, size);
+}
+
+/* move the contents of @request into a new message that outlives the watch
+ * message. Unlike a copy through the header API this keeps every header,
+ * including the ones the message parser has no enum for, and the pointers
+ * already taken from @request stay valid. @request is left empty. */
+static GstRTSPMessage *
+take_request (GstRTSPMessage * request)
+{
+  GstRTSPMessage *taken;
+
+  gst_rtsp_message_new (&taken);
+  *taken = *request;
+  memset (request, 0, sizeof (GstRTSPMessage));
+  request->type = GST_RTSP_MESSAGE_INVALID;
+
+  return taken;
+}
+
+/* make a copy of @response that can be queued for sending */
+static GstRTSPMessage *
+copy_response (GstRTSPMessage * response)
+{
+  GstRTSPMessage *copy;
+  GstRTSPStatusCode code;
+  const gchar *reason;
+  GstRTSPVersion version;
+
+  gst_rtsp_message_parse_response (response, &code, &reason, &version);
+  gst_rtsp_message_new_response (&copy, code, reason, NULL);
+  copy->type_data.response.version = version;
+
+  copy_headers_and_body (response, copy);
+
+  return copy;
+}
+
+/* An interleaved data frame in the send queue of the client. We keep the
+ * buffer mapped until it is written. */
+typedef struct
+{
+  GstBuffer *buffer;
+  GstMapInfo map;
+  guint8 header[4];
+  /* bytes of header and payload written so far */
+  gsize offset;
+} SendFrame;
+
+static SendFrame *
+send_frame_new_data (GstBuffer * buffer, guint8 channel)
+{
+  SendFrame *frame;
+
+  frame = g_slice_new0 (SendFrame);
+  if (!gst_buffer_map (buffer, &frame->map, GST_MAP_READ)) {
+    g_slice_free (SendFrame, frame);
+    return NULL;
+  }
+  frame->buffer = gst_buffer_ref (buffer);
+  frame->header[0] = '$';
+  frame->header[1] = channel;
+  frame->header[2] = (frame->map.size >> 8) & 0xff;
+  frame->header[3] = frame->map.size & 0xff;
+
+  return frame;
+}
+
+static void
+send_frame_free (SendFrame * frame)
+{
+  gst_buffer_unmap (frame->buffer, &frame->map);
+  gst_buffer_unref (frame->buffer);
+  g_slice_free (SendFrame, frame);
+}
+
+#define SEND_FRAME_SIZE(f) (sizeof ((f)->header) + (f)->map.size)
+
+/* called with send_lock */
+static void
+clear_send_queue (GstRTSPClient * client)
+{
+  if (client->send_source) {
+    g_source_destroy (client->send_source);
+    g_source_unref (client->send_source);
+    client->send_source = NULL;
+  }
+  if (client->send_timer) {
+    g_source_destroy (client->send_timer);
+    g_source_unref (client->send_timer);
+    client->send_timer = NULL;
+  }
+  g_queue_foreach (&client->send_queue, (GFunc) send_frame_free, NULL);
+  g_queue_clear (&client->send_queue);
+  client->send_queued = 0;
+  g_queue_foreach (&client->send_control, (GFunc) gst_rtsp_message_free, NULL);
+  g_queue_clear (&client->send_control);
+}
+
+static void flush_send_queue (GstRTSPClient * client);
+
+static gboolean
+send_resume (GstRTSPClient * client)
+{
+  g_atomic_int_set (&client->send_scheduled, 0);
+
+  g_mutex_lock (&client->send_lock);
+  flush_send_queue (client);
+  g_mutex_unlock (&client->send_lock);
+
+  return FALSE;
+}
+
+/* continue flushing the send queue from the context of the client */
+static void
+schedule_flush (GstRTSPClient * client)
+{
+  GSource *source;
+
+  if (!g_atomic_int_compare_and_exchange (&client->send_scheduled, 0, 1))
+    return;
+
+  source = g_idle_source_new ();
+  g_source_set_callback (source, (GSourceFunc) send_resume,
+      g_object_ref (client), g_object_unref);
+  g_source_attach (source, client->context);
+  g_source_unref (source);
+}
+
+static gboolean
+send_writable (GSocket * socket, GIOCondition condition,
+    GstRTSPClient * client)
+{
+  g_mutex_lock (&client->send_lock);
+  if (client->send_source) {
+    g_source_unref (client->send_source);
+    client->send_source = NULL;
+  }
+  flush_send_queue (client);
+  g_mutex_unlock (&client->send_lock);
+
+  return FALSE;
+}
+
+static gboolean
+send_timeout (GstRTSPClient * client)
+{
+  g_mutex_lock (&client->send_lock);
+  if (client->send_timer) {
+    g_source_unref (client->send_timer);
+    client->send_timer = NULL;
+  }
+  flush_send_queue (client);
+  g_mutex_unlock (&client->send_lock);
+
+  return FALSE;
+}
+
+/* hand a control message to the watch. When the watch could not write the
+ * message completely, it keeps the remainder and no data can be written on
+ * the socket until it tells us it is done in message_sent().
+ * called with send_lock from the context of the client */
+static void
+send_watch_message (GstRTSPClient * client, GstRTSPMessage * message)
+{
+  guint id = 0;
+
+  gst_rtsp_watch_send_message (client->watch, message, &id);
+  if (id != 0)
+    g_atomic_int_set (&client->watch_busy, (gint) id);
+}
+
+/* write as much of the send queue as the socket accepts without blocking.
+ * Consecutive data frames are written with one scatter-gather write directly
+ * from the buffer memory. Queued control messages go before the data at the
+ * next frame boundary.
+ * called with send_lock */
+static void
+flush_send_queue (GstRTSPClient * client)
+{
+  GSocket *socket;
+  GError *err = NULL;
+
+  if (client->watch == NULL)
+    return;
+
+  socket = gst_rtsp_connection_get_write_socket (client->connection);
+
+  while (TRUE) {
+    GOutputVector vectors[MAX_SEND_VECTORS];
+    SendFrame *frame;
+    GList *walk;
+    guint n_vectors, max_vectors;
+    gssize written;
+
+    /* the watch is still writing a control message */
+    if (g_atomic_int_get (&client->watch_busy) != 0)
+      break;
+
+    frame = g_queue_peek_head (&client->send_queue);
+    if (!g_queue_is_empty (&client->send_control)) {
+      if (frame == NULL || frame->offset == 0) {
+        GstRTSPMessage *message;
+
+        /* the watch can only be used from the context of the client */
+        if (!g_main_context_is_owner (client->context)) {
+          schedule_flush (client);
+          break;
+        }
+        message = g_queue_pop_head (&client->send_control);
+        send_watch_message (client, message);
+        gst_rtsp_message_free (message);
+        continue;
+      }
+      /* only complete the frame that was started */
+      max_vectors = 2;
+    } else {
+      max_vectors = MAX_SEND_VECTORS;
+    }
+
+    if (frame == NULL)
+      break;
+
+    /* collect the queued data frames */
+    n_vectors = 0;
+    for (walk = client->send_queue.head; walk; walk = g_list_next (walk)) {
+      SendFrame *f = walk->data;
+      gsize hsize = sizeof (f->header);
+
+      if (n_vectors + 2 > max_vectors)
+        break;
+
+      if (f->offset < hsize) {
+        vectors[n_vectors].buffer = f->header + f->offset;
+        vectors[n_vectors].size = hsize - f->offset;
+        n_vectors++;
+        vectors[n_vectors].buffer = f->map.data;
+        vectors[n_vectors].size = f->map.size;
+      } else {
+        vectors[n_vectors].buffer = f->map.data + (f->offset - hsize);
+        vectors[n_vectors].size = SEND_FRAME_SIZE (f) - f->offset;
+      }
+      n_vectors++;
+    }
+
+    written = g_socket_send_message (socket, NULL, vectors, n_vectors,
+        NULL, 0, 0, NULL, &err);
+    if (written < 0)
+      goto write_error;
+
+    /* release the frames that were written completely and remember where we
+     * stopped in the last one */
+    while (written > 0) {
+      gsize left;
+
+      frame = g_queue_peek_head (&client->send_queue);
+      left = SEND_FRAME_SIZE (frame) - frame->offset;
+      if ((gsize) written < left) {
+        frame->offset += written;
+        break;
+      }
+      written -= left;
+      client->send_queued -= frame->map.size;
+      g_queue_pop_head (&client->send_queue);
+      send_frame_free (frame);
+    }
+  }
+  return;
+
+  /* ERRORS */
+write_error:
+  {
+    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+      /* wait until we can write again */
+      if (client->send_source == NULL) {
+        client->send_source = g_socket_create_source (socket, G_IO_OUT, NULL);
+        g_source_set_callback (client->send_source,
+            (GSourceFunc) send_writable, g_object_ref (client),
+            g_object_unref);
+        g_source_attach (client->send_source, client->context);
+      }
+    } else {
+      GST_WARNING ("client %p: failed to write data: %s", client,
+          err->message);
+      clear_send_queue (client);
+    }
+    g_error_free (err);
+    return;
+  }
+}
+
+/* called with send_lock */
+static gboolean
+send_frame_started (GstRTSPClient * client)
+{
+  SendFrame *frame;
+
+  frame = g_queue_peek_head (&client->send_queue);
+
+  return frame != NULL && frame->offset > 0;
+}
+
+static void
+send_message (GstRTSPClient * client, GstRTSPMessage * message)
+{
+  g_mutex_lock (&client->send_lock);
+  if (client->watch == NULL)
+    goto closed;
+
+  /* control messages go before any queued data but can only go out between
+   * data frames */
+  if (g_queue_is_empty (&client->send_control) &&
+      g_atomic_int_get (&client->watch_busy) == 0 &&
+      !send_frame_started (client)) {
+    send_watch_message (client, message);
+  } else {
+    g_queue_push_tail (&client->send_control, copy_response (message));
+    flush_send_queue (client);
+  }
+  g_mutex_unlock (&client->send_lock);
+
+  return;
+
+  /* ERRORS */
+closed:
+  {
+    GST_DEBUG ("client %p: connection closed, dropping message", client);
+    g_mutex_unlock (&client->send_lock);
+    return;
+  }
+}
+
 static void
 send_response (GstRTSPClient * client, GstRTSPSession * session,
     GstRTSPMessage * response)
@@ -303,7 +788,7 @@ send_response (GstRTSPClient * client, GstRTSPSession * session,
     gst_rtsp_message_dump (response);
   }
 
-  gst_rtsp_watch_send_message (client->watch, response, NULL);
+  send_message (client, response);
   gst_rtsp_message_unset (response);
 }
 
@@ -345,6 +830,224 @@ compare_uri (const GstRTSPUrl * uri1, const GstRTSPUrl * uri2)
   return TRUE;
 }
 
+typedef struct
+{
+  GstRTSPClient *client;
+  GstRTSPMedia *media;
+  GstRTSPMediaFactory *factory;
+  GstRTSPUrl *uri;
+  gboolean prepared;
+  gboolean seek;
+} ParkedRequest;
+
+static void
+parked_request_free (ParkedRequest * parked)
+{
+  if (parked->uri)
+    gst_rtsp_url_free (parked->uri);
+  if (parked->media)
+    g_object_unref (parked->media);
+  if (parked->factory)
+    g_object_unref (parked->factory);
+  g_object_unref (parked->client);
+  g_slice_free (ParkedRequest, parked);
+}
+
+/* called from the context of the client when the media of the parked request
+ * is prepared or seeked, or failed to do so */
+static gboolean
+resume_request (ParkedRequest * parked)
+{
+  GstRTSPClient *client = parked->client;
+  GstRTSPMessage *request;
+
+  request = client->parked;
+  client->parked = NULL;
+
+  if (client->watch == NULL)
+    goto closed;
+
+  GST_INFO ("client %p: resuming request, media %p prepared %d seek %d",
+      client, parked->media, parked->prepared, parked->seek);
+
+  if (parked->seek) {
+    /* a failed seek is not fatal, the media plays from where it is */
+    client->seek_done = TRUE;
+    handle_request (client, request);
+    client->seek_done = FALSE;
+  } else if (parked->prepared) {
+    /* cache the uri and the media, handling the request again will use them */
+    if (client->uri)
+      gst_rtsp_url_free (client->uri);
+    client->uri = parked->uri;
+    parked->uri = NULL;
+    if (client->media)
+      g_object_unref (client->media);
+    client->media = parked->media;
+    parked->media = NULL;
+    if (client->factory)
+      g_object_unref (client->factory);
+    client->factory = parked->factory;
+    parked->factory = NULL;
+
+    handle_request (client, request);
+  } else {
+    GstRTSPClientState state = { NULL };
+    GstRTSPMessage response = { 0 };
+
+    state.request = request;
+    state.response = &response;
+
+    send_generic_response (client, GST_RTSP_STS_SERVICE_UNAVAILABLE, &state);
+  }
+  gst_rtsp_message_free (request);
+
+  /* handle the requests that arrived in the meantime, in order, until one of
+   * them is parked again */
+  while (client->parked == NULL && client->pending && client->watch) {
+    request = client->pending->data;
+    client->pending = g_list_delete_link (client->pending, client->pending);
+
+    handle_request (client, request);
+    gst_rtsp_message_free (request);
+  }
+  return FALSE;
+
+  /* ERRORS */
+closed:
+  {
+    GST_INFO ("client %p: closed while the request was parked", client);
+    gst_rtsp_message_free (request);
+    return FALSE;
+  }
+}
+
+/* called from the media bus thread or from gst_rtsp_media_prepare_async() and
+ * gst_rtsp_media_seek_async() */
+static void
+media_prepared (GstRTSPMedia * media, gboolean prepared,
+    ParkedRequest * parked)
+{
+  GSource *source;
+
+  parked->prepared = prepared;
+
+  /* always resume from an idle source in the client context so that we never
+   * handle a request from within another request handler */
+  source = g_idle_source_new ();
+  g_source_set_callback (source, (GSourceFunc) resume_request, parked,
+      (GDestroyNotify) parked_request_free);
+  g_source_attach (source, parked->client->context);
+  g_source_unref (source);
+}
+
+/* keep the request in @state and handle it again when @media is
+ * prepared. Takes ownership of @media. */
+static void
+park_request (GstRTSPClient * client, GstRTSPClientState * state,
+    GstRTSPMedia * media)
+{
+  ParkedRequest *parked;
+
+  GST_INFO ("client %p: parking request until media %p is prepared", client,
+      media);
+
+  client->parked = take_request (state->request);
+
+  parked = g_slice_new (ParkedRequest);
+  parked->client = g_object_ref (client);
+  parked->media = media;
+  parked->factory = state->factory;
+  state->factory = NULL;
+  parked->uri = gst_rtsp_url_copy (state->uri);
+  parked->prepared = FALSE;
+  parked->seek = FALSE;
+
+  gst_rtsp_media_prepare_async (media, (GstRTSPMediaPrepareFunc) media_prepared,
+      parked, NULL);
+}
+
+/* seek @media to @range. When a flushing seek was issued, the PLAY request
+ * in @state is kept and handled again, without seeking, when @media prerolled.
+ * When the client goes away in the meantime, the response is not sent.
+ * Returns %FALSE when the request was not parked. */
+static gboolean
+park_seek (GstRTSPClient * client, GstRTSPClientState * state,
+    GstRTSPMedia * media, GstRTSPTimeRange * range)
+{
+  ParkedRequest *parked;
+
+  parked = g_slice_new (ParkedRequest);
+  parked->client = g_object_ref (client);
+  parked->media = g_object_ref (media);
+  parked->factory = NULL;
+  parked->uri = NULL;
+  parked->prepared = FALSE;
+  parked->seek = TRUE;
+
+  /* the callback is called from the bus thread but the request is only
+   * resumed from our context, after we returned */
+  if (!gst_rtsp_media_seek_async (media, range,
+          (GstRTSPMediaSeekFunc) media_prepared, parked, NULL))
+    goto not_seeked;
+
+  GST_INFO ("client %p: parking request until media %p is seeked", client,
+      media);
+
+  client->parked = take_request (state->request);
+
+  return TRUE;
+
+  /* ERRORS */
+not_seeked:
+  {
+    GST_DEBUG ("client %p: no seek needed for media %p", client, media);
+    parked_request_free (parked);
+    return FALSE;
+  }
+}
+
+static void
+background_prepared (GstRTSPMedia * media, gboolean prepared, gpointer unused)
+{
+  GST_INFO ("media %p prepared in the background: %d", media, prepared);
+}
+
+/* describe @media from the SDP it had the last time it was prepared and
+ * prepare it in the background. The SETUP that follows is parked until the
+ * media is prepared. Takes ownership of @media when it returns %TRUE. */
+static gboolean
+describe_from_cache (GstRTSPClient * client, GstRTSPClientState * state,
+    GstRTSPMediaFactory * factory, GstRTSPMedia * media)
+{
+  GBytes *cache;
+  gchar *sdp;
+
+  /* the SETUP can only find the same media again when it is shared */
+  if (!gst_rtsp_media_is_shared (media))
+    return FALSE;
+
+  if (GST_RTSP_CLIENT_GET_CLASS (client)->create_sdp != create_sdp)
+    return FALSE;
+
+  if (!(cache = gst_rtsp_media_factory_get_sdp_cache (factory, state->uri)))
+    return FALSE;
+
+  GST_INFO ("client %p: describing media %p from cache while preparing",
+      client, media);
+
+  gst_rtsp_media_prepare_async (media,
+      (GstRTSPMediaPrepareFunc) background_prepared, media, g_object_unref);
+
+  /* only live media is cached in the factory */
+  sdp = render_sdp (client, media, cache, "npt=now-");
+  g_bytes_unref (cache);
+
+  send_describe_response (client, state, sdp);
+
+  return TRUE;
+}
+
 /* this function is called to initially find the media for the DESCRIBE request
  * but is cached for when the same client (without breaking the connection) is
  * doing a setup for the exact same url. */
@@ -364,6 +1067,9 @@ find_media (GstRTSPClient * client, GstRTSPClientState * state)
     if (client->media)
       g_object_unref (client->media);
     client->media = NULL;
+    if (client->factory)
+      g_object_unref (client->factory);
+    client->factory = NULL;
 
     if (!client->media_mapping)
       goto no_mapping;
@@ -388,21 +1094,28 @@ find_media (GstRTSPClient * client, GstRTSPClientState * state)
     if (!(media = gst_rtsp_media_factory_construct (factory, state->uri)))
       goto no_media;
 
-    g_object_unref (factory);
-    factory = NULL;
-    state->factory = NULL;
-
-    /* set ipv6 on the media before preparing */
+    /* set ipv6 and the port pool on the media before preparing */
     media->is_ipv6 = client->is_ipv6;
+    if (client->port_pool && media->port_pool == NULL)
+      gst_rtsp_media_set_port_pool (media, client->port_pool);
     state->media = media;
 
-    /* prepare the media */
-    if (!(gst_rtsp_media_prepare (media)))
-      goto no_prepare;
+    /* prepare the media without blocking the other clients in our context,
+     * the request is handled again when the media is prepared. Live media
+     * can be described from its previous SDP right away. */
+    if (!gst_rtsp_media_is_prepared (media)) {
+      if (state->method == GST_RTSP_DESCRIBE &&
+          describe_from_cache (client, state, factory, media))
+        goto described;
+      goto park;
+    }
+
+    state->factory = NULL;
 
-    /* now keep track of the uri and the media */
+    /* now keep track of the uri, the media and its factory */
     client->uri = gst_rtsp_url_copy (state->uri);
     client->media = media;
+    client->factory = factory;
   } else {
     /* we have seen this uri before, used cached media */
     media = client->media;
@@ -439,16 +1152,24 @@ no_media:
     g_object_unref (factory);
     return NULL;
   }
-no_prepare:
+park:
   {
-    send_generic_response (client, GST_RTSP_STS_SERVICE_UNAVAILABLE, state);
-    g_object_unref (media);
+    /* no reply is sent yet, the parked request keeps the factory */
+    park_request (client, state, media);
+    return NULL;
+  }
+described:
+  {
+    g_object_unref (factory);
+    state->factory = NULL;
     return NULL;
   }
 }
 
+/* tunneled connections are written by the watch, wrap the data in a
+ * message for it */
 static gboolean
-do_send_data (GstBuffer * buffer, guint8 channel, GstRTSPClient * client)
+send_data_message (GstBuffer * buffer, guint8 channel, GstRTSPClient * client)
 {
   GstRTSPMessage message = { 0 };
   GstMapInfo map_info;
@@ -474,13 +1195,337 @@ do_send_data (GstBuffer * buffer, guint8 channel, GstRTSPClient * client)
   return TRUE;
 }
 
+#define CHANNEL_IS_DROPPING(c,ch) ((c)->send_dropping[(ch) >> 3] & (1 << ((ch) & 7)))
+#define CHANNEL_SET_DROPPING(c,ch) ((c)->send_dropping[(ch) >> 3] |= (1 << ((ch) & 7)))
+#define CHANNEL_UNSET_DROPPING(c,ch) ((c)->send_dropping[(ch) >> 3] &= ~(1 << ((ch) & 7)))
+#define CHANNEL_HAS_RTPTIME(c,ch) ((c)->send_has_rtptime[(ch) >> 3] & (1 << ((ch) & 7)))
+#define CHANNEL_SET_HAS_RTPTIME(c,ch) ((c)->send_has_rtptime[(ch) >> 3] |= (1 << ((ch) & 7)))
+
+/* check if @buffer is the first packet of a frame. The payloaders don't mark
+ * this reliably, a packet starts a new frame when its RTP timestamp differs
+ * from the previous packet of the channel. Packets that are not RTP, like
+ * RTCP, are never part of a larger unit.
+ * called with send_lock */
+static gboolean
+starts_frame (GstRTSPClient * client, GstBuffer * buffer, guint8 channel)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint8 pt;
+  guint32 rtptime;
+  gboolean res;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp))
+    return TRUE;
+  pt = gst_rtp_buffer_get_payload_type (&rtp);
+  rtptime = gst_rtp_buffer_get_timestamp (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  /* the payload types RTCP would have when parsed as RTP, RFC 5761 */
+  if (pt >= 64 && pt <= 95)
+    return TRUE;
+
+  res = !CHANNEL_HAS_RTPTIME (client, channel) ||
+      client->send_rtptime[channel] != rtptime;
+
+  client->send_rtptime[channel] = rtptime;
+  CHANNEL_SET_HAS_RTPTIME (client, channel);
+
+  return res;
+}
+
+/* called with send_lock */
+static gboolean
+send_over_budget (GstRTSPClient * client)
+{
+  SendFrame *first, *last;
+  GstClockTime first_ts, last_ts;
+
+  if (client->send_max_bytes && client->send_queued > client->send_max_bytes)
+    return TRUE;
+
+  if (client->send_max_time == 0)
+    return FALSE;
+
+  first = g_queue_peek_head (&client->send_queue);
+  last = g_queue_peek_tail (&client->send_queue);
+  if (first == NULL)
+    return FALSE;
+
+  first_ts = GST_BUFFER_TIMESTAMP (first->buffer);
+  last_ts = GST_BUFFER_TIMESTAMP (last->buffer);
+  if (!GST_CLOCK_TIME_IS_VALID (first_ts) || !GST_CLOCK_TIME_IS_VALID (last_ts)
+      || last_ts < first_ts)
+    return FALSE;
+
+  return last_ts - first_ts > client->send_max_time * GST_MSECOND;
+}
+
+/* remove queued data frames that were not started yet. With @droppable, only
+ * the frames with the DROPPABLE flag are removed until we are within the
+ * budget again, else all frames are removed and their channels skip data
+ * until the next keyframe. The payloaders don't set the flag, it comes from
+ * elements in the media pipeline that know which frames are not referenced.
+ * called with send_lock */
+static void
+drop_queued_frames (GstRTSPClient * client, gboolean droppable)
+{
+  GList *walk, *next;
+
+  for (walk = client->send_queue.head; walk; walk = next) {
+    SendFrame *frame = walk->data;
+
+    next = g_list_next (walk);
+
+    if (frame->offset > 0)
+      continue;
+
+    if (droppable) {
+      if (!GST_BUFFER_FLAG_IS_SET (frame->buffer, GST_BUFFER_FLAG_DROPPABLE))
+        continue;
+    } else {
+      CHANNEL_SET_DROPPING (client, frame->header[1]);
+    }
+
+    client->send_queued -= frame->map.size;
+    client->dropped_frames++;
+    client->dropped_bytes += frame->map.size;
+    g_queue_delete_link (&client->send_queue, walk);
+    send_frame_free (frame);
+
+    if (droppable && !send_over_budget (client))
+      break;
+  }
+}
+
+/* apply the drop policy when the queued data exceeds the budget. Returns
+ * %FALSE when the client should be disconnected.
+ * called with send_lock */
+static gboolean
+check_send_budget (GstRTSPClient * client)
+{
+  if (!send_over_budget (client))
+    return TRUE;
+
+  switch (client->drop_policy) {
+    case GST_RTSP_CLIENT_DROP_POLICY_DROPPABLE:
+      GST_DEBUG ("client %p: send queue full, dropping droppable frames",
+          client);
+      client->droppable_drops++;
+      drop_queued_frames (client, TRUE);
+      if (!send_over_budget (client))
+        break;
+      /* not enough, fall back to dropping the GOP */
+    case GST_RTSP_CLIENT_DROP_POLICY_GOP:
+      GST_DEBUG ("client %p: send queue full, dropping until next keyframe",
+          client);
+      client->gop_drops++;
+      drop_queued_frames (client, FALSE);
+      break;
+    case GST_RTSP_CLIENT_DROP_POLICY_DISCONNECT:
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/* the client could not keep up and gets disconnected. We can't close from
+ * here, the watch notify takes the send_lock.
+ * called with send_lock */
+static void
+send_overflow (GstRTSPClient * client)
+{
+  GSource *source;
+
+  GST_WARNING ("client %p: send queue full, disconnecting", client);
+
+  client->send_overflow = TRUE;
+  clear_send_queue (client);
+
+  source = g_idle_source_new ();
+  g_source_set_callback (source, (GSourceFunc) do_close,
+      g_object_ref (client), g_object_unref);
+  g_source_attach (source, client->context);
+  g_source_unref (source);
+}
+
+/* called with send_lock */
+static gboolean
+queue_data_frame (GstRTSPClient * client, GstBuffer * buffer, guint8 channel)
+{
+  SendFrame *frame;
+  gboolean frame_start;
+
+  if (gst_buffer_get_size (buffer) > G_MAXUINT16)
+    goto too_big;
+
+  /* the frames only matter when data can be dropped. Then every packet is
+   * checked so that we know the frame of the previous one */
+  if (client->send_max_bytes || client->send_max_time ||
+      CHANNEL_IS_DROPPING (client, channel)) {
+    frame_start = starts_frame (client, buffer, channel);
+
+    /* after dropping, skip data until the first packet of the next keyframe */
+    if (CHANNEL_IS_DROPPING (client, channel)) {
+      if (!frame_start || GST_BUFFER_FLAG_IS_SET (buffer,
+              GST_BUFFER_FLAG_DELTA_UNIT))
+        goto dropping;
+      CHANNEL_UNSET_DROPPING (client, channel);
+    }
+  }
+
+  if (!(frame = send_frame_new_data (buffer, channel)))
+    goto map_failed;
+
+  g_queue_push_tail (&client->send_queue, frame);
+  client->send_queued += frame->map.size;
+
+  return TRUE;
+
+  /* ERRORS */
+too_big:
+  {
+    GST_WARNING ("client %p: buffer of %" G_GSIZE_FORMAT " bytes does not "
+        "fit in an interleaved frame", client, gst_buffer_get_size (buffer));
+    return FALSE;
+  }
+dropping:
+  {
+    client->dropped_frames++;
+    client->dropped_bytes += gst_buffer_get_size (buffer);
+    return TRUE;
+  }
+map_failed:
+  {
+    GST_WARNING ("client %p: failed to map buffer", client);
+    return FALSE;
+  }
+}
+
+/* when we are waiting for the socket, the queued frames go out when it becomes
+ * writable. Else write now or hold the frames back for at most the send
+ * latency so that more frames can be written with them.
+ * called with send_lock */
+static void
+send_queued_data (GstRTSPClient * client)
+{
+  if (client->send_source != NULL)
+    return;
+
+  if (client->send_latency == 0 || client->send_queued >= SEND_COALESCE_BYTES) {
+    flush_send_queue (client);
+  } else if (client->send_timer == NULL) {
+    client->send_timer = g_timeout_source_new (client->send_latency);
+    g_source_set_callback (client->send_timer, (GSourceFunc) send_timeout,
+        g_object_ref (client), g_object_unref);
+    g_source_attach (client->send_timer, client->context);
+  }
+}
+
+static gboolean
+do_send_data (GstBuffer * buffer, guint8 channel, GstRTSPClient * client)
+{
+  gboolean res;
+
+  if (gst_rtsp_connection_is_tunneled (client->connection))
+    return send_data_message (buffer, channel, client);
+
+  g_mutex_lock (&client->send_lock);
+  if (client->watch == NULL || client->send_overflow)
+    goto closed;
+
+  if ((res = queue_data_frame (client, buffer, channel))) {
+    if (check_send_budget (client))
+      send_queued_data (client);
+    else
+      send_overflow (client);
+  }
+  g_mutex_unlock (&client->send_lock);
+
+  return res;
+
+  /* ERRORS */
+closed:
+  {
+    g_mutex_unlock (&client->send_lock);
+    return FALSE;
+  }
+}
+
+/* queue all packets of @list before writing so that they can go out with one
+ * write */
+static gboolean
+do_send_list (GstBufferList * list, guint8 channel, GstRTSPClient * client)
+{
+  gboolean res = TRUE;
+  guint i, len;
+
+  len = gst_buffer_list_length (list);
+
+  if (gst_rtsp_connection_is_tunneled (client->connection)) {
+    for (i = 0; i < len; i++)
+      res &= send_data_message (gst_buffer_list_get (list, i), channel, client);
+    return res;
+  }
+
+  g_mutex_lock (&client->send_lock);
+  if (client->watch == NULL || client->send_overflow)
+    goto closed;
+
+  for (i = 0; i < len; i++)
+    res &= queue_data_frame (client, gst_buffer_list_get (list, i), channel);
+  if (check_send_budget (client))
+    send_queued_data (client);
+  else
+    send_overflow (client);
+  g_mutex_unlock (&client->send_lock);
+
+  return res;
+
+  /* ERRORS */
+closed:
+  {
+    g_mutex_unlock (&client->send_lock);
+    return FALSE;
+  }
+}
+
+/* add or remove the interleaved channels of @stream in the channel table */
+static void
+map_stream_channels (GstRTSPClient * client, GstRTSPSessionStream * stream,
+    gboolean add)
+{
+  GstRTSPTransport *tr;
+  gint channels[2], i;
+
+  if (!(tr = stream->trans.transport))
+    return;
+
+  if (!(tr->lower_transport & GST_RTSP_LOWER_TRANS_TCP))
+    return;
+
+  channels[0] = tr->interleaved.min;
+  channels[1] = tr->interleaved.max;
+
+  for (i = 0; i < 2; i++) {
+    if (channels[i] < 0 || channels[i] > 255)
+      continue;
+
+    if (add)
+      client->channels[channels[i]] = stream;
+    else if (client->channels[channels[i]] == stream)
+      client->channels[channels[i]] = NULL;
+  }
+}
+
 static void
 link_stream (GstRTSPClient * client, GstRTSPSession * session,
     GstRTSPSessionStream * stream)
 {
   GST_DEBUG ("client %p: linking stream %p", client, stream);
+  map_stream_channels (client, stream, TRUE);
   gst_rtsp_session_stream_set_callbacks (stream, (GstRTSPSendFunc) do_send_data,
       (GstRTSPSendFunc) do_send_data, client, NULL);
+  gst_rtsp_session_stream_set_list_callbacks (stream,
+      (GstRTSPSendListFunc) do_send_list, (GstRTSPSendListFunc) do_send_list);
   client->streams = g_list_prepend (client->streams, stream);
   /* make sure our session can't expire */
   gst_rtsp_session_prevent_expire (session);
@@ -491,6 +1536,8 @@ unlink_stream (GstRTSPClient * client, GstRTSPSession * session,
     GstRTSPSessionStream * stream)
 {
   GST_DEBUG ("client %p: unlinking stream %p", client, stream);
+  map_stream_channels (client, stream, FALSE);
+  gst_rtsp_session_stream_set_list_callbacks (stream, NULL, NULL);
   gst_rtsp_session_stream_set_callbacks (stream, NULL, NULL, NULL, NULL);
   client->streams = g_list_remove (client->streams, stream);
   /* our session can now expire */
@@ -771,14 +1818,20 @@ handle_play_request (GstRTSPClient * client, GstRTSPClientState * state)
       media->state != GST_RTSP_STATE_READY)
     goto invalid_state;
 
-  /* parse the range header if we have one */
+  /* parse the range header if we have one, unless we already seeked for this
+   * request */
   res =
       gst_rtsp_message_get_header (state->request, GST_RTSP_HDR_RANGE, &str, 0);
-  if (res == GST_RTSP_OK) {
+  if (res == GST_RTSP_OK && !client->seek_done) {
     if (gst_rtsp_range_parse (str, &range) == GST_RTSP_OK) {
-      /* we have a range, seek to the position */
-      gst_rtsp_media_seek (media->media, range);
+      gboolean parked;
+
+      /* we have a range, seek to the position and handle the request again
+       * when the pipeline prerolled */
+      parked = park_seek (client, state, media->media, range);
       gst_rtsp_range_free (range);
+      if (parked)
+        return TRUE;
     }
   }
 
@@ -928,8 +1981,9 @@ handle_setup_request (GstRTSPClient * client, GstRTSPClientState * state)
   GstRTSPSession *session;
   GstRTSPSessionStream *stream;
   gchar *trans_str, *pos;
-  guint streamid;
+  guint streamid, generation;
   GstRTSPSessionMedia *media;
+  gboolean linked;
 
   uri = state->uri;
 
@@ -1012,14 +2066,7 @@ handle_setup_request (GstRTSPClient * client, GstRTSPClientState * state)
      * return NULL if this is a new url to manage in this session. */
     media = gst_rtsp_session_get_media (session, uri);
   } else {
-    /* create a session if this fails we probably reached our session limit or
-     * something. */
-    if (!(session = gst_rtsp_session_pool_create (client->session_pool)))
-      goto service_unavailable;
-
-    state->session = session;
-
-    /* we need a new media configuration in this session */
+    /* we need a new media configuration in a new session */
     media = NULL;
   }
 
@@ -1027,11 +2074,23 @@ handle_setup_request (GstRTSPClient * client, GstRTSPClientState * state)
   if (media == NULL) {
     GstRTSPMedia *m;
 
-    /* get a handle to the configuration of the media in the session */
-    if ((m = find_media (client, state))) {
-      /* manage the media in our session now */
-      media = gst_rtsp_session_manage_media (session, uri, m);
+    /* find the media before creating a session, the request might get parked
+     * until the media is prepared */
+    if (!(m = find_media (client, state)))
+      goto no_media;
+
+    if (session == NULL) {
+      /* create a session if this fails we probably reached our session limit
+       * or something. */
+      if (!(session = gst_rtsp_session_pool_create (client->session_pool))) {
+        g_object_unref (m);
+        goto service_unavailable;
+      }
+      state->session = session;
     }
+
+    /* manage the media in our session now */
+    media = gst_rtsp_session_manage_media (session, uri, m);
   }
 
   /* if we stil have no media, error */
@@ -1065,8 +2124,28 @@ handle_setup_request (GstRTSPClient * client, GstRTSPClientState * state)
   if (!(stream = gst_rtsp_session_media_get_stream (media, streamid)))
     goto no_stream;
 
+  /* make sure the media stream has the elements for the new transport before
+   * releasing the old one so that a shared branch is not rebuilt */
+  if (!gst_rtsp_media_acquire_transport (media->media, streamid,
+          ct->lower_transport, &generation))
+    goto no_branch;
+  if (stream->trans.transport)
+    gst_rtsp_media_release_transport (media->media, streamid,
+        stream->trans.transport->lower_transport,
+        stream->trans.branch_generation);
+  stream->trans.branch_generation = generation;
+
+  /* the stream can already be linked when the transport is changed, update the
+   * channels it uses */
+  linked = g_list_find (client->streams, stream) != NULL;
+  if (linked)
+    map_stream_channels (client, stream, FALSE);
+
   st = gst_rtsp_session_stream_set_transport (stream, ct);
 
+  if (linked)
+    map_stream_channels (client, stream, TRUE);
+
   /* configure keepalive for this transport */
   gst_rtsp_session_stream_set_keepalive (stream,
       (GstRTSPKeepAliveFunc) do_keepalive, session, NULL);
@@ -1110,6 +2189,14 @@ bad_request:
     send_generic_response (client, GST_RTSP_STS_BAD_REQUEST, state);
     return FALSE;
   }
+no_media:
+  {
+    /* error reply is already sent or the request is parked */
+    if (session)
+      g_object_unref (session);
+    gst_rtsp_transport_free (ct);
+    return FALSE;
+  }
 not_found:
   {
     send_generic_response (client, GST_RTSP_STS_NOT_FOUND, state);
@@ -1131,6 +2218,13 @@ no_stream:
     gst_rtsp_transport_free (ct);
     return FALSE;
   }
+no_branch:
+  {
+    send_generic_response (client, GST_RTSP_STS_SERVICE_UNAVAILABLE, state);
+    g_object_unref (session);
+    gst_rtsp_transport_free (ct);
+    return FALSE;
+  }
 no_transport:
   {
     send_generic_response (client, GST_RTSP_STS_UNSUPPORTED_TRANSPORT, state);
@@ -1157,11 +2251,11 @@ service_unavailable:
 }
 
 static GstSDPMessage *
-create_sdp (GstRTSPClient * client, GstRTSPMedia * media)
+build_sdp (GstRTSPClient * client, GstRTSPMedia * media, const gchar * proto,
+    const gchar * server_ip)
 {
   GstSDPMessage *sdp;
   GstSDPInfo info;
-  const gchar *proto;
   GstRTSPLowerTrans protocols;
 
   gst_sdp_message_new (&sdp);
@@ -1169,13 +2263,8 @@ create_sdp (GstRTSPClient * client, GstRTSPMedia * media)
   /* some standard things first */
   gst_sdp_message_set_version (sdp, "0");
 
-  if (client->is_ipv6)
-    proto = "IP6";
-  else
-    proto = "IP4";
-
   gst_sdp_message_set_origin (sdp, "-", "1188340656180883", "1", "IN", proto,
-      client->server_ip);
+      server_ip);
 
   gst_sdp_message_set_session_name (sdp, "Session streamed with GStreamer");
   gst_sdp_message_set_information (sdp, "rtsp-server");
@@ -1189,23 +2278,160 @@ create_sdp (GstRTSPClient * client, GstRTSPMedia * media)
   if (protocols & GST_RTSP_LOWER_TRANS_UDP_MCAST)
     info.server_ip = gst_rtsp_media_get_multicast_group (media);
   else
-    info.server_ip = g_strdup (client->server_ip);
+    info.server_ip = g_strdup (server_ip);
+
+  /* create an SDP for the media object */
+  if (!gst_rtsp_sdp_from_media (sdp, &info, media))
+    goto no_sdp;
+
+  g_free (info.server_ip);
+
+  return sdp;
+
+  /* ERRORS */
+no_sdp:
+  {
+    g_free (info.server_ip);
+    gst_sdp_message_free (sdp);
+    return NULL;
+  }
+}
+
+static GstSDPMessage *
+create_sdp (GstRTSPClient * client, GstRTSPMedia * media)
+{
+  return build_sdp (client, media, client->is_ipv6 ? "IP6" : "IP4",
+      client->server_ip);
+}
+
+/* the SDP of a media is the same for all clients except for the address the
+ * client connected to and the range. We cache the SDP text in the media with
+ * these markers in place of the values. */
+#define SDP_MARK_PROTO  "\001"
+#define SDP_MARK_IP     "\002"
+#define SDP_MARK_RANGE  "\003"
+#define SDP_MARKS       SDP_MARK_PROTO SDP_MARK_IP SDP_MARK_RANGE
+
+static GBytes *
+compile_sdp (GstRTSPClient * client, GstRTSPMedia * media)
+{
+  GstSDPMessage *sdp;
+  GString *str;
+  gchar *text, *range, *end;
+  gsize len;
+
+  if (!(sdp = build_sdp (client, media, SDP_MARK_PROTO, SDP_MARK_IP)))
+    return NULL;
+
+  text = gst_sdp_message_as_text (sdp);
+  gst_sdp_message_free (sdp);
+
+  len = strlen (text);
+  str = g_string_new_len (text, len);
+
+  /* the range can change while the media is playing, mark it */
+  if ((range = strstr (text, "a=range:"))) {
+    range += strlen ("a=range:");
+    end = range + strcspn (range, "\r\n");
+    g_string_erase (str, range - text, end - range);
+    g_string_insert (str, range - text, SDP_MARK_RANGE);
+  }
+  g_free (text);
+
+  len = str->len + 1;
+  return g_bytes_new_take (g_string_free (str, FALSE), len);
+}
+
+static gchar *
+render_sdp (GstRTSPClient * client, GstRTSPMedia * media, GBytes * cache,
+    const gchar * range)
+{
+  const gchar *text;
+  GString *str;
+  gsize size;
+
+  text = g_bytes_get_data (cache, &size);
+  str = g_string_sized_new (size + 64);
+
+  while (*text) {
+    gsize len;
+
+    len = strcspn (text, SDP_MARKS);
+    g_string_append_len (str, text, len);
+    text += len;
+
+    switch (*text) {
+      case '\001':
+        g_string_append (str, client->is_ipv6 ? "IP6" : "IP4");
+        break;
+      case '\002':
+        g_string_append (str, client->server_ip);
+        break;
+      case '\003':
+        if (range) {
+          g_string_append (str, range);
+        } else {
+          gchar *rangestr;
+
+          rangestr = gst_rtsp_media_get_range_string (media, FALSE);
+          g_string_append (str, rangestr);
+          g_free (rangestr);
+        }
+        break;
+      default:
+        continue;
+    }
+    text++;
+  }
+  return g_string_free (str, FALSE);
+}
+
+/* keep the SDP of live media in the factory so that the media can be
+ * described while it is prepared again */
+static void
+remember_sdp (GstRTSPClient * client, GstRTSPClientState * state,
+    GBytes * cache)
+{
+  /* the factory was found together with the cached media */
+  if (client->factory == NULL || state->media != client->media)
+    return;
 
-  /* create an SDP for the media object */
-  if (!gst_rtsp_sdp_from_media (sdp, &info, media))
-    goto no_sdp;
+  gst_rtsp_media_factory_set_sdp_cache (client->factory, state->uri, cache);
+}
 
-  g_free (info.server_ip);
+/* get the SDP text of @media for @client. With the default create_sdp, the
+ * SDP is made once for the media and reused for all clients. */
+static gchar *
+get_sdp_text (GstRTSPClient * client, GstRTSPClientState * state,
+    GstRTSPMedia * media)
+{
+  GstRTSPClientClass *klass;
+  GstSDPMessage *sdp;
+  GBytes *cache;
+  guint cookie;
+  gchar *str;
 
-  return sdp;
+  klass = GST_RTSP_CLIENT_GET_CLASS (client);
 
-  /* ERRORS */
-no_sdp:
-  {
-    g_free (info.server_ip);
+  if (klass->create_sdp != create_sdp) {
+    if (!(sdp = klass->create_sdp (client, media)))
+      return NULL;
+    str = gst_sdp_message_as_text (sdp);
     gst_sdp_message_free (sdp);
-    return NULL;
+    return str;
   }
+
+  if (!(cache = gst_rtsp_media_get_sdp_cache (media, &cookie))) {
+    GST_DEBUG ("client %p: making SDP for media %p", client, media);
+    if (!(cache = compile_sdp (client, media)))
+      return NULL;
+    if (gst_rtsp_media_set_sdp_cache (media, cache, cookie) && media->is_live)
+      remember_sdp (client, state, cache);
+  }
+  str = render_sdp (client, media, cache, NULL);
+  g_bytes_unref (cache);
+
+  return str;
 }
 
 /* for the describe we must generate an SDP */
@@ -1213,13 +2439,9 @@ static gboolean
 handle_describe_request (GstRTSPClient * client, GstRTSPClientState * state)
 {
   GstRTSPResult res;
-  GstSDPMessage *sdp;
-  guint i, str_len;
-  gchar *str, *content_base;
+  guint i;
+  gchar *sdp;
   GstRTSPMedia *media;
-  GstRTSPClientClass *klass;
-
-  klass = GST_RTSP_CLIENT_GET_CLASS (client);
 
   /* check what kind of format is accepted, we don't really do anything with it
    * and always return SDP for now. */
@@ -1236,17 +2458,46 @@ handle_describe_request (GstRTSPClient * client, GstRTSPClientState * state)
       break;
   }
 
-  /* find the media object for the uri */
+  /* find the media object for the uri, this can park the request until the
+   * media is prepared */
   if (!(media = find_media (client, state)))
     goto no_media;
 
 
   /* create an SDP for the media object on this client */
-  if (!(sdp = klass->create_sdp (client, media)))
+  if (!(sdp = get_sdp_text (client, state, media)))
     goto no_sdp;
 
   g_object_unref (media);
 
+  send_describe_response (client, state, sdp);
+
+  return TRUE;
+
+  /* ERRORS */
+no_media:
+  {
+    /* error reply is already sent, the request is parked or it was described
+     * from the cache */
+    return FALSE;
+  }
+no_sdp:
+  {
+    send_generic_response (client, GST_RTSP_STS_SERVICE_UNAVAILABLE, state);
+    g_object_unref (media);
+    return FALSE;
+  }
+}
+
+/* send @sdp as the response to the DESCRIBE request in @state, takes
+ * ownership of @sdp */
+static void
+send_describe_response (GstRTSPClient * client, GstRTSPClientState * state,
+    gchar * sdp)
+{
+  gchar *str, *content_base;
+  guint str_len;
+
   gst_rtsp_message_init_response (state->response, GST_RTSP_STS_OK,
       gst_rtsp_status_as_text (GST_RTSP_STS_OK), state->request);
 
@@ -1275,29 +2526,12 @@ handle_describe_request (GstRTSPClient * client, GstRTSPClientState * state)
   g_free (content_base);
 
   /* add SDP to the response body */
-  str = gst_sdp_message_as_text (sdp);
-  gst_rtsp_message_take_body (state->response, (guint8 *) str, strlen (str));
-  gst_sdp_message_free (sdp);
+  gst_rtsp_message_take_body (state->response, (guint8 *) sdp, strlen (sdp));
 
   send_response (client, state->session, state->response);
 
   g_signal_emit (client, gst_rtsp_client_signals[SIGNAL_DESCRIBE_REQUEST],
       0, state);
-
-  return TRUE;
-
-  /* ERRORS */
-no_media:
-  {
-    /* error reply is already sent */
-    return FALSE;
-  }
-no_sdp:
-  {
-    send_generic_response (client, GST_RTSP_STS_SERVICE_UNAVAILABLE, state);
-    g_object_unref (media);
-    return FALSE;
-  }
 }
 
 static gboolean
@@ -1526,11 +2760,12 @@ handle_data (GstRTSPClient * client, GstRTSPMessage * message)
 {
   GstRTSPResult res;
   guint8 channel;
-  GList *walk;
   guint8 *data;
   guint size;
   GstBuffer *buffer;
   gboolean handled;
+  GstRTSPSessionStream *stream;
+  GstRTSPMediaStream *mstream;
 
   /* find the stream for this message */
   res = gst_rtsp_message_parse_data (message, &channel);
@@ -1542,31 +2777,14 @@ handle_data (GstRTSPClient * client, GstRTSPMessage * message)
   buffer = gst_buffer_new_wrapped (data, size);
 
   handled = FALSE;
-  for (walk = client->streams; walk; walk = g_list_next (walk)) {
-    GstRTSPSessionStream *stream = (GstRTSPSessionStream *) walk->data;
-    GstRTSPMediaStream *mstream;
-    GstRTSPTransport *tr;
-
-    /* get the transport, if there is no transport configured, skip this stream */
-    if (!(tr = stream->trans.transport))
-      continue;
-
-    /* we also need a media stream */
-    if (!(mstream = stream->media_stream))
-      continue;
-
-    /* check for TCP transport */
-    if (tr->lower_transport == GST_RTSP_LOWER_TRANS_TCP) {
-      /* dispatch to the stream based on the channel number */
-      if (tr->interleaved.min == channel) {
-        gst_rtsp_media_stream_rtp (mstream, buffer);
-        handled = TRUE;
-        break;
-      } else if (tr->interleaved.max == channel) {
-        gst_rtsp_media_stream_rtcp (mstream, buffer);
-        handled = TRUE;
-        break;
-      }
+  /* dispatch to the stream based on the channel number */
+  if ((stream = client->channels[channel]) && (mstream = stream->media_stream)) {
+    if (stream->trans.transport->interleaved.min == channel) {
+      gst_rtsp_media_stream_rtp (mstream, buffer);
+      handled = TRUE;
+    } else if (stream->trans.transport->interleaved.max == channel) {
+      gst_rtsp_media_stream_rtcp (mstream, buffer);
+      handled = TRUE;
     }
   }
   if (!handled)
@@ -1751,6 +2969,296 @@ gst_rtsp_client_get_auth (GstRTSPClient * client)
   return result;
 }
 
+/**
+ * gst_rtsp_client_set_port_pool:
+ * @client: a #GstRTSPClient
+ * @pool: a #GstRTSPPortPool
+ *
+ * configure @pool to be used for allocating the server ports of the media of
+ * @client that have no port pool of their own.
+ */
+void
+gst_rtsp_client_set_port_pool (GstRTSPClient * client, GstRTSPPortPool * pool)
+{
+  GstRTSPPortPool *old;
+
+  g_return_if_fail (GST_IS_RTSP_CLIENT (client));
+
+  old = client->port_pool;
+
+  if (old != pool) {
+    if (pool)
+      g_object_ref (pool);
+    client->port_pool = pool;
+    if (old)
+      g_object_unref (old);
+  }
+}
+
+/**
+ * gst_rtsp_client_get_port_pool:
+ * @client: a #GstRTSPClient
+ *
+ * Get the #GstRTSPPortPool used for allocating the server ports of the media
+ * of @client.
+ *
+ * Returns: the #GstRTSPPortPool of @client. g_object_unref() after
+ * usage.
+ */
+GstRTSPPortPool *
+gst_rtsp_client_get_port_pool (GstRTSPClient * client)
+{
+  GstRTSPPortPool *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_CLIENT (client), NULL);
+
+  if ((result = client->port_pool))
+    g_object_ref (result);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_client_set_context:
+ * @client: a #GstRTSPClient
+ * @context: a #GMainContext or %NULL
+ *
+ * Set @context as the #GMainContext where the connection of @client will be
+ * handled. When @context is %NULL, the context of the source that accepted
+ * the connection is used.
+ *
+ * This function must be called before the connection of @client is accepted.
+ */
+void
+gst_rtsp_client_set_context (GstRTSPClient * client, GMainContext * context)
+{
+  GMainContext *old;
+
+  g_return_if_fail (GST_IS_RTSP_CLIENT (client));
+
+  old = client->context;
+
+  if (old != context) {
+    if (context)
+      g_main_context_ref (context);
+    client->context = context;
+    if (old)
+      g_main_context_unref (old);
+  }
+}
+
+/**
+ * gst_rtsp_client_get_context:
+ * @client: a #GstRTSPClient
+ *
+ * Get the #GMainContext where the connection of @client is handled.
+ *
+ * Returns: the #GMainContext of @client or %NULL. g_main_context_unref()
+ * after usage.
+ */
+GMainContext *
+gst_rtsp_client_get_context (GstRTSPClient * client)
+{
+  GMainContext *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_CLIENT (client), NULL);
+
+  if ((result = client->context))
+    g_main_context_ref (result);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_client_set_send_latency:
+ * @client: a #GstRTSPClient
+ * @latency: the latency in milliseconds
+ *
+ * Set the maximum time in milliseconds that interleaved data for @client is
+ * held back so that multiple frames can be written in one go. With a latency
+ * of 0, data is written as soon as it is produced.
+ */
+void
+gst_rtsp_client_set_send_latency (GstRTSPClient * client, guint latency)
+{
+  g_return_if_fail (GST_IS_RTSP_CLIENT (client));
+
+  g_mutex_lock (&client->send_lock);
+  client->send_latency = latency;
+  g_mutex_unlock (&client->send_lock);
+}
+
+/**
+ * gst_rtsp_client_get_send_latency:
+ * @client: a #GstRTSPClient
+ *
+ * Get the maximum time in milliseconds that interleaved data for @client is
+ * held back.
+ *
+ * Returns: the send latency of @client.
+ */
+guint
+gst_rtsp_client_get_send_latency (GstRTSPClient * client)
+{
+  guint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_CLIENT (client), 0);
+
+  g_mutex_lock (&client->send_lock);
+  result = client->send_latency;
+  g_mutex_unlock (&client->send_lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_client_set_send_budget:
+ * @client: a #GstRTSPClient
+ * @max_bytes: the maximum amount of queued data in bytes or 0
+ * @max_time: the maximum duration of queued data in milliseconds or 0
+ *
+ * Limit the amount of interleaved data that can be queued for @client when it
+ * can't keep up. When either limit is exceeded, the drop policy of @client is
+ * applied. A limit of 0 disables the limit, which is the default.
+ */
+void
+gst_rtsp_client_set_send_budget (GstRTSPClient * client, guint max_bytes,
+    guint max_time)
+{
+  g_return_if_fail (GST_IS_RTSP_CLIENT (client));
+
+  g_mutex_lock (&client->send_lock);
+  client->send_max_bytes = max_bytes;
+  client->send_max_time = max_time;
+  g_mutex_unlock (&client->send_lock);
+}
+
+/**
+ * gst_rtsp_client_get_send_budget:
+ * @client: a #GstRTSPClient
+ * @max_bytes: (out) (allow-none): the maximum amount of queued data in bytes
+ * @max_time: (out) (allow-none): the maximum duration of queued data in
+ *     milliseconds
+ *
+ * Get the limits of the interleaved data that can be queued for @client.
+ */
+void
+gst_rtsp_client_get_send_budget (GstRTSPClient * client, guint * max_bytes,
+    guint * max_time)
+{
+  g_return_if_fail (GST_IS_RTSP_CLIENT (client));
+
+  g_mutex_lock (&client->send_lock);
+  if (max_bytes)
+    *max_bytes = client->send_max_bytes;
+  if (max_time)
+    *max_time = client->send_max_time;
+  g_mutex_unlock (&client->send_lock);
+}
+
+/**
+ * gst_rtsp_client_set_drop_policy:
+ * @client: a #GstRTSPClient
+ * @policy: a #GstRTSPClientDropPolicy
+ *
+ * Configure what @client does when its queued interleaved data exceeds the
+ * send budget.
+ */
+void
+gst_rtsp_client_set_drop_policy (GstRTSPClient * client,
+    GstRTSPClientDropPolicy policy)
+{
+  g_return_if_fail (GST_IS_RTSP_CLIENT (client));
+
+  g_mutex_lock (&client->send_lock);
+  client->drop_policy = policy;
+  g_mutex_unlock (&client->send_lock);
+}
+
+/**
+ * gst_rtsp_client_get_drop_policy:
+ * @client: a #GstRTSPClient
+ *
+ * Get what @client does when its queued interleaved data exceeds the send
+ * budget.
+ *
+ * Returns: the #GstRTSPClientDropPolicy of @client.
+ */
+GstRTSPClientDropPolicy
+gst_rtsp_client_get_drop_policy (GstRTSPClient * client)
+{
+  GstRTSPClientDropPolicy result;
+
+  g_return_val_if_fail (GST_IS_RTSP_CLIENT (client), DEFAULT_DROP_POLICY);
+
+  g_mutex_lock (&client->send_lock);
+  result = client->drop_policy;
+  g_mutex_unlock (&client->send_lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_client_get_send_stats:
+ * @client: a #GstRTSPClient
+ *
+ * Get statistics about the interleaved data of @client. The structure
+ * contains the fields "queued-bytes", "dropped-frames" and "dropped-bytes"
+ * (#guint64), "droppable-drops" and "gop-drops" (#guint) with the number of
+ * times the respective policy was applied and "overflow-disconnect"
+ * (#gboolean) which is %TRUE when @client was disconnected because it could
+ * not keep up.
+ *
+ * Returns: a #GstStructure, gst_structure_free() after usage.
+ */
+GstStructure *
+gst_rtsp_client_get_send_stats (GstRTSPClient * client)
+{
+  GstStructure *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_CLIENT (client), NULL);
+
+  g_mutex_lock (&client->send_lock);
+  result = gst_structure_new ("application/x-rtsp-client-send-stats",
+      "queued-bytes", G_TYPE_UINT64, (guint64) client->send_queued,
+      "dropped-frames", G_TYPE_UINT64, client->dropped_frames,
+      "dropped-bytes", G_TYPE_UINT64, client->dropped_bytes,
+      "droppable-drops", G_TYPE_UINT, client->droppable_drops,
+      "gop-drops", G_TYPE_UINT, client->gop_drops,
+      "overflow-disconnect", G_TYPE_BOOLEAN, client->send_overflow, NULL);
+  g_mutex_unlock (&client->send_lock);
+
+  return result;
+}
+
+static gboolean
+do_close (GstRTSPClient * client)
+{
+  close_connection (client);
+  return FALSE;
+}
+
+/**
+ * gst_rtsp_client_close:
+ * @client: a #GstRTSPClient
+ *
+ * Close the connection of @client. This can be called from any thread, the
+ * connection is closed from the #GMainContext of @client.
+ */
+void
+gst_rtsp_client_close (GstRTSPClient * client)
+{
+  g_return_if_fail (GST_IS_RTSP_CLIENT (client));
+
+  if (client->context) {
+    g_main_context_invoke_full (client->context, G_PRIORITY_DEFAULT,
+        (GSourceFunc) do_close, g_object_ref (client),
+        (GDestroyNotify) g_object_unref);
+  } else {
+    close_connection (client);
+  }
+}
+
 static GstRTSPResult
 message_received (GstRTSPWatch * watch, GstRTSPMessage * message,
     gpointer user_data)
@@ -1759,7 +3267,16 @@ message_received (GstRTSPWatch * watch, GstRTSPMessage * message,
 
   switch (message->type) {
     case GST_RTSP_MESSAGE_REQUEST:
-      handle_request (client, message);
+      if (client->parked) {
+        /* keep the order of the requests, they are handled when the parked
+         * request is resumed */
+        GST_INFO ("client %p: queueing request behind parked request",
+            client);
+        client->pending = g_list_append (client->pending,
+            take_request (message));
+      } else {
+        handle_request (client, message);
+      }
       break;
     case GST_RTSP_MESSAGE_RESPONSE:
       break;
@@ -1775,11 +3292,13 @@ message_received (GstRTSPWatch * watch, GstRTSPMessage * message,
 static GstRTSPResult
 message_sent (GstRTSPWatch * watch, guint cseq, gpointer user_data)
 {
-  /* GstRTSPClient *client; */
-
-  /* client = GST_RTSP_CLIENT (user_data); */
+  GstRTSPClient *client = GST_RTSP_CLIENT (user_data);
 
-  /* GST_INFO ("client %p: sent a message with cseq %d", client, cseq); */
+  /* the watch wrote the rest of our control message, continue with the data.
+   * We can't use the watch from here, flush from an idle source. */
+  if (cseq != 0 &&
+      g_atomic_int_compare_and_exchange (&client->watch_busy, (gint) cseq, 0))
+    schedule_flush (client);
 
   return GST_RTSP_OK;
 }
@@ -1907,9 +3426,42 @@ tunnel_lost (GstRTSPWatch * watch, gpointer user_data)
   return GST_RTSP_OK;
 }
 
+typedef struct
+{
+  GstRTSPClient *client;
+  GstRTSPClient *oclient;
+} TunnelMerge;
+
+static gboolean
+do_merge_tunnel (TunnelMerge * merge)
+{
+  GstRTSPClient *oclient = merge->oclient;
+
+  if (oclient->watch == NULL) {
+    GST_INFO ("client %p: tunnel %p was closed", merge->client, oclient);
+    return FALSE;
+  }
+
+  /* merge the tunnels into the first client */
+  gst_rtsp_connection_do_tunnel (oclient->connection,
+      merge->client->connection);
+  gst_rtsp_watch_reset (oclient->watch);
+
+  return FALSE;
+}
+
+static void
+free_tunnel_merge (TunnelMerge * merge)
+{
+  g_object_unref (merge->client);
+  g_object_unref (merge->oclient);
+  g_slice_free (TunnelMerge, merge);
+}
+
 static GstRTSPResult
 tunnel_complete (GstRTSPWatch * watch, gpointer user_data)
 {
+  TunnelMerge *merge;
   const gchar *tunnelid;
   GstRTSPClient *client = GST_RTSP_CLIENT (user_data);
   GstRTSPClient *oclient;
@@ -1937,10 +3489,20 @@ tunnel_complete (GstRTSPWatch * watch, gpointer user_data)
   GST_INFO ("client %p: found tunnel %p (old %p, new %p)", client, oclient,
       oclient->connection, client->connection);
 
-  /* merge the tunnels into the first client */
-  gst_rtsp_connection_do_tunnel (oclient->connection, client->connection);
-  gst_rtsp_watch_reset (oclient->watch);
-  g_object_unref (oclient);
+  merge = g_slice_new (TunnelMerge);
+  merge->client = g_object_ref (client);
+  merge->oclient = oclient;
+
+  if (oclient->context == NULL) {
+    do_merge_tunnel (merge);
+    free_tunnel_merge (merge);
+  } else {
+    /* the first client can be handled by another thread, merge the tunnels
+     * from the context of the first client. */
+    g_main_context_invoke_full (oclient->context, G_PRIORITY_DEFAULT,
+        (GSourceFunc) do_merge_tunnel, merge,
+        (GDestroyNotify) free_tunnel_merge);
+  }
 
   /* we don't need this watch anymore */
   g_source_destroy ((GSource *) client->watch);
@@ -1985,8 +3547,11 @@ static void
 client_watch_notify (GstRTSPClient * client)
 {
   GST_INFO ("client %p: watch destroyed", client);
+  g_mutex_lock (&client->send_lock);
   client->watchid = 0;
   client->watch = NULL;
+  clear_send_queue (client);
+  g_mutex_unlock (&client->send_lock);
   g_signal_emit (client, gst_rtsp_client_signals[SIGNAL_CLOSED], 0, NULL);
   g_object_unref (client);
 }
@@ -2031,12 +3596,20 @@ attach_client (GstRTSPClient * client, GSocket * socket,
   client->watch = gst_rtsp_watch_new (client->connection, &watch_funcs,
       g_object_ref (client), (GDestroyNotify) client_watch_notify);
 
-  /* find the context to add the watch */
-  if ((source = g_main_current_source ()))
+  /* find the context to add the watch, use the configured context or else the
+   * context of the source that accepted the connection */
+  if (client->context)
+    context = client->context;
+  else if ((source = g_main_current_source ()))
     context = g_source_get_context (source);
   else
     context = NULL;
 
+  /* remember the context, parked requests are resumed from it */
+  if (client->context == NULL)
+    client->context =
+        g_main_context_ref (context ? context : g_main_context_default ());
+
   GST_INFO ("attaching to context %p", context);
 
   client->watchid = gst_rtsp_watch_attach (client->watch, context);
@@ -2083,6 +3656,8 @@ no_connection:
     gchar *str = gst_rtsp_strresult (res);
 
     GST_ERROR ("could not create connection from socket %p: %s", socket, str);
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+        "could not create connection: %s", str);
     g_free (str);
     return FALSE;
   }
@@ -2121,6 +3696,8 @@ accept_failed:
     gchar *str = gst_rtsp_strresult (res);
 
     GST_ERROR ("Could not accept client on server socket %p: %s", socket, str);
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+        "could not accept client: %s", str);
     g_free (str);
     return FALSE;
   }
@@ -36,6 +36,32 @@ typedef struct _GstRTSPClientState GstRTSPClientState;
 #include "rtsp-auth.h"
 #include "rtsp-sdp.h"
 
+/**
+ * GstRTSPClientDropPolicy:
+ * @GST_RTSP_CLIENT_DROP_POLICY_GOP: drop all queued data and skip new data
+ *     until the next keyframe
+ * @GST_RTSP_CLIENT_DROP_POLICY_DROPPABLE: drop the queued frames that have
+ *     the #GST_BUFFER_FLAG_DROPPABLE flag first, drop the GOP when that is
+ *     not enough
+ * @GST_RTSP_CLIENT_DROP_POLICY_DISCONNECT: disconnect the client
+ *
+ * What a client does when the interleaved data queued for it exceeds its send
+ * budget.
+ *
+ * The payloaders don't mark the packets of frames that are not referenced,
+ * #GST_RTSP_CLIENT_DROP_POLICY_DROPPABLE only drops less than the GOP when the
+ * pipeline of the media sets #GST_BUFFER_FLAG_DROPPABLE on the RTP packets
+ * itself. Without it, it behaves like #GST_RTSP_CLIENT_DROP_POLICY_GOP.
+ */
+typedef enum {
+  GST_RTSP_CLIENT_DROP_POLICY_GOP,
+  GST_RTSP_CLIENT_DROP_POLICY_DROPPABLE,
+  GST_RTSP_CLIENT_DROP_POLICY_DISCONNECT
+} GstRTSPClientDropPolicy;
+
+#define GST_TYPE_RTSP_CLIENT_DROP_POLICY (gst_rtsp_client_drop_policy_get_type())
+GType gst_rtsp_client_drop_policy_get_type (void);
+
 #define GST_TYPE_RTSP_CLIENT              (gst_rtsp_client_get_type ())
 #define GST_IS_RTSP_CLIENT(obj)           (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_RTSP_CLIENT))
 #define GST_IS_RTSP_CLIENT_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_RTSP_CLIENT))
@@ -76,11 +102,40 @@ struct _GstRTSPClientState{
  * @watch: watch for the connection
  * @watchid: id of the watch
  * @ip: ip address used by the client to connect to us
+ * @context: the #GMainContext where the watch is attached to or %NULL
  * @session_pool: handle to the session pool used by the client.
  * @media_mapping: handle to the media mapping used by the client.
+ * @port_pool: the pool for the server ports of the media or %NULL
  * @uri: cached uri
  * @media: cached media
+ * @factory: the factory of @media
+ * @parked: a request waiting for its media to be prepared or seeked or %NULL
+ * @pending: requests received while a request is parked
+ * @seek_done: the request being handled again already seeked the media
+ * @send_lock: lock protecting the send queue
+ * @send_queue: interleaved data frames waiting to be written
+ * @send_control: control messages waiting to be written, these go before
+ *     @send_queue at the next frame boundary
+ * @send_queued: number of payload bytes in @send_queue
+ * @send_latency: maximum time in milliseconds data is held back
+ * @send_source: source waiting for the socket to become writable or %NULL
+ * @send_timer: source flushing held back data or %NULL
+ * @send_scheduled: if a flush from the context is scheduled
+ * @watch_busy: id of the control message the watch is still writing or 0
+ * @send_max_bytes: maximum amount of queued data in bytes or 0
+ * @send_max_time: maximum duration of queued data in milliseconds or 0
+ * @drop_policy: what to do when the queued data exceeds the limits
+ * @send_dropping: bitmap of the channels that skip data until a keyframe
+ * @send_has_rtptime: bitmap of the channels with a valid @send_rtptime
+ * @send_rtptime: the RTP timestamp of the last packet of each channel, a
+ *     packet with another timestamp starts a new frame
+ * @send_overflow: the client is disconnected because it could not keep up
+ * @dropped_frames: number of dropped frames
+ * @dropped_bytes: number of dropped bytes
+ * @droppable_drops: number of times droppable frames were dropped
+ * @gop_drops: number of times the queued data was dropped
  * @streams: a list of streams using @connection.
+ * @channels: the stream of @streams for each interleaved channel or %NULL
  * @sessions: a list of sessions managed by @connection.
  *
  * The client structure.
@@ -93,16 +148,46 @@ struct _GstRTSPClient {
   guint              watchid;
   gchar             *server_ip;
   gboolean           is_ipv6;
+  GMainContext      *context;
 
   GstRTSPServer        *server;
   GstRTSPSessionPool   *session_pool;
   GstRTSPMediaMapping  *media_mapping;
   GstRTSPAuth          *auth;
+  GstRTSPPortPool      *port_pool;
 
   GstRTSPUrl     *uri;
   GstRTSPMedia   *media;
+  GstRTSPMediaFactory *factory;
+
+  GstRTSPMessage *parked;
+  GList          *pending;
+  gboolean        seek_done;
+
+  GMutex          send_lock;
+  GQueue          send_queue;
+  GQueue          send_control;
+  gsize           send_queued;
+  guint           send_latency;
+  GSource        *send_source;
+  GSource        *send_timer;
+  gint            send_scheduled;
+  gint            watch_busy;
+
+  guint           send_max_bytes;
+  guint           send_max_time;
+  GstRTSPClientDropPolicy drop_policy;
+  guint8          send_dropping[32];
+  guint8          send_has_rtptime[32];
+  guint32         send_rtptime[256];
+  gboolean        send_overflow;
+  guint64         dropped_frames;
+  guint64         dropped_bytes;
+  guint           droppable_drops;
+  guint           gop_drops;
 
   GList *streams;
+  GstRTSPSessionStream *channels[256];
   GList *sessions;
 };
 
@@ -142,6 +227,27 @@ GstRTSPMediaMapping * gst_rtsp_client_get_media_mapping (GstRTSPClient *client);
 void                  gst_rtsp_client_set_auth          (GstRTSPClient *client, GstRTSPAuth *auth);
 GstRTSPAuth *         gst_rtsp_client_get_auth          (GstRTSPClient *client);
 
+void                  gst_rtsp_client_set_port_pool     (GstRTSPClient *client, GstRTSPPortPool *pool);
+GstRTSPPortPool *     gst_rtsp_client_get_port_pool     (GstRTSPClient *client);
+
+void                  gst_rtsp_client_set_context       (GstRTSPClient *client, GMainContext *context);
+GMainContext *        gst_rtsp_client_get_context       (GstRTSPClient *client);
+
+void                  gst_rtsp_client_set_send_latency  (GstRTSPClient *client, guint latency);
+guint                 gst_rtsp_client_get_send_latency  (GstRTSPClient *client);
+
+void                  gst_rtsp_client_set_send_budget   (GstRTSPClient *client, guint max_bytes,
+                                                         guint max_time);
+void                  gst_rtsp_client_get_send_budget   (GstRTSPClient *client, guint *max_bytes,
+                                                         guint *max_time);
+
+void                  gst_rtsp_client_set_drop_policy   (GstRTSPClient *client,
+                                                         GstRTSPClientDropPolicy policy);
+GstRTSPClientDropPolicy gst_rtsp_client_get_drop_policy (GstRTSPClient *client);
+
+GstStructure *        gst_rtsp_client_get_send_stats    (GstRTSPClient *client);
+
+void                  gst_rtsp_client_close             (GstRTSPClient *client);
 
 gboolean              gst_rtsp_client_accept            (GstRTSPClient *client,
                                                          GSocket *socket,
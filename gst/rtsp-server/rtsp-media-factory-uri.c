@@ -262,6 +262,8 @@ gst_rtsp_media_factory_uri_set_uri (GstRTSPMediaFactoryURI * factory,
   g_free (factory->uri);
   factory->uri = g_strdup (uri);
   GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+
+  gst_rtsp_media_factory_clear_sdp_cache (GST_RTSP_MEDIA_FACTORY (factory));
 }
 
 /**
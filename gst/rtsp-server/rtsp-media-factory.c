@@ -24,6 +24,9 @@
 #define DEFAULT_EOS_SHUTDOWN    FALSE
 #define DEFAULT_PROTOCOLS       GST_RTSP_LOWER_TRANS_UDP | GST_RTSP_LOWER_TRANS_TCP
 #define DEFAULT_BUFFER_SIZE     0x80000
+#define DEFAULT_UDP_SEND_THREADS 0
+#define DEFAULT_TCP_SEND_THREADS 0
+#define DEFAULT_UDP_RECEIVER    TRUE
 #define DEFAULT_MULTICAST_GROUP "224.2.0.1"
 
 enum
@@ -34,6 +37,9 @@ enum
   PROP_EOS_SHUTDOWN,
   PROP_PROTOCOLS,
   PROP_BUFFER_SIZE,
+  PROP_UDP_SEND_THREADS,
+  PROP_TCP_SEND_THREADS,
+  PROP_UDP_RECEIVER,
   PROP_MULTICAST_GROUP,
   PROP_LAST
 };
@@ -121,6 +127,26 @@ gst_rtsp_media_factory_class_init (GstRTSPMediaFactoryClass * klass)
           "The kernel UDP buffer size to use", 0, G_MAXUINT,
           DEFAULT_BUFFER_SIZE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_UDP_SEND_THREADS,
+      g_param_spec_uint ("udp-send-threads", "UDP Send Threads",
+          "The number of threads sending RTP to the UDP destinations of a "
+          "stream, 0 sends from the streaming thread", 0, 64,
+          DEFAULT_UDP_SEND_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TCP_SEND_THREADS,
+      g_param_spec_uint ("tcp-send-threads", "TCP Send Threads",
+          "The number of threads sending RTP and RTCP to the TCP transports, "
+          "0 sends from the streaming thread of each stream", 0, 64,
+          DEFAULT_TCP_SEND_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_UDP_RECEIVER,
+      g_param_spec_boolean ("udp-receiver", "UDP Receiver",
+          "Receive on the UDP sockets with the threads shared by all media "
+          "instead of a thread per socket", DEFAULT_UDP_RECEIVER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (gobject_class, PROP_MULTICAST_GROUP,
       g_param_spec_string ("multicast-group", "Multicast Group",
           "The Multicast group to send media to",
@@ -156,12 +182,17 @@ gst_rtsp_media_factory_init (GstRTSPMediaFactory * factory)
   factory->eos_shutdown = DEFAULT_EOS_SHUTDOWN;
   factory->protocols = DEFAULT_PROTOCOLS;
   factory->buffer_size = DEFAULT_BUFFER_SIZE;
+  factory->udp_send_threads = DEFAULT_UDP_SEND_THREADS;
+  factory->tcp_send_threads = DEFAULT_TCP_SEND_THREADS;
+  factory->udp_receiver = DEFAULT_UDP_RECEIVER;
   factory->multicast_group = g_strdup (DEFAULT_MULTICAST_GROUP);
 
   g_mutex_init (&factory->lock);
   g_mutex_init (&factory->medias_lock);
   factory->medias = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, g_object_unref);
+  factory->sdp_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_bytes_unref);
 }
 
 static void
@@ -170,6 +201,7 @@ gst_rtsp_media_factory_finalize (GObject * obj)
   GstRTSPMediaFactory *factory = GST_RTSP_MEDIA_FACTORY (obj);
 
   g_hash_table_unref (factory->medias);
+  g_hash_table_unref (factory->sdp_cache);
   g_mutex_clear (&factory->medias_lock);
   g_free (factory->launch);
   g_free (factory->multicast_group);
@@ -204,6 +236,18 @@ gst_rtsp_media_factory_get_property (GObject * object, guint propid,
       g_value_set_uint (value,
           gst_rtsp_media_factory_get_buffer_size (factory));
       break;
+    case PROP_UDP_SEND_THREADS:
+      g_value_set_uint (value,
+          gst_rtsp_media_factory_get_udp_send_threads (factory));
+      break;
+    case PROP_TCP_SEND_THREADS:
+      g_value_set_uint (value,
+          gst_rtsp_media_factory_get_tcp_send_threads (factory));
+      break;
+    case PROP_UDP_RECEIVER:
+      g_value_set_boolean (value,
+          gst_rtsp_media_factory_get_udp_receiver (factory));
+      break;
     case PROP_MULTICAST_GROUP:
       g_value_take_string (value,
           gst_rtsp_media_factory_get_multicast_group (factory));
@@ -237,6 +281,18 @@ gst_rtsp_media_factory_set_property (GObject * object, guint propid,
       gst_rtsp_media_factory_set_buffer_size (factory,
           g_value_get_uint (value));
       break;
+    case PROP_UDP_SEND_THREADS:
+      gst_rtsp_media_factory_set_udp_send_threads (factory,
+          g_value_get_uint (value));
+      break;
+    case PROP_TCP_SEND_THREADS:
+      gst_rtsp_media_factory_set_tcp_send_threads (factory,
+          g_value_get_uint (value));
+      break;
+    case PROP_UDP_RECEIVER:
+      gst_rtsp_media_factory_set_udp_receiver (factory,
+          g_value_get_boolean (value));
+      break;
     case PROP_MULTICAST_GROUP:
       gst_rtsp_media_factory_set_multicast_group (factory,
           g_value_get_string (value));
@@ -290,6 +346,8 @@ gst_rtsp_media_factory_set_launch (GstRTSPMediaFactory * factory,
   g_free (factory->launch);
   factory->launch = g_strdup (launch);
   GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+
+  gst_rtsp_media_factory_clear_sdp_cache (factory);
 }
 
 /**
@@ -331,6 +389,8 @@ gst_rtsp_media_factory_set_shared (GstRTSPMediaFactory * factory,
   GST_RTSP_MEDIA_FACTORY_LOCK (factory);
   factory->shared = shared;
   GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+
+  gst_rtsp_media_factory_clear_sdp_cache (factory);
 }
 
 /**
@@ -437,6 +497,131 @@ gst_rtsp_media_factory_get_buffer_size (GstRTSPMediaFactory * factory)
   return result;
 }
 
+/**
+ * gst_rtsp_media_factory_set_udp_send_threads:
+ * @factory: a #GstRTSPMediaFactory
+ * @threads: the number of threads
+ *
+ * Set the number of threads that send the RTP packets of a stream to its UDP
+ * destinations in the media of @factory. See
+ * gst_rtsp_media_set_udp_send_threads().
+ */
+void
+gst_rtsp_media_factory_set_udp_send_threads (GstRTSPMediaFactory * factory,
+    guint threads)
+{
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory));
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  factory->udp_send_threads = threads;
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+}
+
+/**
+ * gst_rtsp_media_factory_get_udp_send_threads:
+ * @factory: a #GstRTSPMediaFactory
+ *
+ * Get the number of threads that send RTP to the UDP destinations of a stream.
+ *
+ * Returns: the number of UDP send threads.
+ */
+guint
+gst_rtsp_media_factory_get_udp_send_threads (GstRTSPMediaFactory * factory)
+{
+  guint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory), 0);
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  result = factory->udp_send_threads;
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_media_factory_set_tcp_send_threads:
+ * @factory: a #GstRTSPMediaFactory
+ * @threads: the number of threads
+ *
+ * Set the number of threads that send to the TCP transports of the media of
+ * @factory. See gst_rtsp_media_set_tcp_send_threads().
+ */
+void
+gst_rtsp_media_factory_set_tcp_send_threads (GstRTSPMediaFactory * factory,
+    guint threads)
+{
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory));
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  factory->tcp_send_threads = threads;
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+}
+
+/**
+ * gst_rtsp_media_factory_get_tcp_send_threads:
+ * @factory: a #GstRTSPMediaFactory
+ *
+ * Get the number of threads that send to the TCP transports.
+ *
+ * Returns: the number of TCP send threads.
+ */
+guint
+gst_rtsp_media_factory_get_tcp_send_threads (GstRTSPMediaFactory * factory)
+{
+  guint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory), 0);
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  result = factory->tcp_send_threads;
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_media_factory_set_udp_receiver:
+ * @factory: a #GstRTSPMediaFactory
+ * @use_receiver: if the shared receiver should be used
+ *
+ * Configure if the UDP sockets of the media of @factory are polled by the
+ * shared receiver. See gst_rtsp_media_set_udp_receiver().
+ */
+void
+gst_rtsp_media_factory_set_udp_receiver (GstRTSPMediaFactory * factory,
+    gboolean use_receiver)
+{
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory));
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  factory->udp_receiver = use_receiver;
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+}
+
+/**
+ * gst_rtsp_media_factory_get_udp_receiver:
+ * @factory: a #GstRTSPMediaFactory
+ *
+ * Check if the UDP sockets of the media of @factory are polled by the shared
+ * receiver.
+ *
+ * Returns: %TRUE when the shared receiver is used.
+ */
+gboolean
+gst_rtsp_media_factory_get_udp_receiver (GstRTSPMediaFactory * factory)
+{
+  gboolean result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory), FALSE);
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  result = factory->udp_receiver;
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+
+  return result;
+}
+
 /**
  * gst_rtsp_media_factory_set_multicast_group:
  * @factory: a #GstRTSPMedia
@@ -454,6 +639,8 @@ gst_rtsp_media_factory_set_multicast_group (GstRTSPMediaFactory * factory,
   g_free (factory->multicast_group);
   factory->multicast_group = g_strdup (mc);
   GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+
+  gst_rtsp_media_factory_clear_sdp_cache (factory);
 }
 
 /**
@@ -540,6 +727,8 @@ gst_rtsp_media_factory_set_protocols (GstRTSPMediaFactory * factory,
   g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory));
 
   factory->protocols = protocols;
+
+  gst_rtsp_media_factory_clear_sdp_cache (factory);
 }
 
 /**
@@ -659,6 +848,106 @@ gst_rtsp_media_factory_construct (GstRTSPMediaFactory * factory,
   return media;
 }
 
+/* the key of @url in the SDP cache or %NULL when nothing is cached */
+static gchar *
+get_sdp_cache_key (GstRTSPMediaFactory * factory, const GstRTSPUrl * url)
+{
+  GstRTSPMediaFactoryClass *klass;
+
+  klass = GST_RTSP_MEDIA_FACTORY_GET_CLASS (factory);
+
+  if (klass->gen_key == NULL)
+    return NULL;
+
+  return klass->gen_key (factory, url);
+}
+
+/**
+ * gst_rtsp_media_factory_get_sdp_cache:
+ * @factory: a #GstRTSPMediaFactory
+ * @url: the url used
+ *
+ * Get the SDP that was stored for the media of @url with
+ * gst_rtsp_media_factory_set_sdp_cache(). Unlike the cache of the media,
+ * this SDP is kept when the media is unprepared and can be used to describe
+ * the media while it is being prepared again.
+ *
+ * Returns: the cached SDP or %NULL. g_bytes_unref() after usage.
+ */
+GBytes *
+gst_rtsp_media_factory_get_sdp_cache (GstRTSPMediaFactory * factory,
+    const GstRTSPUrl * url)
+{
+  GBytes *result = NULL;
+  gchar *key;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory), NULL);
+  g_return_val_if_fail (url != NULL, NULL);
+
+  /* without a key nothing is cached */
+  if (!(key = get_sdp_cache_key (factory, url)))
+    return NULL;
+
+  g_mutex_lock (&factory->medias_lock);
+  if ((result = g_hash_table_lookup (factory->sdp_cache, key)))
+    g_bytes_ref (result);
+  g_mutex_unlock (&factory->medias_lock);
+
+  g_free (key);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_media_factory_set_sdp_cache:
+ * @factory: a #GstRTSPMediaFactory
+ * @url: the url used
+ * @sdp: the SDP of the media or %NULL
+ *
+ * Store @sdp as the SDP of the media of @url. When @sdp is %NULL, the cached
+ * SDP is removed.
+ */
+void
+gst_rtsp_media_factory_set_sdp_cache (GstRTSPMediaFactory * factory,
+    const GstRTSPUrl * url, GBytes * sdp)
+{
+  gchar *key;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory));
+  g_return_if_fail (url != NULL);
+
+  if (!(key = get_sdp_cache_key (factory, url)))
+    return;
+
+  g_mutex_lock (&factory->medias_lock);
+  if (sdp)
+    g_hash_table_insert (factory->sdp_cache, key, g_bytes_ref (sdp));
+  else
+    g_hash_table_remove (factory->sdp_cache, key);
+  g_mutex_unlock (&factory->medias_lock);
+
+  if (sdp == NULL)
+    g_free (key);
+}
+
+/**
+ * gst_rtsp_media_factory_clear_sdp_cache:
+ * @factory: a #GstRTSPMediaFactory
+ *
+ * Remove all SDP stored with gst_rtsp_media_factory_set_sdp_cache(). This is
+ * done when the configuration of @factory changes so that the next DESCRIBE
+ * returns the SDP of the new media.
+ */
+void
+gst_rtsp_media_factory_clear_sdp_cache (GstRTSPMediaFactory * factory)
+{
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory));
+
+  g_mutex_lock (&factory->medias_lock);
+  g_hash_table_remove_all (factory->sdp_cache);
+  g_mutex_unlock (&factory->medias_lock);
+}
+
 static gchar *
 default_gen_key (GstRTSPMediaFactory * factory, const GstRTSPUrl * url)
 {
@@ -743,6 +1032,8 @@ gst_rtsp_media_factory_collect_streams (GstRTSPMediaFactory * factory,
       /* create the stream */
       stream = g_new0 (GstRTSPMediaStream, 1);
       stream->payloader = elem;
+      g_mutex_init (&stream->transports_lock);
+      g_cond_init (&stream->transports_cond);
 
       GST_INFO ("found stream %d with payloader %p", i, elem);
 
@@ -849,8 +1140,8 @@ no_element:
 static void
 default_configure (GstRTSPMediaFactory * factory, GstRTSPMedia * media)
 {
-  gboolean shared, eos_shutdown;
-  guint size;
+  gboolean shared, eos_shutdown, udp_receiver;
+  guint size, udp_send_threads, tcp_send_threads;
   GstRTSPAuth *auth;
   GstRTSPLowerTrans protocols;
   gchar *mc;
@@ -860,12 +1151,18 @@ default_configure (GstRTSPMediaFactory * factory, GstRTSPMedia * media)
   shared = factory->shared;
   eos_shutdown = factory->eos_shutdown;
   size = factory->buffer_size;
+  udp_send_threads = factory->udp_send_threads;
+  tcp_send_threads = factory->tcp_send_threads;
+  udp_receiver = factory->udp_receiver;
   protocols = factory->protocols;
   GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
 
   gst_rtsp_media_set_shared (media, shared);
   gst_rtsp_media_set_eos_shutdown (media, eos_shutdown);
   gst_rtsp_media_set_buffer_size (media, size);
+  gst_rtsp_media_set_udp_send_threads (media, udp_send_threads);
+  gst_rtsp_media_set_tcp_send_threads (media, tcp_send_threads);
+  gst_rtsp_media_set_udp_receiver (media, udp_receiver);
   gst_rtsp_media_set_protocols (media, protocols);
 
   if ((auth = gst_rtsp_media_factory_get_auth (factory))) {
@@ -54,9 +54,13 @@ typedef struct _GstRTSPMediaFactoryClass GstRTSPMediaFactoryClass;
  * @protocols: allowed transport protocols
  * @auth: the authentication manager
  * @buffer_size: the kernel udp buffer size
+ * @udp_send_threads: the number of threads sending RTP to UDP destinations
+ * @tcp_send_threads: the number of threads sending to TCP transports
+ * @udp_receiver: if the UDP sockets are polled by the shared receiver
  * @multicast_group: the multicast group to send to
  * @medias_lock: mutex protecting the medias.
  * @medias: hashtable of shared media
+ * @sdp_cache: hashtable with the last known SDP of the media
  *
  * The definition and logic for constructing the pipeline for a media. The media
  * can contain multiple streams like audio and video.
@@ -71,10 +75,14 @@ struct _GstRTSPMediaFactory {
   GstRTSPLowerTrans  protocols;
   GstRTSPAuth       *auth;
   guint              buffer_size;
+  guint              udp_send_threads;
+  guint              tcp_send_threads;
+  gboolean           udp_receiver;
   gchar             *multicast_group;
 
   GMutex             medias_lock;
   GHashTable        *medias;
+  GHashTable        *sdp_cache;
 };
 
 /**
@@ -141,6 +149,15 @@ GstRTSPAuth *         gst_rtsp_media_factory_get_auth     (GstRTSPMediaFactory *
 void                  gst_rtsp_media_factory_set_buffer_size    (GstRTSPMediaFactory * factory, guint size);
 guint                 gst_rtsp_media_factory_get_buffer_size    (GstRTSPMediaFactory * factory);
 
+void                  gst_rtsp_media_factory_set_udp_send_threads (GstRTSPMediaFactory * factory, guint threads);
+guint                 gst_rtsp_media_factory_get_udp_send_threads (GstRTSPMediaFactory * factory);
+
+void                  gst_rtsp_media_factory_set_tcp_send_threads (GstRTSPMediaFactory * factory, guint threads);
+guint                 gst_rtsp_media_factory_get_tcp_send_threads (GstRTSPMediaFactory * factory);
+
+void                  gst_rtsp_media_factory_set_udp_receiver (GstRTSPMediaFactory * factory, gboolean use_receiver);
+gboolean              gst_rtsp_media_factory_get_udp_receiver (GstRTSPMediaFactory * factory);
+
 void                  gst_rtsp_media_factory_set_multicast_group (GstRTSPMediaFactory * factory, const gchar *mc);
 gchar *               gst_rtsp_media_factory_get_multicast_group (GstRTSPMediaFactory * factory);
 
@@ -148,6 +165,13 @@ gchar *               gst_rtsp_media_factory_get_multicast_group (GstRTSPMediaFa
 GstRTSPMedia *        gst_rtsp_media_factory_construct    (GstRTSPMediaFactory *factory,
                                                            const GstRTSPUrl *url);
 
+GBytes *              gst_rtsp_media_factory_get_sdp_cache (GstRTSPMediaFactory *factory,
+                                                            const GstRTSPUrl *url);
+void                  gst_rtsp_media_factory_set_sdp_cache (GstRTSPMediaFactory *factory,
+                                                            const GstRTSPUrl *url,
+                                                            GBytes *sdp);
+void                  gst_rtsp_media_factory_clear_sdp_cache (GstRTSPMediaFactory *factory);
+
 void                  gst_rtsp_media_factory_collect_streams (GstRTSPMediaFactory *factory,
                                                               const GstRTSPUrl *url,
                                                               GstRTSPMedia *media);
@@ -21,9 +21,11 @@
 #include <stdlib.h>
 
 #include <gst/app/gstappsrc.h>
-#include <gst/app/gstappsink.h>
 
 #include "rtsp-media.h"
+#include "rtsp-tcp-sink.h"
+#include "rtsp-udp-sink.h"
+#include "rtsp-udp-src.h"
 
 #define DEFAULT_SHARED          FALSE
 #define DEFAULT_REUSABLE        FALSE
@@ -31,8 +33,20 @@
 //#define DEFAULT_PROTOCOLS      GST_RTSP_LOWER_TRANS_UDP_MCAST
 #define DEFAULT_EOS_SHUTDOWN    FALSE
 #define DEFAULT_BUFFER_SIZE     0x80000
+#define DEFAULT_UDP_SEND_THREADS 0
+#define DEFAULT_TCP_SEND_THREADS 0
+#define DEFAULT_UDP_RECEIVER    TRUE
 #define DEFAULT_MULTICAST_GROUP "224.2.0.1"
 
+/* max number of pipelines that are shut down at the same time */
+#define DEFAULT_REAPER_THREADS  4
+/* maximum number of threads dispatching the bus messages of the media */
+#define DEFAULT_BUS_THREADS     4
+/* seconds to wait for a seek to complete */
+#define DEFAULT_SEEK_TIMEOUT    10
+/* packets queued for a TCP send thread before new ones are dropped */
+#define TCP_FANOUT_MAX_QUEUED   256
+
 /* define to dump received RTCP packets */
 #undef DUMP_STATS
 
@@ -44,6 +58,9 @@ enum
   PROP_PROTOCOLS,
   PROP_EOS_SHUTDOWN,
   PROP_BUFFER_SIZE,
+  PROP_UDP_SEND_THREADS,
+  PROP_TCP_SEND_THREADS,
+  PROP_UDP_RECEIVER,
   PROP_MULTICAST_GROUP,
   PROP_LAST
 };
@@ -67,15 +84,31 @@ static void gst_rtsp_media_set_property (GObject * object, guint propid,
     const GValue * value, GParamSpec * pspec);
 static void gst_rtsp_media_finalize (GObject * obj);
 
-static gpointer do_loop (GstRTSPMediaClass * klass);
+static gpointer do_loop (GMainLoop * loop);
+static void seek_finished (GstRTSPMedia * media, gboolean seeked);
 static gboolean default_handle_message (GstRTSPMedia * media,
     GstMessage * message);
 static gboolean default_unprepare (GstRTSPMedia * media);
 static void unlock_streams (GstRTSPMedia * media);
+static void do_reap (GstRTSPMedia * media, gpointer user_data);
+static void remove_elements (GstRTSPMedia * media);
+static gboolean make_udp_branch (GstRTSPMedia * media,
+    GstRTSPMediaStream * stream);
+static void remove_udp_branch (GstRTSPMedia * media,
+    GstRTSPMediaStream * stream);
+static void make_tcp_branch (GstRTSPMedia * media, GstRTSPMediaStream * stream);
+static void remove_tcp_branch (GstRTSPMedia * media,
+    GstRTSPMediaStream * stream);
 static void default_handle_mtu (GstRTSPMedia * media, guint mtu);
+static void tcp_fanout_free (GstRTSPTCPFanout * fanout);
+static guint tcp_fanout_n_workers (GstRTSPTCPFanout * fanout);
+static guint tcp_fanout_worker_id (guint n_workers, GstRTSPMediaTrans * tr);
 
 static guint gst_rtsp_media_signals[SIGNAL_LAST] = { 0 };
 
+/* protects starting the bus threads */
+G_LOCK_DEFINE_STATIC (bus_threads);
+
 G_DEFINE_TYPE (GstRTSPMedia, gst_rtsp_media, G_TYPE_OBJECT);
 
 static void
@@ -114,6 +147,26 @@ gst_rtsp_media_class_init (GstRTSPMediaClass * klass)
           "The kernel UDP buffer size to use", 0, G_MAXUINT,
           DEFAULT_BUFFER_SIZE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_UDP_SEND_THREADS,
+      g_param_spec_uint ("udp-send-threads", "UDP Send Threads",
+          "The number of threads sending RTP to the UDP destinations of a "
+          "stream, 0 sends from the streaming thread", 0, 64,
+          DEFAULT_UDP_SEND_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TCP_SEND_THREADS,
+      g_param_spec_uint ("tcp-send-threads", "TCP Send Threads",
+          "The number of threads sending RTP and RTCP to the TCP transports, "
+          "0 sends from the streaming thread of each stream", 0, 64,
+          DEFAULT_TCP_SEND_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_UDP_RECEIVER,
+      g_param_spec_boolean ("udp-receiver", "UDP Receiver",
+          "Receive on the UDP sockets with the threads shared by all media "
+          "instead of a thread per socket", DEFAULT_UDP_RECEIVER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (gobject_class, PROP_MULTICAST_GROUP,
       g_param_spec_string ("multicast-group", "Multicast Group",
           "The Multicast group to send media to",
@@ -134,12 +187,16 @@ gst_rtsp_media_class_init (GstRTSPMediaClass * klass)
       G_STRUCT_OFFSET (GstRTSPMediaClass, new_state), NULL, NULL,
       g_cclosure_marshal_VOID__INT, G_TYPE_NONE, 0, G_TYPE_INT);
 
-  klass->context = g_main_context_new ();
-  klass->loop = g_main_loop_new (klass->context, TRUE);
-
   GST_DEBUG_CATEGORY_INIT (rtsp_media_debug, "rtspmedia", 0, "GstRTSPMedia");
 
-  klass->thread = g_thread_new ("Bus Thread", (GThreadFunc) do_loop, klass);
+  /* the messages of the media are spread over the bus threads, they are
+   * started when the first media needs them */
+  klass->n_bus_threads = DEFAULT_BUS_THREADS;
+
+  /* pipelines are shut down from these threads so that unpreparing does not
+   * block the caller */
+  klass->reaper = g_thread_pool_new ((GFunc) do_reap, NULL,
+      DEFAULT_REAPER_THREADS, FALSE, NULL);
 
   klass->handle_message = default_handle_message;
   klass->unprepare = default_unprepare;
@@ -148,11 +205,93 @@ gst_rtsp_media_class_init (GstRTSPMediaClass * klass)
   ssrc_stream_map_key = g_quark_from_static_string ("GstRTSPServer.stream");
 }
 
+/**
+ * gst_rtsp_media_class_set_bus_threads:
+ * @klass: a #GstRTSPMediaClass
+ * @threads: the maximum number of threads
+ *
+ * Set the maximum number of threads that dispatch the messages of the media
+ * of @klass. The threads are started when the media need them. This has no
+ * effect after the first media of @klass was made.
+ */
+void
+gst_rtsp_media_class_set_bus_threads (GstRTSPMediaClass * klass,
+    guint threads)
+{
+  g_return_if_fail (GST_IS_RTSP_MEDIA_CLASS (klass));
+  g_return_if_fail (threads > 0);
+
+  G_LOCK (bus_threads);
+  if (klass->bus_contexts == NULL)
+    klass->n_bus_threads = threads;
+  else
+    GST_WARNING ("bus threads of %s are already in use",
+        G_OBJECT_CLASS_NAME (klass));
+  G_UNLOCK (bus_threads);
+}
+
+/* start the bus thread @idx of @klass, the first one is also the context of
+ * the class. Must be called with the bus_threads lock. */
+static void
+start_bus_thread (GstRTSPMediaClass * klass, guint idx)
+{
+  gchar *name;
+
+  if (klass->bus_contexts == NULL) {
+    klass->bus_contexts = g_new0 (GMainContext *, klass->n_bus_threads);
+    klass->bus_loops = g_new0 (GMainLoop *, klass->n_bus_threads);
+    klass->bus_threads = g_new0 (GThread *, klass->n_bus_threads);
+  }
+
+  GST_DEBUG ("starting bus thread %u of %s", idx, G_OBJECT_CLASS_NAME (klass));
+
+  klass->bus_contexts[idx] = g_main_context_new ();
+  klass->bus_loops[idx] = g_main_loop_new (klass->bus_contexts[idx], TRUE);
+
+  name = g_strdup_printf ("Bus Thread %u", idx);
+  klass->bus_threads[idx] = g_thread_new (name, (GThreadFunc) do_loop,
+      klass->bus_loops[idx]);
+  g_free (name);
+
+  if (idx == 0) {
+    klass->context = klass->bus_contexts[0];
+    klass->loop = klass->bus_loops[0];
+    klass->thread = klass->bus_threads[0];
+  }
+}
+
+/* spread the media over the bus threads */
+static GMainContext *
+pick_bus_context (GstRTSPMedia * media)
+{
+  GstRTSPMediaClass *klass;
+  GMainContext *context;
+  guint hash, idx;
+
+  klass = GST_RTSP_MEDIA_GET_CLASS (media);
+
+  /* the low bits of the pointer are always the same, mix them */
+  hash = GPOINTER_TO_UINT (media);
+  hash ^= hash >> 16;
+  hash *= 0x45d9f3b;
+  hash ^= hash >> 16;
+
+  G_LOCK (bus_threads);
+  idx = hash % klass->n_bus_threads;
+  if (klass->bus_contexts == NULL || klass->bus_contexts[idx] == NULL)
+    start_bus_thread (klass, idx);
+  context = klass->bus_contexts[idx];
+  G_UNLOCK (bus_threads);
+
+  return context;
+}
+
 static void
 gst_rtsp_media_init (GstRTSPMedia * media)
 {
   media->streams = g_array_new (FALSE, TRUE, sizeof (GstRTSPMediaStream *));
   g_mutex_init (&media->lock);
+  g_mutex_init (&media->branch_lock);
   g_cond_init (&media->cond);
 
   media->shared = DEFAULT_SHARED;
@@ -160,7 +299,11 @@ gst_rtsp_media_init (GstRTSPMedia * media)
   media->protocols = DEFAULT_PROTOCOLS;
   media->eos_shutdown = DEFAULT_EOS_SHUTDOWN;
   media->buffer_size = DEFAULT_BUFFER_SIZE;
+  media->udp_send_threads = DEFAULT_UDP_SEND_THREADS;
+  media->tcp_send_threads = DEFAULT_TCP_SEND_THREADS;
+  media->udp_receiver = DEFAULT_UDP_RECEIVER;
   media->multicast_group = g_strdup (DEFAULT_MULTICAST_GROUP);
+  media->context = pick_bus_context (media);
 }
 
 void
@@ -176,6 +319,182 @@ gst_rtsp_media_trans_cleanup (GstRTSPMediaTrans * trans)
   }
 }
 
+/* the transports of a stream. A snapshot is never changed after it is
+ * published, readers keep a ref while they walk it. The transports are owned
+ * by the session, a snapshot that is replaced is retired and the publisher
+ * waits until its readers are gone before the removed transports can be
+ * freed. */
+struct _GstRTSPTransportSnapshot
+{
+  gint refcount;
+  gint retired;
+
+  /* the TCP transports grouped by the send thread serving them, thread i
+   * sends to by_worker[worker_start[i]] up to by_worker[worker_start[i + 1]].
+   * NULL without send threads. */
+  guint n_workers;
+  guint *worker_start;
+  GstRTSPMediaTrans **by_worker;
+
+  guint n_transports;
+  GstRTSPMediaTrans *transports[1];
+};
+
+static GstRTSPTransportSnapshot *
+snapshot_new (guint n_transports)
+{
+  GstRTSPTransportSnapshot *snapshot;
+
+  snapshot = g_malloc (sizeof (GstRTSPTransportSnapshot) +
+      MAX (n_transports, 1) * sizeof (GstRTSPMediaTrans *) -
+      sizeof (GstRTSPMediaTrans *));
+  snapshot->refcount = 1;
+  snapshot->retired = FALSE;
+  snapshot->n_workers = 0;
+  snapshot->worker_start = NULL;
+  snapshot->by_worker = NULL;
+  snapshot->n_transports = 0;
+
+  return snapshot;
+}
+
+static void
+snapshot_free (GstRTSPTransportSnapshot * snapshot)
+{
+  g_free (snapshot->worker_start);
+  g_free (snapshot->by_worker);
+  g_free (snapshot);
+}
+
+/* group the TCP transports of @snapshot by the send thread serving them */
+static void
+snapshot_partition (GstRTSPTransportSnapshot * snapshot, guint n_workers)
+{
+  guint i, n_tcp, *pos;
+
+  snapshot->n_workers = n_workers;
+  snapshot->worker_start = g_new0 (guint, n_workers + 1);
+
+  for (i = 0; i < snapshot->n_transports; i++) {
+    GstRTSPMediaTrans *tr = snapshot->transports[i];
+
+    if (tr->transport->lower_transport == GST_RTSP_LOWER_TRANS_TCP)
+      snapshot->worker_start[tcp_fanout_worker_id (n_workers, tr) + 1]++;
+  }
+  for (i = 0; i < n_workers; i++)
+    snapshot->worker_start[i + 1] += snapshot->worker_start[i];
+  n_tcp = snapshot->worker_start[n_workers];
+
+  snapshot->by_worker = g_new (GstRTSPMediaTrans *, MAX (n_tcp, 1));
+  pos = g_newa (guint, n_workers);
+  memcpy (pos, snapshot->worker_start, n_workers * sizeof (guint));
+
+  for (i = 0; i < snapshot->n_transports; i++) {
+    GstRTSPMediaTrans *tr = snapshot->transports[i];
+
+    if (tr->transport->lower_transport == GST_RTSP_LOWER_TRANS_TCP)
+      snapshot->by_worker[pos[tcp_fanout_worker_id (n_workers, tr)]++] = tr;
+  }
+}
+
+static void
+snapshot_unref (GstRTSPMediaStream * stream,
+    GstRTSPTransportSnapshot * snapshot)
+{
+  gint old;
+
+  if (snapshot == NULL)
+    return;
+
+  old = g_atomic_int_add (&snapshot->refcount, -1);
+  if (old == 1) {
+    snapshot_free (snapshot);
+  } else if (old == 2 && g_atomic_int_get (&snapshot->retired)) {
+    /* the last reader of a retired snapshot, only the publisher is left */
+    g_mutex_lock (&stream->transports_lock);
+    g_cond_broadcast (&stream->transports_cond);
+    g_mutex_unlock (&stream->transports_lock);
+  }
+}
+
+/* get the current transports of @stream, unref with snapshot_unref() */
+static GstRTSPTransportSnapshot *
+snapshot_get (GstRTSPMediaStream * stream)
+{
+  GstRTSPTransportSnapshot *snapshot;
+
+  g_mutex_lock (&stream->transports_lock);
+  if ((snapshot = stream->transports))
+    g_atomic_int_inc (&snapshot->refcount);
+  g_mutex_unlock (&stream->transports_lock);
+
+  return snapshot;
+}
+
+/* publish a new snapshot with the active transports of the current snapshot
+ * and @added. The transports removed since the last snapshot have been marked
+ * inactive already, so this is linear in the number of transports. When
+ * transports were removed, this waits until no thread uses the old snapshot
+ * anymore so that the caller can free them. */
+static void
+update_transports (GstRTSPMediaStream * stream, GPtrArray * added)
+{
+  GstRTSPTransportSnapshot *old, *snapshot;
+  guint i, n_added;
+  gboolean removed = FALSE;
+
+  n_added = added ? added->len : 0;
+
+  g_mutex_lock (&stream->transports_lock);
+  old = stream->transports;
+  snapshot = snapshot_new ((old ? old->n_transports : 0) + n_added);
+  for (i = 0; old && i < old->n_transports; i++) {
+    GstRTSPMediaTrans *tr = old->transports[i];
+
+    if (tr->active)
+      snapshot->transports[snapshot->n_transports++] = tr;
+    else
+      removed = TRUE;
+  }
+  for (i = 0; i < n_added; i++)
+    snapshot->transports[snapshot->n_transports++] =
+        g_ptr_array_index (added, i);
+  if (stream->tcp_fanout)
+    snapshot_partition (snapshot,
+        tcp_fanout_n_workers (stream->tcp_fanout));
+  stream->transports = snapshot;
+
+  if (removed) {
+    g_atomic_int_set (&old->retired, TRUE);
+    while (g_atomic_int_get (&old->refcount) > 1)
+      g_cond_wait (&stream->transports_cond, &stream->transports_lock);
+  }
+  g_mutex_unlock (&stream->transports_lock);
+
+  snapshot_unref (stream, old);
+}
+
+/* give the server ports of @stream back to the port pool */
+static void
+free_udp_ports (GstRTSPMediaStream * stream)
+{
+  gint i;
+
+  for (i = 0; i < 2; i++) {
+    if (stream->socket[i] == NULL)
+      continue;
+    g_socket_close (stream->socket[i], NULL);
+    g_object_unref (stream->socket[i]);
+    stream->socket[i] = NULL;
+  }
+  if (stream->port_pool == NULL)
+    return;
+
+  gst_rtsp_port_pool_release (stream->port_pool, stream->server_port.min);
+  g_object_unref (stream->port_pool);
+  stream->port_pool = NULL;
+}
+
 static void
 gst_rtsp_media_stream_free (GstRTSPMediaStream * stream)
 {
@@ -196,7 +515,19 @@ gst_rtsp_media_stream_free (GstRTSPMediaStream * stream)
   if (stream->recv_rtp_sink)
     gst_object_unref (stream->recv_rtp_sink);
 
-  g_list_free (stream->transports);
+  /* the send threads can still have packets queued with the snapshot */
+  g_mutex_lock (&stream->transports_lock);
+  if (stream->transports) {
+    g_atomic_int_set (&stream->transports->retired, TRUE);
+    while (g_atomic_int_get (&stream->transports->refcount) > 1)
+      g_cond_wait (&stream->transports_cond, &stream->transports_lock);
+  }
+  g_mutex_unlock (&stream->transports_lock);
+  snapshot_unref (stream, stream->transports);
+  g_mutex_clear (&stream->transports_lock);
+  g_cond_clear (&stream->transports_cond);
+
+  free_udp_ports (stream);
 
   g_free (stream);
 }
@@ -217,6 +548,10 @@ gst_rtsp_media_finalize (GObject * obj)
     gst_object_unref (media->pipeline);
   }
 
+  /* the queued packets of the send threads refer to the streams */
+  if (media->tcp_fanout)
+    tcp_fanout_free (media->tcp_fanout);
+
   for (i = 0; i < media->streams->len; i++) {
     GstRTSPMediaStream *stream;
 
@@ -234,7 +569,12 @@ gst_rtsp_media_finalize (GObject * obj)
     g_source_unref (media->source);
   }
   g_free (media->multicast_group);
+  if (media->port_pool)
+    g_object_unref (media->port_pool);
+  if (media->sdp_cache)
+    g_bytes_unref (media->sdp_cache);
   g_mutex_clear (&media->lock);
+  g_mutex_clear (&media->branch_lock);
   g_cond_clear (&media->cond);
 
   G_OBJECT_CLASS (gst_rtsp_media_parent_class)->finalize (obj);
@@ -262,6 +602,15 @@ gst_rtsp_media_get_property (GObject * object, guint propid,
     case PROP_BUFFER_SIZE:
       g_value_set_uint (value, gst_rtsp_media_get_buffer_size (media));
       break;
+    case PROP_UDP_SEND_THREADS:
+      g_value_set_uint (value, gst_rtsp_media_get_udp_send_threads (media));
+      break;
+    case PROP_TCP_SEND_THREADS:
+      g_value_set_uint (value, gst_rtsp_media_get_tcp_send_threads (media));
+      break;
+    case PROP_UDP_RECEIVER:
+      g_value_set_boolean (value, gst_rtsp_media_get_udp_receiver (media));
+      break;
     case PROP_MULTICAST_GROUP:
       g_value_take_string (value, gst_rtsp_media_get_multicast_group (media));
       break;
@@ -292,6 +641,15 @@ gst_rtsp_media_set_property (GObject * object, guint propid,
     case PROP_BUFFER_SIZE:
       gst_rtsp_media_set_buffer_size (media, g_value_get_uint (value));
       break;
+    case PROP_UDP_SEND_THREADS:
+      gst_rtsp_media_set_udp_send_threads (media, g_value_get_uint (value));
+      break;
+    case PROP_TCP_SEND_THREADS:
+      gst_rtsp_media_set_tcp_send_threads (media, g_value_get_uint (value));
+      break;
+    case PROP_UDP_RECEIVER:
+      gst_rtsp_media_set_udp_receiver (media, g_value_get_boolean (value));
+      break;
     case PROP_MULTICAST_GROUP:
       gst_rtsp_media_set_multicast_group (media, g_value_get_string (value));
       break;
@@ -301,10 +659,10 @@ gst_rtsp_media_set_property (GObject * object, guint propid,
 }
 
 static gpointer
-do_loop (GstRTSPMediaClass * klass)
+do_loop (GMainLoop * loop)
 {
   GST_INFO ("enter mainloop");
-  g_main_loop_run (klass->loop);
+  g_main_loop_run (loop);
   GST_INFO ("exit mainloop");
 
   return NULL;
@@ -537,6 +895,122 @@ gst_rtsp_media_get_buffer_size (GstRTSPMedia * media)
   return media->buffer_size;
 }
 
+/**
+ * gst_rtsp_media_set_udp_send_threads:
+ * @media: a #GstRTSPMedia
+ * @threads: the number of threads
+ *
+ * Set the number of threads that send the RTP packets of a stream to its UDP
+ * destinations. The destinations are spread over the threads. With 0 threads
+ * the packets are sent from the streaming thread.
+ *
+ * This applies to the streams that get their UDP transport after this call.
+ */
+void
+gst_rtsp_media_set_udp_send_threads (GstRTSPMedia * media, guint threads)
+{
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  media->udp_send_threads = threads;
+}
+
+/**
+ * gst_rtsp_media_get_udp_send_threads:
+ * @media: a #GstRTSPMedia
+ *
+ * Get the number of threads that send RTP to the UDP destinations of a stream.
+ *
+ * Returns: the number of UDP send threads.
+ */
+guint
+gst_rtsp_media_get_udp_send_threads (GstRTSPMedia * media)
+{
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), 0);
+
+  return media->udp_send_threads;
+}
+
+/**
+ * gst_rtsp_media_set_tcp_send_threads:
+ * @media: a #GstRTSPMedia
+ * @threads: the number of threads
+ *
+ * Set the number of threads that send the RTP and RTCP packets of the streams
+ * to the TCP transports. Each transport is served by one of the threads. With
+ * 0 threads the packets are sent from the streaming thread of each stream.
+ *
+ * This must be called before the first TCP transport is acquired.
+ */
+void
+gst_rtsp_media_set_tcp_send_threads (GstRTSPMedia * media, guint threads)
+{
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  media->tcp_send_threads = threads;
+}
+
+/**
+ * gst_rtsp_media_get_tcp_send_threads:
+ * @media: a #GstRTSPMedia
+ *
+ * Get the number of threads that send to the TCP transports.
+ *
+ * Returns: the number of TCP send threads.
+ */
+guint
+gst_rtsp_media_get_tcp_send_threads (GstRTSPMedia * media)
+{
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), 0);
+
+  return media->tcp_send_threads;
+}
+
+/**
+ * gst_rtsp_media_set_udp_receiver:
+ * @media: a #GstRTSPMedia
+ * @use_receiver: if the shared receiver should be used
+ *
+ * Configure if the UDP sockets of @media are polled by the threads of
+ * gst_rtsp_udp_receiver_get_default(), which are shared by all media. When
+ * %FALSE, each socket is received on by a udpsrc with its own thread.
+ *
+ * This must be called before @media is prepared.
+ */
+void
+gst_rtsp_media_set_udp_receiver (GstRTSPMedia * media, gboolean use_receiver)
+{
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  media->udp_receiver = use_receiver;
+}
+
+/**
+ * gst_rtsp_media_get_udp_receiver:
+ * @media: a #GstRTSPMedia
+ *
+ * Check if the UDP sockets of @media are polled by the shared receiver.
+ *
+ * Returns: %TRUE when the shared receiver is used.
+ */
+gboolean
+gst_rtsp_media_get_udp_receiver (GstRTSPMedia * media)
+{
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+
+  return media->udp_receiver;
+}
+
+/* called with the lock */
+static void
+invalidate_sdp_cache (GstRTSPMedia * media)
+{
+  if (media->sdp_cache) {
+    g_bytes_unref (media->sdp_cache);
+    media->sdp_cache = NULL;
+  }
+  media->sdp_cookie++;
+}
+
 /**
  * gst_rtsp_media_set_multicast_group:
  * @media: a #GstRTSPMedia
@@ -552,6 +1026,7 @@ gst_rtsp_media_set_multicast_group (GstRTSPMedia * media, const gchar * mc)
   g_mutex_lock (&media->lock);
   g_free (media->multicast_group);
   media->multicast_group = g_strdup (mc);
+  invalidate_sdp_cache (media);
   g_mutex_unlock (&media->lock);
 }
 
@@ -577,6 +1052,67 @@ gst_rtsp_media_get_multicast_group (GstRTSPMedia * media)
   return result;
 }
 
+/**
+ * gst_rtsp_media_get_sdp_cache:
+ * @media: a #GstRTSPMedia
+ * @cookie: (out): the cookie of the current state of @media
+ *
+ * Get the SDP that was stored for @media with gst_rtsp_media_set_sdp_cache().
+ * The cache is cleared when @media is prepared or unprepared and when the caps
+ * of one of its streams change.
+ *
+ * @cookie identifies the state of @media that an SDP made now would describe
+ * and should be passed to gst_rtsp_media_set_sdp_cache().
+ *
+ * Returns: the cached SDP or %NULL. g_bytes_unref() after usage.
+ */
+GBytes *
+gst_rtsp_media_get_sdp_cache (GstRTSPMedia * media, guint * cookie)
+{
+  GBytes *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), NULL);
+  g_return_val_if_fail (cookie != NULL, NULL);
+
+  g_mutex_lock (&media->lock);
+  if ((result = media->sdp_cache))
+    g_bytes_ref (result);
+  *cookie = media->sdp_cookie;
+  g_mutex_unlock (&media->lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_media_set_sdp_cache:
+ * @media: a #GstRTSPMedia
+ * @sdp: the SDP to cache
+ * @cookie: the cookie from gst_rtsp_media_get_sdp_cache()
+ *
+ * Cache @sdp for @media. The SDP is only stored when @media did not change
+ * since @cookie was retrieved.
+ *
+ * Returns: %TRUE when @sdp was stored.
+ */
+gboolean
+gst_rtsp_media_set_sdp_cache (GstRTSPMedia * media, GBytes * sdp, guint cookie)
+{
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+  g_return_val_if_fail (sdp != NULL, FALSE);
+
+  g_mutex_lock (&media->lock);
+  if ((res = (media->sdp_cookie == cookie))) {
+    if (media->sdp_cache)
+      g_bytes_unref (media->sdp_cache);
+    media->sdp_cache = g_bytes_ref (sdp);
+  }
+  g_mutex_unlock (&media->lock);
+
+  return res;
+}
+
 /**
  * gst_rtsp_media_set_auth:
  * @media: a #GstRTSPMedia
@@ -624,6 +1160,54 @@ gst_rtsp_media_get_auth (GstRTSPMedia * media)
   return result;
 }
 
+/**
+ * gst_rtsp_media_set_port_pool:
+ * @media: a #GstRTSPMedia
+ * @pool: a #GstRTSPPortPool
+ *
+ * configure @pool to be used for allocating the server ports of the streams of
+ * @media. Without a pool, a random pair of ports is bound for each stream.
+ * This function should be called before @media is prepared.
+ */
+void
+gst_rtsp_media_set_port_pool (GstRTSPMedia * media, GstRTSPPortPool * pool)
+{
+  GstRTSPPortPool *old;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  old = media->port_pool;
+
+  if (old != pool) {
+    if (pool)
+      g_object_ref (pool);
+    media->port_pool = pool;
+    if (old)
+      g_object_unref (old);
+  }
+}
+
+/**
+ * gst_rtsp_media_get_port_pool:
+ * @media: a #GstRTSPMedia
+ *
+ * Get the #GstRTSPPortPool used for allocating the server ports of @media.
+ *
+ * Returns: the #GstRTSPPortPool of @media. g_object_unref() after
+ * usage.
+ */
+GstRTSPPortPool *
+gst_rtsp_media_get_port_pool (GstRTSPMedia * media)
+{
+  GstRTSPPortPool *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), NULL);
+
+  if ((result = media->port_pool))
+    g_object_ref (result);
+
+  return result;
+}
 
 /**
  * gst_rtsp_media_n_streams:
@@ -667,52 +1251,216 @@ gst_rtsp_media_get_stream (GstRTSPMedia * media, guint idx)
 }
 
 /**
- * gst_rtsp_media_get_range_string:
+ * gst_rtsp_media_acquire_transport:
  * @media: a #GstRTSPMedia
- * @play: for the PLAY request
+ * @idx: the stream index
+ * @lower: the lower transport
  *
- * Get the current range as a string.
+ * Make sure the stream with index @idx of @media has the elements for sending
+ * and receiving over @lower. The elements are made when the first transport
+ * with @lower is acquired. Release the transport again with
+ * gst_rtsp_media_release_transport() and @generation.
  *
- * Returns: The range as a string, g_free() after usage.
+ * @media must be prepared.
+ *
+ * Returns: %TRUE when the stream can use @lower.
  */
-gchar *
-gst_rtsp_media_get_range_string (GstRTSPMedia * media, gboolean play)
+gboolean
+gst_rtsp_media_acquire_transport (GstRTSPMedia * media, guint idx,
+    GstRTSPLowerTrans lower, guint * generation)
 {
-  gchar *result;
-  GstRTSPTimeRange range;
+  GstRTSPMediaStream *stream;
 
-  /* make copy */
-  range = media->range;
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+  g_return_val_if_fail (generation != NULL, FALSE);
 
-  if (!play && media->active > 0) {
-    range.min.type = GST_RTSP_TIME_NOW;
-    range.min.seconds = -1;
+  g_mutex_lock (&media->branch_lock);
+  stream = gst_rtsp_media_get_stream (media, idx);
+  if (stream == NULL || !stream->prepared)
+    goto not_prepared;
+
+  if (lower & GST_RTSP_LOWER_TRANS_TCP) {
+    if (stream->n_tcp == 0)
+      make_tcp_branch (media, stream);
+    stream->n_tcp++;
+  } else {
+    if (stream->n_udp == 0 && !make_udp_branch (media, stream))
+      goto no_branch;
+    stream->n_udp++;
   }
+  *generation = media->branch_generation;
+  g_mutex_unlock (&media->branch_lock);
 
-  result = gst_rtsp_range_to_string (&range);
+  return TRUE;
 
-  return result;
+  /* ERRORS */
+not_prepared:
+  {
+    GST_WARNING ("stream %u of media %p is not prepared", idx, media);
+    g_mutex_unlock (&media->branch_lock);
+    return FALSE;
+  }
+no_branch:
+  {
+    GST_WARNING ("could not make the UDP branch of stream %u", idx);
+    g_mutex_unlock (&media->branch_lock);
+    return FALSE;
+  }
 }
 
 /**
- * gst_rtsp_media_seek:
+ * gst_rtsp_media_release_transport:
  * @media: a #GstRTSPMedia
- * @range: a #GstRTSPTimeRange
+ * @idx: the stream index
+ * @lower: the lower transport
+ * @generation: the generation returned by gst_rtsp_media_acquire_transport()
  *
- * Seek the pipeline to @range.
+ * Release a transport with @lower acquired with
+ * gst_rtsp_media_acquire_transport(). The elements for @lower are removed
+ * from the stream when the last transport with @lower is released.
+ */
+void
+gst_rtsp_media_release_transport (GstRTSPMedia * media, guint idx,
+    GstRTSPLowerTrans lower, guint generation)
+{
+  GstRTSPMediaStream *stream;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  g_mutex_lock (&media->branch_lock);
+  stream = gst_rtsp_media_get_stream (media, idx);
+  /* the branches are already gone when the media was unprepared, the
+   * transport must not release the elements of a new preparation */
+  if (stream == NULL || !stream->prepared ||
+      generation != media->branch_generation)
+    goto done;
+
+  if (lower & GST_RTSP_LOWER_TRANS_TCP) {
+    if (stream->n_tcp > 0 && --stream->n_tcp == 0)
+      remove_tcp_branch (media, stream);
+  } else {
+    if (stream->n_udp > 0 && --stream->n_udp == 0)
+      remove_udp_branch (media, stream);
+  }
+done:
+  g_mutex_unlock (&media->branch_lock);
+}
+
+/**
+ * gst_rtsp_media_get_range_string:
+ * @media: a #GstRTSPMedia
+ * @play: for the PLAY request
  *
- * Returns: %TRUE on success.
+ * Get the current range as a string.
+ *
+ * Returns: The range as a string, g_free() after usage.
  */
-gboolean
-gst_rtsp_media_seek (GstRTSPMedia * media, GstRTSPTimeRange * range)
+gchar *
+gst_rtsp_media_get_range_string (GstRTSPMedia * media, gboolean play)
+{
+  gchar *result;
+  GstRTSPTimeRange range;
+
+  /* make copy */
+  range = media->range;
+
+  if (!play && media->active > 0) {
+    range.min.type = GST_RTSP_TIME_NOW;
+    range.min.seconds = -1;
+  }
+
+  result = gst_rtsp_range_to_string (&range);
+
+  return result;
+}
+
+typedef struct
+{
+  GstRTSPMediaPrepareFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+} PrepareCallback;
+
+static PrepareCallback *
+prepare_callback_new (GstRTSPMediaPrepareFunc func, gpointer user_data,
+    GDestroyNotify notify)
+{
+  PrepareCallback *cb;
+
+  cb = g_slice_new (PrepareCallback);
+  cb->func = func;
+  cb->user_data = user_data;
+  cb->notify = notify;
+
+  return cb;
+}
+
+static void
+prepare_callback_free (PrepareCallback * cb)
+{
+  if (cb->notify)
+    cb->notify (cb->user_data);
+  g_slice_free (PrepareCallback, cb);
+}
+
+static void
+prepare_callback_invoke (PrepareCallback * cb, GstRTSPMedia * media,
+    gboolean prepared)
+{
+  cb->func (media, prepared, cb->user_data);
+  prepare_callback_free (cb);
+}
+
+static gboolean
+seek_timeout (GstRTSPMedia * media)
+{
+  GST_WARNING ("media %p: timeout while seeking", media);
+  seek_finished (media, FALSE);
+
+  return FALSE;
+}
+
+/* complete all pending seeks, usually called from the bus thread */
+static void
+seek_finished (GstRTSPMedia * media, gboolean seeked)
+{
+  GList *pending, *walk;
+  GSource *timeout;
+
+  g_mutex_lock (&media->lock);
+  /* the callbacks were prepended */
+  pending = g_list_reverse (media->seek_pending);
+  media->seek_pending = NULL;
+  timeout = media->seek_timeout;
+  media->seek_timeout = NULL;
+  g_mutex_unlock (&media->lock);
+
+  if (timeout) {
+    g_source_destroy (timeout);
+    g_source_unref (timeout);
+  }
+
+  for (walk = pending; walk; walk = g_list_next (walk))
+    prepare_callback_invoke (walk->data, media, seeked);
+  g_list_free (pending);
+}
+
+/* seek the pipeline to @range. @seeked is set to %TRUE when a flushing seek was
+ * performed and the pipeline is prerolling again. When @cb is not %NULL, *@cb
+ * is added to the pending seeks before seeking and set to %NULL when it was
+ * taken, the caller completes it otherwise. */
+static gboolean
+seek_pipeline (GstRTSPMedia * media, GstRTSPTimeRange * range,
+    PrepareCallback ** cb, gboolean * seeked)
 {
   GstSeekFlags flags;
   gboolean res;
   gint64 start, stop;
   GstSeekType start_type, stop_type;
+  GstEvent *event;
+  guint32 seqnum;
 
-  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
-  g_return_val_if_fail (range != NULL, FALSE);
+  *seeked = FALSE;
 
   if (!media->seekable) {
     GST_INFO ("pipeline is not seekable");
@@ -768,15 +1516,43 @@ gst_rtsp_media_seek (GstRTSPMedia * media, GstRTSPTimeRange * range)
     GST_INFO ("seeking to %" GST_TIME_FORMAT " - %" GST_TIME_FORMAT,
         GST_TIME_ARGS (start), GST_TIME_ARGS (stop));
 
-    res = gst_element_seek (media->pipeline, 1.0, GST_FORMAT_TIME,
-        flags, start_type, start, stop_type, stop);
-
-    /* and block for the seek to complete */
-    GST_INFO ("done seeking %d", res);
-    gst_element_get_state (media->pipeline, NULL, NULL, -1);
-    GST_INFO ("prerolled again");
+    /* the ASYNC_DONE of the flushing seek has the seqnum of the seek */
+    event = gst_event_new_seek (1.0, GST_FORMAT_TIME, flags, start_type, start,
+        stop_type, stop);
+    seqnum = gst_util_seqnum_next ();
+    gst_event_set_seqnum (event, seqnum);
+
+    if (cb) {
+      /* the ASYNC_DONE can arrive before the seek returns. Seeks from other
+       * clients flush this one, all of them complete with the ASYNC_DONE of
+       * the last seek */
+      g_mutex_lock (&media->lock);
+      media->seek_pending = g_list_prepend (media->seek_pending, *cb);
+      media->seek_seqnum = seqnum;
+      if (media->seek_timeout == NULL) {
+        media->seek_timeout = g_timeout_source_new_seconds
+            (DEFAULT_SEEK_TIMEOUT);
+        g_source_set_callback (media->seek_timeout, (GSourceFunc) seek_timeout,
+            g_object_ref (media), g_object_unref);
+        g_source_attach (media->seek_timeout, media->context);
+      }
+      g_mutex_unlock (&media->lock);
+    }
 
-    collect_media_stats (media);
+    res = gst_element_send_event (media->pipeline, event);
+    GST_INFO ("done seeking %d, seqnum %u", res, seqnum);
+
+    if (cb) {
+      g_mutex_lock (&media->lock);
+      /* the ASYNC_DONE of a seek from another client can have completed the
+       * callback already */
+      if (res || !g_list_find (media->seek_pending, *cb))
+        *cb = NULL;
+      else
+        media->seek_pending = g_list_remove (media->seek_pending, *cb);
+      g_mutex_unlock (&media->lock);
+    }
+    *seeked = res;
   } else {
     GST_INFO ("no seek needed");
     res = TRUE;
@@ -797,6 +1573,115 @@ weird_type:
   }
 }
 
+/**
+ * gst_rtsp_media_seek:
+ * @media: a #GstRTSPMedia
+ * @range: a #GstRTSPTimeRange
+ *
+ * Seek the pipeline to @range. This function blocks until the pipeline has
+ * prerolled again, use gst_rtsp_media_seek_async() to avoid blocking.
+ *
+ * Returns: %TRUE on success.
+ */
+gboolean
+gst_rtsp_media_seek (GstRTSPMedia * media, GstRTSPTimeRange * range)
+{
+  gboolean seeked;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+  g_return_val_if_fail (range != NULL, FALSE);
+
+  if (!seek_pipeline (media, range, NULL, &seeked))
+    return FALSE;
+
+  if (seeked) {
+    /* and block for the seek to complete */
+    gst_element_get_state (media->pipeline, NULL, NULL, -1);
+    GST_INFO ("prerolled again");
+
+    collect_media_stats (media);
+  }
+  return TRUE;
+}
+
+/**
+ * gst_rtsp_media_seek_async:
+ * @media: a #GstRTSPMedia
+ * @range: a #GstRTSPTimeRange
+ * @func: a #GstRTSPMediaSeekFunc
+ * @user_data: user data passed to @func
+ * @notify: called with @user_data when @func is no longer needed
+ *
+ * Seek the pipeline to @range without waiting for the pipeline to preroll
+ * again.
+ *
+ * When a flushing seek was issued, @func is called exactly once from the
+ * thread that dispatches the pipeline messages of @media, when the pipeline
+ * has prerolled after the seek and the stats of the media were updated, or
+ * when the seek did not complete within a timeout.
+ *
+ * When @media is not seekable, is already at @range or seeking failed, @func
+ * is not called and @notify is called before this function returns.
+ *
+ * Returns: %TRUE when a seek was issued and @func will be called.
+ */
+gboolean
+gst_rtsp_media_seek_async (GstRTSPMedia * media, GstRTSPTimeRange * range,
+    GstRTSPMediaSeekFunc func, gpointer user_data, GDestroyNotify notify)
+{
+  PrepareCallback *cb;
+  gboolean res, seeked;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+  g_return_val_if_fail (range != NULL, FALSE);
+  g_return_val_if_fail (func != NULL, FALSE);
+
+  /* the seek and prepare callbacks have the same signature */
+  cb = prepare_callback_new ((GstRTSPMediaPrepareFunc) func, user_data,
+      notify);
+
+  res = seek_pipeline (media, range, &cb, &seeked);
+  if (!res)
+    GST_WARNING ("media %p: seeking failed", media);
+
+  /* the callback was not taken when no seek was issued */
+  if (cb) {
+    prepare_callback_free (cb);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* push @buffer into the appsrc @idx of @stream. The TCP branch can be removed
+ * at the same time, keep a ref to the appsrc while pushing. */
+static GstFlowReturn
+push_tcp_data (GstRTSPMediaStream * stream, gint idx, GstBuffer * buffer)
+{
+  GstElement *appsrc;
+  GstFlowReturn ret;
+
+  g_mutex_lock (&stream->media->branch_lock);
+  if ((appsrc = stream->appsrc[idx]))
+    gst_object_ref (appsrc);
+  g_mutex_unlock (&stream->media->branch_lock);
+
+  /* no TCP transport is set up for the stream */
+  if (appsrc == NULL)
+    goto not_linked;
+
+  ret = gst_app_src_push_buffer (GST_APP_SRC_CAST (appsrc), buffer);
+  gst_object_unref (appsrc);
+
+  return ret;
+
+  /* ERRORS */
+not_linked:
+  {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_NOT_LINKED;
+  }
+}
+
 /**
  * gst_rtsp_media_stream_rtp:
  * @stream: a #GstRTSPMediaStream
@@ -812,11 +1697,7 @@ weird_type:
 GstFlowReturn
 gst_rtsp_media_stream_rtp (GstRTSPMediaStream * stream, GstBuffer * buffer)
 {
-  GstFlowReturn ret;
-
-  ret = gst_app_src_push_buffer (GST_APP_SRC_CAST (stream->appsrc[0]), buffer);
-
-  return ret;
+  return push_tcp_data (stream, 0, buffer);
 }
 
 /**
@@ -834,11 +1715,213 @@ gst_rtsp_media_stream_rtp (GstRTSPMediaStream * stream, GstBuffer * buffer)
 GstFlowReturn
 gst_rtsp_media_stream_rtcp (GstRTSPMediaStream * stream, GstBuffer * buffer)
 {
-  GstFlowReturn ret;
+  return push_tcp_data (stream, 1, buffer);
+}
+
+/* make the udp sinks sending from the sockets of the udp sources */
+static gboolean
+make_udp_sinks (GstRTSPMedia * media, GSocket * rtp_socket,
+    GSocket * rtcp_socket, GstElement ** sink0, GstElement ** sink1)
+{
+  GstElement *udpsink0, *udpsink1;
 
-  ret = gst_app_src_push_buffer (GST_APP_SRC_CAST (stream->appsrc[1]), buffer);
+  if (rtp_socket == NULL || rtcp_socket == NULL)
+    goto no_socket;
 
-  return ret;
+  udpsink0 = gst_rtsp_udp_sink_new (rtp_socket);
+  g_object_set (G_OBJECT (udpsink0), "buffer-size", media->buffer_size, NULL);
+  g_object_set (G_OBJECT (udpsink0), "send-threads", media->udp_send_threads,
+      NULL);
+
+  udpsink1 = gst_rtsp_udp_sink_new (rtcp_socket);
+  g_object_set (G_OBJECT (udpsink1), "sync", FALSE, NULL);
+  g_object_set (G_OBJECT (udpsink1), "async", FALSE, NULL);
+
+  *sink0 = udpsink0;
+  *sink1 = udpsink1;
+
+  return TRUE;
+
+  /* ERRORS */
+no_socket:
+  {
+    GST_WARNING ("udp source has no socket");
+    return FALSE;
+  }
+}
+
+/* the receiver polling the sockets of @media or %NULL when each source
+ * receives with its own thread */
+static GstRTSPUDPReceiver *
+get_udp_receiver (GstRTSPMedia * media)
+{
+  if (!media->udp_receiver)
+    return NULL;
+
+  return gst_rtsp_udp_receiver_get_default ();
+}
+
+/* make the source receiving on @socket. The shared receiver polls the sockets
+ * of all streams with a few threads, without it each source needs a thread. */
+static GstElement *
+make_udp_src (GstRTSPMedia * media, GSocket * socket)
+{
+  GstRTSPUDPReceiver *receiver;
+  GstElement *udpsrc;
+
+  if ((receiver = get_udp_receiver (media)))
+    return gst_rtsp_udp_src_new (receiver, socket);
+
+  udpsrc = gst_element_factory_make ("udpsrc", NULL);
+  if (udpsrc == NULL)
+    return NULL;
+
+  /* the stream closes the socket when it gives back the ports */
+  g_object_set (G_OBJECT (udpsrc), "socket", socket, "close-socket", FALSE,
+      NULL);
+
+  return udpsrc;
+}
+
+/* make the sources and sinks for the sockets of @stream */
+static gboolean
+make_socket_elements (GstRTSPMedia * media, GstRTSPMediaStream * stream)
+{
+  GstElement *udpsrc[2] = { NULL, NULL };
+  GstElement *udpsink0, *udpsink1;
+  gint i;
+
+  for (i = 0; i < 2; i++) {
+    if (!(udpsrc[i] = make_udp_src (media, stream->socket[i])))
+      goto no_udp_protocol;
+  }
+
+  if (!make_udp_sinks (media, stream->socket[0], stream->socket[1],
+          &udpsink0, &udpsink1))
+    goto no_udp_protocol;
+
+  stream->udpsrc[0] = udpsrc[0];
+  stream->udpsrc[1] = udpsrc[1];
+  stream->udpsink[0] = udpsink0;
+  stream->udpsink[1] = udpsink1;
+
+  return TRUE;
+
+  /* ERRORS */
+no_udp_protocol:
+  {
+    GST_WARNING ("could not make udp elements");
+    for (i = 0; i < 2; i++) {
+      if (udpsrc[i])
+        gst_object_unref (udpsrc[i]);
+    }
+    /* the caller gives the ports back */
+    return FALSE;
+  }
+}
+
+static GSocket *
+bind_udp_socket (GSocketFamily family, guint port)
+{
+  GSocket *socket;
+  GInetAddress *any;
+  GSocketAddress *addr;
+  gboolean res;
+
+  socket = g_socket_new (family, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  if (socket == NULL)
+    return NULL;
+
+  any = g_inet_address_new_any (family);
+  addr = g_inet_socket_address_new (any, port);
+  g_object_unref (any);
+
+  res = g_socket_bind (socket, addr, FALSE, NULL);
+  g_object_unref (addr);
+
+  if (!res) {
+    g_object_unref (socket);
+    socket = NULL;
+  }
+  return socket;
+}
+
+/* bind an even RTP port and the next port for RTCP ourselves, for when the
+ * sockets are polled by the shared receiver */
+static gboolean
+alloc_socket_ports (GstRTSPMedia * media, GstRTSPMediaStream * stream)
+{
+  GSocketFamily family;
+  GSocketAddress *addr;
+  GSocket *rtp, *rtcp;
+  guint port, count;
+
+  family = media->is_ipv6 ? G_SOCKET_FAMILY_IPV6 : G_SOCKET_FAMILY_IPV4;
+
+  for (count = 0; count < 20; count++) {
+    /* let the kernel pick a port */
+    if (!(rtp = bind_udp_socket (family, 0)))
+      goto no_ports;
+
+    addr = g_socket_get_local_address (rtp, NULL);
+    port = addr ? g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (addr))
+        : 0;
+    if (addr)
+      g_object_unref (addr);
+
+    /* the RTP port must be even and the next port free */
+    if (port != 0 && (port & 1) == 0 && port < 65535 &&
+        (rtcp = bind_udp_socket (family, port + 1)))
+      goto bound;
+
+    g_socket_close (rtp, NULL);
+    g_object_unref (rtp);
+  }
+  goto no_ports;
+
+bound:
+  stream->socket[0] = rtp;
+  stream->socket[1] = rtcp;
+  stream->server_port.min = port;
+  stream->server_port.max = port + 1;
+
+  return make_socket_elements (media, stream);
+
+  /* ERRORS */
+no_ports:
+  {
+    GST_WARNING ("could not bind a pair of UDP ports");
+    return FALSE;
+  }
+}
+
+/* Get the udp ports and sockets from the port pool */
+static gboolean
+alloc_pool_ports (GstRTSPMedia * media, GstRTSPMediaStream * stream)
+{
+  GSocketFamily family;
+  guint rtpport;
+
+  family = media->is_ipv6 ? G_SOCKET_FAMILY_IPV6 : G_SOCKET_FAMILY_IPV4;
+
+  /* the sockets are bound already, no need to try ports */
+  if (!gst_rtsp_port_pool_acquire (media->port_pool, family, &rtpport,
+          &stream->socket[0], &stream->socket[1]))
+    goto no_ports;
+
+  stream->port_pool = g_object_ref (media->port_pool);
+  stream->server_port.min = rtpport;
+  stream->server_port.max = rtpport + 1;
+
+  return make_socket_elements (media, stream);
+
+  /* ERRORS */
+no_ports:
+  {
+    GST_WARNING ("no free ports in the port pool");
+    return FALSE;
+  }
 }
 
 /* Allocate the udp ports and sockets */
@@ -851,9 +1934,15 @@ alloc_udp_ports (GstRTSPMedia * media, GstRTSPMediaStream * stream)
   gint tmp_rtp, tmp_rtcp;
   guint count;
   gint rtpport, rtcpport;
-  GSocket *socket;
+  GSocket *rtp_socket, *rtcp_socket;
+  gboolean res;
   const gchar *host;
 
+  if (media->port_pool)
+    return alloc_pool_ports (media, stream);
+  if (get_udp_receiver (media))
+    return alloc_socket_ports (media, stream);
+
   udpsrc0 = NULL;
   udpsrc1 = NULL;
   udpsink0 = NULL;
@@ -940,45 +2029,16 @@ again:
   if (rtpport != tmp_rtp || rtcpport != tmp_rtcp)
     goto port_error;
 
-  udpsink0 = gst_element_factory_make ("multiudpsink", NULL);
-  if (!udpsink0)
-    goto no_udp_protocol;
-
-  g_object_get (G_OBJECT (udpsrc0), "socket", &socket, NULL);
-  g_object_set (G_OBJECT (udpsink0), "socket", socket, NULL);
-  g_object_set (G_OBJECT (udpsink0), "close-socket", FALSE, NULL);
-
-  udpsink1 = gst_element_factory_make ("multiudpsink", NULL);
-  if (!udpsink1)
+  g_object_get (G_OBJECT (udpsrc0), "socket", &rtp_socket, NULL);
+  g_object_get (G_OBJECT (udpsrc1), "socket", &rtcp_socket, NULL);
+  res = make_udp_sinks (media, rtp_socket, rtcp_socket, &udpsink0, &udpsink1);
+  if (rtp_socket)
+    g_object_unref (rtp_socket);
+  if (rtcp_socket)
+    g_object_unref (rtcp_socket);
+  if (!res)
     goto no_udp_protocol;
 
-  if (g_object_class_find_property (G_OBJECT_GET_CLASS (udpsink0),
-          "send-duplicates")) {
-    g_object_set (G_OBJECT (udpsink0), "send-duplicates", FALSE, NULL);
-    g_object_set (G_OBJECT (udpsink1), "send-duplicates", FALSE, NULL);
-  } else {
-    g_warning
-        ("old multiudpsink version found without send-duplicates property");
-  }
-
-  if (g_object_class_find_property (G_OBJECT_GET_CLASS (udpsink0),
-          "buffer-size")) {
-    g_object_set (G_OBJECT (udpsink0), "buffer-size", media->buffer_size, NULL);
-  } else {
-    GST_WARNING ("multiudpsink version found without buffer-size property");
-  }
-
-  g_object_get (G_OBJECT (udpsrc1), "socket", &socket, NULL);
-  g_object_set (G_OBJECT (udpsink1), "socket", socket, NULL);
-  g_object_set (G_OBJECT (udpsink1), "close-socket", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink1), "sync", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink1), "async", FALSE, NULL);
-
-  g_object_set (G_OBJECT (udpsink0), "auto-multicast", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink0), "loop", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink1), "auto-multicast", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink1), "loop", FALSE, NULL);
-
   /* we keep these elements, we configure all in configure_transport when the
    * server told us to really use the UDP ports. */
   stream->udpsrc[0] = udpsrc0;
@@ -1033,6 +2093,7 @@ cleanup:
 static void
 caps_notify (GstPad * pad, GParamSpec * unused, GstRTSPMediaStream * stream)
 {
+  GstRTSPMedia *media = stream->media;
   gchar *capsstr;
   GstCaps *newcaps, *oldcaps;
 
@@ -1044,6 +2105,11 @@ caps_notify (GstPad * pad, GParamSpec * unused, GstRTSPMediaStream * stream)
   if (oldcaps)
     gst_caps_unref (oldcaps);
 
+  /* the SDP describes the caps */
+  g_mutex_lock (&media->lock);
+  invalidate_sdp_cache (media);
+  g_mutex_unlock (&media->lock);
+
   capsstr = gst_caps_to_string (newcaps);
   GST_INFO ("stream %p received caps %p, %s", stream, newcaps, capsstr);
   g_free (capsstr);
@@ -1059,14 +2125,14 @@ dump_structure (const GstStructure * s)
   g_free (sstr);
 }
 
+/* find the transport in @snapshot that sends to @rtcp_from */
 static GstRTSPMediaTrans *
-find_transport (GstRTSPMediaStream * stream, const gchar * rtcp_from)
+find_transport (GstRTSPTransportSnapshot * snapshot, const gchar * rtcp_from)
 {
-  GList *walk;
   GstRTSPMediaTrans *result = NULL;
   const gchar *tmp;
   gchar *dest;
-  guint port;
+  guint i, port;
 
   if (rtcp_from == NULL)
     return NULL;
@@ -1079,10 +2145,10 @@ find_transport (GstRTSPMediaStream * stream, const gchar * rtcp_from)
   dest = g_strndup (rtcp_from, tmp - rtcp_from);
 
   GST_INFO ("finding %s:%d in %d transports", dest, port,
-      g_list_length (stream->transports));
+      snapshot ? snapshot->n_transports : 0);
 
-  for (walk = stream->transports; walk; walk = g_list_next (walk)) {
-    GstRTSPMediaTrans *trans = walk->data;
+  for (i = 0; snapshot && i < snapshot->n_transports; i++) {
+    GstRTSPMediaTrans *trans = snapshot->transports[i];
     gint min, max;
 
     min = trans->transport->client_port.min;
@@ -1110,12 +2176,15 @@ check_transport (GObject * source, GstRTSPMediaStream * stream)
   if (trans == NULL) {
     g_object_get (source, "stats", &stats, NULL);
     if (stats) {
+      GstRTSPTransportSnapshot *snapshot;
       const gchar *rtcp_from;
 
       dump_structure (stats);
 
+      /* the transports of the snapshot are not freed while we use it */
+      snapshot = snapshot_get (stream);
       rtcp_from = gst_structure_get_string (stats, "rtcp-from");
-      if ((trans = find_transport (stream, rtcp_from))) {
+      if ((trans = find_transport (snapshot, rtcp_from))) {
         GST_INFO ("%p: found transport %p for source  %p", stream, trans,
             source);
 
@@ -1124,6 +2193,7 @@ check_transport (GObject * source, GstRTSPMediaStream * stream)
 
         g_object_set_qdata (source, ssrc_stream_map_key, trans);
       }
+      snapshot_unref (stream, snapshot);
       gst_structure_free (stats);
     }
   }
@@ -1209,77 +2279,475 @@ on_timeout (GObject * session, GObject * source, GstRTSPMediaStream * stream)
   }
 }
 
-static GstFlowReturn
-handle_new_sample (GstAppSink * sink, gpointer user_data)
+/* send the buffer or buffer list @obj to @tr */
+static void
+send_transport (GstRTSPMediaTrans * tr, GstMiniObject * obj, gboolean is_rtp)
+{
+  GstRTSPSendListFunc send_list;
+  GstRTSPSendFunc send;
+  guint8 channel;
+  guint i, len;
+
+  if (is_rtp) {
+    send_list = tr->send_rtp_list;
+    send = tr->send_rtp;
+    channel = tr->transport->interleaved.min;
+  } else {
+    send_list = tr->send_rtcp_list;
+    send = tr->send_rtcp;
+    channel = tr->transport->interleaved.max;
+  }
+
+  if (GST_IS_BUFFER_LIST (obj)) {
+    GstBufferList *list = GST_BUFFER_LIST_CAST (obj);
+
+    if (send_list) {
+      send_list (list, channel, tr->user_data);
+    } else if (send) {
+      len = gst_buffer_list_length (list);
+      for (i = 0; i < len; i++)
+        send (gst_buffer_list_get (list, i), channel, tr->user_data);
+    }
+  } else if (send) {
+    send (GST_BUFFER_CAST (obj), channel, tr->user_data);
+  }
+}
+
+/* the threads sending to the TCP transports of a media. Each transport is
+ * served by one thread so that its packets stay in order, the streaming
+ * threads only queue a ref of the packets and the transports for each
+ * thread that serves a transport of the stream. */
+typedef struct
+{
+  guint id;
+  /* protects the queue */
+  GMutex lock;
+  GCond cond;
+  GQueue queue;
+  gboolean running;
+  GThread *thread;
+} TCPWorker;
+
+/* the packets and transports queued for a worker */
+typedef struct
 {
-  GList *walk;
-  GstSample *sample;
-  GstBuffer *buffer;
   GstRTSPMediaStream *stream;
+  GstRTSPTransportSnapshot *snapshot;
+  GstMiniObject *obj;
+  gboolean is_rtp;
+} TCPSend;
 
-  sample = gst_app_sink_pull_sample (sink);
-  if (!sample)
-    return GST_FLOW_OK;
+struct _GstRTSPTCPFanout
+{
+  guint n_workers;
+  TCPWorker *workers;
+};
 
-  stream = (GstRTSPMediaStream *) user_data;
-  buffer = gst_sample_get_buffer (sample);
+static void
+tcp_send_free (TCPSend * send)
+{
+  snapshot_unref (send->stream, send->snapshot);
+  gst_mini_object_unref (send->obj);
+  g_slice_free (TCPSend, send);
+}
+
+/* the worker serving @tr */
+static guint
+tcp_fanout_worker_id (guint n_workers, GstRTSPMediaTrans * tr)
+{
+  guint32 hash = GPOINTER_TO_SIZE (tr) * 2654435761u;
 
-  for (walk = stream->transports; walk; walk = g_list_next (walk)) {
-    GstRTSPMediaTrans *tr = (GstRTSPMediaTrans *) walk->data;
+  return (hash >> 16) % n_workers;
+}
 
-    if (GST_ELEMENT_CAST (sink) == stream->appsink[0]) {
-      if (tr->send_rtp)
-        tr->send_rtp (buffer, tr->transport->interleaved.min, tr->user_data);
-    } else {
-      if (tr->send_rtcp)
-        tr->send_rtcp (buffer, tr->transport->interleaved.max, tr->user_data);
+static guint
+tcp_fanout_n_workers (GstRTSPTCPFanout * fanout)
+{
+  return fanout->n_workers;
+}
+
+static gpointer
+tcp_worker_loop (TCPWorker * worker)
+{
+  GstRTSPTransportSnapshot *snapshot;
+  TCPSend *send;
+  guint i;
+
+  g_mutex_lock (&worker->lock);
+  while (worker->running) {
+    if (!(send = g_queue_pop_head (&worker->queue))) {
+      g_cond_wait (&worker->cond, &worker->lock);
+      continue;
     }
+    g_mutex_unlock (&worker->lock);
+
+    snapshot = send->snapshot;
+    for (i = snapshot->worker_start[worker->id];
+        i < snapshot->worker_start[worker->id + 1]; i++)
+      send_transport (snapshot->by_worker[i], send->obj, send->is_rtp);
+    tcp_send_free (send);
+
+    g_mutex_lock (&worker->lock);
   }
-  gst_sample_unref (sample);
+  g_mutex_unlock (&worker->lock);
 
-  return GST_FLOW_OK;
+  return NULL;
 }
 
-static GstAppSinkCallbacks sink_cb = {
-  NULL,                         /* not interested in EOS */
-  NULL,                         /* not interested in preroll samples */
-  handle_new_sample,
-};
+static GstRTSPTCPFanout *
+tcp_fanout_new (guint n_workers)
+{
+  GstRTSPTCPFanout *fanout;
+  guint i;
+
+  fanout = g_slice_new0 (GstRTSPTCPFanout);
+  fanout->n_workers = n_workers;
+  fanout->workers = g_new0 (TCPWorker, n_workers);
+
+  for (i = 0; i < n_workers; i++) {
+    TCPWorker *worker = &fanout->workers[i];
+
+    worker->id = i;
+    g_mutex_init (&worker->lock);
+    g_cond_init (&worker->cond);
+    g_queue_init (&worker->queue);
+    worker->running = TRUE;
+    worker->thread = g_thread_new ("rtsp-tcp-send",
+        (GThreadFunc) tcp_worker_loop, worker);
+  }
+  GST_INFO ("started %u TCP send threads", n_workers);
+
+  return fanout;
+}
+
+/* stop the workers and free @fanout, nothing must be queued anymore */
+static void
+tcp_fanout_free (GstRTSPTCPFanout * fanout)
+{
+  guint i;
+
+  for (i = 0; i < fanout->n_workers; i++) {
+    TCPWorker *worker = &fanout->workers[i];
+
+    g_mutex_lock (&worker->lock);
+    worker->running = FALSE;
+    g_cond_signal (&worker->cond);
+    g_mutex_unlock (&worker->lock);
+  }
 
-/* prepare the pipeline objects to handle @stream in @media */
+  for (i = 0; i < fanout->n_workers; i++) {
+    TCPWorker *worker = &fanout->workers[i];
+
+    g_thread_join (worker->thread);
+    g_queue_foreach (&worker->queue, (GFunc) tcp_send_free, NULL);
+    g_queue_clear (&worker->queue);
+    g_cond_clear (&worker->cond);
+    g_mutex_clear (&worker->lock);
+  }
+  g_free (fanout->workers);
+  g_slice_free (GstRTSPTCPFanout, fanout);
+}
+
+/* queue @obj with @snapshot for the workers serving a transport in it. A full
+ * queue drops the packet instead of blocking the streaming thread. The queued
+ * packets keep a ref of @snapshot, so removing a transport waits for them. */
+static void
+tcp_fanout_push (GstRTSPTCPFanout * fanout, GstRTSPMediaStream * stream,
+    GstRTSPTransportSnapshot * snapshot, GstMiniObject * obj, gboolean is_rtp)
+{
+  guint i;
+
+  for (i = 0; i < fanout->n_workers; i++) {
+    TCPWorker *worker = &fanout->workers[i];
+    TCPSend *send;
+
+    if (snapshot->worker_start[i] == snapshot->worker_start[i + 1])
+      continue;
+
+    g_mutex_lock (&worker->lock);
+    if (worker->queue.length >= TCP_FANOUT_MAX_QUEUED) {
+      g_mutex_unlock (&worker->lock);
+      GST_DEBUG ("TCP send thread %u is full, dropping packet", i);
+      continue;
+    }
+
+    send = g_slice_new (TCPSend);
+    g_atomic_int_inc (&snapshot->refcount);
+    send->stream = stream;
+    send->snapshot = snapshot;
+    send->obj = gst_mini_object_ref (obj);
+    send->is_rtp = is_rtp;
+    g_queue_push_tail (&worker->queue, send);
+    g_cond_signal (&worker->cond);
+    g_mutex_unlock (&worker->lock);
+  }
+}
+
+/* called from the streaming thread with a buffer or a buffer list for the
+ * TCP transports of @stream */
+static void
+handle_tcp_data (GstRTSPTCPSink * sink, GstMiniObject * obj,
+    GstRTSPMediaStream * stream)
+{
+  GstRTSPTransportSnapshot *snapshot;
+  gboolean is_rtp;
+  guint i;
+
+  is_rtp = GST_ELEMENT_CAST (sink) == stream->appsink[0];
+
+  if (!(snapshot = snapshot_get (stream)))
+    return;
+
+  if (stream->tcp_fanout && snapshot->worker_start) {
+    tcp_fanout_push (stream->tcp_fanout, stream, snapshot, obj, is_rtp);
+  } else {
+    /* walk the transports without holding any lock */
+    for (i = 0; i < snapshot->n_transports; i++)
+      send_transport (snapshot->transports[i], obj, is_rtp);
+  }
+  snapshot_unref (stream, snapshot);
+}
+
+/* link a new request pad of @tee to @sink and return the request pad */
+static GstPad *
+link_tee (GstElement * tee, GstElement * sink)
+{
+  GstPad *teepad, *pad;
+
+  teepad = gst_element_get_request_pad (tee, "src_%u");
+  pad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_link (teepad, pad);
+  gst_object_unref (pad);
+
+  return teepad;
+}
+
+/* link @src to a new request pad of @funnel and return the request pad */
+static GstPad *
+link_funnel (GstElement * src, GstElement * funnel)
+{
+  GstPad *selpad, *pad;
+
+  selpad = gst_element_get_request_pad (funnel, "sink_%u");
+  pad = gst_element_get_static_pad (src, "src");
+  gst_pad_link (pad, selpad);
+  gst_object_unref (pad);
+
+  return selpad;
+}
+
+typedef struct
+{
+  GMutex lock;
+  GCond cond;
+  gboolean unlinked;
+} UnlinkWait;
+
+/* called when no data flows through the request pad @reqpad, from the
+ * streaming thread or from gst_pad_add_probe() */
+static GstPadProbeReturn
+unlink_idle (GstPad * reqpad, GstPadProbeInfo * info, UnlinkWait * wait)
+{
+  GstPad *peer;
+
+  if ((peer = gst_pad_get_peer (reqpad))) {
+    if (GST_PAD_IS_SRC (reqpad))
+      gst_pad_unlink (reqpad, peer);
+    else
+      gst_pad_unlink (peer, reqpad);
+    gst_object_unref (peer);
+  }
+
+  g_mutex_lock (&wait->lock);
+  wait->unlinked = TRUE;
+  g_cond_signal (&wait->cond);
+  g_mutex_unlock (&wait->lock);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+/* unlink and release a request pad obtained with link_tee() or link_funnel().
+ * The pipeline can be PLAYING, the pad is unlinked when no buffer is pushed
+ * through it. */
+static void
+release_request_pad (GstElement * element, GstPad * reqpad)
+{
+  UnlinkWait wait;
+
+  g_mutex_init (&wait.lock);
+  g_cond_init (&wait.cond);
+  wait.unlinked = FALSE;
+
+  gst_pad_add_probe (reqpad, GST_PAD_PROBE_TYPE_IDLE,
+      (GstPadProbeCallback) unlink_idle, &wait, NULL);
+
+  g_mutex_lock (&wait.lock);
+  while (!wait.unlinked)
+    g_cond_wait (&wait.cond, &wait.lock);
+  g_mutex_unlock (&wait.lock);
+
+  g_mutex_clear (&wait.lock);
+  g_cond_clear (&wait.cond);
+
+  gst_element_release_request_pad (element, reqpad);
+  gst_object_unref (reqpad);
+}
+
+static void
+remove_element (GstRTSPMedia * media, GstElement * element)
+{
+  gst_element_set_state (element, GST_STATE_NULL);
+  gst_bin_remove (GST_BIN_CAST (media->pipeline), element);
+}
+
+/* make the elements for sending and receiving RTP and RTCP over UDP, called
+ * with the branch lock */
 static gboolean
-setup_stream (GstRTSPMediaStream * stream, guint idx, GstRTSPMedia * media)
+make_udp_branch (GstRTSPMedia * media, GstRTSPMediaStream * stream)
 {
-  gchar *name;
-  GstPad *pad, *teepad, *queuepad, *selpad;
-  GstPadLinkReturn ret;
   gint i;
 
   /* allocate udp ports, we will have 4 of them, 2 for receiving RTP/RTCP and 2
    * for sending RTP/RTCP. The sender and receiver ports are shared between the
    * elements */
   if (!alloc_udp_ports (media, stream))
-    return FALSE;
+    goto no_ports;
 
-  /* add the ports to the pipeline */
   for (i = 0; i < 2; i++) {
+    /* the stream is prerolled by its fakesink, the pipeline must not lose its
+     * state when the branch is added */
+    g_object_set (stream->udpsink[i], "async", FALSE, NULL);
     gst_bin_add (GST_BIN_CAST (media->pipeline), stream->udpsink[i]);
     gst_bin_add (GST_BIN_CAST (media->pipeline), stream->udpsrc[i]);
+
+    stream->udp_teepad[i] = link_tee (stream->tee[i], stream->udpsink[i]);
+    gst_element_sync_state_with_parent (stream->udpsink[i]);
+
+    stream->udp_selpad[i] = link_funnel (stream->udpsrc[i],
+        stream->selector[i]);
+
+    /* we set and keep these to playing so that they don't cause NO_PREROLL
+     * return values */
+    gst_element_set_state (stream->udpsrc[i], GST_STATE_PLAYING);
+    gst_element_set_locked_state (stream->udpsrc[i], TRUE);
   }
+  GST_INFO ("added UDP branch on ports %d-%d", stream->server_port.min,
+      stream->server_port.max);
+
+  return TRUE;
+
+  /* ERRORS */
+no_ports:
+  {
+    GST_WARNING ("failed to allocate UDP ports");
+    free_udp_ports (stream);
+    return FALSE;
+  }
+}
+
+/* called with the branch lock */
+static void
+remove_udp_branch (GstRTSPMedia * media, GstRTSPMediaStream * stream)
+{
+  gint i;
+
+  for (i = 0; i < 2; i++) {
+    release_request_pad (stream->tee[i], stream->udp_teepad[i]);
+    remove_element (media, stream->udpsink[i]);
+
+    /* stop the source before unlinking it */
+    gst_element_set_locked_state (stream->udpsrc[i], FALSE);
+    gst_element_set_state (stream->udpsrc[i], GST_STATE_NULL);
+    release_request_pad (stream->selector[i], stream->udp_selpad[i]);
+    remove_element (media, stream->udpsrc[i]);
+
+    stream->udp_teepad[i] = NULL;
+    stream->udp_selpad[i] = NULL;
+    stream->udpsink[i] = NULL;
+    stream->udpsrc[i] = NULL;
+  }
+  free_udp_ports (stream);
+
+  GST_INFO ("removed UDP branch");
+}
+
+/* make the elements for sending and receiving RTP and RTCP over the RTSP
+ * connection, called with the branch lock */
+static void
+make_tcp_branch (GstRTSPMedia * media, GstRTSPMediaStream * stream)
+{
+  GstPad *queuepad, *pad;
+  gint i;
+
+  /* the send threads are shared by all streams of the media */
+  if (media->tcp_send_threads > 0 && media->tcp_fanout == NULL)
+    media->tcp_fanout = tcp_fanout_new (media->tcp_send_threads);
+  stream->tcp_fanout = media->tcp_fanout;
 
-  /* create elements for the TCP transfer */
   for (i = 0; i < 2; i++) {
     stream->appsrc[i] = gst_element_factory_make ("appsrc", NULL);
     stream->appqueue[i] = gst_element_factory_make ("queue", NULL);
-    stream->appsink[i] = gst_element_factory_make ("appsink", NULL);
-    g_object_set (stream->appsink[i], "async", FALSE, "sync", FALSE, NULL);
-    g_object_set (stream->appsink[i], "emit-signals", FALSE, NULL);
+    stream->appsink[i] = gst_rtsp_tcp_sink_new ();
     gst_bin_add (GST_BIN_CAST (media->pipeline), stream->appqueue[i]);
     gst_bin_add (GST_BIN_CAST (media->pipeline), stream->appsink[i]);
     gst_bin_add (GST_BIN_CAST (media->pipeline), stream->appsrc[i]);
-    gst_app_sink_set_callbacks (GST_APP_SINK_CAST (stream->appsink[i]),
-        &sink_cb, stream, NULL);
+    gst_rtsp_tcp_sink_set_callback (GST_RTSP_TCP_SINK_CAST (stream->appsink[i]),
+        (GstRTSPTCPSinkFunc) handle_tcp_data, stream, NULL);
+
+    queuepad = gst_element_get_static_pad (stream->appqueue[i], "src");
+    pad = gst_element_get_static_pad (stream->appsink[i], "sink");
+    gst_pad_link (queuepad, pad);
+    gst_object_unref (pad);
+    gst_object_unref (queuepad);
+
+    stream->tcp_teepad[i] = link_tee (stream->tee[i], stream->appqueue[i]);
+    gst_element_sync_state_with_parent (stream->appsink[i]);
+    gst_element_sync_state_with_parent (stream->appqueue[i]);
+
+    stream->tcp_selpad[i] = link_funnel (stream->appsrc[i],
+        stream->selector[i]);
+    gst_element_sync_state_with_parent (stream->appsrc[i]);
+  }
+  GST_INFO ("added TCP branch");
+}
+
+/* called with the branch lock */
+static void
+remove_tcp_branch (GstRTSPMedia * media, GstRTSPMediaStream * stream)
+{
+  gint i;
+
+  for (i = 0; i < 2; i++) {
+    release_request_pad (stream->tee[i], stream->tcp_teepad[i]);
+    remove_element (media, stream->appqueue[i]);
+    remove_element (media, stream->appsink[i]);
+
+    gst_element_set_state (stream->appsrc[i], GST_STATE_NULL);
+    release_request_pad (stream->selector[i], stream->tcp_selpad[i]);
+    remove_element (media, stream->appsrc[i]);
+
+    stream->tcp_teepad[i] = NULL;
+    stream->tcp_selpad[i] = NULL;
+    stream->appqueue[i] = NULL;
+    stream->appsink[i] = NULL;
+    stream->appsrc[i] = NULL;
   }
+  GST_INFO ("removed TCP branch");
+}
+
+/* prepare the elements of @stream that are always needed. The elements for
+ * the UDP and TCP transports are made when the first transport of that kind is
+ * acquired. */
+static gboolean
+setup_stream (GstRTSPMediaStream * stream, guint idx, GstRTSPMedia * media)
+{
+  gchar *name;
+  GstPad *pad;
+  GstPadLinkReturn ret;
+  gint i;
+
+  stream->n_udp = 0;
+  stream->n_tcp = 0;
 
   /* hook up the stream to the RTP session elements. */
   name = g_strdup_printf ("send_rtp_sink_%u", idx);
@@ -1320,108 +2788,34 @@ setup_stream (GstRTSPMediaStream * stream, guint idx, GstRTSPMedia * media)
   if (ret != GST_PAD_LINK_OK)
     goto link_failed;
 
-  /* make tee for RTP and link to stream */
-  stream->tee[0] = gst_element_factory_make ("tee", NULL);
-  gst_bin_add (GST_BIN_CAST (media->pipeline), stream->tee[0]);
-
-  pad = gst_element_get_static_pad (stream->tee[0], "sink");
-  gst_pad_link (stream->send_rtp_src, pad);
-  gst_object_unref (pad);
-
-  /* link RTP sink, we're pretty sure this will work. */
-  teepad = gst_element_get_request_pad (stream->tee[0], "src_%u");
-  pad = gst_element_get_static_pad (stream->udpsink[0], "sink");
-  gst_pad_link (teepad, pad);
-  gst_object_unref (pad);
-  gst_object_unref (teepad);
-
-  teepad = gst_element_get_request_pad (stream->tee[0], "src_%u");
-  pad = gst_element_get_static_pad (stream->appqueue[0], "sink");
-  gst_pad_link (teepad, pad);
-  gst_object_unref (pad);
-  gst_object_unref (teepad);
-
-  queuepad = gst_element_get_static_pad (stream->appqueue[0], "src");
-  pad = gst_element_get_static_pad (stream->appsink[0], "sink");
-  gst_pad_link (queuepad, pad);
-  gst_object_unref (pad);
-  gst_object_unref (queuepad);
-
-  /* make tee for RTCP */
-  stream->tee[1] = gst_element_factory_make ("tee", NULL);
-  gst_bin_add (GST_BIN_CAST (media->pipeline), stream->tee[1]);
-
-  pad = gst_element_get_static_pad (stream->tee[1], "sink");
-  gst_pad_link (stream->send_rtcp_src, pad);
-  gst_object_unref (pad);
-
-  /* link RTCP elements */
-  teepad = gst_element_get_request_pad (stream->tee[1], "src_%u");
-  pad = gst_element_get_static_pad (stream->udpsink[1], "sink");
-  gst_pad_link (teepad, pad);
-  gst_object_unref (pad);
-  gst_object_unref (teepad);
-
-  teepad = gst_element_get_request_pad (stream->tee[1], "src_%u");
-  pad = gst_element_get_static_pad (stream->appqueue[1], "sink");
-  gst_pad_link (teepad, pad);
-  gst_object_unref (pad);
-  gst_object_unref (teepad);
-
-  queuepad = gst_element_get_static_pad (stream->appqueue[1], "src");
-  pad = gst_element_get_static_pad (stream->appsink[1], "sink");
-  gst_pad_link (queuepad, pad);
-  gst_object_unref (pad);
-  gst_object_unref (queuepad);
-
-  /* make selector for the RTP receivers */
-  stream->selector[0] = gst_element_factory_make ("funnel", NULL);
-  gst_bin_add (GST_BIN_CAST (media->pipeline), stream->selector[0]);
-
-  pad = gst_element_get_static_pad (stream->selector[0], "src");
-  gst_pad_link (pad, stream->recv_rtp_sink);
-  gst_object_unref (pad);
-
-  selpad = gst_element_get_request_pad (stream->selector[0], "sink_%u");
-  pad = gst_element_get_static_pad (stream->udpsrc[0], "src");
-  gst_pad_link (pad, selpad);
-  gst_object_unref (pad);
-  gst_object_unref (selpad);
-
-  selpad = gst_element_get_request_pad (stream->selector[0], "sink_%u");
-  pad = gst_element_get_static_pad (stream->appsrc[0], "src");
-  gst_pad_link (pad, selpad);
-  gst_object_unref (pad);
-  gst_object_unref (selpad);
-
-  /* make selector for the RTCP receivers */
-  stream->selector[1] = gst_element_factory_make ("funnel", NULL);
-  gst_bin_add (GST_BIN_CAST (media->pipeline), stream->selector[1]);
-
-  pad = gst_element_get_static_pad (stream->selector[1], "src");
-  gst_pad_link (pad, stream->recv_rtcp_sink);
-  gst_object_unref (pad);
-
-  selpad = gst_element_get_request_pad (stream->selector[1], "sink_%u");
-  pad = gst_element_get_static_pad (stream->udpsrc[1], "src");
-  gst_pad_link (pad, selpad);
-  gst_object_unref (pad);
-  gst_object_unref (selpad);
-
-  selpad = gst_element_get_request_pad (stream->selector[1], "sink_%u");
-  pad = gst_element_get_static_pad (stream->appsrc[1], "src");
-  gst_pad_link (pad, selpad);
-  gst_object_unref (pad);
-  gst_object_unref (selpad);
-
-  /* we set and keep these to playing so that they don't cause NO_PREROLL return
-   * values */
-  gst_element_set_state (stream->udpsrc[0], GST_STATE_PLAYING);
-  gst_element_set_state (stream->udpsrc[1], GST_STATE_PLAYING);
-  gst_element_set_locked_state (stream->udpsrc[0], TRUE);
-  gst_element_set_locked_state (stream->udpsrc[1], TRUE);
+  for (i = 0; i < 2; i++) {
+    /* make tee for RTP and RTCP and link to the session manager */
+    stream->tee[i] = gst_element_factory_make ("tee", NULL);
+    gst_bin_add (GST_BIN_CAST (media->pipeline), stream->tee[i]);
+
+    pad = gst_element_get_static_pad (stream->tee[i], "sink");
+    gst_pad_link (i == 0 ? stream->send_rtp_src : stream->send_rtcp_src, pad);
+    gst_object_unref (pad);
+
+    /* the fakesink keeps the tee linked when the stream has no transports,
+     * the RTP fakesink also prerolls the stream */
+    stream->fakesink[i] = gst_element_factory_make ("fakesink", NULL);
+    g_object_set (stream->fakesink[i], "sync", FALSE, "async", i == 0,
+        "enable-last-sample", FALSE, NULL);
+    gst_bin_add (GST_BIN_CAST (media->pipeline), stream->fakesink[i]);
+    gst_object_unref (link_tee (stream->tee[i], stream->fakesink[i]));
+
+    /* make selector for the RTP and RTCP receivers */
+    stream->selector[i] = gst_element_factory_make ("funnel", NULL);
+    gst_bin_add (GST_BIN_CAST (media->pipeline), stream->selector[i]);
+
+    pad = gst_element_get_static_pad (stream->selector[i], "src");
+    gst_pad_link (pad, i == 0 ? stream->recv_rtp_sink : stream->recv_rtcp_sink);
+    gst_object_unref (pad);
+  }
 
   /* be notified of caps changes */
+  stream->media = media;
   stream->caps_sig = g_signal_connect (stream->send_rtp_sink, "notify::caps",
       (GCallback) caps_notify, stream);
 
@@ -1449,51 +2843,92 @@ unlock_streams (GstRTSPMedia * media)
 
     stream = gst_rtsp_media_get_stream (media, i);
 
+    if (stream->udpsrc[0] == NULL)
+      continue;
+
     gst_element_set_locked_state (stream->udpsrc[0], FALSE);
     gst_element_set_locked_state (stream->udpsrc[1], FALSE);
   }
 }
 
+/* called without the lock when the media left the PREPARING state, this
+ * usually happens from the bus thread */
+static void
+prepare_finished (GstRTSPMedia * media, GstRTSPMediaStatus status,
+    GList * pending, GSource * timeout)
+{
+  gboolean prepared;
+  GList *walk;
+
+  if (timeout) {
+    g_source_destroy (timeout);
+    g_source_unref (timeout);
+  }
+
+  prepared = (status == GST_RTSP_MEDIA_STATUS_PREPARED);
+
+  if (prepared) {
+    GST_INFO ("object %p is prerolled", media);
+    g_signal_emit (media, gst_rtsp_media_signals[SIGNAL_PREPARED], 0, NULL);
+  } else if (status == GST_RTSP_MEDIA_STATUS_ERROR) {
+    GST_WARNING ("failed to preroll pipeline");
+    unlock_streams (media);
+    gst_element_set_state (media->pipeline, GST_STATE_NULL);
+    gst_rtsp_media_unprepare (media);
+  }
+
+  /* the callbacks were prepended */
+  pending = g_list_reverse (pending);
+  for (walk = pending; walk; walk = g_list_next (walk))
+    prepare_callback_invoke (walk->data, media, prepared);
+  g_list_free (pending);
+}
+
 static void
 gst_rtsp_media_set_status (GstRTSPMedia * media, GstRTSPMediaStatus status)
 {
+  GList *pending = NULL;
+  GSource *timeout = NULL;
+  gboolean finished;
+
   g_mutex_lock (&media->lock);
+  finished = media->status == GST_RTSP_MEDIA_STATUS_PREPARING &&
+      status != GST_RTSP_MEDIA_STATUS_PREPARING;
+  if (finished) {
+    pending = media->prepare_pending;
+    media->prepare_pending = NULL;
+    timeout = media->prepare_timeout;
+    media->prepare_timeout = NULL;
+  }
   /* never overwrite the error status */
   if (media->status != GST_RTSP_MEDIA_STATUS_ERROR)
     media->status = status;
+  status = media->status;
+  if (status == GST_RTSP_MEDIA_STATUS_PREPARED)
+    invalidate_sdp_cache (media);
   GST_DEBUG ("setting new status to %d", status);
   g_cond_broadcast (&media->cond);
   g_mutex_unlock (&media->lock);
+
+  if (finished)
+    prepare_finished (media, status, pending, timeout);
 }
 
-static GstRTSPMediaStatus
-gst_rtsp_media_get_status (GstRTSPMedia * media)
+static gboolean
+prepare_timeout (GstRTSPMedia * media)
 {
-  GstRTSPMediaStatus result;
-  gint64 end_time;
-
-  g_mutex_lock (&media->lock);
-  end_time = g_get_monotonic_time () + 20 * G_TIME_SPAN_SECOND;
-  /* while we are preparing, wait */
-  while (media->status == GST_RTSP_MEDIA_STATUS_PREPARING) {
-    GST_DEBUG ("waiting for status change");
-    if (!g_cond_wait_until (&media->cond, &media->lock, end_time)) {
-      GST_DEBUG ("timeout, assuming error status");
-      media->status = GST_RTSP_MEDIA_STATUS_ERROR;
-    }
-  }
-  /* could be success or error */
-  result = media->status;
-  GST_DEBUG ("got status %d", result);
-  g_mutex_unlock (&media->lock);
+  GST_WARNING ("media %p: timeout while preparing, assuming error status",
+      media);
+  gst_rtsp_media_set_status (media, GST_RTSP_MEDIA_STATUS_ERROR);
 
-  return result;
+  return FALSE;
 }
 
 static gboolean
 default_handle_message (GstRTSPMedia * media, GstMessage * message)
 {
   GstMessageType type;
+  gboolean seek_done;
 
   type = GST_MESSAGE_TYPE (message);
 
@@ -1577,6 +3012,15 @@ default_handle_message (GstRTSPMedia * media, GstMessage * message)
         collect_media_stats (media);
 
         gst_rtsp_media_set_status (media, GST_RTSP_MEDIA_STATUS_PREPARED);
+
+        /* only the preroll after the last seek completes the pending seeks */
+        g_mutex_lock (&media->lock);
+        seek_done = media->seek_pending != NULL &&
+            gst_message_get_seqnum (message) == media->seek_seqnum;
+        g_mutex_unlock (&media->lock);
+
+        if (seek_done)
+          seek_finished (media, TRUE);
       } else {
         GST_INFO ("%p: ignoring ASYNC_DONE", media);
       }
@@ -1598,6 +3042,28 @@ default_handle_message (GstRTSPMedia * media, GstMessage * message)
   return TRUE;
 }
 
+/* called from the thread posting @message. Drop the messages that the default
+ * handler ignores */
+static GstBusSyncReply
+bus_sync_filter (GstBus * bus, GstMessage * message, GstRTSPMedia * media)
+{
+  switch (GST_MESSAGE_TYPE (message)) {
+    case GST_MESSAGE_QOS:
+    case GST_MESSAGE_TAG:
+    case GST_MESSAGE_PROGRESS:
+    case GST_MESSAGE_STREAM_STATUS:
+    case GST_MESSAGE_ELEMENT:
+      return GST_BUS_DROP;
+    case GST_MESSAGE_STATE_CHANGED:
+      if (GST_MESSAGE_SRC (message) != GST_OBJECT_CAST (media->pipeline))
+        return GST_BUS_DROP;
+      break;
+    default:
+      break;
+  }
+  return GST_BUS_PASS;
+}
+
 static gboolean
 bus_message (GstBus * bus, GstMessage * message, GstRTSPMedia * media)
 {
@@ -1628,6 +3094,8 @@ pad_added_cb (GstElement * element, GstPad * pad, GstRTSPMedia * media)
 
   stream = g_new0 (GstRTSPMediaStream, 1);
   stream->payloader = element;
+  g_mutex_init (&stream->transports_lock);
+  g_cond_init (&stream->transports_cond);
 
   name = g_strdup_printf ("dynpay%d", i);
 
@@ -1645,12 +3113,9 @@ pad_added_cb (GstElement * element, GstPad * pad, GstRTSPMedia * media)
   setup_stream (stream, i, media);
 
   for (i = 0; i < 2; i++) {
-    gst_element_set_state (stream->udpsink[i], GST_STATE_PAUSED);
-    gst_element_set_state (stream->appsink[i], GST_STATE_PAUSED);
-    gst_element_set_state (stream->appqueue[i], GST_STATE_PAUSED);
+    gst_element_set_state (stream->fakesink[i], GST_STATE_PAUSED);
     gst_element_set_state (stream->tee[i], GST_STATE_PAUSED);
     gst_element_set_state (stream->selector[i], GST_STATE_PAUSED);
-    gst_element_set_state (stream->appsrc[i], GST_STATE_PAUSED);
   }
   media->adding = FALSE;
 }
@@ -1670,33 +3135,69 @@ no_more_pads_cb (GstElement * element, GstRTSPMedia * media)
 }
 
 /**
- * gst_rtsp_media_prepare:
+ * gst_rtsp_media_prepare_async:
  * @media: a #GstRTSPMedia
+ * @func: a #GstRTSPMediaPrepareFunc
+ * @user_data: user data passed to @func
+ * @notify: called with @user_data when @func is no longer needed
  *
- * Prepare @media for streaming. This function will create the pipeline and
- * other objects to manage the streaming.
+ * Prepare @media for streaming without waiting for the pipeline to preroll.
+ * This function will create the pipeline and other objects to manage the
+ * streaming and start prerolling the pipeline.
  *
- * It will preroll the pipeline and collect vital information about the streams
- * such as the duration.
+ * @func is called exactly once, when the pipeline has prerolled and vital
+ * information about the streams such as the duration has been collected, or
+ * when preparing failed. When @media was already prepared or failed to start
+ * preparing, @func is called from this function, otherwise it is called from
+ * the thread that dispatches the pipeline messages of @media.
  *
- * Returns: %TRUE on success.
+ * Returns: %FALSE when preparing @media failed immediately.
  */
 gboolean
-gst_rtsp_media_prepare (GstRTSPMedia * media)
+gst_rtsp_media_prepare_async (GstRTSPMedia * media,
+    GstRTSPMediaPrepareFunc func, gpointer user_data, GDestroyNotify notify)
 {
   GstStateChangeReturn ret;
-  GstRTSPMediaStatus status;
   guint i, n_streams;
   GstRTSPMediaClass *klass;
   GstBus *bus;
   GList *walk;
+  PrepareCallback *cb;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+  g_return_val_if_fail (func != NULL, FALSE);
 
+  cb = prepare_callback_new (func, user_data, notify);
+  klass = GST_RTSP_MEDIA_GET_CLASS (media);
+
+  /* shared media can be prepared from multiple threads */
+  g_mutex_lock (&media->lock);
   if (media->status == GST_RTSP_MEDIA_STATUS_PREPARED)
     goto was_prepared;
 
+  if (media->status == GST_RTSP_MEDIA_STATUS_PREPARING)
+    goto is_preparing;
+
+  if (media->status == GST_RTSP_MEDIA_STATUS_UNPREPARING)
+    goto is_unpreparing;
+
+  if (media->status == GST_RTSP_MEDIA_STATUS_ERROR)
+    goto is_error;
+
   if (!media->reusable && media->reused)
     goto is_reused;
 
+  /* we're preparing now, the callback is called when we leave this state */
+  media->status = GST_RTSP_MEDIA_STATUS_PREPARING;
+  media->prepare_pending = g_list_prepend (NULL, cb);
+
+  /* don't wait forever for the pipeline to preroll */
+  media->prepare_timeout = g_timeout_source_new_seconds (20);
+  g_source_set_callback (media->prepare_timeout, (GSourceFunc) prepare_timeout,
+      g_object_ref (media), g_object_unref);
+  g_source_attach (media->prepare_timeout, media->context);
+  g_mutex_unlock (&media->lock);
+
   media->rtpbin = gst_element_factory_make ("rtpbin", NULL);
   if (media->rtpbin == NULL)
     goto no_rtpbin;
@@ -1707,19 +3208,22 @@ gst_rtsp_media_prepare (GstRTSPMedia * media)
   media->is_live = FALSE;
   media->seekable = FALSE;
   media->buffering = FALSE;
-  /* we're preparing now */
-  media->status = GST_RTSP_MEDIA_STATUS_PREPARING;
 
   bus = gst_pipeline_get_bus (GST_PIPELINE_CAST (media->pipeline));
 
+  /* don't pass the messages that we ignore anyway to the bus thread */
+  gst_bus_set_sync_handler (bus, NULL, NULL, NULL);
+  if (klass->handle_message == default_handle_message)
+    gst_bus_set_sync_handler (bus, (GstBusSyncHandler) bus_sync_filter, media,
+        NULL);
+
   /* add the pipeline bus to our custom mainloop */
   media->source = gst_bus_create_watch (bus);
   gst_object_unref (bus);
 
   g_source_set_callback (media->source, (GSourceFunc) bus_message, media, NULL);
 
-  klass = GST_RTSP_MEDIA_GET_CLASS (media);
-  media->id = g_source_attach (media->source, klass->context);
+  media->id = g_source_attach (media->source, media->context);
 
   /* add stuff to the bin */
   gst_bin_add (GST_BIN (media->pipeline), media->rtpbin);
@@ -1778,44 +3282,130 @@ gst_rtsp_media_prepare (GstRTSPMedia * media)
       goto state_failed;
   }
 
-  /* now wait for all pads to be prerolled */
-  status = gst_rtsp_media_get_status (media);
-  if (status == GST_RTSP_MEDIA_STATUS_ERROR)
-    goto state_failed;
-
-  g_signal_emit (media, gst_rtsp_media_signals[SIGNAL_PREPARED], 0, NULL);
-
-  GST_INFO ("object %p is prerolled", media);
-
+  /* the pipeline messages will tell us when we are prerolled */
   return TRUE;
 
   /* OK */
 was_prepared:
   {
+    g_mutex_unlock (&media->lock);
+    prepare_callback_invoke (cb, media, TRUE);
+    return TRUE;
+  }
+is_preparing:
+  {
+    GST_INFO ("media %p is being prepared, queueing callback", media);
+    media->prepare_pending = g_list_prepend (media->prepare_pending, cb);
+    g_mutex_unlock (&media->lock);
+    return TRUE;
+  }
+is_unpreparing:
+  {
+    /* the reaper prepares again when the pipeline is shut down */
+    GST_INFO ("media %p is being unprepared, delaying prepare", media);
+    media->prepare_pending = g_list_prepend (media->prepare_pending, cb);
+    g_mutex_unlock (&media->lock);
     return TRUE;
   }
   /* ERRORS */
+is_error:
+  {
+    g_mutex_unlock (&media->lock);
+    GST_WARNING ("media %p is in error", media);
+    prepare_callback_invoke (cb, media, FALSE);
+    return FALSE;
+  }
 is_reused:
   {
+    g_mutex_unlock (&media->lock);
     GST_WARNING ("can not reuse media %p", media);
+    prepare_callback_invoke (cb, media, FALSE);
     return FALSE;
   }
 no_rtpbin:
   {
     GST_WARNING ("no rtpbin element");
     g_warning ("failed to create element 'rtpbin', check your installation");
+    gst_rtsp_media_set_status (media, GST_RTSP_MEDIA_STATUS_UNPREPARED);
     return FALSE;
   }
 state_failed:
   {
-    GST_WARNING ("failed to preroll pipeline");
-    unlock_streams (media);
-    gst_element_set_state (media->pipeline, GST_STATE_NULL);
-    gst_rtsp_media_unprepare (media);
+    gst_rtsp_media_set_status (media, GST_RTSP_MEDIA_STATUS_ERROR);
     return FALSE;
   }
 }
 
+typedef struct
+{
+  gboolean done;
+  gboolean prepared;
+} PrepareWait;
+
+static void
+prepare_wait_done (GstRTSPMedia * media, gboolean prepared, PrepareWait * wait)
+{
+  g_mutex_lock (&media->lock);
+  wait->prepared = prepared;
+  wait->done = TRUE;
+  g_cond_broadcast (&media->cond);
+  g_mutex_unlock (&media->lock);
+}
+
+/**
+ * gst_rtsp_media_prepare:
+ * @media: a #GstRTSPMedia
+ *
+ * Prepare @media for streaming. This function will create the pipeline and
+ * other objects to manage the streaming.
+ *
+ * It will preroll the pipeline and collect vital information about the streams
+ * such as the duration. This function blocks until the pipeline prerolled,
+ * use gst_rtsp_media_prepare_async() to avoid blocking. It must not be called
+ * from a #GstRTSPMedia signal handler.
+ *
+ * Returns: %TRUE on success.
+ */
+gboolean
+gst_rtsp_media_prepare (GstRTSPMedia * media)
+{
+  PrepareWait wait = { FALSE, FALSE };
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+
+  gst_rtsp_media_prepare_async (media,
+      (GstRTSPMediaPrepareFunc) prepare_wait_done, &wait, NULL);
+
+  g_mutex_lock (&media->lock);
+  while (!wait.done)
+    g_cond_wait (&media->cond, &media->lock);
+  g_mutex_unlock (&media->lock);
+
+  return wait.prepared;
+}
+
+/**
+ * gst_rtsp_media_is_prepared:
+ * @media: a #GstRTSPMedia
+ *
+ * Check if @media is prepared and ready for streaming.
+ *
+ * Returns: %TRUE if @media is prepared.
+ */
+gboolean
+gst_rtsp_media_is_prepared (GstRTSPMedia * media)
+{
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+
+  g_mutex_lock (&media->lock);
+  res = media->status == GST_RTSP_MEDIA_STATUS_PREPARED;
+  g_mutex_unlock (&media->lock);
+
+  return res;
+}
+
 /**
  * gst_rtsp_media_unprepare:
  * @media: a #GstRTSPMedia
@@ -1824,34 +3414,97 @@ state_failed:
  * it can be used again. If the media is set to be non-reusable, a new instance
  * must be created.
  *
+ * The pipeline of @media is shut down asynchronously from a reaper thread, the
+ * "unprepared" signal is emitted before this function returns. Preparing
+ * @media again is delayed until the pipeline is shut down.
+ *
  * Returns: %TRUE on success.
  */
 gboolean
 gst_rtsp_media_unprepare (GstRTSPMedia * media)
 {
   GstRTSPMediaClass *klass;
-  gboolean success;
 
-  if (media->status == GST_RTSP_MEDIA_STATUS_UNPREPARED)
-    return TRUE;
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+
+  g_mutex_lock (&media->lock);
+  if (media->status == GST_RTSP_MEDIA_STATUS_UNPREPARED ||
+      media->status == GST_RTSP_MEDIA_STATUS_UNPREPARING)
+    goto was_unprepared;
 
   GST_INFO ("unprepare media %p", media);
+  media->status = GST_RTSP_MEDIA_STATUS_UNPREPARING;
   media->target_state = GST_STATE_NULL;
+  invalidate_sdp_cache (media);
+  media->reused = TRUE;
+  g_mutex_unlock (&media->lock);
 
-  klass = GST_RTSP_MEDIA_GET_CLASS (media);
-  if (klass->unprepare)
-    success = klass->unprepare (media);
-  else
-    success = TRUE;
+  /* the pipeline will not preroll again for pending seeks */
+  seek_finished (media, FALSE);
 
-  media->status = GST_RTSP_MEDIA_STATUS_UNPREPARED;
-  media->reused = TRUE;
+  /* the reaper keeps a ref to the media until the pipeline is shut down */
+  klass = GST_RTSP_MEDIA_GET_CLASS (media);
+  g_thread_pool_push (klass->reaper, g_object_ref (media), NULL);
 
   /* when the media is not reusable, this will effectively unref the media and
    * recreate it */
   g_signal_emit (media, gst_rtsp_media_signals[SIGNAL_UNPREPARED], 0, NULL);
 
-  return success;
+  return TRUE;
+
+  /* OK */
+was_unprepared:
+  {
+    g_mutex_unlock (&media->lock);
+    return TRUE;
+  }
+}
+
+/* called from a reaper thread with a ref to @media */
+static void
+do_reap (GstRTSPMedia * media, gpointer user_data)
+{
+  GstRTSPMediaClass *klass;
+  gboolean unprepare, remove;
+  GList *pending = NULL, *walk;
+
+  klass = GST_RTSP_MEDIA_GET_CLASS (media);
+
+  g_mutex_lock (&media->lock);
+  unprepare = media->status == GST_RTSP_MEDIA_STATUS_UNPREPARING;
+  g_mutex_unlock (&media->lock);
+
+  if (unprepare) {
+    GST_INFO ("shutting down media %p", media);
+    if (klass->unprepare)
+      klass->unprepare (media);
+  }
+
+  g_mutex_lock (&media->lock);
+  if (unprepare) {
+    media->status = GST_RTSP_MEDIA_STATUS_UNPREPARED;
+    /* prepares that were requested while we were shutting down */
+    pending = g_list_reverse (media->prepare_pending);
+    media->prepare_pending = NULL;
+  }
+  remove = media->remove_pending;
+  media->remove_pending = FALSE;
+  g_cond_broadcast (&media->cond);
+  g_mutex_unlock (&media->lock);
+
+  if (remove)
+    remove_elements (media);
+
+  for (walk = pending; walk; walk = g_list_next (walk)) {
+    PrepareCallback *cb = walk->data;
+
+    gst_rtsp_media_prepare_async (media, cb->func, cb->user_data, cb->notify);
+    g_slice_free (PrepareCallback, cb);
+  }
+  g_list_free (pending);
+
+  GST_INFO ("media %p reaped", media);
+  g_object_unref (media);
 }
 
 static gboolean
@@ -1877,18 +3530,42 @@ static void
 add_udp_destination (GstRTSPMedia * media, GstRTSPMediaStream * stream,
     gchar * dest, gint min, gint max)
 {
+  if (stream->udpsink[0] == NULL) {
+    GST_WARNING ("stream has no UDP transport");
+    return;
+  }
+
   GST_INFO ("adding %s:%d-%d", dest, min, max);
-  g_signal_emit_by_name (stream->udpsink[0], "add", dest, min, NULL);
-  g_signal_emit_by_name (stream->udpsink[1], "add", dest, max, NULL);
+  gst_rtsp_udp_sink_add (GST_RTSP_UDP_SINK_CAST (stream->udpsink[0]), dest,
+      min);
+  gst_rtsp_udp_sink_add (GST_RTSP_UDP_SINK_CAST (stream->udpsink[1]), dest,
+      max);
 }
 
 static void
 remove_udp_destination (GstRTSPMedia * media, GstRTSPMediaStream * stream,
     gchar * dest, gint min, gint max)
 {
+  if (stream->udpsink[0] == NULL) {
+    GST_WARNING ("stream has no UDP transport");
+    return;
+  }
+
   GST_INFO ("removing %s:%d-%d", dest, min, max);
-  g_signal_emit_by_name (stream->udpsink[0], "remove", dest, min, NULL);
-  g_signal_emit_by_name (stream->udpsink[1], "remove", dest, max, NULL);
+  gst_rtsp_udp_sink_remove (GST_RTSP_UDP_SINK_CAST (stream->udpsink[0]), dest,
+      min);
+  gst_rtsp_udp_sink_remove (GST_RTSP_UDP_SINK_CAST (stream->udpsink[1]), dest,
+      max);
+}
+
+/* mark @tr active and remember it for the next snapshot of its stream */
+static void
+add_transport (GPtrArray ** added, GstRTSPMediaTrans * tr)
+{
+  if (*added == NULL)
+    *added = g_ptr_array_new ();
+  g_ptr_array_add (*added, tr);
+  tr->active = TRUE;
 }
 
 /**
@@ -1908,6 +3585,9 @@ gst_rtsp_media_set_state (GstRTSPMedia * media, GstState state,
   gint i;
   gboolean add, remove, do_state;
   gint old_active;
+  guint n_streams;
+  gboolean *changed;
+  GPtrArray **added;
 
   g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
   g_return_val_if_fail (transports != NULL, FALSE);
@@ -1940,6 +3620,13 @@ gst_rtsp_media_set_state (GstRTSPMedia * media, GstState state,
   }
   old_active = media->active;
 
+  /* collect the changes per stream and publish each stream's transports once */
+  n_streams = media->streams->len;
+  changed = g_newa (gboolean, n_streams);
+  memset (changed, 0, n_streams * sizeof (gboolean));
+  added = g_newa (GPtrArray *, n_streams);
+  memset (added, 0, n_streams * sizeof (GPtrArray *));
+
   for (i = 0; i < transports->len; i++) {
     GstRTSPMediaTrans *tr;
     GstRTSPMediaStream *stream;
@@ -1954,8 +3641,17 @@ gst_rtsp_media_set_state (GstRTSPMedia * media, GstState state,
     if (!(trans = tr->transport))
       continue;
 
+    /* the changes are collected for the streams that were there when we
+     * started */
+    if (tr->idx >= n_streams) {
+      GST_WARNING ("transport for unknown stream %u", tr->idx);
+      continue;
+    }
+
     /* get the stream and add the destinations */
-    stream = gst_rtsp_media_get_stream (media, tr->idx);
+    if (!(stream = gst_rtsp_media_get_stream (media, tr->idx)))
+      continue;
+
     switch (trans->lower_transport) {
       case GST_RTSP_LOWER_TRANS_UDP:
       case GST_RTSP_LOWER_TRANS_UDP_MCAST:
@@ -1974,13 +3670,13 @@ gst_rtsp_media_set_state (GstRTSPMedia * media, GstState state,
 
         if (add && !tr->active) {
           add_udp_destination (media, stream, dest, min, max);
-          stream->transports = g_list_prepend (stream->transports, tr);
-          tr->active = TRUE;
+          add_transport (&added[tr->idx], tr);
+          changed[tr->idx] = TRUE;
           media->active++;
         } else if (remove && tr->active) {
           remove_udp_destination (media, stream, dest, min, max);
-          stream->transports = g_list_remove (stream->transports, tr);
           tr->active = FALSE;
+          changed[tr->idx] = TRUE;
           media->active--;
         }
         break;
@@ -1988,13 +3684,13 @@ gst_rtsp_media_set_state (GstRTSPMedia * media, GstState state,
       case GST_RTSP_LOWER_TRANS_TCP:
         if (add && !tr->active) {
           GST_INFO ("adding TCP %s", trans->destination);
-          stream->transports = g_list_prepend (stream->transports, tr);
-          tr->active = TRUE;
+          add_transport (&added[tr->idx], tr);
+          changed[tr->idx] = TRUE;
           media->active++;
         } else if (remove && tr->active) {
           GST_INFO ("removing TCP %s", trans->destination);
-          stream->transports = g_list_remove (stream->transports, tr);
           tr->active = FALSE;
+          changed[tr->idx] = TRUE;
           media->active--;
         }
         break;
@@ -2004,6 +3700,15 @@ gst_rtsp_media_set_state (GstRTSPMedia * media, GstState state,
     }
   }
 
+  for (i = 0; i < n_streams; i++) {
+    if (!changed[i])
+      continue;
+
+    update_transports (gst_rtsp_media_get_stream (media, i), added[i]);
+    if (added[i])
+      g_ptr_array_free (added[i], TRUE);
+  }
+
   /* we just added the first media, do the playing state change */
   if (old_active == 0 && add)
     do_state = TRUE;
@@ -2039,14 +3744,8 @@ gst_rtsp_media_set_state (GstRTSPMedia * media, GstState state,
   return TRUE;
 }
 
-/**
- * gst_rtsp_media_remove_elements:
- * @media: a #GstRTSPMedia
- *
- * Remove all elements and the pipeline controlled by @media.
- */
-void
-gst_rtsp_media_remove_elements (GstRTSPMedia * media)
+static void
+remove_elements (GstRTSPMedia * media)
 {
   gint i, j;
 
@@ -2063,20 +3762,23 @@ gst_rtsp_media_remove_elements (GstRTSPMedia * media)
 
     g_signal_handler_disconnect (stream->send_rtp_sink, stream->caps_sig);
 
+    g_mutex_lock (&media->branch_lock);
+    if (stream->n_udp > 0)
+      remove_udp_branch (media, stream);
+    if (stream->n_tcp > 0)
+      remove_tcp_branch (media, stream);
+    stream->n_udp = 0;
+    stream->n_tcp = 0;
+    /* the transports of the sessions release nothing anymore */
+    media->branch_generation++;
+    g_mutex_unlock (&media->branch_lock);
+
     for (j = 0; j < 2; j++) {
-      gst_element_set_state (stream->udpsrc[j], GST_STATE_NULL);
-      gst_element_set_state (stream->udpsink[j], GST_STATE_NULL);
-      gst_element_set_state (stream->appsrc[j], GST_STATE_NULL);
-      gst_element_set_state (stream->appsink[j], GST_STATE_NULL);
-      gst_element_set_state (stream->appqueue[j], GST_STATE_NULL);
+      gst_element_set_state (stream->fakesink[j], GST_STATE_NULL);
       gst_element_set_state (stream->tee[j], GST_STATE_NULL);
       gst_element_set_state (stream->selector[j], GST_STATE_NULL);
 
-      gst_bin_remove (GST_BIN (media->pipeline), stream->udpsrc[j]);
-      gst_bin_remove (GST_BIN (media->pipeline), stream->udpsink[j]);
-      gst_bin_remove (GST_BIN (media->pipeline), stream->appsrc[j]);
-      gst_bin_remove (GST_BIN (media->pipeline), stream->appsink[j]);
-      gst_bin_remove (GST_BIN (media->pipeline), stream->appqueue[j]);
+      gst_bin_remove (GST_BIN (media->pipeline), stream->fakesink[j]);
       gst_bin_remove (GST_BIN (media->pipeline), stream->tee[j]);
       gst_bin_remove (GST_BIN (media->pipeline), stream->selector[j]);
     }
@@ -2094,6 +3796,35 @@ gst_rtsp_media_remove_elements (GstRTSPMedia * media)
   media->pipeline = NULL;
 }
 
+/**
+ * gst_rtsp_media_remove_elements:
+ * @media: a #GstRTSPMedia
+ *
+ * Remove all elements and the pipeline controlled by @media. The elements are
+ * removed asynchronously from a reaper thread, after the pipeline is shut
+ * down when @media is being unprepared.
+ */
+void
+gst_rtsp_media_remove_elements (GstRTSPMedia * media)
+{
+  GstRTSPMediaClass *klass;
+  gboolean schedule;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  g_mutex_lock (&media->lock);
+  /* when unpreparing, the reaper removes the elements after the shutdown */
+  schedule = !media->remove_pending &&
+      media->status != GST_RTSP_MEDIA_STATUS_UNPREPARING;
+  media->remove_pending = TRUE;
+  g_mutex_unlock (&media->lock);
+
+  if (schedule) {
+    klass = GST_RTSP_MEDIA_GET_CLASS (media);
+    g_thread_pool_push (klass->reaper, g_object_ref (media), NULL);
+  }
+}
+
 static void
 default_handle_mtu (GstRTSPMedia * media, guint mtu)
 {
@@ -37,20 +37,45 @@ G_BEGIN_DECLS
 #define GST_RTSP_MEDIA_CLASS_CAST(klass) ((GstRTSPMediaClass*)(klass))
 
 typedef struct _GstRTSPMediaStream GstRTSPMediaStream;
+typedef struct _GstRTSPTransportSnapshot GstRTSPTransportSnapshot;
+typedef struct _GstRTSPTCPFanout GstRTSPTCPFanout;
 typedef struct _GstRTSPMedia GstRTSPMedia;
 typedef struct _GstRTSPMediaClass GstRTSPMediaClass;
 typedef struct _GstRTSPMediaTrans GstRTSPMediaTrans;
 
 typedef gboolean (*GstRTSPSendFunc)      (GstBuffer *buffer, guint8 channel, gpointer user_data);
+typedef gboolean (*GstRTSPSendListFunc)  (GstBufferList *blist, guint8 channel, gpointer user_data);
 typedef void     (*GstRTSPKeepAliveFunc) (gpointer user_data);
 
+/**
+ * GstRTSPMediaPrepareFunc:
+ * @media: a #GstRTSPMedia
+ * @prepared: %TRUE when @media was prepared successfully
+ * @user_data: user data passed to gst_rtsp_media_prepare_async()
+ *
+ * Called when preparing @media has completed, either successfully or with an
+ * error.
+ */
+typedef void     (*GstRTSPMediaPrepareFunc) (GstRTSPMedia *media, gboolean prepared,
+                                             gpointer user_data);
+
+/**
+ * GstRTSPMediaSeekFunc:
+ * @media: a #GstRTSPMedia
+ * @seeked: %TRUE when @media was seeked and prerolled again
+ * @user_data: user data passed to gst_rtsp_media_seek_async()
+ *
+ * Called when seeking @media has completed, either successfully, with an error
+ * or after a timeout.
+ */
+typedef void     (*GstRTSPMediaSeekFunc) (GstRTSPMedia *media, gboolean seeked,
+                                          gpointer user_data);
+
 /**
  * GstRTSPMediaTrans:
  * @idx: a stream index
  * @send_rtp: callback for sending RTP messages
  * @send_rtcp: callback for sending RTCP messages
- * @send_rtp_list: callback for sending RTP messages
- * @send_rtcp_list: callback for sending RTCP messages
  * @user_data: user data passed in the callbacks
  * @notify: free function for the user_data.
  * @keep_alive: keep alive callback
@@ -60,6 +85,10 @@ typedef void     (*GstRTSPKeepAliveFunc) (gpointer user_data);
  * @timeout: if we timed out
  * @transport: a transport description
  * @rtpsource: the receiver rtp source object
+ * @send_rtp_list: callback for sending a list of RTP messages
+ * @send_rtcp_list: callback for sending a list of RTCP messages
+ * @branch_generation: the generation of the stream elements acquired for
+ *     @transport
  *
  * A Transport description for stream @idx
  */
@@ -80,9 +109,15 @@ struct _GstRTSPMediaTrans {
   GstRTSPTransport    *transport;
 
   GObject             *rtpsource;
+
+  GstRTSPSendListFunc  send_rtp_list;
+  GstRTSPSendListFunc  send_rtcp_list;
+
+  guint                branch_generation;
 };
 
 #include "rtsp-auth.h"
+#include "rtsp-port-pool.h"
 
 /**
  * GstRTSPMediaStream:
@@ -93,16 +128,32 @@ struct _GstRTSPMediaTrans {
  * @recv_rtcp_sink: sinkpad for RTCP buffers
  * @send_rtp_src: srcpad for RTP buffers
  * @send_rtcp_src: srcpad for RTCP buffers
- * @udpsrc: the udp source elements for RTP/RTCP
- * @udpsink: the udp sink elements for RTP/RTCP
- * @appsrc: the app source elements for RTP/RTCP
- * @appsink: the app sink elements for RTP/RTCP
+ * @udpsrc: the udp source elements for RTP/RTCP, %NULL without UDP transports
+ * @udpsink: the udp sink elements for RTP/RTCP, %NULL without UDP transports
+ * @appsrc: the app source elements for RTP/RTCP, %NULL without TCP transports
+ * @appsink: the sinks passing RTP/RTCP to the TCP transports, %NULL without
+ *    TCP transports
+ * @fakesink: the sinks keeping the stream linked and prerolled
+ * @n_udp: the number of UDP transports using @udpsrc and @udpsink
+ * @n_tcp: the number of TCP transports using @appsrc and @appsink
  * @server_port: the server ports for this stream
+ * @port_pool: the pool @server_port was acquired from or %NULL
+ * @socket: the sockets of @server_port when acquired from @port_pool
  * @caps_sig: the signal id for detecting caps
  * @caps: the caps of the stream
- * @tranports: the current transports being streamed
+ * @transports_lock: protects publishing @transports
+ * @transports: the current transports being streamed, an immutable snapshot
+ *   that is replaced when transports are added or removed
+ * @transports_cond: signaled when the last reader of a replaced @transports is
+ *   done
+ * @tcp_fanout: the TCP send threads of the media or %NULL to send to the TCP
+ *   transports from the streaming thread
+ * @media: the media of the stream, set when the stream is prepared
  *
  * The definition of a media stream. The streams are identified by @id.
+ *
+ * The elements for the UDP and TCP lower transports are only made while a
+ * transport of that kind is acquired with gst_rtsp_media_acquire_transport().
  */
 struct _GstRTSPMediaStream {
   GstPad       *srcpad;
@@ -130,16 +181,33 @@ struct _GstRTSPMediaStream {
 
   GstElement   *tee[2];
   GstElement   *selector[2];
+  GstElement   *fakesink[2];
+
+  /* request pads of the transport branches on the tee and selector */
+  GstPad       *udp_teepad[2];
+  GstPad       *udp_selpad[2];
+  GstPad       *tcp_teepad[2];
+  GstPad       *tcp_selpad[2];
+  guint         n_udp;
+  guint         n_tcp;
 
   /* server ports for sending/receiving */
   GstRTSPRange  server_port;
+  GstRTSPPortPool *port_pool;
+  GSocket      *socket[2];
 
   /* the caps of the stream */
   gulong        caps_sig;
   GstCaps      *caps;
 
   /* transports we stream to */
-  GList        *transports;
+  GMutex        transports_lock;
+  GstRTSPTransportSnapshot *transports;
+  GCond         transports_cond;
+
+  GstRTSPTCPFanout *tcp_fanout;
+
+  GstRTSPMedia *media;
 };
 
 /**
@@ -148,6 +216,7 @@ struct _GstRTSPMediaStream {
  * @GST_RTSP_MEDIA_STATUS_PREPARING: media pipeline is prerolling
  * @GST_RTSP_MEDIA_STATUS_PREPARED: media pipeline is prerolled
  * @GST_RTSP_MEDIA_STATUS_ERROR: media pipeline is in error
+ * @GST_RTSP_MEDIA_STATUS_UNPREPARING: media pipeline is being shut down
  *
  * The state of the media pipeline.
  */
@@ -155,18 +224,27 @@ typedef enum {
   GST_RTSP_MEDIA_STATUS_UNPREPARED = 0,
   GST_RTSP_MEDIA_STATUS_PREPARING  = 1,
   GST_RTSP_MEDIA_STATUS_PREPARED   = 2,
-  GST_RTSP_MEDIA_STATUS_ERROR      = 3
+  GST_RTSP_MEDIA_STATUS_ERROR      = 3,
+  GST_RTSP_MEDIA_STATUS_UNPREPARING = 4
 } GstRTSPMediaStatus;
 
 /**
  * GstRTSPMedia:
  * @lock: for protecting the object
  * @cond: for signaling the object
+ * @branch_lock: for adding and removing the transport elements of the streams
+ * @branch_generation: changes when the transport elements of all streams are
+ *     removed
  * @shared: if this media can be shared between clients
  * @reusable: if this media can be reused after an unprepare
  * @protocols: the allowed lower transport for this stream
  * @reused: if this media has been reused
  * @is_ipv6: if this media is using ipv6
+ * @udp_send_threads: the number of threads sending RTP to UDP destinations
+ * @tcp_send_threads: the number of threads sending to TCP transports
+ * @tcp_fanout: the TCP send threads, made with the first TCP transport
+ * @udp_receiver: if the UDP sockets are polled by the shared receiver
+ * @port_pool: the pool for allocating the server ports or %NULL
  * @element: the data providing element
  * @streams: the different streams provided by @element
  * @dynamic: list of dynamic elements managed by @element
@@ -174,14 +252,24 @@ typedef enum {
  * @active: the number of active connections
  * @pipeline: the toplevel pipeline
  * @fakesink: for making state changes async
+ * @context: the context dispatching the pipeline messages
  * @source: the bus watch for pipeline messages.
  * @id: the id of the watch
  * @is_live: if the pipeline is live
  * @seekable: if the pipeline can perform a seek
  * @buffering: if the pipeline is buffering
  * @target_state: the desired target state of the pipeline
+ * @prepare_pending: callbacks waiting for the media to be prepared
+ * @prepare_timeout: the timeout for preparing the media
+ * @seek_pending: callbacks waiting for the media to preroll after a seek
+ * @seek_timeout: the timeout for completing the pending seeks
+ * @seek_seqnum: the seqnum of the last seek, its ASYNC_DONE completes the
+ *     pending seeks
+ * @remove_pending: the elements should be removed by the reaper
  * @rtpbin: the rtpbin
  * @range: the range of the media being streamed
+ * @sdp_cache: the cached SDP of the media or %NULL
+ * @sdp_cookie: changes when @sdp_cache is invalidated
  *
  * A class that contains the GStreamer element along with a list of
  * #GstRTSPMediaStream objects that can produce data.
@@ -193,6 +281,8 @@ struct _GstRTSPMedia {
 
   GMutex             lock;
   GCond              cond;
+  GMutex             branch_lock;
+  guint              branch_generation;
 
   gboolean           shared;
   gboolean           reusable;
@@ -201,8 +291,13 @@ struct _GstRTSPMedia {
   gboolean           is_ipv6;
   gboolean           eos_shutdown;
   guint              buffer_size;
+  guint              udp_send_threads;
+  guint              tcp_send_threads;
+  GstRTSPTCPFanout  *tcp_fanout;
+  gboolean           udp_receiver;
   GstRTSPAuth       *auth;
   gchar             *multicast_group;
+  GstRTSPPortPool   *port_pool;
 
   GstElement        *element;
   GArray            *streams;
@@ -215,6 +310,7 @@ struct _GstRTSPMedia {
   /* the pipeline for the media */
   GstElement        *pipeline;
   GstElement        *fakesink;
+  GMainContext      *context;
   GSource           *source;
   guint              id;
 
@@ -223,18 +319,39 @@ struct _GstRTSPMedia {
   gboolean           buffering;
   GstState           target_state;
 
+  /* pending prepare callbacks */
+  GList             *prepare_pending;
+  GSource           *prepare_timeout;
+  gboolean           remove_pending;
+
+  /* pending seek callbacks */
+  GList             *seek_pending;
+  GSource           *seek_timeout;
+  guint32            seek_seqnum;
+
   /* RTP session manager */
   GstElement        *rtpbin;
 
   /* the range of media */
   GstRTSPTimeRange   range;
+
+  /* cached SDP */
+  GBytes            *sdp_cache;
+  guint              sdp_cookie;
 };
 
 /**
  * GstRTSPMediaClass:
- * @context: the main context for dispatching messages
+ * @context: the main context for dispatching messages, %NULL until the first
+ *     bus thread is started
  * @loop: the mainloop for message.
  * @thread: the thread dispatching messages.
+ * @n_bus_threads: the maximum number of threads dispatching messages
+ * @bus_contexts: the main contexts for dispatching messages, the media are
+ *     spread over these. The contexts are made when a media needs them.
+ * @bus_loops: the mainloops of @bus_contexts
+ * @bus_threads: the threads running @bus_loops
+ * @reaper: the threads shutting down pipelines
  * @handle_message: handle a message
  * @unprepare: the default implementation sets the pipeline's state
  *             to GST_STATE_NULL.
@@ -250,6 +367,14 @@ struct _GstRTSPMediaClass {
   GMainLoop    *loop;
   GThread      *thread;
 
+  guint          n_bus_threads;
+  GMainContext **bus_contexts;
+  GMainLoop    **bus_loops;
+  GThread      **bus_threads;
+
+  /* threads for unpreparing */
+  GThreadPool  *reaper;
+
   /* vmethods */
   gboolean     (*handle_message)  (GstRTSPMedia *media, GstMessage *message);
   gboolean     (*unprepare)       (GstRTSPMedia *media);
@@ -264,6 +389,8 @@ struct _GstRTSPMediaClass {
 
 GType                 gst_rtsp_media_get_type         (void);
 
+void                  gst_rtsp_media_class_set_bus_threads (GstRTSPMediaClass *klass, guint threads);
+
 /* creating the media */
 GstRTSPMedia *        gst_rtsp_media_new              (void);
 
@@ -282,15 +409,35 @@ gboolean              gst_rtsp_media_is_eos_shutdown  (GstRTSPMedia *media);
 void                  gst_rtsp_media_set_auth         (GstRTSPMedia *media, GstRTSPAuth *auth);
 GstRTSPAuth *         gst_rtsp_media_get_auth         (GstRTSPMedia *media);
 
+void                  gst_rtsp_media_set_port_pool    (GstRTSPMedia *media, GstRTSPPortPool *pool);
+GstRTSPPortPool *     gst_rtsp_media_get_port_pool    (GstRTSPMedia *media);
+
 void                  gst_rtsp_media_set_buffer_size  (GstRTSPMedia *media, guint size);
 guint                 gst_rtsp_media_get_buffer_size  (GstRTSPMedia *media);
 
+void                  gst_rtsp_media_set_udp_send_threads (GstRTSPMedia *media, guint threads);
+guint                 gst_rtsp_media_get_udp_send_threads (GstRTSPMedia *media);
+
+void                  gst_rtsp_media_set_tcp_send_threads (GstRTSPMedia *media, guint threads);
+guint                 gst_rtsp_media_get_tcp_send_threads (GstRTSPMedia *media);
+
+void                  gst_rtsp_media_set_udp_receiver (GstRTSPMedia *media, gboolean use_receiver);
+gboolean              gst_rtsp_media_get_udp_receiver (GstRTSPMedia *media);
+
 void                  gst_rtsp_media_set_multicast_group (GstRTSPMedia *media, const gchar * mc);
 gchar *               gst_rtsp_media_get_multicast_group (GstRTSPMedia *media);
 
+GBytes *              gst_rtsp_media_get_sdp_cache    (GstRTSPMedia *media, guint *cookie);
+gboolean              gst_rtsp_media_set_sdp_cache    (GstRTSPMedia *media, GBytes *sdp,
+                                                       guint cookie);
+
 
 /* prepare the media for playback */
 gboolean              gst_rtsp_media_prepare          (GstRTSPMedia *media);
+gboolean              gst_rtsp_media_prepare_async    (GstRTSPMedia *media,
+                                                       GstRTSPMediaPrepareFunc func,
+                                                       gpointer user_data,
+                                                       GDestroyNotify notify);
 gboolean              gst_rtsp_media_is_prepared      (GstRTSPMedia *media);
 gboolean              gst_rtsp_media_unprepare        (GstRTSPMedia *media);
 
@@ -298,7 +445,17 @@ gboolean              gst_rtsp_media_unprepare        (GstRTSPMedia *media);
 guint                 gst_rtsp_media_n_streams        (GstRTSPMedia *media);
 GstRTSPMediaStream *  gst_rtsp_media_get_stream       (GstRTSPMedia *media, guint idx);
 
+gboolean              gst_rtsp_media_acquire_transport (GstRTSPMedia *media, guint idx,
+                                                        GstRTSPLowerTrans lower,
+                                                        guint *generation);
+void                  gst_rtsp_media_release_transport (GstRTSPMedia *media, guint idx,
+                                                        GstRTSPLowerTrans lower,
+                                                        guint generation);
+
 gboolean              gst_rtsp_media_seek             (GstRTSPMedia *media, GstRTSPTimeRange *range);
+gboolean              gst_rtsp_media_seek_async       (GstRTSPMedia *media, GstRTSPTimeRange *range,
+                                                       GstRTSPMediaSeekFunc func, gpointer user_data,
+                                                       GDestroyNotify notify);
 gchar *               gst_rtsp_media_get_range_string (GstRTSPMedia *media, gboolean play);
 
 GstFlowReturn         gst_rtsp_media_stream_rtp       (GstRTSPMediaStream *stream, GstBuffer *buffer);
@@ -0,0 +1,626 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent at local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "rtsp-port-pool.h"
+
+#define DEFAULT_MIN_PORT        16384
+#define DEFAULT_MAX_PORT        32767
+#define DEFAULT_WARM_PAIRS      4
+
+enum
+{
+  PROP_0,
+  PROP_MIN_PORT,
+  PROP_MAX_PORT,
+  PROP_WARM_PAIRS,
+  PROP_LAST
+};
+
+GST_DEBUG_CATEGORY_STATIC (rtsp_port_pool_debug);
+#define GST_CAT_DEFAULT rtsp_port_pool_debug
+
+#define FAMILY_INDEX(f)   ((f) == G_SOCKET_FAMILY_IPV6 ? 1 : 0)
+#define INDEX_FAMILY(i)   ((i) ? G_SOCKET_FAMILY_IPV6 : G_SOCKET_FAMILY_IPV4)
+
+/* a bound RTP/RTCP pair */
+typedef struct
+{
+  guint port;
+  guint generation;
+  GSocket *socket[2];
+} PortPair;
+
+/* the acquired pairs of an RTP port. The sockets of a pair from a previous
+ * range can be closed before it is released, the port can then be acquired
+ * again in the new range. */
+typedef struct
+{
+  guint generation;
+  guint count;
+} AcquiredPair;
+
+static void
+acquired_pair_free (AcquiredPair * acquired)
+{
+  g_slice_free (AcquiredPair, acquired);
+}
+
+static void gst_rtsp_port_pool_get_property (GObject * object, guint propid,
+    GValue * value, GParamSpec * pspec);
+static void gst_rtsp_port_pool_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec);
+static void gst_rtsp_port_pool_finalize (GObject * object);
+
+static void do_refill (GstRTSPPortPool * pool, gpointer user_data);
+
+G_DEFINE_TYPE (GstRTSPPortPool, gst_rtsp_port_pool, G_TYPE_OBJECT);
+
+static void
+gst_rtsp_port_pool_class_init (GstRTSPPortPoolClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->get_property = gst_rtsp_port_pool_get_property;
+  gobject_class->set_property = gst_rtsp_port_pool_set_property;
+  gobject_class->finalize = gst_rtsp_port_pool_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_MIN_PORT,
+      g_param_spec_uint ("min-port", "Min Port",
+          "The first UDP port of the range", 0, 65535, DEFAULT_MIN_PORT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_PORT,
+      g_param_spec_uint ("max-port", "Max Port",
+          "The last UDP port of the range", 0, 65535, DEFAULT_MAX_PORT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_WARM_PAIRS,
+      g_param_spec_uint ("warm-pairs", "Warm Pairs",
+          "The number of bound port pairs to keep ready per address family",
+          0, G_MAXUINT, DEFAULT_WARM_PAIRS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  GST_DEBUG_CATEGORY_INIT (rtsp_port_pool_debug, "rtspportpool", 0,
+      "GstRTSPPortPool");
+}
+
+/* configure the range, called with the lock */
+static void
+set_range (GstRTSPPortPool * pool, guint min_port, guint max_port)
+{
+  /* the RTP port must be even */
+  min_port = (min_port + 1) & ~1;
+
+  pool->min_port = min_port;
+  pool->max_port = max_port;
+  pool->n_pairs = max_port > min_port ? (max_port - min_port + 1) / 2 : 0;
+  g_free (pool->used);
+  pool->used = g_new0 (guint32, (pool->n_pairs + 31) / 32);
+  pool->next = 0;
+  pool->generation++;
+}
+
+static void
+gst_rtsp_port_pool_init (GstRTSPPortPool * pool)
+{
+  g_mutex_init (&pool->lock);
+  pool->warm_pairs = DEFAULT_WARM_PAIRS;
+  set_range (pool, DEFAULT_MIN_PORT, DEFAULT_MAX_PORT);
+  g_queue_init (&pool->warm[0]);
+  g_queue_init (&pool->warm[1]);
+  pool->acquired = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) acquired_pair_free);
+  pool->refill = g_thread_pool_new ((GFunc) do_refill, NULL, 1, FALSE, NULL);
+}
+
+static void
+close_pair (PortPair * pair)
+{
+  gint i;
+
+  for (i = 0; i < 2; i++) {
+    g_socket_close (pair->socket[i], NULL);
+    g_object_unref (pair->socket[i]);
+  }
+  g_slice_free (PortPair, pair);
+}
+
+static void
+gst_rtsp_port_pool_finalize (GObject * object)
+{
+  GstRTSPPortPool *pool = GST_RTSP_PORT_POOL (object);
+  gint i;
+
+  /* the refill thread keeps a ref, there is nothing to wait for */
+  g_thread_pool_free (pool->refill, FALSE, FALSE);
+
+  for (i = 0; i < 2; i++) {
+    g_queue_foreach (&pool->warm[i], (GFunc) close_pair, NULL);
+    g_queue_clear (&pool->warm[i]);
+  }
+  g_hash_table_unref (pool->acquired);
+  g_free (pool->used);
+  g_mutex_clear (&pool->lock);
+
+  G_OBJECT_CLASS (gst_rtsp_port_pool_parent_class)->finalize (object);
+}
+
+static void
+gst_rtsp_port_pool_get_property (GObject * object, guint propid,
+    GValue * value, GParamSpec * pspec)
+{
+  GstRTSPPortPool *pool = GST_RTSP_PORT_POOL (object);
+  guint min_port, max_port;
+
+  switch (propid) {
+    case PROP_MIN_PORT:
+      gst_rtsp_port_pool_get_range (pool, &min_port, &max_port);
+      g_value_set_uint (value, min_port);
+      break;
+    case PROP_MAX_PORT:
+      gst_rtsp_port_pool_get_range (pool, &min_port, &max_port);
+      g_value_set_uint (value, max_port);
+      break;
+    case PROP_WARM_PAIRS:
+      g_value_set_uint (value, gst_rtsp_port_pool_get_warm_pairs (pool));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+      break;
+  }
+}
+
+static void
+gst_rtsp_port_pool_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstRTSPPortPool *pool = GST_RTSP_PORT_POOL (object);
+  guint min_port, max_port;
+
+  switch (propid) {
+    case PROP_MIN_PORT:
+      gst_rtsp_port_pool_get_range (pool, &min_port, &max_port);
+      gst_rtsp_port_pool_set_range (pool, g_value_get_uint (value), max_port);
+      break;
+    case PROP_MAX_PORT:
+      gst_rtsp_port_pool_get_range (pool, &min_port, &max_port);
+      gst_rtsp_port_pool_set_range (pool, min_port, g_value_get_uint (value));
+      break;
+    case PROP_WARM_PAIRS:
+      gst_rtsp_port_pool_set_warm_pairs (pool, g_value_get_uint (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+      break;
+  }
+}
+
+/**
+ * gst_rtsp_port_pool_new:
+ *
+ * Create a new #GstRTSPPortPool instance.
+ *
+ * Returns: A new #GstRTSPPortPool. g_object_unref() after usage.
+ */
+GstRTSPPortPool *
+gst_rtsp_port_pool_new (void)
+{
+  GstRTSPPortPool *result;
+
+  result = g_object_new (GST_TYPE_RTSP_PORT_POOL, NULL);
+
+  return result;
+}
+
+/* start binding warm pairs in the background */
+static void
+schedule_refill (GstRTSPPortPool * pool)
+{
+  gboolean refill;
+
+  g_mutex_lock (&pool->lock);
+  refill = !pool->refilling && pool->warm_pairs > 0;
+  if (refill)
+    pool->refilling = TRUE;
+  g_mutex_unlock (&pool->lock);
+
+  if (refill)
+    g_thread_pool_push (pool->refill, g_object_ref (pool), NULL);
+}
+
+/**
+ * gst_rtsp_port_pool_set_range:
+ * @pool: a #GstRTSPPortPool
+ * @min_port: the first port
+ * @max_port: the last port
+ *
+ * Configure the range of UDP ports that @pool hands out. The RTP ports are the
+ * even ports in the range.
+ *
+ * The range should be configured before @pool is used, the warm pairs are
+ * closed and ports acquired from the previous range are not handed out again.
+ */
+void
+gst_rtsp_port_pool_set_range (GstRTSPPortPool * pool, guint min_port,
+    guint max_port)
+{
+  GQueue warm[2];
+  gint i;
+
+  g_return_if_fail (GST_IS_RTSP_PORT_POOL (pool));
+  g_return_if_fail (min_port <= max_port && max_port <= 65535);
+
+  g_mutex_lock (&pool->lock);
+  for (i = 0; i < 2; i++) {
+    warm[i] = pool->warm[i];
+    g_queue_init (&pool->warm[i]);
+  }
+  set_range (pool, min_port, max_port);
+  g_mutex_unlock (&pool->lock);
+
+  GST_INFO ("pool %p: range %u-%u", pool, min_port, max_port);
+
+  for (i = 0; i < 2; i++) {
+    g_queue_foreach (&warm[i], (GFunc) close_pair, NULL);
+    g_queue_clear (&warm[i]);
+  }
+  schedule_refill (pool);
+}
+
+/**
+ * gst_rtsp_port_pool_get_range:
+ * @pool: a #GstRTSPPortPool
+ * @min_port: (out): the first port
+ * @max_port: (out): the last port
+ *
+ * Get the range of UDP ports that @pool hands out.
+ */
+void
+gst_rtsp_port_pool_get_range (GstRTSPPortPool * pool, guint * min_port,
+    guint * max_port)
+{
+  g_return_if_fail (GST_IS_RTSP_PORT_POOL (pool));
+
+  g_mutex_lock (&pool->lock);
+  if (min_port)
+    *min_port = pool->min_port;
+  if (max_port)
+    *max_port = pool->max_port;
+  g_mutex_unlock (&pool->lock);
+}
+
+/**
+ * gst_rtsp_port_pool_set_warm_pairs:
+ * @pool: a #GstRTSPPortPool
+ * @pairs: the number of pairs
+ *
+ * Configure the number of bound RTP/RTCP pairs that @pool keeps ready for each
+ * address family. IPv4 pairs are bound right away, IPv6 pairs after the first
+ * IPv6 pair was acquired. 0 disables binding pairs in advance.
+ */
+void
+gst_rtsp_port_pool_set_warm_pairs (GstRTSPPortPool * pool, guint pairs)
+{
+  g_return_if_fail (GST_IS_RTSP_PORT_POOL (pool));
+
+  g_mutex_lock (&pool->lock);
+  pool->warm_pairs = pairs;
+  pool->want_warm[0] = TRUE;
+  g_mutex_unlock (&pool->lock);
+
+  schedule_refill (pool);
+}
+
+/**
+ * gst_rtsp_port_pool_get_warm_pairs:
+ * @pool: a #GstRTSPPortPool
+ *
+ * Get the number of bound RTP/RTCP pairs that @pool keeps ready.
+ *
+ * Returns: the number of warm pairs.
+ */
+guint
+gst_rtsp_port_pool_get_warm_pairs (GstRTSPPortPool * pool)
+{
+  guint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_PORT_POOL (pool), 0);
+
+  g_mutex_lock (&pool->lock);
+  result = pool->warm_pairs;
+  g_mutex_unlock (&pool->lock);
+
+  return result;
+}
+
+#define PAIR_USED(pool,i)   ((pool)->used[(i) / 32] & (1u << ((i) % 32)))
+#define PAIR_SET(pool,i)    ((pool)->used[(i) / 32] |= (1u << ((i) % 32)))
+#define PAIR_CLEAR(pool,i)  ((pool)->used[(i) / 32] &= ~(1u << ((i) % 32)))
+
+/* find a free pair starting from the last allocated one and mark it used,
+ * called with the lock. Returns the RTP port or 0 when the range is full. */
+static guint
+take_free_pair (GstRTSPPortPool * pool)
+{
+  guint i, idx;
+
+  for (i = 0; i < pool->n_pairs; i++) {
+    idx = (pool->next + i) % pool->n_pairs;
+
+    /* skip full words quickly */
+    if (idx % 32 == 0 && pool->used[idx / 32] == 0xffffffff &&
+        i + 32 <= pool->n_pairs) {
+      i += 31;
+      continue;
+    }
+    if (!PAIR_USED (pool, idx)) {
+      PAIR_SET (pool, idx);
+      pool->next = idx + 1;
+      return pool->min_port + 2 * idx;
+    }
+  }
+  return 0;
+}
+
+/* mark the pair of @port free again, called with the lock */
+static void
+free_pair (GstRTSPPortPool * pool, guint port, guint generation)
+{
+  guint idx;
+
+  if (generation != pool->generation)
+    return;
+  if (port < pool->min_port || port >= pool->min_port + 2 * pool->n_pairs)
+    return;
+
+  idx = (port - pool->min_port) / 2;
+  PAIR_CLEAR (pool, idx);
+}
+
+static GSocket *
+bind_socket (GSocketFamily family, guint port)
+{
+  GSocket *socket;
+  GInetAddress *any;
+  GSocketAddress *addr;
+  gboolean res;
+
+  socket = g_socket_new (family, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  if (socket == NULL)
+    return NULL;
+
+  any = g_inet_address_new_any (family);
+  addr = g_inet_socket_address_new (any, port);
+  g_object_unref (any);
+
+  res = g_socket_bind (socket, addr, FALSE, NULL);
+  g_object_unref (addr);
+
+  if (!res) {
+    g_object_unref (socket);
+    socket = NULL;
+  }
+  return socket;
+}
+
+/* take a free pair from the range and bind it. Pairs that are in use outside
+ * of the pool are skipped. */
+static PortPair *
+bind_pair (GstRTSPPortPool * pool, GSocketFamily family)
+{
+  PortPair *pair;
+  guint i, n_pairs, port, generation;
+  GSocket *rtp, *rtcp;
+
+  g_mutex_lock (&pool->lock);
+  n_pairs = pool->n_pairs;
+  g_mutex_unlock (&pool->lock);
+
+  for (i = 0; i < n_pairs; i++) {
+    g_mutex_lock (&pool->lock);
+    port = take_free_pair (pool);
+    generation = pool->generation;
+    g_mutex_unlock (&pool->lock);
+
+    if (port == 0)
+      goto range_full;
+
+    rtcp = NULL;
+    if ((rtp = bind_socket (family, port)))
+      rtcp = bind_socket (family, port + 1);
+
+    if (rtp && rtcp)
+      goto done;
+
+    GST_DEBUG ("pool %p: ports %u-%u are in use", pool, port, port + 1);
+    if (rtp) {
+      g_socket_close (rtp, NULL);
+      g_object_unref (rtp);
+    }
+    /* the next search starts after this pair */
+    g_mutex_lock (&pool->lock);
+    free_pair (pool, port, generation);
+    g_mutex_unlock (&pool->lock);
+  }
+range_full:
+  {
+    GST_WARNING ("pool %p: no free port pairs", pool);
+    return NULL;
+  }
+done:
+  {
+    pair = g_slice_new (PortPair);
+    pair->port = port;
+    pair->generation = generation;
+    pair->socket[0] = rtp;
+    pair->socket[1] = rtcp;
+
+    return pair;
+  }
+}
+
+/* called from the refill thread with a ref to @pool */
+static void
+do_refill (GstRTSPPortPool * pool, gpointer user_data)
+{
+  PortPair *pair;
+  gboolean need;
+  gint i;
+
+  for (i = 0; i < 2; i++) {
+    do {
+      g_mutex_lock (&pool->lock);
+      need = pool->want_warm[i] &&
+          g_queue_get_length (&pool->warm[i]) < pool->warm_pairs;
+      g_mutex_unlock (&pool->lock);
+
+      if (!need || !(pair = bind_pair (pool, INDEX_FAMILY (i))))
+        break;
+
+      g_mutex_lock (&pool->lock);
+      /* pairs of a previous range are not kept */
+      if (pair->generation == pool->generation) {
+        g_queue_push_tail (&pool->warm[i], pair);
+        pair = NULL;
+      }
+      g_mutex_unlock (&pool->lock);
+
+      if (pair)
+        close_pair (pair);
+    } while (TRUE);
+  }
+
+  g_mutex_lock (&pool->lock);
+  pool->refilling = FALSE;
+  g_mutex_unlock (&pool->lock);
+
+  g_object_unref (pool);
+}
+
+/**
+ * gst_rtsp_port_pool_acquire:
+ * @pool: a #GstRTSPPortPool
+ * @family: the address family of the sockets
+ * @rtp_port: (out): the RTP port of the pair
+ * @rtp_socket: (out) (transfer full): the bound RTP socket
+ * @rtcp_socket: (out) (transfer full): the bound RTCP socket, bound to
+ *     @rtp_port + 1
+ *
+ * Get a pair of bound UDP sockets from @pool. When the pair is no longer
+ * needed, the sockets should be closed and the pair should be given back to
+ * @pool with gst_rtsp_port_pool_release().
+ *
+ * Returns: %FALSE when no pair is available.
+ */
+gboolean
+gst_rtsp_port_pool_acquire (GstRTSPPortPool * pool, GSocketFamily family,
+    guint * rtp_port, GSocket ** rtp_socket, GSocket ** rtcp_socket)
+{
+  PortPair *pair;
+  AcquiredPair *acquired;
+  gint fam;
+
+  g_return_val_if_fail (GST_IS_RTSP_PORT_POOL (pool), FALSE);
+  g_return_val_if_fail (rtp_port != NULL, FALSE);
+  g_return_val_if_fail (rtp_socket != NULL, FALSE);
+  g_return_val_if_fail (rtcp_socket != NULL, FALSE);
+
+  fam = FAMILY_INDEX (family);
+
+  g_mutex_lock (&pool->lock);
+  pool->want_warm[fam] = TRUE;
+  pair = g_queue_pop_head (&pool->warm[fam]);
+  g_mutex_unlock (&pool->lock);
+
+  /* nothing ready, bind one ourselves */
+  if (pair == NULL)
+    pair = bind_pair (pool, family);
+
+  schedule_refill (pool);
+
+  if (pair == NULL)
+    return FALSE;
+
+  GST_DEBUG ("pool %p: acquired ports %u-%u", pool, pair->port,
+      pair->port + 1);
+
+  /* the pair is only freed again in the range it was taken from */
+  g_mutex_lock (&pool->lock);
+  acquired = g_hash_table_lookup (pool->acquired, GUINT_TO_POINTER (pair->port));
+  if (acquired == NULL) {
+    acquired = g_slice_new0 (AcquiredPair);
+    g_hash_table_insert (pool->acquired, GUINT_TO_POINTER (pair->port),
+        acquired);
+  }
+  acquired->generation = pair->generation;
+  acquired->count++;
+  g_mutex_unlock (&pool->lock);
+
+  *rtp_port = pair->port;
+  *rtp_socket = pair->socket[0];
+  *rtcp_socket = pair->socket[1];
+  g_slice_free (PortPair, pair);
+
+  return TRUE;
+}
+
+/**
+ * gst_rtsp_port_pool_release:
+ * @pool: a #GstRTSPPortPool
+ * @rtp_port: the RTP port of a pair
+ *
+ * Give back the pair of @rtp_port that was acquired with
+ * gst_rtsp_port_pool_acquire(). The sockets of the pair must be closed.
+ */
+void
+gst_rtsp_port_pool_release (GstRTSPPortPool * pool, guint rtp_port)
+{
+  AcquiredPair *acquired;
+
+  g_return_if_fail (GST_IS_RTSP_PORT_POOL (pool));
+
+  GST_DEBUG ("pool %p: released ports %u-%u", pool, rtp_port, rtp_port + 1);
+
+  g_mutex_lock (&pool->lock);
+  acquired = g_hash_table_lookup (pool->acquired, GUINT_TO_POINTER (rtp_port));
+  if (acquired == NULL)
+    goto not_acquired;
+
+  /* the pair is free when the last pair of the port is released, in the range
+   * of the most recent pair */
+  if (--acquired->count == 0) {
+    free_pair (pool, rtp_port, acquired->generation);
+    g_hash_table_remove (pool->acquired, GUINT_TO_POINTER (rtp_port));
+  }
+  g_mutex_unlock (&pool->lock);
+
+  return;
+
+  /* ERRORS */
+not_acquired:
+  {
+    g_mutex_unlock (&pool->lock);
+    GST_WARNING ("pool %p: ports %u-%u were not acquired", pool, rtp_port,
+        rtp_port + 1);
+    return;
+  }
+}
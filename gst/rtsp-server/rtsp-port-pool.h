@@ -0,0 +1,110 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent at local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+
+#ifndef __GST_RTSP_PORT_POOL_H__
+#define __GST_RTSP_PORT_POOL_H__
+
+G_BEGIN_DECLS
+
+typedef struct _GstRTSPPortPool GstRTSPPortPool;
+typedef struct _GstRTSPPortPoolClass GstRTSPPortPoolClass;
+
+#define GST_TYPE_RTSP_PORT_POOL              (gst_rtsp_port_pool_get_type ())
+#define GST_IS_RTSP_PORT_POOL(obj)           (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_RTSP_PORT_POOL))
+#define GST_IS_RTSP_PORT_POOL_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_RTSP_PORT_POOL))
+#define GST_RTSP_PORT_POOL_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_RTSP_PORT_POOL, GstRTSPPortPoolClass))
+#define GST_RTSP_PORT_POOL(obj)              (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_RTSP_PORT_POOL, GstRTSPPortPool))
+#define GST_RTSP_PORT_POOL_CLASS(klass)      (G_TYPE_CHECK_CLASS_CAST ((klass), GST_TYPE_RTSP_PORT_POOL, GstRTSPPortPoolClass))
+#define GST_RTSP_PORT_POOL_CAST(obj)         ((GstRTSPPortPool*)(obj))
+#define GST_RTSP_PORT_POOL_CLASS_CAST(klass) ((GstRTSPPortPoolClass*)(klass))
+
+/**
+ * GstRTSPPortPool:
+ * @lock: lock protecting the pool
+ * @min_port: the first port of the range, always even
+ * @max_port: the last port of the range
+ * @warm_pairs: the number of bound pairs to keep ready per address family
+ * @n_pairs: the number of RTP/RTCP port pairs in the range
+ * @used: bitmap of the pairs in use, including the warm pairs
+ * @next: the pair to try first when allocating
+ * @generation: changes when the range changes
+ * @acquired: the range generation and the number of the acquired pairs of
+ *     each RTP port
+ * @warm: the bound pairs ready to be handed out, for IPv4 and IPv6
+ * @want_warm: if pairs of the address family are kept ready
+ * @refilling: if the warm pairs are being refilled
+ * @refill: the thread binding the warm pairs
+ *
+ * An object that hands out bound RTP/RTCP socket pairs from a range of UDP
+ * ports. The RTP port of a pair is even and the RTCP port is the next port.
+ *
+ * A number of pairs is bound in the background so that acquiring a pair
+ * normally does not need to bind sockets. This object is usually attached to a
+ * #GstRTSPServer to manage the ports of all its media.
+ */
+struct _GstRTSPPortPool {
+  GObject       parent;
+
+  GMutex        lock;
+  guint         min_port;
+  guint         max_port;
+  guint         warm_pairs;
+
+  guint         n_pairs;
+  guint32      *used;
+  guint         next;
+  guint         generation;
+  GHashTable   *acquired;
+
+  GQueue        warm[2];
+  gboolean      want_warm[2];
+  gboolean      refilling;
+  GThreadPool  *refill;
+};
+
+struct _GstRTSPPortPoolClass {
+  GObjectClass  parent_class;
+};
+
+GType                 gst_rtsp_port_pool_get_type          (void);
+
+GstRTSPPortPool *     gst_rtsp_port_pool_new               (void);
+
+void                  gst_rtsp_port_pool_set_range         (GstRTSPPortPool *pool,
+                                                            guint min_port, guint max_port);
+void                  gst_rtsp_port_pool_get_range         (GstRTSPPortPool *pool,
+                                                            guint *min_port, guint *max_port);
+
+void                  gst_rtsp_port_pool_set_warm_pairs    (GstRTSPPortPool *pool, guint pairs);
+guint                 gst_rtsp_port_pool_get_warm_pairs    (GstRTSPPortPool *pool);
+
+gboolean              gst_rtsp_port_pool_acquire           (GstRTSPPortPool *pool,
+                                                            GSocketFamily family,
+                                                            guint *rtp_port,
+                                                            GSocket **rtp_socket,
+                                                            GSocket **rtcp_socket);
+void                  gst_rtsp_port_pool_release           (GstRTSPPortPool *pool,
+                                                            guint rtp_port);
+
+G_END_DECLS
+
+#endif /* __GST_RTSP_PORT_POOL_H__ */
@@ -19,15 +19,29 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #include "rtsp-server.h"
 #include "rtsp-client.h"
 
+#ifdef G_OS_UNIX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
 #define DEFAULT_ADDRESS         "0.0.0.0"
 #define DEFAULT_BOUND_PORT      -1
 /* #define DEFAULT_ADDRESS         "::0" */
 #define DEFAULT_SERVICE         "8554"
 #define DEFAULT_BACKLOG         5
+#define DEFAULT_REUSE_PORT      FALSE
+#define DEFAULT_ACCEPT_BATCH    16
+#define DEFAULT_DEFER_ACCEPT    0
+#define DEFAULT_FAST_OPEN       0
+#define DEFAULT_WORKER_THREADS  0
+#define DEFAULT_WORKER_POLICY   GST_RTSP_SERVER_WORKER_POLICY_ROUND_ROBIN
 
 /* Define to use the SO_LINGER option so that the server sockets can be resused
  * sooner. Disabled for now because it is not very well implemented by various
@@ -41,9 +55,15 @@ enum
   PROP_SERVICE,
   PROP_BOUND_PORT,
   PROP_BACKLOG,
+  PROP_REUSE_PORT,
+  PROP_ACCEPT_BATCH,
+  PROP_DEFER_ACCEPT,
+  PROP_FAST_OPEN,
 
   PROP_SESSION_POOL,
   PROP_MEDIA_MAPPING,
+  PROP_WORKER_THREADS,
+  PROP_WORKER_POLICY,
   PROP_LAST
 };
 
@@ -53,6 +73,20 @@ enum
   SIGNAL_LAST
 };
 
+/* a thread with a mainloop that runs the watches of a set of clients */
+struct _GstRTSPServerWorker
+{
+  GMainContext *context;
+  GMainLoop *loop;
+  GThread *thread;
+
+  /* number of clients attached to the context */
+  guint n_clients;
+
+  /* the listener of this worker when the server uses SO_REUSEPORT */
+  GSource *listener;
+};
+
 G_DEFINE_TYPE (GstRTSPServer, gst_rtsp_server, G_TYPE_OBJECT);
 
 GST_DEBUG_CATEGORY_STATIC (rtsp_server_debug);
@@ -69,6 +103,26 @@ static void gst_rtsp_server_finalize (GObject * object);
 static GstRTSPClient *default_create_client (GstRTSPServer * server);
 static gboolean default_accept_client (GstRTSPServer * server,
     GstRTSPClient * client, GSocket * socket, GError ** error);
+static void stop_workers (GstRTSPServer * server);
+
+GType
+gst_rtsp_server_worker_policy_get_type (void)
+{
+  static volatile gsize id = 0;
+  static const GEnumValue values[] = {
+    {GST_RTSP_SERVER_WORKER_POLICY_ROUND_ROBIN,
+        "GST_RTSP_SERVER_WORKER_POLICY_ROUND_ROBIN", "round-robin"},
+    {GST_RTSP_SERVER_WORKER_POLICY_LEAST_CONNECTIONS,
+        "GST_RTSP_SERVER_WORKER_POLICY_LEAST_CONNECTIONS", "least-connections"},
+    {0, NULL, NULL}
+  };
+
+  if (g_once_init_enter (&id)) {
+    GType tmp = g_enum_register_static ("GstRTSPServerWorkerPolicy", values);
+    g_once_init_leave (&id, tmp);
+  }
+  return (GType) id;
+}
 
 static void
 gst_rtsp_server_class_init (GstRTSPServerClass * klass)
@@ -127,6 +181,54 @@ gst_rtsp_server_class_init (GstRTSPServerClass * klass)
           "The maximum length to which the queue "
           "of pending connections may grow", 0, G_MAXINT, DEFAULT_BACKLOG,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  /**
+   * GstRTSPServer::reuse-port
+   *
+   * Open a listening socket with SO_REUSEPORT for each of the worker threads
+   * of the server so that the kernel spreads new connections over the
+   * workers. Each worker handles the clients it accepted itself.
+   *
+   * This has no effect when #GstRTSPServer::worker-threads is 0 or when the
+   * platform does not support SO_REUSEPORT.
+   */
+  g_object_class_install_property (gobject_class, PROP_REUSE_PORT,
+      g_param_spec_boolean ("reuse-port", "Reuse Port",
+          "Open a SO_REUSEPORT listener for each worker thread",
+          DEFAULT_REUSE_PORT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  /**
+   * GstRTSPServer::accept-batch
+   *
+   * The maximum number of pending connections that are accepted each time the
+   * listening socket becomes readable.
+   */
+  g_object_class_install_property (gobject_class, PROP_ACCEPT_BATCH,
+      g_param_spec_int ("accept-batch", "Accept Batch",
+          "The maximum number of connections accepted per wakeup",
+          1, G_MAXINT, DEFAULT_ACCEPT_BATCH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  /**
+   * GstRTSPServer::defer-accept
+   *
+   * When not 0, the listening socket only reports new connections after the
+   * client sent data or after this amount of seconds (TCP_DEFER_ACCEPT). This
+   * avoids creating clients for connections that never send a request.
+   */
+  g_object_class_install_property (gobject_class, PROP_DEFER_ACCEPT,
+      g_param_spec_int ("defer-accept", "Defer Accept",
+          "Seconds to wait for data before accepting a connection (0 = disable)",
+          0, G_MAXINT, DEFAULT_DEFER_ACCEPT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  /**
+   * GstRTSPServer::fast-open
+   *
+   * When not 0, enable TCP_FASTOPEN on the listening socket with the given
+   * maximum length of the queue of pending fast open requests.
+   */
+  g_object_class_install_property (gobject_class, PROP_FAST_OPEN,
+      g_param_spec_int ("fast-open", "Fast Open",
+          "The queue length for TCP fast open requests (0 = disable)",
+          0, G_MAXINT, DEFAULT_FAST_OPEN,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
   /**
    * GstRTSPServer::session-pool
    *
@@ -150,6 +252,29 @@ gst_rtsp_server_class_init (GstRTSPServerClass * klass)
           "The media mapping to use for client session",
           GST_TYPE_RTSP_MEDIA_MAPPING,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  /**
+   * GstRTSPServer::worker-threads
+   *
+   * The amount of worker threads that handle the client connections. Each
+   * worker runs its own #GMainContext and new clients are distributed over the
+   * workers with #GstRTSPServer::worker-policy. When set to 0, the clients are
+   * handled in the context that the server is attached to.
+   */
+  g_object_class_install_property (gobject_class, PROP_WORKER_THREADS,
+      g_param_spec_int ("worker-threads", "Worker Threads",
+          "The amount of threads handling client connections (0 = none)",
+          0, G_MAXINT, DEFAULT_WORKER_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  /**
+   * GstRTSPServer::worker-policy
+   *
+   * The policy used to select the worker thread for a new client.
+   */
+  g_object_class_install_property (gobject_class, PROP_WORKER_POLICY,
+      g_param_spec_enum ("worker-policy", "Worker Policy",
+          "The policy used to select a worker thread for new clients",
+          GST_TYPE_RTSP_SERVER_WORKER_POLICY, DEFAULT_WORKER_POLICY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   gst_rtsp_server_signals[SIGNAL_CLIENT_CONNECTED] =
       g_signal_new ("client-connected", G_TYPE_FROM_CLASS (gobject_class),
@@ -171,8 +296,15 @@ gst_rtsp_server_init (GstRTSPServer * server)
   server->service = g_strdup (DEFAULT_SERVICE);
   server->socket = NULL;
   server->backlog = DEFAULT_BACKLOG;
+  server->reuse_port = DEFAULT_REUSE_PORT;
+  server->accept_batch = DEFAULT_ACCEPT_BATCH;
+  server->defer_accept = DEFAULT_DEFER_ACCEPT;
+  server->fast_open = DEFAULT_FAST_OPEN;
   server->session_pool = gst_rtsp_session_pool_new ();
   server->media_mapping = gst_rtsp_media_mapping_new ();
+  server->clients = g_hash_table_new (g_direct_hash, g_direct_equal);
+  server->worker_threads = DEFAULT_WORKER_THREADS;
+  server->worker_policy = DEFAULT_WORKER_POLICY;
 }
 
 static void
@@ -182,6 +314,10 @@ gst_rtsp_server_finalize (GObject * object)
 
   GST_DEBUG_OBJECT (server, "finalize server");
 
+  stop_workers (server);
+
+  g_hash_table_destroy (server->clients);
+
   g_free (server->address);
   g_free (server->service);
   if (server->socket)
@@ -192,6 +328,8 @@ gst_rtsp_server_finalize (GObject * object)
 
   if (server->auth)
     g_object_unref (server->auth);
+  if (server->port_pool)
+    g_object_unref (server->port_pool);
 
   g_mutex_clear (&server->lock);
 
@@ -364,6 +502,178 @@ gst_rtsp_server_get_backlog (GstRTSPServer * server)
   return result;
 }
 
+/**
+ * gst_rtsp_server_set_reuse_port:
+ * @server: a #GstRTSPServer
+ * @reuse_port: the new value
+ *
+ * When @reuse_port is %TRUE, @server will open a listening socket with
+ * SO_REUSEPORT for each of its worker threads so that the kernel can spread
+ * new connections over the workers.
+ *
+ * This function must be called before the server is bound.
+ */
+void
+gst_rtsp_server_set_reuse_port (GstRTSPServer * server, gboolean reuse_port)
+{
+  g_return_if_fail (GST_IS_RTSP_SERVER (server));
+
+  GST_RTSP_SERVER_LOCK (server);
+  server->reuse_port = reuse_port;
+  GST_RTSP_SERVER_UNLOCK (server);
+}
+
+/**
+ * gst_rtsp_server_get_reuse_port:
+ * @server: a #GstRTSPServer
+ *
+ * Check if @server opens a SO_REUSEPORT listener for each worker thread.
+ *
+ * Returns: %TRUE if @server uses SO_REUSEPORT listeners.
+ */
+gboolean
+gst_rtsp_server_get_reuse_port (GstRTSPServer * server)
+{
+  gboolean result;
+
+  g_return_val_if_fail (GST_IS_RTSP_SERVER (server), FALSE);
+
+  GST_RTSP_SERVER_LOCK (server);
+  result = server->reuse_port;
+  GST_RTSP_SERVER_UNLOCK (server);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_server_set_accept_batch:
+ * @server: a #GstRTSPServer
+ * @batch: the maximum number of connections to accept
+ *
+ * Configure the maximum number of pending connections that @server accepts
+ * each time its listening socket becomes readable.
+ */
+void
+gst_rtsp_server_set_accept_batch (GstRTSPServer * server, gint batch)
+{
+  g_return_if_fail (GST_IS_RTSP_SERVER (server));
+  g_return_if_fail (batch > 0);
+
+  GST_RTSP_SERVER_LOCK (server);
+  server->accept_batch = batch;
+  GST_RTSP_SERVER_UNLOCK (server);
+}
+
+/**
+ * gst_rtsp_server_get_accept_batch:
+ * @server: a #GstRTSPServer
+ *
+ * Get the maximum number of connections @server accepts per wakeup.
+ *
+ * Returns: the accept batch size.
+ */
+gint
+gst_rtsp_server_get_accept_batch (GstRTSPServer * server)
+{
+  gint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_SERVER (server), -1);
+
+  GST_RTSP_SERVER_LOCK (server);
+  result = server->accept_batch;
+  GST_RTSP_SERVER_UNLOCK (server);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_server_set_defer_accept:
+ * @server: a #GstRTSPServer
+ * @seconds: the timeout in seconds or 0
+ *
+ * Only report new connections on the listening socket of @server when the
+ * client sent data or when @seconds have passed. This uses TCP_DEFER_ACCEPT
+ * and has no effect on platforms that don't support it.
+ *
+ * This function must be called before the server is bound.
+ */
+void
+gst_rtsp_server_set_defer_accept (GstRTSPServer * server, gint seconds)
+{
+  g_return_if_fail (GST_IS_RTSP_SERVER (server));
+  g_return_if_fail (seconds >= 0);
+
+  GST_RTSP_SERVER_LOCK (server);
+  server->defer_accept = seconds;
+  GST_RTSP_SERVER_UNLOCK (server);
+}
+
+/**
+ * gst_rtsp_server_get_defer_accept:
+ * @server: a #GstRTSPServer
+ *
+ * Get the TCP_DEFER_ACCEPT timeout of @server.
+ *
+ * Returns: the timeout in seconds, 0 when disabled.
+ */
+gint
+gst_rtsp_server_get_defer_accept (GstRTSPServer * server)
+{
+  gint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_SERVER (server), -1);
+
+  GST_RTSP_SERVER_LOCK (server);
+  result = server->defer_accept;
+  GST_RTSP_SERVER_UNLOCK (server);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_server_set_fast_open:
+ * @server: a #GstRTSPServer
+ * @qlen: the fast open queue length or 0
+ *
+ * Enable TCP_FASTOPEN on the listening socket of @server with a queue of
+ * @qlen pending requests. This has no effect on platforms that don't support
+ * it.
+ *
+ * This function must be called before the server is bound.
+ */
+void
+gst_rtsp_server_set_fast_open (GstRTSPServer * server, gint qlen)
+{
+  g_return_if_fail (GST_IS_RTSP_SERVER (server));
+  g_return_if_fail (qlen >= 0);
+
+  GST_RTSP_SERVER_LOCK (server);
+  server->fast_open = qlen;
+  GST_RTSP_SERVER_UNLOCK (server);
+}
+
+/**
+ * gst_rtsp_server_get_fast_open:
+ * @server: a #GstRTSPServer
+ *
+ * Get the TCP_FASTOPEN queue length of @server.
+ *
+ * Returns: the queue length, 0 when disabled.
+ */
+gint
+gst_rtsp_server_get_fast_open (GstRTSPServer * server)
+{
+  gint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_SERVER (server), -1);
+
+  GST_RTSP_SERVER_LOCK (server);
+  result = server->fast_open;
+  GST_RTSP_SERVER_UNLOCK (server);
+
+  return result;
+}
+
 /**
  * gst_rtsp_server_set_session_pool:
  * @server: a #GstRTSPServer
@@ -518,6 +828,144 @@ gst_rtsp_server_get_auth (GstRTSPServer * server)
   return result;
 }
 
+/**
+ * gst_rtsp_server_set_port_pool:
+ * @server: a #GstRTSPServer
+ * @pool: a #GstRTSPPortPool
+ *
+ * configure @pool to be used for allocating the UDP server ports of the media
+ * of @server. Without a pool, each stream binds a random pair of ports.
+ */
+void
+gst_rtsp_server_set_port_pool (GstRTSPServer * server, GstRTSPPortPool * pool)
+{
+  GstRTSPPortPool *old;
+
+  g_return_if_fail (GST_IS_RTSP_SERVER (server));
+
+  if (pool)
+    g_object_ref (pool);
+
+  GST_RTSP_SERVER_LOCK (server);
+  old = server->port_pool;
+  server->port_pool = pool;
+  GST_RTSP_SERVER_UNLOCK (server);
+
+  if (old)
+    g_object_unref (old);
+}
+
+/**
+ * gst_rtsp_server_get_port_pool:
+ * @server: a #GstRTSPServer
+ *
+ * Get the #GstRTSPPortPool used for allocating the server ports of @server.
+ *
+ * Returns: the #GstRTSPPortPool of @server. g_object_unref() after
+ * usage.
+ */
+GstRTSPPortPool *
+gst_rtsp_server_get_port_pool (GstRTSPServer * server)
+{
+  GstRTSPPortPool *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_SERVER (server), NULL);
+
+  GST_RTSP_SERVER_LOCK (server);
+  if ((result = server->port_pool))
+    g_object_ref (result);
+  GST_RTSP_SERVER_UNLOCK (server);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_server_set_worker_threads:
+ * @server: a #GstRTSPServer
+ * @threads: the number of worker threads
+ *
+ * Configure @server to handle its clients in @threads worker threads, each
+ * running its own #GMainContext. When @threads is 0, clients are handled in
+ * the context that @server is attached to.
+ *
+ * This function must be called before the server is attached.
+ */
+void
+gst_rtsp_server_set_worker_threads (GstRTSPServer * server, gint threads)
+{
+  g_return_if_fail (GST_IS_RTSP_SERVER (server));
+  g_return_if_fail (threads >= 0);
+
+  GST_RTSP_SERVER_LOCK (server);
+  server->worker_threads = threads;
+  GST_RTSP_SERVER_UNLOCK (server);
+}
+
+/**
+ * gst_rtsp_server_get_worker_threads:
+ * @server: a #GstRTSPServer
+ *
+ * Get the number of worker threads that handle the clients of @server.
+ *
+ * Returns: the number of worker threads.
+ */
+gint
+gst_rtsp_server_get_worker_threads (GstRTSPServer * server)
+{
+  gint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_SERVER (server), -1);
+
+  GST_RTSP_SERVER_LOCK (server);
+  result = server->worker_threads;
+  GST_RTSP_SERVER_UNLOCK (server);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_server_set_worker_policy:
+ * @server: a #GstRTSPServer
+ * @policy: a #GstRTSPServerWorkerPolicy
+ *
+ * Configure the policy that @server uses to select the worker thread for a
+ * new client.
+ */
+void
+gst_rtsp_server_set_worker_policy (GstRTSPServer * server,
+    GstRTSPServerWorkerPolicy policy)
+{
+  g_return_if_fail (GST_IS_RTSP_SERVER (server));
+
+  GST_RTSP_SERVER_LOCK (server);
+  server->worker_policy = policy;
+  GST_RTSP_SERVER_UNLOCK (server);
+}
+
+/**
+ * gst_rtsp_server_get_worker_policy:
+ * @server: a #GstRTSPServer
+ *
+ * Get the policy that @server uses to select the worker thread for a new
+ * client.
+ *
+ * Returns: the #GstRTSPServerWorkerPolicy of @server.
+ */
+GstRTSPServerWorkerPolicy
+gst_rtsp_server_get_worker_policy (GstRTSPServer * server)
+{
+  GstRTSPServerWorkerPolicy result;
+
+  g_return_val_if_fail (GST_IS_RTSP_SERVER (server),
+      DEFAULT_WORKER_POLICY);
+
+  GST_RTSP_SERVER_LOCK (server);
+  result = server->worker_policy;
+  GST_RTSP_SERVER_UNLOCK (server);
+
+  return result;
+}
+
 static void
 gst_rtsp_server_get_property (GObject * object, guint propid,
     GValue * value, GParamSpec * pspec)
@@ -537,12 +985,30 @@ gst_rtsp_server_get_property (GObject * object, guint propid,
     case PROP_BACKLOG:
       g_value_set_int (value, gst_rtsp_server_get_backlog (server));
       break;
+    case PROP_REUSE_PORT:
+      g_value_set_boolean (value, gst_rtsp_server_get_reuse_port (server));
+      break;
+    case PROP_ACCEPT_BATCH:
+      g_value_set_int (value, gst_rtsp_server_get_accept_batch (server));
+      break;
+    case PROP_DEFER_ACCEPT:
+      g_value_set_int (value, gst_rtsp_server_get_defer_accept (server));
+      break;
+    case PROP_FAST_OPEN:
+      g_value_set_int (value, gst_rtsp_server_get_fast_open (server));
+      break;
     case PROP_SESSION_POOL:
       g_value_take_object (value, gst_rtsp_server_get_session_pool (server));
       break;
     case PROP_MEDIA_MAPPING:
       g_value_take_object (value, gst_rtsp_server_get_media_mapping (server));
       break;
+    case PROP_WORKER_THREADS:
+      g_value_set_int (value, gst_rtsp_server_get_worker_threads (server));
+      break;
+    case PROP_WORKER_POLICY:
+      g_value_set_enum (value, gst_rtsp_server_get_worker_policy (server));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -564,17 +1030,104 @@ gst_rtsp_server_set_property (GObject * object, guint propid,
     case PROP_BACKLOG:
       gst_rtsp_server_set_backlog (server, g_value_get_int (value));
       break;
+    case PROP_REUSE_PORT:
+      gst_rtsp_server_set_reuse_port (server, g_value_get_boolean (value));
+      break;
+    case PROP_ACCEPT_BATCH:
+      gst_rtsp_server_set_accept_batch (server, g_value_get_int (value));
+      break;
+    case PROP_DEFER_ACCEPT:
+      gst_rtsp_server_set_defer_accept (server, g_value_get_int (value));
+      break;
+    case PROP_FAST_OPEN:
+      gst_rtsp_server_set_fast_open (server, g_value_get_int (value));
+      break;
     case PROP_SESSION_POOL:
       gst_rtsp_server_set_session_pool (server, g_value_get_object (value));
       break;
     case PROP_MEDIA_MAPPING:
       gst_rtsp_server_set_media_mapping (server, g_value_get_object (value));
       break;
+    case PROP_WORKER_THREADS:
+      gst_rtsp_server_set_worker_threads (server, g_value_get_int (value));
+      break;
+    case PROP_WORKER_POLICY:
+      gst_rtsp_server_set_worker_policy (server, g_value_get_enum (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
 }
 
+static void
+set_reuse_port (GstRTSPServer * server, GSocket * socket)
+{
+#ifdef SO_REUSEPORT
+  gint val = 1;
+
+  if (setsockopt (g_socket_get_fd (socket), SOL_SOCKET, SO_REUSEPORT,
+          (void *) &val, sizeof (val)) < 0)
+    GST_WARNING_OBJECT (server, "failed to set SO_REUSEPORT: %s",
+        g_strerror (errno));
+#else
+  GST_WARNING_OBJECT (server, "SO_REUSEPORT is not supported");
+#endif
+}
+
+#if defined (TCP_DEFER_ACCEPT) || defined (TCP_FASTOPEN)
+static void
+set_tcp_option (GstRTSPServer * server, GSocket * socket, gint option,
+    const gchar * name, gint val)
+{
+  if (setsockopt (g_socket_get_fd (socket), IPPROTO_TCP, option,
+          (void *) &val, sizeof (val)) < 0)
+    GST_WARNING_OBJECT (server, "failed to set %s: %s", name,
+        g_strerror (errno));
+}
+#endif
+
+/* with LOCK */
+static gboolean
+setup_listen_socket (GstRTSPServer * server, GSocket * socket, GError ** error)
+{
+  /* keep connection alive; avoids SIGPIPE during write */
+  g_socket_set_keepalive (socket, TRUE);
+
+  /* only wake us up when the client sent its first request */
+  if (server->defer_accept > 0) {
+#ifdef TCP_DEFER_ACCEPT
+    set_tcp_option (server, socket, TCP_DEFER_ACCEPT, "TCP_DEFER_ACCEPT",
+        server->defer_accept);
+#else
+    GST_WARNING_OBJECT (server, "TCP_DEFER_ACCEPT is not supported");
+#endif
+  }
+
+  /* needs to be configured before listen() */
+  if (server->fast_open > 0) {
+#ifdef TCP_FASTOPEN
+    set_tcp_option (server, socket, TCP_FASTOPEN, "TCP_FASTOPEN",
+        server->fast_open);
+#else
+    GST_WARNING_OBJECT (server, "TCP_FASTOPEN is not supported");
+#endif
+  }
+
+  /* set the server socket to nonblocking */
+  g_socket_set_blocking (socket, FALSE);
+
+  /* set listen backlog */
+  g_socket_set_listen_backlog (socket, server->backlog);
+
+  if (!g_socket_listen (socket, error))
+    return FALSE;
+
+  GST_DEBUG_OBJECT (server, "listening on server socket %p with queue of %d",
+      socket, server->backlog);
+
+  return TRUE;
+}
+
 /**
  * gst_rtsp_server_create_socket:
  * @server: a #GstRTSPServer
@@ -644,6 +1197,10 @@ gst_rtsp_server_create_socket (GstRTSPServer * server,
       continue;
     }
 
+    /* other listeners will be bound to the same address */
+    if (server->reuse_port && server->worker_threads > 0)
+      set_reuse_port (server, socket);
+
     if (g_socket_bind (socket, sockaddr, TRUE, bind_error ? NULL : &bind_error)) {
       g_object_unref (sockaddr);
       break;
@@ -665,9 +1222,6 @@ gst_rtsp_server_create_socket (GstRTSPServer * server,
 
   GST_DEBUG_OBJECT (server, "opened sending server socket");
 
-  /* keep connection alive; avoids SIGPIPE during write */
-  g_socket_set_keepalive (socket, TRUE);
-
 #if 0
 #ifdef USE_SOLINGER
   /* make sure socket is reset 5 seconds after close. This ensure that we can
@@ -681,18 +1235,9 @@ gst_rtsp_server_create_socket (GstRTSPServer * server,
 #endif
 #endif
 
-  /* set the server socket to nonblocking */
-  g_socket_set_blocking (socket, FALSE);
-
-  /* set listen backlog */
-  g_socket_set_listen_backlog (socket, server->backlog);
-
-  if (!g_socket_listen (socket, error))
+  if (!setup_listen_socket (server, socket, error))
     goto listen_failed;
 
-  GST_DEBUG_OBJECT (server, "listening on server socket %p with queue of %d",
-      socket, server->backlog);
-
   GST_RTSP_SERVER_UNLOCK (server);
 
   return socket;
@@ -741,33 +1286,193 @@ close_error:
   }
 }
 
+static gpointer
+do_worker_loop (GstRTSPServerWorker * worker)
+{
+  GMainContext *context;
+  GMainLoop *loop;
+
+  /* keep our own refs, the worker can be freed while we run */
+  context = g_main_context_ref (worker->context);
+  loop = g_main_loop_ref (worker->loop);
+
+  GST_INFO ("enter worker mainloop");
+  g_main_context_push_thread_default (context);
+  g_main_loop_run (loop);
+  g_main_context_pop_thread_default (context);
+  GST_INFO ("exit worker mainloop");
+
+  g_main_loop_unref (loop);
+  g_main_context_unref (context);
+
+  return NULL;
+}
+
+/* with LOCK */
+static void
+start_workers (GstRTSPServer * server)
+{
+  guint i;
+
+  if (server->workers != NULL || server->worker_threads == 0)
+    return;
+
+  GST_DEBUG_OBJECT (server, "starting %d worker threads",
+      server->worker_threads);
+
+  server->n_workers = server->worker_threads;
+  server->workers = g_new0 (GstRTSPServerWorker, server->n_workers);
+
+  for (i = 0; i < server->n_workers; i++) {
+    GstRTSPServerWorker *worker = &server->workers[i];
+    gchar *name;
+
+    worker->context = g_main_context_new ();
+    worker->loop = g_main_loop_new (worker->context, FALSE);
+
+    name = g_strdup_printf ("rtsp-worker-%u", i);
+    worker->thread = g_thread_new (name, (GThreadFunc) do_worker_loop, worker);
+    g_free (name);
+  }
+}
+
+static gboolean
+quit_worker (GMainLoop * loop)
+{
+  g_main_loop_quit (loop);
+  return FALSE;
+}
+
+static void
+stop_workers (GstRTSPServer * server)
+{
+  GThread *self = g_thread_self ();
+  guint i;
+
+  for (i = 0; i < server->n_workers; i++) {
+    GstRTSPServerWorker *worker = &server->workers[i];
+    GSource *source;
+
+    /* quit from inside the loop so that we can't race with the thread
+     * starting the loop */
+    source = g_idle_source_new ();
+    g_source_set_callback (source, (GSourceFunc) quit_worker,
+        g_main_loop_ref (worker->loop), (GDestroyNotify) g_main_loop_unref);
+    g_source_attach (source, worker->context);
+    g_source_unref (source);
+
+    /* the last client of a worker can release the last ref to the server */
+    if (worker->thread == self)
+      g_thread_unref (worker->thread);
+    else
+      g_thread_join (worker->thread);
+
+    g_main_loop_unref (worker->loop);
+    g_main_context_unref (worker->context);
+  }
+  g_free (server->workers);
+  server->workers = NULL;
+  server->n_workers = 0;
+}
+
+static GstRTSPServerWorker *find_worker (GstRTSPServer * server,
+    GMainContext * context);
+
+/* with LOCK */
+static GstRTSPServerWorker *
+pick_worker (GstRTSPServer * server)
+{
+  GstRTSPServerWorker *worker;
+  GSource *source;
+  guint i;
+
+  start_workers (server);
+
+  if (server->n_workers == 0)
+    return NULL;
+
+  /* connections accepted by the listener of a worker stay in that worker */
+  if ((source = g_main_current_source ()) &&
+      (worker = find_worker (server, g_source_get_context (source))))
+    return worker;
+
+  switch (server->worker_policy) {
+    case GST_RTSP_SERVER_WORKER_POLICY_LEAST_CONNECTIONS:
+      worker = &server->workers[0];
+      for (i = 1; i < server->n_workers; i++) {
+        if (server->workers[i].n_clients < worker->n_clients)
+          worker = &server->workers[i];
+      }
+      break;
+    case GST_RTSP_SERVER_WORKER_POLICY_ROUND_ROBIN:
+    default:
+      worker = &server->workers[server->next_worker];
+      server->next_worker = (server->next_worker + 1) % server->n_workers;
+      break;
+  }
+  return worker;
+}
+
+/* with LOCK */
+static GstRTSPServerWorker *
+find_worker (GstRTSPServer * server, GMainContext * context)
+{
+  guint i;
+
+  if (context == NULL)
+    return NULL;
+
+  for (i = 0; i < server->n_workers; i++) {
+    if (server->workers[i].context == context)
+      return &server->workers[i];
+  }
+  return NULL;
+}
+
 static void
 unmanage_client (GstRTSPClient * client, GstRTSPServer * server)
 {
+  GstRTSPServerWorker *worker;
+
   GST_DEBUG_OBJECT (server, "unmanage client %p", client);
 
   g_object_ref (server);
   gst_rtsp_client_set_server (client, NULL);
 
   GST_RTSP_SERVER_LOCK (server);
-  server->clients = g_list_remove (server->clients, client);
+  if (g_hash_table_lookup_extended (server->clients, client, NULL,
+          (gpointer *) & worker)) {
+    if (worker)
+      worker->n_clients--;
+    g_hash_table_remove (server->clients, client);
+  }
   GST_RTSP_SERVER_UNLOCK (server);
+
   g_object_unref (server);
 
   g_object_unref (client);
 }
 
 /* add the client to the active list of clients, takes ownership of
- * the client */
+ * the client. This selects the worker that will handle the client so it needs
+ * to be called before the connection of the client is accepted. */
 static void
 manage_client (GstRTSPServer * server, GstRTSPClient * client)
 {
+  GstRTSPServerWorker *worker;
+
   GST_DEBUG_OBJECT (server, "manage client %p", client);
   gst_rtsp_client_set_server (client, server);
 
   GST_RTSP_SERVER_LOCK (server);
+  if ((worker = pick_worker (server))) {
+    GST_DEBUG_OBJECT (server, "client %p handled by worker %p with %u clients",
+        client, worker, worker->n_clients);
+    gst_rtsp_client_set_context (client, worker->context);
+    worker->n_clients++;
+  }
   g_signal_connect (client, "closed", (GCallback) unmanage_client, server);
-  server->clients = g_list_prepend (server->clients, client);
+  g_hash_table_insert (server->clients, client, worker);
   GST_RTSP_SERVER_UNLOCK (server);
 }
 
@@ -786,6 +1491,8 @@ default_create_client (GstRTSPServer * server)
   gst_rtsp_client_set_media_mapping (client, server->media_mapping);
   /* set authentication manager */
   gst_rtsp_client_set_auth (client, server->auth);
+  /* set the allocator for the server ports */
+  gst_rtsp_client_set_port_pool (client, server->port_pool);
   GST_RTSP_SERVER_UNLOCK (server);
 
   return client;
@@ -799,7 +1506,8 @@ default_accept_client (GstRTSPServer * server, GstRTSPClient * client,
 {
   /* accept connections for that client, this function returns after accepting
    * the connection and will run the remainder of the communication with the
-   * client asyncronously. */
+   * client asyncronously in the context that was selected for the client when
+   * it was managed. */
   if (!gst_rtsp_client_accept (client, socket, NULL, error))
     goto accept_failed;
 
@@ -814,6 +1522,71 @@ accept_failed:
   }
 }
 
+/**
+ * gst_rtsp_server_client_filter:
+ * @server: a #GstRTSPServer
+ * @func: a callback
+ * @user_data: user data passed to @func
+ *
+ * Call @func for each client managed by @server. The result value of @func
+ * determines what happens to the client. @func will be called with @server
+ * locked so no further actions on @server can be performed from @func.
+ *
+ * If @func returns #GST_RTSP_FILTER_REMOVE, the connection of the client will
+ * be closed, which removes the client from @server.
+ *
+ * If @func returns #GST_RTSP_FILTER_KEEP, the client will remain in @server.
+ *
+ * If @func returns #GST_RTSP_FILTER_REF, the client will remain in @server but
+ * will also be added with an additional ref to the result #GList of this
+ * function.
+ *
+ * Returns: a #GList with all clients for which @func returned
+ * #GST_RTSP_FILTER_REF. After usage, each element in the #GList should be
+ * unreffed before the list is freed.
+ */
+GList *
+gst_rtsp_server_client_filter (GstRTSPServer * server,
+    GstRTSPServerClientFilterFunc func, gpointer user_data)
+{
+  GHashTableIter iter;
+  gpointer key;
+  GList *result = NULL, *remove = NULL, *walk;
+
+  g_return_val_if_fail (GST_IS_RTSP_SERVER (server), NULL);
+  g_return_val_if_fail (func != NULL, NULL);
+
+  GST_RTSP_SERVER_LOCK (server);
+  g_hash_table_iter_init (&iter, server->clients);
+  while (g_hash_table_iter_next (&iter, &key, NULL)) {
+    GstRTSPClient *client = key;
+
+    switch (func (server, client, user_data)) {
+      case GST_RTSP_FILTER_REMOVE:
+        remove = g_list_prepend (remove, g_object_ref (client));
+        break;
+      case GST_RTSP_FILTER_REF:
+        result = g_list_prepend (result, g_object_ref (client));
+        break;
+      case GST_RTSP_FILTER_KEEP:
+      default:
+        break;
+    }
+  }
+  GST_RTSP_SERVER_UNLOCK (server);
+
+  /* closing unmanages the client, which takes the lock */
+  for (walk = remove; walk; walk = g_list_next (walk)) {
+    GstRTSPClient *client = walk->data;
+
+    gst_rtsp_client_close (client);
+    g_object_unref (client);
+  }
+  g_list_free (remove);
+
+  return result;
+}
+
 /**
  * gst_rtsp_server_transfer_connection:
  * @server: a #GstRTSPServer
@@ -844,15 +1617,15 @@ gst_rtsp_server_transfer_connection (GstRTSPServer * server, GSocket * socket,
   if (client == NULL)
     goto client_failed;
 
+  /* manage the client connection, this selects the context for the client */
+  manage_client (server, client);
+
   /* a new client connected, create a client object to handle the client. */
   if (!gst_rtsp_client_create_from_socket (client, socket, ip, port,
           initial_buffer, &error)) {
     goto transfer_failed;
   }
 
-  /* manage the client connection */
-  manage_client (server, client);
-
   g_signal_emit (server, gst_rtsp_server_signals[SIGNAL_CLIENT_CONNECTED], 0,
       client);
 
@@ -868,52 +1641,40 @@ transfer_failed:
   {
     GST_ERROR_OBJECT (server, "failed to accept client: %s", error->message);
     g_error_free (error);
-    gst_object_unref (client);
+    unmanage_client (client, server);
     return FALSE;
   }
 }
 
-/**
- * gst_rtsp_server_io_func:
- * @socket: a #GSocket
- * @condition: the condition on @source
- *
- * A default #GSocketSourceFunc that creates a new #GstRTSPClient to accept and handle a
- * new connection on @socket or @server.
- *
- * Returns: TRUE if the source could be connected, FALSE if an error occured.
- */
-gboolean
-gst_rtsp_server_io_func (GSocket * socket, GIOCondition condition,
-    GstRTSPServer * server)
+static gboolean
+accept_one_client (GstRTSPServer * server, GSocket * socket)
 {
   gboolean result = TRUE;
   GstRTSPClient *client = NULL;
   GstRTSPServerClass *klass;
   GError *error = NULL;
 
-  if (condition & G_IO_IN) {
-    klass = GST_RTSP_SERVER_GET_CLASS (server);
+  klass = GST_RTSP_SERVER_GET_CLASS (server);
+
+  if (klass->create_client)
+    client = klass->create_client (server);
+  if (client == NULL)
+    goto client_failed;
 
-    if (klass->create_client)
-      client = klass->create_client (server);
-    if (client == NULL)
-      goto client_failed;
+  /* manage the client connection, this selects the context for the client.
+   * We do this before accepting so that we can't miss the closed signal when
+   * the client runs in a worker thread. */
+  manage_client (server, client);
 
-    /* a new client connected, create a client object to handle the client. */
-    if (klass->accept_client)
-      result = klass->accept_client (server, client, socket, &error);
-    if (!result)
-      goto accept_failed;
+  /* a new client connected, create a client object to handle the client. */
+  if (klass->accept_client)
+    result = klass->accept_client (server, client, socket, &error);
+  if (!result)
+    goto accept_failed;
 
-    /* manage the client connection */
-    manage_client (server, client);
+  g_signal_emit (server, gst_rtsp_server_signals[SIGNAL_CLIENT_CONNECTED], 0,
+      client);
 
-    g_signal_emit (server, gst_rtsp_server_signals[SIGNAL_CLIENT_CONNECTED], 0,
-        client);
-  } else {
-    GST_WARNING_OBJECT (server, "received unknown event %08x", condition);
-  }
   return TRUE;
 
   /* ERRORS */
@@ -924,20 +1685,161 @@ client_failed:
   }
 accept_failed:
   {
-    GST_ERROR_OBJECT (server, "failed to accept client: %s", error->message);
-    g_error_free (error);
-    gst_object_unref (client);
+    GST_ERROR_OBJECT (server, "failed to accept client: %s",
+        error ? error->message : "unknown error");
+    g_clear_error (&error);
+    unmanage_client (client, server);
     return FALSE;
   }
 }
 
+/**
+ * gst_rtsp_server_io_func:
+ * @socket: a #GSocket
+ * @condition: the condition on @source
+ *
+ * A default #GSocketSourceFunc that creates a new #GstRTSPClient to accept and handle a
+ * new connection on @socket or @server.
+ *
+ * Up to #GstRTSPServer::accept-batch pending connections are accepted for
+ * each wakeup. A connection that fails to be accepted ends the batch but does
+ * not remove the source.
+ *
+ * Returns: TRUE if the source could be connected, FALSE if an error occured.
+ */
+gboolean
+gst_rtsp_server_io_func (GSocket * socket, GIOCondition condition,
+    GstRTSPServer * server)
+{
+  gint i, batch;
+
+  if (condition & G_IO_IN) {
+    GST_RTSP_SERVER_LOCK (server);
+    batch = server->accept_batch;
+    GST_RTSP_SERVER_UNLOCK (server);
+
+    for (i = 0; i < batch; i++) {
+      /* the first connection is pending, check for the others */
+      if (i > 0 && !(g_socket_condition_check (socket, G_IO_IN) & G_IO_IN))
+        break;
+
+      if (!accept_one_client (server, socket))
+        break;
+    }
+    GST_LOG_OBJECT (server, "accepted %d clients", i);
+  } else {
+    GST_WARNING_OBJECT (server, "received unknown event %08x", condition);
+  }
+  return TRUE;
+}
+
 static void
 watch_destroyed (GstRTSPServer * server)
 {
+  guint i;
+
   GST_DEBUG_OBJECT (server, "source destroyed");
+
+  /* the listeners of the workers go away with the main source */
+  GST_RTSP_SERVER_LOCK (server);
+  for (i = 0; i < server->n_workers; i++) {
+    GSource *listener = server->workers[i].listener;
+
+    if (listener) {
+      server->workers[i].listener = NULL;
+      g_source_destroy (listener);
+      g_source_unref (listener);
+    }
+  }
+  GST_RTSP_SERVER_UNLOCK (server);
+
   g_object_unref (server);
 }
 
+static void
+listener_destroyed (GstRTSPServer * server)
+{
+  GST_DEBUG_OBJECT (server, "listener destroyed");
+  g_object_unref (server);
+}
+
+/* with LOCK. Open a SO_REUSEPORT listener on the address of @socket for each
+ * worker and attach it to the context of the worker */
+static void
+attach_worker_listeners (GstRTSPServer * server, GSocket * socket,
+    GCancellable * cancellable)
+{
+  GSocketAddress *address;
+  GError *error = NULL;
+  guint i;
+
+  if (!(address = g_socket_get_local_address (socket, &error)))
+    goto no_address;
+
+  start_workers (server);
+
+  for (i = 0; i < server->n_workers; i++) {
+    GstRTSPServerWorker *worker = &server->workers[i];
+    GSocket *wsocket;
+
+    if (worker->listener)
+      continue;
+
+    wsocket = g_socket_new (g_socket_address_get_family (address),
+        G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, &error);
+    if (wsocket == NULL)
+      goto socket_failed;
+
+    set_reuse_port (server, wsocket);
+
+    if (!g_socket_bind (wsocket, address, TRUE, &error))
+      goto bind_failed;
+
+    if (!setup_listen_socket (server, wsocket, &error))
+      goto bind_failed;
+
+    worker->listener = g_socket_create_source (wsocket, G_IO_IN |
+        G_IO_ERR | G_IO_HUP | G_IO_NVAL, cancellable);
+    g_object_unref (wsocket);
+
+    g_source_set_callback (worker->listener,
+        (GSourceFunc) gst_rtsp_server_io_func, g_object_ref (server),
+        (GDestroyNotify) listener_destroyed);
+    g_source_attach (worker->listener, worker->context);
+
+    GST_DEBUG_OBJECT (server, "attached listener to worker %u", i);
+  }
+  g_object_unref (address);
+
+  return;
+
+  /* ERRORS */
+no_address:
+  {
+    GST_WARNING_OBJECT (server, "failed to get local address: %s",
+        error->message);
+    g_error_free (error);
+    return;
+  }
+socket_failed:
+  {
+    GST_WARNING_OBJECT (server, "failed to make worker socket: %s",
+        error->message);
+    g_error_free (error);
+    g_object_unref (address);
+    return;
+  }
+bind_failed:
+  {
+    GST_WARNING_OBJECT (server, "failed to set up worker socket: %s",
+        error->message);
+    g_error_free (error);
+    g_object_unref (wsocket);
+    g_object_unref (address);
+    return;
+  }
+}
+
 /**
  * gst_rtsp_server_create_source:
  * @server: a #GstRTSPServer
@@ -952,6 +1854,10 @@ watch_destroyed (GstRTSPServer * server)
  * unless cancellation happened at the same time as a condition change). You can
  * check for this in the callback using g_cancellable_is_cancelled().
  *
+ * When #GstRTSPServer::reuse-port is enabled and the server has worker
+ * threads, an additional listener is attached to the context of each worker.
+ * These listeners are removed when the returned source is destroyed.
+ *
  * Returns: the #GSource for @server or NULL when an error occured. Free with
  * g_source_unref ()
  */
@@ -979,6 +1885,11 @@ gst_rtsp_server_create_source (GstRTSPServer * server,
       (GSourceFunc) gst_rtsp_server_io_func, g_object_ref (server),
       (GDestroyNotify) watch_destroyed);
 
+  GST_RTSP_SERVER_LOCK (server);
+  if (server->reuse_port && server->worker_threads > 0)
+    attach_worker_listeners (server, server->socket, cancellable);
+  GST_RTSP_SERVER_UNLOCK (server);
+
   return source;
 
 no_socket:
@@ -26,12 +26,18 @@ G_BEGIN_DECLS
 
 typedef struct _GstRTSPServer GstRTSPServer;
 typedef struct _GstRTSPServerClass GstRTSPServerClass;
+typedef struct _GstRTSPServerWorker GstRTSPServerWorker;
 
 #include "rtsp-session-pool.h"
 #include "rtsp-media-mapping.h"
 #include "rtsp-media-factory-uri.h"
 #include "rtsp-client.h"
 #include "rtsp-auth.h"
+#include "rtsp-port-pool.h"
+#include "rtsp-udp-sink.h"
+#include "rtsp-udp-receiver.h"
+#include "rtsp-udp-src.h"
+#include "rtsp-tcp-sink.h"
 
 #define GST_TYPE_RTSP_SERVER              (gst_rtsp_server_get_type ())
 #define GST_IS_RTSP_SERVER(obj)           (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_RTSP_SERVER))
@@ -46,6 +52,22 @@ typedef struct _GstRTSPServerClass GstRTSPServerClass;
 #define GST_RTSP_SERVER_LOCK(server)      (g_mutex_lock(GST_RTSP_SERVER_GET_LOCK(server)))
 #define GST_RTSP_SERVER_UNLOCK(server)    (g_mutex_unlock(GST_RTSP_SERVER_GET_LOCK(server)))
 
+/**
+ * GstRTSPServerWorkerPolicy:
+ * @GST_RTSP_SERVER_WORKER_POLICY_ROUND_ROBIN: hand out the workers in turn
+ * @GST_RTSP_SERVER_WORKER_POLICY_LEAST_CONNECTIONS: use the worker that
+ *     currently handles the least clients
+ *
+ * The policy used to select the worker thread that handles a new client.
+ */
+typedef enum {
+  GST_RTSP_SERVER_WORKER_POLICY_ROUND_ROBIN,
+  GST_RTSP_SERVER_WORKER_POLICY_LEAST_CONNECTIONS
+} GstRTSPServerWorkerPolicy;
+
+#define GST_TYPE_RTSP_SERVER_WORKER_POLICY (gst_rtsp_server_worker_policy_get_type())
+GType gst_rtsp_server_worker_policy_get_type (void);
+
 /**
  * GstRTSPServer:
  *
@@ -61,6 +83,10 @@ struct _GstRTSPServer {
   gchar       *address;
   gchar       *service;
   gint         backlog;
+  gboolean     reuse_port;
+  gint         accept_batch;
+  gint         defer_accept;
+  gint         fast_open;
 
   GSocket     *socket;
 
@@ -73,8 +99,18 @@ struct _GstRTSPServer {
   /* authentication manager */
   GstRTSPAuth *auth;
 
-  /* the clients that are connected */
-  GList   *clients;
+  /* allocator for the server ports of the media */
+  GstRTSPPortPool *port_pool;
+
+  /* the clients that are connected, maps the client to its worker */
+  GHashTable *clients;
+
+  /* worker threads that run the clients */
+  gint                       worker_threads;
+  GstRTSPServerWorkerPolicy  worker_policy;
+  GstRTSPServerWorker       *workers;
+  guint                      n_workers;
+  guint                      next_worker;
 };
 
 /**
@@ -96,6 +132,30 @@ struct _GstRTSPServerClass {
   void            (*client_connected)   (GstRTSPServer *server, GstRTSPClient *client);
 };
 
+/**
+ * GstRTSPServerClientFilterFunc:
+ * @server: a #GstRTSPServer object
+ * @client: a #GstRTSPClient in @server
+ * @user_data: user data that has been given to gst_rtsp_server_client_filter()
+ *
+ * This function will be called by the gst_rtsp_server_client_filter(). An
+ * implementation should return a value of #GstRTSPFilterResult.
+ *
+ * When this function returns #GST_RTSP_FILTER_REMOVE, the connection of
+ * @client will be closed.
+ *
+ * A return value of #GST_RTSP_FILTER_KEEP will leave @client untouched in
+ * @server.
+ *
+ * A value of GST_RTSP_FILTER_REF will add @client to the result #GList of
+ * gst_rtsp_server_client_filter().
+ *
+ * Returns: a #GstRTSPFilterResult.
+ */
+typedef GstRTSPFilterResult (*GstRTSPServerClientFilterFunc)  (GstRTSPServer *server,
+                                                               GstRTSPClient *client,
+                                                               gpointer user_data);
+
 GType                 gst_rtsp_server_get_type             (void);
 
 GstRTSPServer *       gst_rtsp_server_new                  (void);
@@ -111,6 +171,18 @@ int                   gst_rtsp_server_get_bound_port       (GstRTSPServer *serve
 void                  gst_rtsp_server_set_backlog          (GstRTSPServer *server, gint backlog);
 gint                  gst_rtsp_server_get_backlog          (GstRTSPServer *server);
 
+void                  gst_rtsp_server_set_reuse_port       (GstRTSPServer *server, gboolean reuse_port);
+gboolean              gst_rtsp_server_get_reuse_port       (GstRTSPServer *server);
+
+void                  gst_rtsp_server_set_accept_batch     (GstRTSPServer *server, gint batch);
+gint                  gst_rtsp_server_get_accept_batch     (GstRTSPServer *server);
+
+void                  gst_rtsp_server_set_defer_accept     (GstRTSPServer *server, gint seconds);
+gint                  gst_rtsp_server_get_defer_accept     (GstRTSPServer *server);
+
+void                  gst_rtsp_server_set_fast_open        (GstRTSPServer *server, gint qlen);
+gint                  gst_rtsp_server_get_fast_open        (GstRTSPServer *server);
+
 void                  gst_rtsp_server_set_session_pool     (GstRTSPServer *server, GstRTSPSessionPool *pool);
 GstRTSPSessionPool *  gst_rtsp_server_get_session_pool     (GstRTSPServer *server);
 
@@ -120,6 +192,20 @@ GstRTSPMediaMapping * gst_rtsp_server_get_media_mapping    (GstRTSPServer *serve
 void                  gst_rtsp_server_set_auth             (GstRTSPServer *server, GstRTSPAuth *auth);
 GstRTSPAuth *         gst_rtsp_server_get_auth             (GstRTSPServer *server);
 
+void                  gst_rtsp_server_set_port_pool        (GstRTSPServer *server, GstRTSPPortPool *pool);
+GstRTSPPortPool *     gst_rtsp_server_get_port_pool        (GstRTSPServer *server);
+
+void                  gst_rtsp_server_set_worker_threads   (GstRTSPServer *server, gint threads);
+gint                  gst_rtsp_server_get_worker_threads   (GstRTSPServer *server);
+
+void                  gst_rtsp_server_set_worker_policy    (GstRTSPServer *server,
+                                                            GstRTSPServerWorkerPolicy policy);
+GstRTSPServerWorkerPolicy gst_rtsp_server_get_worker_policy (GstRTSPServer *server);
+
+GList *               gst_rtsp_server_client_filter        (GstRTSPServer *server,
+                                                            GstRTSPServerClientFilterFunc func,
+                                                            gpointer user_data);
+
 gboolean              gst_rtsp_server_transfer_connection  (GstRTSPServer * server, GSocket *socket, const gchar * ip, gint port, const gchar *initial_buffer);
 
 gboolean              gst_rtsp_server_io_func              (GSocket *socket, GIOCondition condition,
@@ -23,6 +23,9 @@
 
 #define DEFAULT_MAX_SESSIONS 0
 
+/* number of independently locked parts of the session table */
+#define N_SHARDS 16
+
 enum
 {
   PROP_0,
@@ -48,6 +51,8 @@ static void gst_rtsp_session_pool_set_property (GObject * object, guint propid,
 static void gst_rtsp_session_pool_finalize (GObject * object);
 
 static gchar *create_session_id (GstRTSPSessionPool * pool);
+static void session_timeout_changed (GstRTSPSession * sess, GParamSpec * pspec,
+    GstRTSPSessionPool * pool);
 
 G_DEFINE_TYPE (GstRTSPSessionPool, gst_rtsp_session_pool, G_TYPE_OBJECT);
 
@@ -74,22 +79,92 @@ gst_rtsp_session_pool_class_init (GstRTSPSessionPoolClass * klass)
       "GstRTSPSessionPool");
 }
 
+/* The sessions are spread over N_SHARDS shards by the hash of their id, each
+ * shard has its own lock so that finding sessions from different threads does
+ * not contend on a single lock.
+ *
+ * In each shard, sessions are kept in the timeouts sequence, ordered by the
+ * time they expire at the earliest. Touching a session only moves its expire
+ * time further away so the entries are not updated on each touch, instead an
+ * entry is rescheduled when it reaches the head of the sequence and the
+ * session is not expired yet.
+ *
+ * A changed session timeout can make a session expire earlier, those sessions
+ * are collected in the changed set and only they are rescheduled. The changed
+ * set has its own lock because the timeout can be changed while the shard lock
+ * is held. */
+struct _GstRTSPSessionPoolShard
+{
+  GMutex lock;
+  GHashTable *sessions;
+
+  GSequence *timeouts;
+  GHashTable *timeout_iters;
+
+  GMutex changed_lock;
+  GHashTable *changed;
+};
+
+typedef struct
+{
+  GstRTSPSession *session;
+  gint64 due;
+} TimeoutEntry;
+
+static void
+timeout_entry_free (TimeoutEntry * entry)
+{
+  g_slice_free (TimeoutEntry, entry);
+}
+
 static void
 gst_rtsp_session_pool_init (GstRTSPSessionPool * pool)
 {
+  guint i;
+
   g_mutex_init (&pool->lock);
-  pool->sessions = g_hash_table_new_full (g_str_hash, g_str_equal,
-      NULL, g_object_unref);
   pool->max_sessions = DEFAULT_MAX_SESSIONS;
+
+  pool->shards = g_new0 (GstRTSPSessionPoolShard, N_SHARDS);
+  for (i = 0; i < N_SHARDS; i++) {
+    GstRTSPSessionPoolShard *shard = &pool->shards[i];
+
+    g_mutex_init (&shard->lock);
+    shard->sessions = g_hash_table_new_full (g_str_hash, g_str_equal,
+        NULL, g_object_unref);
+    shard->timeouts = g_sequence_new ((GDestroyNotify) timeout_entry_free);
+    shard->timeout_iters = g_hash_table_new (g_direct_hash, g_direct_equal);
+    g_mutex_init (&shard->changed_lock);
+    shard->changed = g_hash_table_new (g_direct_hash, g_direct_equal);
+  }
+}
+
+static void
+disconnect_session (gchar * sessionid, GstRTSPSession * sess,
+    GstRTSPSessionPool * pool)
+{
+  g_signal_handlers_disconnect_by_func (sess, session_timeout_changed, pool);
 }
 
 static void
 gst_rtsp_session_pool_finalize (GObject * object)
 {
   GstRTSPSessionPool *pool = GST_RTSP_SESSION_POOL (object);
-
+  guint i;
+
+  for (i = 0; i < N_SHARDS; i++) {
+    GstRTSPSessionPoolShard *shard = &pool->shards[i];
+
+    g_hash_table_foreach (shard->sessions, (GHFunc) disconnect_session, pool);
+    g_hash_table_unref (shard->sessions);
+    g_hash_table_unref (shard->timeout_iters);
+    g_sequence_free (shard->timeouts);
+    g_hash_table_unref (shard->changed);
+    g_mutex_clear (&shard->changed_lock);
+    g_mutex_clear (&shard->lock);
+  }
+  g_free (pool->shards);
   g_mutex_clear (&pool->lock);
-  g_hash_table_unref (pool->sessions);
 
   G_OBJECT_CLASS (gst_rtsp_session_pool_parent_class)->finalize (object);
 }
@@ -199,13 +274,146 @@ gst_rtsp_session_pool_get_n_sessions (GstRTSPSessionPool * pool)
 
   g_return_val_if_fail (GST_IS_RTSP_SESSION_POOL (pool), 0);
 
-  g_mutex_lock (&pool->lock);
-  result = g_hash_table_size (pool->sessions);
-  g_mutex_unlock (&pool->lock);
+  result = g_atomic_int_get (&pool->n_sessions);
 
   return result;
 }
 
+static GstRTSPSessionPoolShard *
+get_shard (GstRTSPSessionPool * pool, const gchar * sessionid)
+{
+  return &pool->shards[g_str_hash (sessionid) % N_SHARDS];
+}
+
+static gint
+compare_timeout (TimeoutEntry * a, TimeoutEntry * b, gpointer user_data)
+{
+  if (a->due < b->due)
+    return -1;
+  if (a->due > b->due)
+    return 1;
+  return 0;
+}
+
+/* must be called with the shard lock, returns the time in microseconds at
+ * which @sess expires at the earliest */
+static gint64
+session_due (GstRTSPSession * sess, gint64 now)
+{
+  return now + gst_rtsp_session_next_timeout_usec (sess, now);
+}
+
+/* must be called with the shard lock */
+static void
+schedule_session (GstRTSPSessionPoolShard * shard, GstRTSPSession * sess,
+    gint64 now)
+{
+  GSequenceIter *iter;
+  TimeoutEntry *entry;
+
+  if ((iter = g_hash_table_lookup (shard->timeout_iters, sess))) {
+    entry = g_sequence_get (iter);
+    entry->due = session_due (sess, now);
+    g_sequence_sort_changed (iter, (GCompareDataFunc) compare_timeout, NULL);
+  } else {
+    entry = g_slice_new (TimeoutEntry);
+    entry->session = sess;
+    entry->due = session_due (sess, now);
+    iter = g_sequence_insert_sorted (shard->timeouts, entry,
+        (GCompareDataFunc) compare_timeout, NULL);
+    g_hash_table_insert (shard->timeout_iters, sess, iter);
+  }
+}
+
+/* must be called with the shard lock */
+static void
+unschedule_session (GstRTSPSessionPool * pool,
+    GstRTSPSessionPoolShard * shard, GstRTSPSession * sess)
+{
+  GSequenceIter *iter;
+
+  if ((iter = g_hash_table_lookup (shard->timeout_iters, sess))) {
+    g_sequence_remove (iter);
+    g_hash_table_remove (shard->timeout_iters, sess);
+  }
+  g_signal_handlers_disconnect_by_func (sess, session_timeout_changed, pool);
+
+  g_mutex_lock (&shard->changed_lock);
+  g_hash_table_remove (shard->changed, sess);
+  g_mutex_unlock (&shard->changed_lock);
+}
+
+/* must be called with the shard lock, move the sessions whose timeout was
+ * changed to their new place in the sequence */
+static void
+reschedule_changed (GstRTSPSessionPoolShard * shard, gint64 now)
+{
+  GHashTableIter iter;
+  gpointer sess;
+
+  g_mutex_lock (&shard->changed_lock);
+  g_hash_table_iter_init (&iter, shard->changed);
+  while (g_hash_table_iter_next (&iter, &sess, NULL)) {
+    /* a session that is being removed can still be added from a notify that
+     * races with the removal, only touch the scheduled ones */
+    if (g_hash_table_lookup (shard->timeout_iters, sess)) {
+      GST_DEBUG ("%p: rescheduling session with changed timeout", sess);
+      schedule_session (shard, sess, now);
+    }
+    g_hash_table_iter_remove (&iter);
+  }
+  g_mutex_unlock (&shard->changed_lock);
+}
+
+/* must be called with the shard lock. Get the first session that is expired or
+ * %NULL when no session expired. @timeout is set to the amount of milliseconds
+ * until the next session expires or -1 when there are no sessions. */
+static GstRTSPSession *
+next_expired (GstRTSPSessionPoolShard * shard, gint64 now, gint * timeout)
+{
+  reschedule_changed (shard, now);
+
+  while (TRUE) {
+    GSequenceIter *iter;
+    TimeoutEntry *entry;
+
+    iter = g_sequence_get_begin_iter (shard->timeouts);
+    if (g_sequence_iter_is_end (iter)) {
+      *timeout = -1;
+      return NULL;
+    }
+
+    entry = g_sequence_get (iter);
+    if (entry->due > now) {
+      *timeout = (entry->due - now + 999) / 1000;
+      return NULL;
+    }
+
+    /* the session could have been touched after it was scheduled */
+    if (gst_rtsp_session_is_expired_usec (entry->session, now)) {
+      *timeout = 0;
+      return entry->session;
+    }
+
+    GST_DEBUG ("%p: rescheduling session", entry->session);
+    schedule_session (shard, entry->session, now);
+  }
+}
+
+static void
+session_timeout_changed (GstRTSPSession * sess, GParamSpec * pspec,
+    GstRTSPSessionPool * pool)
+{
+  GstRTSPSessionPoolShard *shard;
+
+  /* we can be called with or without the shard lock, remember the session so
+   * that it is rescheduled the next time the shard is checked */
+  shard = get_shard (pool, sess->sessionid);
+  g_mutex_lock (&shard->changed_lock);
+  g_hash_table_add (shard->changed, sess);
+  g_mutex_unlock (&shard->changed_lock);
+}
+
 /**
  * gst_rtsp_session_pool_find:
  * @pool: the pool to search
@@ -220,18 +428,21 @@ gst_rtsp_session_pool_get_n_sessions (GstRTSPSessionPool * pool)
 GstRTSPSession *
 gst_rtsp_session_pool_find (GstRTSPSessionPool * pool, const gchar * sessionid)
 {
+  GstRTSPSessionPoolShard *shard;
   GstRTSPSession *result;
 
   g_return_val_if_fail (GST_IS_RTSP_SESSION_POOL (pool), NULL);
   g_return_val_if_fail (sessionid != NULL, NULL);
 
-  g_mutex_lock (&pool->lock);
-  result = g_hash_table_lookup (pool->sessions, sessionid);
+  shard = get_shard (pool, sessionid);
+
+  g_mutex_lock (&shard->lock);
+  result = g_hash_table_lookup (shard->sessions, sessionid);
   if (result) {
     g_object_ref (result);
     gst_rtsp_session_touch (result);
   }
-  g_mutex_unlock (&pool->lock);
+  g_mutex_unlock (&shard->lock);
 
   return result;
 }
@@ -264,13 +475,24 @@ gst_rtsp_session_pool_create (GstRTSPSessionPool * pool)
 {
   GstRTSPSession *result = NULL;
   GstRTSPSessionPoolClass *klass;
+  GstRTSPSessionPoolShard *shard;
   gchar *id = NULL;
-  guint retry;
+  guint retry, max_sessions;
+  gint n_sessions;
 
   g_return_val_if_fail (GST_IS_RTSP_SESSION_POOL (pool), NULL);
 
   klass = GST_RTSP_SESSION_POOL_GET_CLASS (pool);
 
+  /* check session limit, reserve our session first so that concurrent creates
+   * can't go over the limit */
+  n_sessions = g_atomic_int_add (&pool->n_sessions, 1);
+  g_mutex_lock (&pool->lock);
+  max_sessions = pool->max_sessions;
+  g_mutex_unlock (&pool->lock);
+  if (max_sessions > 0 && (guint) n_sessions >= max_sessions)
+    goto too_many_sessions;
+
   retry = 0;
   do {
     /* start by creating a new random session id, we assume that this is random
@@ -283,14 +505,11 @@ gst_rtsp_session_pool_create (GstRTSPSessionPool * pool)
     if (id == NULL)
       goto no_session;
 
-    g_mutex_lock (&pool->lock);
-    /* check session limit */
-    if (pool->max_sessions > 0) {
-      if (g_hash_table_size (pool->sessions) >= pool->max_sessions)
-        goto too_many_sessions;
-    }
+    shard = get_shard (pool, id);
+
+    g_mutex_lock (&shard->lock);
     /* check if the sessionid existed */
-    result = g_hash_table_lookup (pool->sessions, id);
+    result = g_hash_table_lookup (shard->sessions, id);
     if (result) {
       /* found, retry with a different session id */
       result = NULL;
@@ -302,9 +521,13 @@ gst_rtsp_session_pool_create (GstRTSPSessionPool * pool)
       result = gst_rtsp_session_new (id);
       /* take additional ref for the pool */
       g_object_ref (result);
-      g_hash_table_insert (pool->sessions, result->sessionid, result);
+      g_hash_table_insert (shard->sessions, result->sessionid, result);
+
+      schedule_session (shard, result, gst_rtsp_session_get_time ());
+      g_signal_connect (result, "notify::timeout",
+          (GCallback) session_timeout_changed, pool);
     }
-    g_mutex_unlock (&pool->lock);
+    g_mutex_unlock (&shard->lock);
 
     g_free (id);
   } while (result == NULL);
@@ -315,25 +538,27 @@ gst_rtsp_session_pool_create (GstRTSPSessionPool * pool)
 no_function:
   {
     GST_WARNING ("no create_session_id vmethod in GstRTSPSessionPool %p", pool);
+    g_atomic_int_add (&pool->n_sessions, -1);
     return NULL;
   }
 no_session:
   {
     GST_WARNING ("can't create session id with GstRTSPSessionPool %p", pool);
+    g_atomic_int_add (&pool->n_sessions, -1);
     return NULL;
   }
 collision:
   {
     GST_WARNING ("can't find unique sessionid for GstRTSPSessionPool %p", pool);
-    g_mutex_unlock (&pool->lock);
+    g_mutex_unlock (&shard->lock);
+    g_atomic_int_add (&pool->n_sessions, -1);
     g_free (id);
     return NULL;
   }
 too_many_sessions:
   {
-    GST_WARNING ("session pool reached max sessions of %d", pool->max_sessions);
-    g_mutex_unlock (&pool->lock);
-    g_free (id);
+    GST_WARNING ("session pool reached max sessions of %d", max_sessions);
+    g_atomic_int_add (&pool->n_sessions, -1);
     return NULL;
   }
 }
@@ -350,48 +575,63 @@ too_many_sessions:
 gboolean
 gst_rtsp_session_pool_remove (GstRTSPSessionPool * pool, GstRTSPSession * sess)
 {
+  GstRTSPSessionPoolShard *shard;
   gboolean found;
 
   g_return_val_if_fail (GST_IS_RTSP_SESSION_POOL (pool), FALSE);
   g_return_val_if_fail (GST_IS_RTSP_SESSION (sess), FALSE);
 
-  g_mutex_lock (&pool->lock);
-  found = g_hash_table_remove (pool->sessions, sess->sessionid);
-  g_mutex_unlock (&pool->lock);
+  shard = get_shard (pool, sess->sessionid);
 
-  return found;
-}
+  g_mutex_lock (&shard->lock);
+  found = g_hash_table_lookup (shard->sessions, sess->sessionid) == sess;
+  if (found) {
+    unschedule_session (pool, shard, sess);
+    g_hash_table_remove (shard->sessions, sess->sessionid);
+  }
+  g_mutex_unlock (&shard->lock);
 
-static gboolean
-cleanup_func (gchar * sessionid, GstRTSPSession * sess, GTimeVal * now)
-{
-  return gst_rtsp_session_is_expired (sess, now);
+  if (found)
+    g_atomic_int_add (&pool->n_sessions, -1);
+
+  return found;
 }
 
 /**
  * gst_rtsp_session_pool_cleanup:
  * @pool: a #GstRTSPSessionPool
  *
- * Inspect all the sessions in @pool and remove the sessions that are inactive
- * for more than their timeout.
+ * Remove the sessions in @pool that are inactive for more than their timeout.
+ * Only the sessions that could have expired are inspected.
  *
  * Returns: the amount of sessions that got removed.
  */
 guint
 gst_rtsp_session_pool_cleanup (GstRTSPSessionPool * pool)
 {
-  guint result;
-  GTimeVal now;
+  guint i, result;
+  gint64 now;
+  GstRTSPSession *sess;
+  gint timeout;
 
   g_return_val_if_fail (GST_IS_RTSP_SESSION_POOL (pool), 0);
 
-  g_get_current_time (&now);
+  now = gst_rtsp_session_get_time ();
 
-  g_mutex_lock (&pool->lock);
-  result =
-      g_hash_table_foreach_remove (pool->sessions, (GHRFunc) cleanup_func,
-      &now);
-  g_mutex_unlock (&pool->lock);
+  result = 0;
+  for (i = 0; i < N_SHARDS; i++) {
+    GstRTSPSessionPoolShard *shard = &pool->shards[i];
+
+    g_mutex_lock (&shard->lock);
+    while ((sess = next_expired (shard, now, &timeout))) {
+      GST_INFO ("%p: session expired", sess);
+      unschedule_session (pool, shard, sess);
+      g_hash_table_remove (shard->sessions, sess->sessionid);
+      result++;
+    }
+    g_mutex_unlock (&shard->lock);
+  }
+  g_atomic_int_add (&pool->n_sessions, -(gint) result);
 
   return result;
 }
@@ -399,6 +639,7 @@ gst_rtsp_session_pool_cleanup (GstRTSPSessionPool * pool)
 typedef struct
 {
   GstRTSPSessionPool *pool;
+  GstRTSPSessionPoolShard *shard;
   GstRTSPSessionFilterFunc func;
   gpointer user_data;
   GList *list;
@@ -409,6 +650,7 @@ filter_func (gchar * sessionid, GstRTSPSession * sess, FilterData * data)
 {
   switch (data->func (data->pool, sess, data->user_data)) {
     case GST_RTSP_FILTER_REMOVE:
+      unschedule_session (data->pool, data->shard, sess);
       return TRUE;
     case GST_RTSP_FILTER_REF:
       /* keep ref */
@@ -427,8 +669,9 @@ filter_func (gchar * sessionid, GstRTSPSession * sess, FilterData * data)
  * @user_data: user data passed to @func
  *
  * Call @func for each session in @pool. The result value of @func determines
- * what happens to the session. @func will be called with the session pool
- * locked so no further actions on @pool can be performed from @func.
+ * what happens to the session. @func will be called with the part of the
+ * session pool that contains the session locked so no further actions on
+ * @pool can be performed from @func.
  *
  * If @func returns #GST_RTSP_FILTER_REMOVE, the session will be removed from
  * @pool.
@@ -448,6 +691,7 @@ gst_rtsp_session_pool_filter (GstRTSPSessionPool * pool,
     GstRTSPSessionFilterFunc func, gpointer user_data)
 {
   FilterData data;
+  guint i, removed;
 
   g_return_val_if_fail (GST_IS_RTSP_SESSION_POOL (pool), NULL);
   g_return_val_if_fail (func != NULL, NULL);
@@ -457,9 +701,16 @@ gst_rtsp_session_pool_filter (GstRTSPSessionPool * pool,
   data.user_data = user_data;
   data.list = NULL;
 
-  g_mutex_lock (&pool->lock);
-  g_hash_table_foreach_remove (pool->sessions, (GHRFunc) filter_func, &data);
-  g_mutex_unlock (&pool->lock);
+  for (i = 0; i < N_SHARDS; i++) {
+    data.shard = &pool->shards[i];
+
+    g_mutex_lock (&data.shard->lock);
+    removed = g_hash_table_foreach_remove (data.shard->sessions,
+        (GHRFunc) filter_func, &data);
+    g_mutex_unlock (&data.shard->lock);
+
+    g_atomic_int_add (&pool->n_sessions, -(gint) removed);
+  }
 
   return data.list;
 }
@@ -471,35 +722,32 @@ typedef struct
   gint timeout;
 } GstPoolSource;
 
-static void
-collect_timeout (gchar * sessionid, GstRTSPSession * sess, GstPoolSource * psrc)
-{
-  gint timeout;
-  GTimeVal now;
-  gint64 tmp;
-
-  tmp = g_source_get_time ((GSource *) psrc);
-  now.tv_sec = tmp / G_USEC_PER_SEC;
-  now.tv_usec = tmp % G_USEC_PER_SEC;
-
-  timeout = gst_rtsp_session_next_timeout (sess, &now);
-  GST_INFO ("%p: next timeout: %d", sess, timeout);
-  if (psrc->timeout == -1 || timeout < psrc->timeout)
-    psrc->timeout = timeout;
-}
-
 static gboolean
 gst_pool_source_prepare (GSource * source, gint * timeout)
 {
   GstPoolSource *psrc;
   gboolean result;
+  gint64 now;
+  guint i;
 
   psrc = (GstPoolSource *) source;
   psrc->timeout = -1;
 
-  g_mutex_lock (&psrc->pool->lock);
-  g_hash_table_foreach (psrc->pool->sessions, (GHFunc) collect_timeout, psrc);
-  g_mutex_unlock (&psrc->pool->lock);
+  /* the sessions use the monotonic time, cached for this iteration */
+  now = g_source_get_time (source);
+
+  /* only looks at the sessions that could have expired */
+  for (i = 0; i < N_SHARDS; i++) {
+    GstRTSPSessionPoolShard *shard = &psrc->pool->shards[i];
+    gint stimeout;
+
+    g_mutex_lock (&shard->lock);
+    next_expired (shard, now, &stimeout);
+    g_mutex_unlock (&shard->lock);
+
+    if (stimeout != -1 && (psrc->timeout == -1 || stimeout < psrc->timeout))
+      psrc->timeout = stimeout;
+  }
 
   if (timeout)
     *timeout = psrc->timeout;
@@ -27,6 +27,7 @@ G_BEGIN_DECLS
 
 typedef struct _GstRTSPSessionPool GstRTSPSessionPool;
 typedef struct _GstRTSPSessionPoolClass GstRTSPSessionPoolClass;
+typedef struct _GstRTSPSessionPoolShard GstRTSPSessionPoolShard;
 
 #include "rtsp-session.h"
 
@@ -42,8 +43,9 @@ typedef struct _GstRTSPSessionPoolClass GstRTSPSessionPoolClass;
 /**
  * GstRTSPSessionPool:
  * @max_sessions: the maximum number of sessions.
- * @lock: locking the session hashtable
- * @session: hashtable of sessions indexed by the session id.
+ * @lock: locking the configuration
+ * @n_sessions: the number of sessions, updated atomically
+ * @shards: the independently locked parts of the session table
  *
  * An object that keeps track of the active sessions. This object is usually
  * attached to a #GstRTSPServer object to manage the sessions in that server.
@@ -54,7 +56,9 @@ struct _GstRTSPSessionPool {
   guint         max_sessions;
 
   GMutex        lock;
-  GHashTable   *sessions;
+  gint          n_sessions;
+
+  GstRTSPSessionPoolShard *shards;
 };
 
 /**
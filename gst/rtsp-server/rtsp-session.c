@@ -17,6 +17,7 @@
  * Boston, MA 02111-1307, USA.
  */
 #include <string.h>
+#include <time.h>
 
 #include "rtsp-session.h"
 
@@ -73,7 +74,9 @@ gst_rtsp_session_init (GstRTSPSession * session)
 {
   session->timeout = DEFAULT_TIMEOUT;
   g_get_current_time (&session->create_time);
-  gst_rtsp_session_touch (session);
+  session->last_access = session->create_time;
+  session->create_time_usec = gst_rtsp_session_get_time ();
+  session->last_access_usec = session->create_time_usec;
 }
 
 static void
@@ -82,6 +85,7 @@ gst_rtsp_session_free_stream (GstRTSPSessionStream * stream)
   GST_INFO ("free session stream %p", stream);
 
   /* remove callbacks now */
+  gst_rtsp_session_stream_set_list_callbacks (stream, NULL, NULL);
   gst_rtsp_session_stream_set_callbacks (stream, NULL, NULL, NULL, NULL);
   gst_rtsp_session_stream_set_keepalive (stream, NULL, NULL, NULL);
 
@@ -100,15 +104,24 @@ gst_rtsp_session_free_media (GstRTSPSessionMedia * media,
 
   GST_INFO ("free session media %p", media);
 
+  /* the media waits until its streaming threads no longer use the transports
+   * before this returns, so the streams can be freed */
   gst_rtsp_session_media_set_state (media, GST_STATE_NULL);
 
   for (i = 0; i < size; i++) {
     GstRTSPSessionStream *stream;
 
     stream = g_array_index (media->streams, GstRTSPSessionStream *, i);
+    if (stream == NULL)
+      continue;
 
-    if (stream)
-      gst_rtsp_session_free_stream (stream);
+    /* give back the transport elements of the media stream */
+    if (stream->trans.transport)
+      gst_rtsp_media_release_transport (media->media, i,
+          stream->trans.transport->lower_transport,
+          stream->trans.branch_generation);
+
+    gst_rtsp_session_free_stream (stream);
   }
   g_array_free (media->streams, TRUE);
 
@@ -391,6 +404,8 @@ gst_rtsp_session_set_timeout (GstRTSPSession * session, guint timeout)
   g_return_if_fail (GST_IS_RTSP_SESSION (session));
 
   session->timeout = timeout;
+  /* the session pool needs to reschedule the expiry of the session */
+  g_object_notify (G_OBJECT (session), "timeout");
 }
 
 /**
@@ -409,6 +424,38 @@ gst_rtsp_session_get_timeout (GstRTSPSession * session)
   return session->timeout;
 }
 
+/**
+ * gst_rtsp_session_get_time:
+ *
+ * Get the current time as used for the session timeouts. This is a monotonic
+ * time in microseconds. When called from a #GSource callback, the cached time
+ * of the current main loop iteration is used, otherwise the time is taken from
+ * a coarse clock when available.
+ *
+ * Returns: the current monotonic time in microseconds.
+ */
+gint64
+gst_rtsp_session_get_time (void)
+{
+  GSource *source;
+
+  /* cached once per main loop iteration */
+  if ((source = g_main_current_source ()) && !g_source_is_destroyed (source))
+    return g_source_get_time (source);
+
+#ifdef CLOCK_MONOTONIC_COARSE
+  {
+    struct timespec ts;
+
+    /* same base as g_get_monotonic_time() but without a syscall */
+    if (clock_gettime (CLOCK_MONOTONIC_COARSE, &ts) == 0)
+      return (((gint64) ts.tv_sec) * G_USEC_PER_SEC) + ts.tv_nsec / 1000;
+  }
+#endif
+
+  return g_get_monotonic_time ();
+}
+
 /**
  * gst_rtsp_session_touch:
  * @session: a #GstRTSPSession
@@ -420,7 +467,7 @@ gst_rtsp_session_touch (GstRTSPSession * session)
 {
   g_return_if_fail (GST_IS_RTSP_SESSION (session));
 
-  g_get_current_time (&session->last_access);
+  session->last_access_usec = gst_rtsp_session_get_time ();
 }
 
 void
@@ -438,36 +485,33 @@ gst_rtsp_session_allow_expire (GstRTSPSession * session)
 }
 
 /**
- * gst_rtsp_session_next_timeout:
+ * gst_rtsp_session_next_timeout_usec:
  * @session: a #GstRTSPSession
- * @now: the current system time
+ * @now: the current monotonic time, as returned by gst_rtsp_session_get_time()
  *
- * Get the amount of milliseconds till the session will expire.
+ * Get the amount of microseconds till the session will expire.
  *
- * Returns: the amount of milliseconds since the session will time out.
+ * Returns: the amount of microseconds till the session will time out.
  */
-gint
-gst_rtsp_session_next_timeout (GstRTSPSession * session, GTimeVal * now)
+gint64
+gst_rtsp_session_next_timeout_usec (GstRTSPSession * session, gint64 now)
 {
-  gint res;
-  GstClockTime last_access, now_ns;
+  gint64 res;
+  gint64 expire;
 
   g_return_val_if_fail (GST_IS_RTSP_SESSION (session), -1);
-  g_return_val_if_fail (now != NULL, -1);
 
   if (g_atomic_int_get (&session->expire_count) != 0) {
     /* touch session when the expire count is not 0 */
-    g_get_current_time (&session->last_access);
+    session->last_access_usec = now;
   }
 
-  last_access = GST_TIMEVAL_TO_TIME (session->last_access);
   /* add timeout allow for 5 seconds of extra time */
-  last_access += session->timeout * GST_SECOND + (5 * GST_SECOND);
-
-  now_ns = GST_TIMEVAL_TO_TIME (*now);
+  expire = session->last_access_usec +
+      ((gint64) session->timeout + 5) * G_USEC_PER_SEC;
 
-  if (last_access > now_ns)
-    res = GST_TIME_AS_MSECONDS (last_access - now_ns);
+  if (expire > now)
+    res = expire - now;
   else
     res = 0;
 
@@ -475,24 +519,81 @@ gst_rtsp_session_next_timeout (GstRTSPSession * session, GTimeVal * now)
 }
 
 /**
- * gst_rtsp_session_is_expired:
+ * gst_rtsp_session_is_expired_usec:
  * @session: a #GstRTSPSession
- * @now: the current system time
+ * @now: the current monotonic time, as returned by gst_rtsp_session_get_time()
  *
  * Check if @session timeout out.
  *
  * Returns: %TRUE if @session timed out
  */
 gboolean
-gst_rtsp_session_is_expired (GstRTSPSession * session, GTimeVal * now)
+gst_rtsp_session_is_expired_usec (GstRTSPSession * session, gint64 now)
 {
   gboolean res;
 
-  res = (gst_rtsp_session_next_timeout (session, now) == 0);
+  res = (gst_rtsp_session_next_timeout_usec (session, now) == 0);
 
   return res;
 }
 
+/* convert the system time @now to the monotonic time of the sessions by
+ * moving the current monotonic time by the distance of @now to the current
+ * system time */
+static gint64
+timeval_to_session_time (GTimeVal * now)
+{
+  gint64 now_real;
+
+  now_real = (gint64) now->tv_sec * G_USEC_PER_SEC + now->tv_usec;
+
+  return gst_rtsp_session_get_time () + (now_real - g_get_real_time ());
+}
+
+/**
+ * gst_rtsp_session_next_timeout:
+ * @session: a #GstRTSPSession
+ * @now: the current system time
+ *
+ * Get the amount of milliseconds till the session will expire.
+ *
+ * The session times are monotonic, @now is converted to the monotonic time
+ * with the current system time. Use gst_rtsp_session_next_timeout_usec() in
+ * new code.
+ *
+ * Returns: the amount of milliseconds till the session will time out.
+ */
+gint
+gst_rtsp_session_next_timeout (GstRTSPSession * session, GTimeVal * now)
+{
+  g_return_val_if_fail (now != NULL, -1);
+
+  return gst_rtsp_session_next_timeout_usec (session,
+      timeval_to_session_time (now)) / 1000;
+}
+
+/**
+ * gst_rtsp_session_is_expired:
+ * @session: a #GstRTSPSession
+ * @now: the current system time
+ *
+ * Check if @session timeout out.
+ *
+ * The session times are monotonic, @now is converted to the monotonic time
+ * with the current system time. Use gst_rtsp_session_is_expired_usec() in new
+ * code.
+ *
+ * Returns: %TRUE if @session timed out
+ */
+gboolean
+gst_rtsp_session_is_expired (GstRTSPSession * session, GTimeVal * now)
+{
+  g_return_val_if_fail (now != NULL, FALSE);
+
+  return gst_rtsp_session_is_expired_usec (session,
+      timeval_to_session_time (now));
+}
+
 /**
  * gst_rtsp_session_stream_init_udp:
  * @stream: a #GstRTSPSessionStream
@@ -552,8 +653,6 @@ gst_rtsp_session_stream_set_transport (GstRTSPSessionStream * stream,
  * @stream: a #GstRTSPSessionStream
  * @send_rtp: a callback called when RTP should be sent
  * @send_rtcp: a callback called when RTCP should be sent
- * @send_rtp_list: a callback called when RTP should be sent
- * @send_rtcp_list: a callback called when RTCP should be sent
  * @user_data: user data passed to callbacks
  * @notify: called with the user_data when no longer needed.
  *
@@ -573,6 +672,26 @@ gst_rtsp_session_stream_set_callbacks (GstRTSPSessionStream * stream,
   stream->trans.notify = notify;
 }
 
+/**
+ * gst_rtsp_session_stream_set_list_callbacks:
+ * @stream: a #GstRTSPSessionStream
+ * @send_rtp_list: a callback called when a list of RTP packets should be sent
+ * @send_rtcp_list: a callback called when a list of RTCP packets should be
+ *    sent
+ *
+ * Install callbacks that send a group of packets at once. They are called with
+ * the user_data given to gst_rtsp_session_stream_set_callbacks(). When they
+ * are %NULL, the callbacks of gst_rtsp_session_stream_set_callbacks() are
+ * called for each packet in the group.
+ */
+void
+gst_rtsp_session_stream_set_list_callbacks (GstRTSPSessionStream * stream,
+    GstRTSPSendListFunc send_rtp_list, GstRTSPSendListFunc send_rtcp_list)
+{
+  stream->trans.send_rtp_list = send_rtp_list;
+  stream->trans.send_rtcp_list = send_rtcp_list;
+}
+
 /**
  * gst_rtsp_session_stream_set_keepalive:
  * @stream: a #GstRTSPSessionStream
@@ -87,9 +87,14 @@ struct _GstRTSPSessionMedia
  * @sessionid: the session id of the session
  * @timeout: the timeout of the session
  * @create_time: the time when the session was created
- * @last_access: the time the session was last accessed
+ * @last_access: the time the session was created, it is not updated when the
+ *    session is accessed, use @last_access_usec
  * @expire_count: the expire prevention counter
  * @media: a list of #GstRTSPSessionMedia managed in this session
+ * @create_time_usec: the monotonic time in microseconds when the session was
+ *    created
+ * @last_access_usec: the monotonic time in microseconds the session was last
+ *    accessed, used for the timeouts
  *
  * Session information kept by the server for a specific client.
  * One client session, identified with a session id, can handle multiple medias
@@ -106,6 +111,9 @@ struct _GstRTSPSession {
   gint          expire_count;
 
   GList        *medias;
+
+  gint64        create_time_usec;
+  gint64        last_access_usec;
 };
 
 struct _GstRTSPSessionClass {
@@ -123,11 +131,14 @@ void                   gst_rtsp_session_set_timeout          (GstRTSPSession *se
 guint                  gst_rtsp_session_get_timeout          (GstRTSPSession *session);
 
 /* session timeout stuff */
+gint64                 gst_rtsp_session_get_time             (void);
 void                   gst_rtsp_session_touch                (GstRTSPSession *session);
 void                   gst_rtsp_session_prevent_expire       (GstRTSPSession *session);
 void                   gst_rtsp_session_allow_expire         (GstRTSPSession *session);
 gint                   gst_rtsp_session_next_timeout         (GstRTSPSession *session, GTimeVal *now);
 gboolean               gst_rtsp_session_is_expired           (GstRTSPSession *session, GTimeVal *now);
+gint64                 gst_rtsp_session_next_timeout_usec    (GstRTSPSession *session, gint64 now);
+gboolean               gst_rtsp_session_is_expired_usec      (GstRTSPSession *session, gint64 now);
 
 /* handle media in a session */
 GstRTSPSessionMedia *  gst_rtsp_session_manage_media         (GstRTSPSession *sess,
@@ -156,6 +167,9 @@ void                   gst_rtsp_session_stream_set_callbacks (GstRTSPSessionStre
                                                               GstRTSPSendFunc send_rtcp,
                                                               gpointer user_data,
                                                               GDestroyNotify  notify);
+void                   gst_rtsp_session_stream_set_list_callbacks (GstRTSPSessionStream *stream,
+                                                              GstRTSPSendListFunc send_rtp_list,
+                                                              GstRTSPSendListFunc send_rtcp_list);
 void                   gst_rtsp_session_stream_set_keepalive (GstRTSPSessionStream *stream,
                                                               GstRTSPKeepAliveFunc keep_alive,
                                                               gpointer user_data,
@@ -0,0 +1,161 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent at local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "rtsp-tcp-sink.h"
+
+GST_DEBUG_CATEGORY_STATIC (rtsp_tcp_sink_debug);
+#define GST_CAT_DEFAULT rtsp_tcp_sink_debug
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static void gst_rtsp_tcp_sink_finalize (GObject * object);
+
+static GstFlowReturn gst_rtsp_tcp_sink_render (GstBaseSink * bsink,
+    GstBuffer * buffer);
+static GstFlowReturn gst_rtsp_tcp_sink_render_list (GstBaseSink * bsink,
+    GstBufferList * list);
+
+G_DEFINE_TYPE (GstRTSPTCPSink, gst_rtsp_tcp_sink, GST_TYPE_BASE_SINK);
+
+static void
+gst_rtsp_tcp_sink_class_init (GstRTSPTCPSinkClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *element_class;
+  GstBaseSinkClass *basesink_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  element_class = GST_ELEMENT_CLASS (klass);
+  basesink_class = GST_BASE_SINK_CLASS (klass);
+
+  gobject_class->finalize = gst_rtsp_tcp_sink_finalize;
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+  gst_element_class_set_static_metadata (element_class,
+      "RTSP TCP sink", "Sink/Network",
+      "Pass packets to the RTSP connections",
+      "agent <agent@local>");
+
+  basesink_class->render = gst_rtsp_tcp_sink_render;
+  basesink_class->render_list = gst_rtsp_tcp_sink_render_list;
+
+  GST_DEBUG_CATEGORY_INIT (rtsp_tcp_sink_debug, "rtsptcpsink", 0,
+      "GstRTSPTCPSink");
+}
+
+static void
+gst_rtsp_tcp_sink_init (GstRTSPTCPSink * sink)
+{
+  /* the packets are sent as soon as they arrive and the sink is added to
+   * running pipelines */
+  gst_base_sink_set_sync (GST_BASE_SINK_CAST (sink), FALSE);
+  gst_base_sink_set_async_enabled (GST_BASE_SINK_CAST (sink), FALSE);
+}
+
+static void
+gst_rtsp_tcp_sink_finalize (GObject * object)
+{
+  GstRTSPTCPSink *sink = GST_RTSP_TCP_SINK (object);
+
+  if (sink->notify)
+    sink->notify (sink->user_data);
+
+  G_OBJECT_CLASS (gst_rtsp_tcp_sink_parent_class)->finalize (object);
+}
+
+/**
+ * gst_rtsp_tcp_sink_new:
+ *
+ * Create a new #GstRTSPTCPSink. Set its callback with
+ * gst_rtsp_tcp_sink_set_callback() before it receives data.
+ *
+ * Returns: A new #GstRTSPTCPSink.
+ */
+GstElement *
+gst_rtsp_tcp_sink_new (void)
+{
+  GstElement *result;
+
+  result = g_object_new (GST_TYPE_RTSP_TCP_SINK, NULL);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_tcp_sink_set_callback:
+ * @sink: a #GstRTSPTCPSink
+ * @func: the callback receiving the data
+ * @user_data: user data passed to @func
+ * @notify: called with @user_data when no longer needed
+ *
+ * Set the callback that receives the buffers and buffer lists of @sink. This
+ * should be done while @sink is not streaming.
+ */
+void
+gst_rtsp_tcp_sink_set_callback (GstRTSPTCPSink * sink,
+    GstRTSPTCPSinkFunc func, gpointer user_data, GDestroyNotify notify)
+{
+  GDestroyNotify old_notify;
+  gpointer old_data;
+
+  g_return_if_fail (GST_IS_RTSP_TCP_SINK (sink));
+
+  GST_OBJECT_LOCK (sink);
+  old_notify = sink->notify;
+  old_data = sink->user_data;
+  sink->func = func;
+  sink->user_data = user_data;
+  sink->notify = notify;
+  GST_OBJECT_UNLOCK (sink);
+
+  if (old_notify)
+    old_notify (old_data);
+}
+
+static GstFlowReturn
+gst_rtsp_tcp_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
+{
+  GstRTSPTCPSink *sink = GST_RTSP_TCP_SINK (bsink);
+
+  if (sink->func)
+    sink->func (sink, GST_MINI_OBJECT_CAST (buffer), sink->user_data);
+
+  return GST_FLOW_OK;
+}
+
+/* payloaders push a frame worth of packets as one buffer list, hand it over
+ * in one go */
+static GstFlowReturn
+gst_rtsp_tcp_sink_render_list (GstBaseSink * bsink, GstBufferList * list)
+{
+  GstRTSPTCPSink *sink = GST_RTSP_TCP_SINK (bsink);
+
+  if (sink->func)
+    sink->func (sink, GST_MINI_OBJECT_CAST (list), sink->user_data);
+
+  return GST_FLOW_OK;
+}
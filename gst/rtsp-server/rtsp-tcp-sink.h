@@ -0,0 +1,86 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent at local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+#ifndef __GST_RTSP_TCP_SINK_H__
+#define __GST_RTSP_TCP_SINK_H__
+
+G_BEGIN_DECLS
+
+typedef struct _GstRTSPTCPSink GstRTSPTCPSink;
+typedef struct _GstRTSPTCPSinkClass GstRTSPTCPSinkClass;
+
+#define GST_TYPE_RTSP_TCP_SINK              (gst_rtsp_tcp_sink_get_type ())
+#define GST_IS_RTSP_TCP_SINK(obj)           (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_RTSP_TCP_SINK))
+#define GST_IS_RTSP_TCP_SINK_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_RTSP_TCP_SINK))
+#define GST_RTSP_TCP_SINK_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_RTSP_TCP_SINK, GstRTSPTCPSinkClass))
+#define GST_RTSP_TCP_SINK(obj)              (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_RTSP_TCP_SINK, GstRTSPTCPSink))
+#define GST_RTSP_TCP_SINK_CLASS(klass)      (G_TYPE_CHECK_CLASS_CAST ((klass), GST_TYPE_RTSP_TCP_SINK, GstRTSPTCPSinkClass))
+#define GST_RTSP_TCP_SINK_CAST(obj)         ((GstRTSPTCPSink*)(obj))
+#define GST_RTSP_TCP_SINK_CLASS_CAST(klass) ((GstRTSPTCPSinkClass*)(klass))
+
+/**
+ * GstRTSPTCPSinkFunc:
+ * @sink: a #GstRTSPTCPSink
+ * @obj: the #GstBuffer or #GstBufferList to send
+ * @user_data: user data passed to gst_rtsp_tcp_sink_set_callback()
+ *
+ * Called from the streaming thread for each buffer and buffer list that
+ * reaches @sink.
+ */
+typedef void (*GstRTSPTCPSinkFunc) (GstRTSPTCPSink *sink, GstMiniObject *obj,
+                                    gpointer user_data);
+
+/**
+ * GstRTSPTCPSink:
+ * @func: the callback receiving the data
+ * @user_data: user data for @func
+ * @notify: called with @user_data when no longer needed
+ *
+ * A sink that hands the buffers and buffer lists it receives to a callback,
+ * used to send the packets of a stream over the RTSP connections. Unlike
+ * appsink, buffer lists are passed as a whole so that all packets of a frame
+ * can be sent at once.
+ */
+struct _GstRTSPTCPSink {
+  GstBaseSink         parent;
+
+  GstRTSPTCPSinkFunc  func;
+  gpointer            user_data;
+  GDestroyNotify      notify;
+};
+
+struct _GstRTSPTCPSinkClass {
+  GstBaseSinkClass  parent_class;
+};
+
+GType                 gst_rtsp_tcp_sink_get_type           (void);
+
+GstElement *          gst_rtsp_tcp_sink_new                (void);
+
+void                  gst_rtsp_tcp_sink_set_callback       (GstRTSPTCPSink *sink,
+                                                            GstRTSPTCPSinkFunc func,
+                                                            gpointer user_data,
+                                                            GDestroyNotify notify);
+
+G_END_DECLS
+
+#endif /* __GST_RTSP_TCP_SINK_H__ */
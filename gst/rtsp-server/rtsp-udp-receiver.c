@@ -0,0 +1,516 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent at local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "rtsp-udp-receiver.h"
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H)
+#define USE_EPOLL 1
+#endif
+
+#ifdef USE_EPOLL
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (rtsp_udp_receiver_debug);
+#define GST_CAT_DEFAULT rtsp_udp_receiver_debug
+
+/* the events handled in one wakeup of a poll thread */
+#define MAX_EVENTS      64
+/* microseconds to wait before polling again after an error */
+#define POLL_RETRY_DELAY 10000
+
+/* a thread polling a part of the sockets */
+typedef struct
+{
+  GstRTSPUDPReceiver *receiver;
+  gint epfd;
+  gint wakefd;
+
+  /* protects the fields below */
+  GMutex lock;
+  gboolean running;
+  /* the receiver was finalized from this thread, it frees itself */
+  gboolean detached;
+  /* the removed sockets, freed after the events being handled */
+  GList *dead;
+  guint n_watches;
+  GThread *thread;
+} PollThread;
+
+/* an added socket */
+typedef struct
+{
+  GSocket *socket;
+  GstRTSPUDPReceiveFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+  PollThread *thread;
+  gboolean removed;
+} Watch;
+
+static void gst_rtsp_udp_receiver_finalize (GObject * object);
+
+G_DEFINE_TYPE (GstRTSPUDPReceiver, gst_rtsp_udp_receiver, G_TYPE_OBJECT);
+
+static void
+gst_rtsp_udp_receiver_class_init (GstRTSPUDPReceiverClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gst_rtsp_udp_receiver_finalize;
+
+  GST_DEBUG_CATEGORY_INIT (rtsp_udp_receiver_debug, "rtspudpreceiver", 0,
+      "GstRTSPUDPReceiver");
+}
+
+static void
+gst_rtsp_udp_receiver_init (GstRTSPUDPReceiver * receiver)
+{
+  g_mutex_init (&receiver->lock);
+  receiver->watches = g_hash_table_new (NULL, NULL);
+}
+
+static void
+watch_free (Watch * watch)
+{
+  if (watch->notify)
+    watch->notify (watch->user_data);
+  g_object_unref (watch->socket);
+  g_slice_free (Watch, watch);
+}
+
+static void
+free_watch_value (GSocket * socket, Watch * watch, gpointer user_data)
+{
+  watch_free (watch);
+}
+
+#ifdef USE_EPOLL
+/* the watches of the thread that finalizes the receiver can still be in use
+ * by the callback that dropped the last ref, the thread frees them when it
+ * stops */
+static gboolean
+detach_watch (GSocket * socket, Watch * watch, PollThread * self)
+{
+  if (watch->thread != self)
+    return FALSE;
+
+  g_mutex_lock (&self->lock);
+  watch->removed = TRUE;
+  self->dead = g_list_prepend (self->dead, watch);
+  g_mutex_unlock (&self->lock);
+
+  return TRUE;
+}
+#endif
+
+#ifdef USE_EPOLL
+static void
+wake_thread (PollThread * thread)
+{
+  guint64 one = 1;
+
+  if (write (thread->wakefd, &one, sizeof (one)) < 0)
+    GST_WARNING ("could not wake up poll thread: %s", g_strerror (errno));
+}
+
+static void poll_thread_clear (PollThread * thread);
+
+static gpointer
+poll_loop (PollThread * thread)
+{
+  struct epoll_event events[MAX_EVENTS];
+  gint i, n;
+  GList *dead;
+
+  while (TRUE) {
+    n = epoll_wait (thread->epfd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      /* keep polling, the removed sockets are still freed and the thread
+       * can still be stopped */
+      if (errno != EINTR) {
+        GST_WARNING ("epoll_wait failed: %s", g_strerror (errno));
+        g_usleep (POLL_RETRY_DELAY);
+      }
+      n = 0;
+    }
+
+    g_mutex_lock (&thread->lock);
+    if (!thread->running)
+      break;
+
+    for (i = 0; i < n; i++) {
+      Watch *watch = events[i].data.ptr;
+
+      if (watch == NULL) {
+        guint64 count;
+
+        if (read (thread->wakefd, &count, sizeof (count)) < 0)
+          GST_DEBUG ("could not clear wakeup: %s", g_strerror (errno));
+        continue;
+      }
+      /* removed while we handled the previous events */
+      if (watch->removed)
+        continue;
+
+      g_mutex_unlock (&thread->lock);
+      watch->func (watch->socket, watch->user_data);
+      g_mutex_lock (&thread->lock);
+
+      /* the callback dropped the last ref of the receiver, the watches of the
+       * remaining events can be freed already */
+      if (!thread->running)
+        break;
+    }
+    if (!thread->running)
+      break;
+
+    dead = thread->dead;
+    thread->dead = NULL;
+    g_mutex_unlock (&thread->lock);
+
+    /* no event refers to them anymore. This can drop the last ref of the
+     * receiver, after which the thread is detached. */
+    g_list_free_full (dead, (GDestroyNotify) watch_free);
+  }
+  g_mutex_unlock (&thread->lock);
+
+  if (thread->detached)
+    poll_thread_clear (thread);
+
+  return NULL;
+}
+
+/* close and free @thread after its thread stopped */
+static void
+poll_thread_clear (PollThread * thread)
+{
+  g_list_free_full (thread->dead, (GDestroyNotify) watch_free);
+  thread->dead = NULL;
+  if (thread->wakefd >= 0)
+    close (thread->wakefd);
+  if (thread->epfd >= 0)
+    close (thread->epfd);
+  g_mutex_clear (&thread->lock);
+  g_slice_free (PollThread, thread);
+}
+
+static PollThread *
+poll_thread_new (GstRTSPUDPReceiver * receiver)
+{
+  PollThread *thread;
+  struct epoll_event ev;
+
+  thread = g_slice_new0 (PollThread);
+  thread->receiver = receiver;
+  thread->wakefd = -1;
+  g_mutex_init (&thread->lock);
+
+  thread->epfd = epoll_create1 (EPOLL_CLOEXEC);
+  if (thread->epfd < 0)
+    goto no_epoll;
+
+  thread->wakefd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (thread->wakefd < 0)
+    goto no_eventfd;
+
+  memset (&ev, 0, sizeof (ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  if (epoll_ctl (thread->epfd, EPOLL_CTL_ADD, thread->wakefd, &ev) < 0)
+    goto no_eventfd;
+
+  thread->running = TRUE;
+  thread->thread = g_thread_new ("rtsp-udp-recv", (GThreadFunc) poll_loop,
+      thread);
+
+  return thread;
+
+  /* ERRORS */
+no_epoll:
+  {
+    GST_WARNING ("could not create epoll instance: %s", g_strerror (errno));
+    poll_thread_clear (thread);
+    return NULL;
+  }
+no_eventfd:
+  {
+    GST_WARNING ("could not create wakeup: %s", g_strerror (errno));
+    poll_thread_clear (thread);
+    return NULL;
+  }
+}
+
+static void
+poll_thread_stop (PollThread * thread)
+{
+  g_mutex_lock (&thread->lock);
+  thread->running = FALSE;
+  wake_thread (thread);
+  /* the last ref of the receiver was dropped from a callback of @thread, it
+   * clears itself when it is done */
+  if (g_thread_self () == thread->thread)
+    thread->detached = TRUE;
+  g_mutex_unlock (&thread->lock);
+
+  if (thread->detached) {
+    g_thread_unref (thread->thread);
+    return;
+  }
+  g_thread_join (thread->thread);
+  poll_thread_clear (thread);
+}
+#endif
+
+static void
+gst_rtsp_udp_receiver_finalize (GObject * object)
+{
+  GstRTSPUDPReceiver *receiver = GST_RTSP_UDP_RECEIVER (object);
+#ifdef USE_EPOLL
+  PollThread **threads = receiver->threads;
+  guint i;
+
+  for (i = 0; i < receiver->n_threads; i++) {
+    if (threads[i]->thread == g_thread_self ()) {
+      g_hash_table_foreach_remove (receiver->watches,
+          (GHRFunc) detach_watch, threads[i]);
+      break;
+    }
+  }
+  for (i = 0; i < receiver->n_threads; i++)
+    poll_thread_stop (threads[i]);
+#endif
+  g_free (receiver->threads);
+
+  g_hash_table_foreach (receiver->watches, (GHFunc) free_watch_value, NULL);
+  g_hash_table_unref (receiver->watches);
+  g_mutex_clear (&receiver->lock);
+
+  G_OBJECT_CLASS (gst_rtsp_udp_receiver_parent_class)->finalize (object);
+}
+
+/**
+ * gst_rtsp_udp_receiver_new:
+ * @n_threads: the number of poll threads or 0 for one per processor
+ *
+ * Create a new #GstRTSPUDPReceiver.
+ *
+ * Returns: a new #GstRTSPUDPReceiver or %NULL when the platform does not
+ * support it.
+ */
+GstRTSPUDPReceiver *
+gst_rtsp_udp_receiver_new (guint n_threads)
+{
+#ifdef USE_EPOLL
+  GstRTSPUDPReceiver *result;
+  PollThread **threads;
+  guint i;
+
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+
+  result = g_object_new (GST_TYPE_RTSP_UDP_RECEIVER, NULL);
+
+  threads = g_new0 (PollThread *, n_threads);
+  result->threads = threads;
+  for (i = 0; i < n_threads; i++) {
+    if (!(threads[i] = poll_thread_new (result)))
+      goto start_failed;
+    result->n_threads++;
+  }
+  GST_INFO ("receiving with %u threads", n_threads);
+
+  return result;
+
+  /* ERRORS */
+start_failed:
+  {
+    g_object_unref (result);
+    return NULL;
+  }
+#else
+  GST_INFO ("no epoll support");
+  return NULL;
+#endif
+}
+
+static gpointer
+make_default (gpointer data)
+{
+  return gst_rtsp_udp_receiver_new (0);
+}
+
+/**
+ * gst_rtsp_udp_receiver_get_default:
+ *
+ * Get the receiver that is shared by all media, with one thread per
+ * processor. The receiver is made when it is first used.
+ *
+ * Returns: (transfer none): the default #GstRTSPUDPReceiver or %NULL when the
+ * platform does not support it.
+ */
+GstRTSPUDPReceiver *
+gst_rtsp_udp_receiver_get_default (void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  return g_once (&once, make_default, NULL);
+}
+
+/**
+ * gst_rtsp_udp_receiver_add:
+ * @receiver: a #GstRTSPUDPReceiver
+ * @socket: a #GSocket
+ * @func: the function to call when @socket has data
+ * @user_data: user data passed to @func
+ * @notify: called with @user_data when @func is not called anymore
+ *
+ * Call @func from one of the threads of @receiver when @socket has data.
+ * @socket is added to the thread with the fewest sockets.
+ *
+ * @notify is also called when @socket could not be added.
+ *
+ * Returns: %TRUE when @socket was added.
+ */
+gboolean
+gst_rtsp_udp_receiver_add (GstRTSPUDPReceiver * receiver, GSocket * socket,
+    GstRTSPUDPReceiveFunc func, gpointer user_data, GDestroyNotify notify)
+{
+#ifdef USE_EPOLL
+  PollThread **threads, *thread;
+  struct epoll_event ev;
+  Watch *watch;
+  guint i;
+
+  g_return_val_if_fail (GST_IS_RTSP_UDP_RECEIVER (receiver), FALSE);
+  g_return_val_if_fail (G_IS_SOCKET (socket), FALSE);
+  g_return_val_if_fail (func != NULL, FALSE);
+
+  g_mutex_lock (&receiver->lock);
+  if (g_hash_table_lookup (receiver->watches, socket))
+    goto was_added;
+
+  threads = receiver->threads;
+  thread = threads[0];
+  for (i = 1; i < receiver->n_threads; i++) {
+    if (threads[i]->n_watches < thread->n_watches)
+      thread = threads[i];
+  }
+
+  watch = g_slice_new0 (Watch);
+  watch->socket = g_object_ref (socket);
+  watch->func = func;
+  watch->user_data = user_data;
+  watch->notify = notify;
+  watch->thread = thread;
+
+  memset (&ev, 0, sizeof (ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = watch;
+  if (epoll_ctl (thread->epfd, EPOLL_CTL_ADD, g_socket_get_fd (socket),
+          &ev) < 0)
+    goto add_failed;
+
+  thread->n_watches++;
+  g_hash_table_insert (receiver->watches, socket, watch);
+  g_mutex_unlock (&receiver->lock);
+
+  return TRUE;
+
+  /* ERRORS */
+was_added:
+  {
+    GST_WARNING ("socket %p was added already", socket);
+    g_mutex_unlock (&receiver->lock);
+    if (notify)
+      notify (user_data);
+    return FALSE;
+  }
+add_failed:
+  {
+    GST_WARNING ("could not poll socket %p: %s", socket, g_strerror (errno));
+    g_mutex_unlock (&receiver->lock);
+    watch_free (watch);
+    return FALSE;
+  }
+#else
+  if (notify)
+    notify (user_data);
+  return FALSE;
+#endif
+}
+
+/**
+ * gst_rtsp_udp_receiver_remove:
+ * @receiver: a #GstRTSPUDPReceiver
+ * @socket: a #GSocket
+ *
+ * Stop receiving on @socket. This does not wait for the thread of @socket,
+ * its callback can still be running when this function returns but it is
+ * not called again. The notify function passed to
+ * gst_rtsp_udp_receiver_add() is called when the callback is done.
+ */
+void
+gst_rtsp_udp_receiver_remove (GstRTSPUDPReceiver * receiver, GSocket * socket)
+{
+#ifdef USE_EPOLL
+  PollThread *thread;
+  Watch *watch;
+
+  g_return_if_fail (GST_IS_RTSP_UDP_RECEIVER (receiver));
+  g_return_if_fail (G_IS_SOCKET (socket));
+
+  g_mutex_lock (&receiver->lock);
+  if (!(watch = g_hash_table_lookup (receiver->watches, socket)))
+    goto not_added;
+  g_hash_table_remove (receiver->watches, socket);
+  thread = watch->thread;
+  thread->n_watches--;
+  g_mutex_unlock (&receiver->lock);
+
+  /* the poll thread can still have events for the socket, it frees the
+   * watch after handling them */
+  g_mutex_lock (&thread->lock);
+  epoll_ctl (thread->epfd, EPOLL_CTL_DEL, g_socket_get_fd (socket), NULL);
+  watch->removed = TRUE;
+  thread->dead = g_list_prepend (thread->dead, watch);
+  if (g_thread_self () != thread->thread)
+    wake_thread (thread);
+  g_mutex_unlock (&thread->lock);
+
+  return;
+
+  /* ERRORS */
+not_added:
+  {
+    g_mutex_unlock (&receiver->lock);
+    return;
+  }
+#endif
+}
@@ -0,0 +1,93 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent at local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+
+#ifndef __GST_RTSP_UDP_RECEIVER_H__
+#define __GST_RTSP_UDP_RECEIVER_H__
+
+G_BEGIN_DECLS
+
+typedef struct _GstRTSPUDPReceiver GstRTSPUDPReceiver;
+typedef struct _GstRTSPUDPReceiverClass GstRTSPUDPReceiverClass;
+
+#define GST_TYPE_RTSP_UDP_RECEIVER              (gst_rtsp_udp_receiver_get_type ())
+#define GST_IS_RTSP_UDP_RECEIVER(obj)           (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_RTSP_UDP_RECEIVER))
+#define GST_IS_RTSP_UDP_RECEIVER_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_RTSP_UDP_RECEIVER))
+#define GST_RTSP_UDP_RECEIVER_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_RTSP_UDP_RECEIVER, GstRTSPUDPReceiverClass))
+#define GST_RTSP_UDP_RECEIVER(obj)              (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_RTSP_UDP_RECEIVER, GstRTSPUDPReceiver))
+#define GST_RTSP_UDP_RECEIVER_CLASS(klass)      (G_TYPE_CHECK_CLASS_CAST ((klass), GST_TYPE_RTSP_UDP_RECEIVER, GstRTSPUDPReceiverClass))
+#define GST_RTSP_UDP_RECEIVER_CAST(obj)         ((GstRTSPUDPReceiver*)(obj))
+#define GST_RTSP_UDP_RECEIVER_CLASS_CAST(klass) ((GstRTSPUDPReceiverClass*)(klass))
+
+/**
+ * GstRTSPUDPReceiveFunc:
+ * @socket: the #GSocket that can be read
+ * @user_data: user data passed to gst_rtsp_udp_receiver_add()
+ *
+ * Called from a thread of the receiver when @socket has data. The callback
+ * should read the available packets without blocking, the other sockets of
+ * the thread wait for it.
+ */
+typedef void (*GstRTSPUDPReceiveFunc) (GSocket *socket, gpointer user_data);
+
+/**
+ * GstRTSPUDPReceiver:
+ * @lock: lock protecting @watches
+ * @n_threads: the number of poll threads
+ * @threads: the poll threads
+ * @watches: the added sockets
+ *
+ * An object that waits for data on many UDP sockets with a few threads. Each
+ * socket is handled by one of the threads, which calls its callback when data
+ * arrives.
+ *
+ * The receiver uses epoll, gst_rtsp_udp_receiver_get_default() returns %NULL
+ * where the platform does not have it.
+ */
+struct _GstRTSPUDPReceiver {
+  GObject       parent;
+
+  GMutex        lock;
+  guint         n_threads;
+  gpointer      threads;
+  GHashTable   *watches;
+};
+
+struct _GstRTSPUDPReceiverClass {
+  GObjectClass  parent_class;
+};
+
+GType                 gst_rtsp_udp_receiver_get_type       (void);
+
+GstRTSPUDPReceiver *  gst_rtsp_udp_receiver_new            (guint n_threads);
+GstRTSPUDPReceiver *  gst_rtsp_udp_receiver_get_default    (void);
+
+gboolean              gst_rtsp_udp_receiver_add            (GstRTSPUDPReceiver *receiver,
+                                                            GSocket *socket,
+                                                            GstRTSPUDPReceiveFunc func,
+                                                            gpointer user_data,
+                                                            GDestroyNotify notify);
+void                  gst_rtsp_udp_receiver_remove         (GstRTSPUDPReceiver *receiver,
+                                                            GSocket *socket);
+
+G_END_DECLS
+
+#endif /* __GST_RTSP_UDP_RECEIVER_H__ */
@@ -0,0 +1,1390 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent at local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* for sendmmsg() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+
+#include "rtsp-udp-sink.h"
+
+#ifdef G_OS_UNIX
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_NETINET_UDP_H
+#include <netinet/udp.h>
+#endif
+
+#if defined(HAVE_SENDMMSG) && defined(UDP_SEGMENT)
+#define USE_GSO 1
+#endif
+
+#define DEFAULT_BUFFER_SIZE     0
+#define DEFAULT_GSO             TRUE
+#define DEFAULT_SEND_THREADS    0
+#define DEFAULT_LOOP            FALSE
+#define DEFAULT_TTL             64
+#define DEFAULT_TTL_MC          1
+
+enum
+{
+  PROP_0,
+  PROP_SOCKET,
+  PROP_BUFFER_SIZE,
+  PROP_GSO,
+  PROP_SEND_THREADS,
+  PROP_LOOP,
+  PROP_TTL,
+  PROP_TTL_MC,
+  PROP_LAST
+};
+
+/* if the kernel segments the messages, known after the first segmented
+ * message was sent */
+enum
+{
+  GSO_UNKNOWN,
+  GSO_SUPPORTED,
+  GSO_UNSUPPORTED
+};
+
+GST_DEBUG_CATEGORY_STATIC (rtsp_udp_sink_debug);
+#define GST_CAT_DEFAULT rtsp_udp_sink_debug
+
+/* the number of destinations sent to with one system call */
+#define BATCH_SIZE      64
+/* the number of memory blocks sent in one message */
+#define MAX_VECS        128
+/* limits of one segmented message */
+#define GSO_MAX_SEGMENTS  64
+#define GSO_MAX_SIZE      65000
+/* the maximum number of sender threads */
+#define MAX_SEND_THREADS  64
+/* the buffers queued for a sender thread before the streaming thread waits */
+#define MAX_QUEUED        64
+
+/* a destination with its address in the format of the platform. @count is
+ * protected by the lock of the sink. */
+typedef struct
+{
+  gint refcount;
+  GSocketAddress *address;
+  gpointer native;
+  gsize native_len;
+  guint count;
+} UDPDest;
+
+/* a part of the destinations. A destination always goes to the same shard so
+ * that its packets are sent in order by the shard's sender thread. */
+typedef struct
+{
+  GstRTSPUDPSink *sink;
+
+  /* protects the destinations. The array is replaced, never changed, when
+   * destinations are added or removed so that a sender can keep a ref and
+   * send without the lock. */
+  GMutex lock;
+  GPtrArray *destinations;
+  /* the destinations being changed, with the lock of the sink */
+  GPtrArray *edit;
+
+  /* the buffers and buffer lists waiting for the sender thread */
+  GMutex queue_lock;
+  GCond queue_cond;
+  GQueue queue;
+  gboolean running;
+  GThread *thread;
+} SendShard;
+
+/* the mapped memory of the buffers in one message */
+typedef struct
+{
+  GOutputVector vec[MAX_VECS];
+  GstMapInfo map[MAX_VECS];
+  guint n_vec;
+  gsize size;
+  GstMemory *merged;
+} Vectors;
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static void gst_rtsp_udp_sink_get_property (GObject * object, guint propid,
+    GValue * value, GParamSpec * pspec);
+static void gst_rtsp_udp_sink_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec);
+static void gst_rtsp_udp_sink_finalize (GObject * object);
+
+static gboolean gst_rtsp_udp_sink_start (GstBaseSink * bsink);
+static gboolean gst_rtsp_udp_sink_stop (GstBaseSink * bsink);
+static gboolean gst_rtsp_udp_sink_unlock (GstBaseSink * bsink);
+static gboolean gst_rtsp_udp_sink_unlock_stop (GstBaseSink * bsink);
+static void configure_shards (GstRTSPUDPSink * sink);
+static void stop_threads (GstRTSPUDPSink * sink);
+static void set_flushing (GstRTSPUDPSink * sink, gboolean flushing);
+
+static GstFlowReturn gst_rtsp_udp_sink_render (GstBaseSink * bsink,
+    GstBuffer * buffer);
+static GstFlowReturn gst_rtsp_udp_sink_render_list (GstBaseSink * bsink,
+    GstBufferList * list);
+
+G_DEFINE_TYPE (GstRTSPUDPSink, gst_rtsp_udp_sink, GST_TYPE_BASE_SINK);
+
+static void
+gst_rtsp_udp_sink_class_init (GstRTSPUDPSinkClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *element_class;
+  GstBaseSinkClass *basesink_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  element_class = GST_ELEMENT_CLASS (klass);
+  basesink_class = GST_BASE_SINK_CLASS (klass);
+
+  gobject_class->get_property = gst_rtsp_udp_sink_get_property;
+  gobject_class->set_property = gst_rtsp_udp_sink_set_property;
+  gobject_class->finalize = gst_rtsp_udp_sink_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_SOCKET,
+      g_param_spec_object ("socket", "Socket",
+          "The socket to send from", G_TYPE_SOCKET,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BUFFER_SIZE,
+      g_param_spec_int ("buffer-size", "Buffer Size",
+          "The send buffer size of the socket, 0 for the default", 0,
+          G_MAXINT, DEFAULT_BUFFER_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_GSO,
+      g_param_spec_boolean ("gso", "GSO",
+          "Send buffer lists with UDP segmentation offload when possible",
+          DEFAULT_GSO, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SEND_THREADS,
+      g_param_spec_uint ("send-threads", "Send Threads",
+          "The number of threads sending to the destinations, 0 sends from "
+          "the streaming thread", 0, MAX_SEND_THREADS, DEFAULT_SEND_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LOOP,
+      g_param_spec_boolean ("loop", "Multicast Loopback",
+          "Deliver the multicast packets to the local host", DEFAULT_LOOP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TTL,
+      g_param_spec_int ("ttl", "Unicast TTL",
+          "The time to live of the unicast packets", 0, 255, DEFAULT_TTL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TTL_MC,
+      g_param_spec_int ("ttl-mc", "Multicast TTL",
+          "The time to live of the multicast packets", 0, 255, DEFAULT_TTL_MC,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+  gst_element_class_set_static_metadata (element_class,
+      "RTSP UDP sink", "Sink/Network",
+      "Send packets to many UDP destinations",
+      "agent <agent@local>");
+
+  basesink_class->start = gst_rtsp_udp_sink_start;
+  basesink_class->stop = gst_rtsp_udp_sink_stop;
+  basesink_class->unlock = gst_rtsp_udp_sink_unlock;
+  basesink_class->unlock_stop = gst_rtsp_udp_sink_unlock_stop;
+  basesink_class->render = gst_rtsp_udp_sink_render;
+  basesink_class->render_list = gst_rtsp_udp_sink_render_list;
+
+  GST_DEBUG_CATEGORY_INIT (rtsp_udp_sink_debug, "rtspudpsink", 0,
+      "GstRTSPUDPSink");
+}
+
+static UDPDest *
+udp_dest_ref (UDPDest * dest)
+{
+  g_atomic_int_inc (&dest->refcount);
+  return dest;
+}
+
+static void
+udp_dest_unref (UDPDest * dest)
+{
+  if (g_atomic_int_dec_and_test (&dest->refcount)) {
+    g_object_unref (dest->address);
+    g_free (dest->native);
+    g_slice_free (UDPDest, dest);
+  }
+}
+
+/* a new array with a ref of each destination of @dests */
+static GPtrArray *
+copy_dests (GPtrArray * dests)
+{
+  GPtrArray *result;
+  guint i;
+
+  result = g_ptr_array_new_full (dests->len + 1,
+      (GDestroyNotify) udp_dest_unref);
+  for (i = 0; i < dests->len; i++)
+    g_ptr_array_add (result, udp_dest_ref (g_ptr_array_index (dests, i)));
+
+  return result;
+}
+
+static SendShard *
+shard_new (GstRTSPUDPSink * sink)
+{
+  SendShard *shard;
+
+  shard = g_slice_new0 (SendShard);
+  shard->sink = sink;
+  g_mutex_init (&shard->lock);
+  shard->destinations = g_ptr_array_new_with_free_func ((GDestroyNotify)
+      udp_dest_unref);
+  g_mutex_init (&shard->queue_lock);
+  g_cond_init (&shard->queue_cond);
+  g_queue_init (&shard->queue);
+
+  return shard;
+}
+
+/* free @shard, its sender thread must be stopped */
+static void
+shard_free (SendShard * shard)
+{
+  g_ptr_array_unref (shard->destinations);
+  g_mutex_clear (&shard->lock);
+  g_mutex_clear (&shard->queue_lock);
+  g_cond_clear (&shard->queue_cond);
+  g_slice_free (SendShard, shard);
+}
+
+static void
+gst_rtsp_udp_sink_init (GstRTSPUDPSink * sink)
+{
+  g_mutex_init (&sink->lock);
+  sink->buffer_size = DEFAULT_BUFFER_SIZE;
+  sink->gso = DEFAULT_GSO;
+  sink->send_threads = DEFAULT_SEND_THREADS;
+  sink->loop = DEFAULT_LOOP;
+  sink->ttl = DEFAULT_TTL;
+  sink->ttl_mc = DEFAULT_TTL_MC;
+  sink->cancellable = g_cancellable_new ();
+  sink->shards = g_ptr_array_new ();
+  g_ptr_array_add (sink->shards, shard_new (sink));
+}
+
+static void
+gst_rtsp_udp_sink_finalize (GObject * object)
+{
+  GstRTSPUDPSink *sink = GST_RTSP_UDP_SINK (object);
+  guint i;
+
+  for (i = 0; i < sink->shards->len; i++)
+    shard_free (g_ptr_array_index (sink->shards, i));
+  g_ptr_array_free (sink->shards, TRUE);
+
+  if (sink->socket)
+    g_object_unref (sink->socket);
+  g_object_unref (sink->cancellable);
+  g_mutex_clear (&sink->lock);
+
+  G_OBJECT_CLASS (gst_rtsp_udp_sink_parent_class)->finalize (object);
+}
+
+static void
+gst_rtsp_udp_sink_get_property (GObject * object, guint propid,
+    GValue * value, GParamSpec * pspec)
+{
+  GstRTSPUDPSink *sink = GST_RTSP_UDP_SINK (object);
+
+  switch (propid) {
+    case PROP_SOCKET:
+      GST_OBJECT_LOCK (sink);
+      g_value_set_object (value, sink->socket);
+      GST_OBJECT_UNLOCK (sink);
+      break;
+    case PROP_BUFFER_SIZE:
+      g_value_set_int (value, sink->buffer_size);
+      break;
+    case PROP_GSO:
+      g_value_set_boolean (value, sink->gso);
+      break;
+    case PROP_SEND_THREADS:
+      g_value_set_uint (value, sink->send_threads);
+      break;
+    case PROP_LOOP:
+      g_value_set_boolean (value, sink->loop);
+      break;
+    case PROP_TTL:
+      g_value_set_int (value, sink->ttl);
+      break;
+    case PROP_TTL_MC:
+      g_value_set_int (value, sink->ttl_mc);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+      break;
+  }
+}
+
+static void
+gst_rtsp_udp_sink_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstRTSPUDPSink *sink = GST_RTSP_UDP_SINK (object);
+  GSocket *old;
+
+  switch (propid) {
+    case PROP_SOCKET:
+      GST_OBJECT_LOCK (sink);
+      old = sink->socket;
+      sink->socket = g_value_dup_object (value);
+      GST_OBJECT_UNLOCK (sink);
+      if (old)
+        g_object_unref (old);
+      break;
+    case PROP_BUFFER_SIZE:
+      sink->buffer_size = g_value_get_int (value);
+      break;
+    case PROP_GSO:
+      sink->gso = g_value_get_boolean (value);
+      break;
+    case PROP_SEND_THREADS:
+      /* takes effect when the sink is started */
+      sink->send_threads = g_value_get_uint (value);
+      break;
+    case PROP_LOOP:
+      /* like the following, takes effect when the sink is started */
+      sink->loop = g_value_get_boolean (value);
+      break;
+    case PROP_TTL:
+      sink->ttl = g_value_get_int (value);
+      break;
+    case PROP_TTL_MC:
+      sink->ttl_mc = g_value_get_int (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+      break;
+  }
+}
+
+/**
+ * gst_rtsp_udp_sink_new:
+ * @socket: a #GSocket
+ *
+ * Create a new #GstRTSPUDPSink that sends from @socket. @socket is not closed
+ * by the sink.
+ *
+ * Returns: A new #GstRTSPUDPSink.
+ */
+GstElement *
+gst_rtsp_udp_sink_new (GSocket * socket)
+{
+  GstElement *result;
+
+  g_return_val_if_fail (G_IS_SOCKET (socket), NULL);
+
+  result = g_object_new (GST_TYPE_RTSP_UDP_SINK, "socket", socket, NULL);
+
+  return result;
+}
+
+#ifdef G_OS_UNIX
+static gboolean
+set_option (gint fd, gint level, gint option, gint value)
+{
+  return setsockopt (fd, level, option, &value, sizeof (value)) == 0;
+}
+
+/* apply the settings multiudpsink had for the socket */
+static void
+configure_socket (GstRTSPUDPSink * sink)
+{
+  gint fd = g_socket_get_fd (sink->socket);
+
+  if (sink->buffer_size > 0 &&
+      !set_option (fd, SOL_SOCKET, SO_SNDBUF, sink->buffer_size))
+    GST_WARNING_OBJECT (sink, "could not set buffer size to %d",
+        sink->buffer_size);
+
+  if (g_socket_get_family (sink->socket) == G_SOCKET_FAMILY_IPV6) {
+    if (!set_option (fd, IPPROTO_IPV6, IPV6_UNICAST_HOPS, sink->ttl) ||
+        !set_option (fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, sink->ttl_mc) ||
+        !set_option (fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, sink->loop))
+      GST_WARNING_OBJECT (sink, "could not configure the socket: %s",
+          g_strerror (errno));
+    /* for the mapped IPv4 destinations, where the platform allows it */
+    set_option (fd, IPPROTO_IP, IP_TTL, sink->ttl);
+    set_option (fd, IPPROTO_IP, IP_MULTICAST_TTL, sink->ttl_mc);
+    set_option (fd, IPPROTO_IP, IP_MULTICAST_LOOP, sink->loop);
+  } else {
+    if (!set_option (fd, IPPROTO_IP, IP_TTL, sink->ttl) ||
+        !set_option (fd, IPPROTO_IP, IP_MULTICAST_TTL, sink->ttl_mc) ||
+        !set_option (fd, IPPROTO_IP, IP_MULTICAST_LOOP, sink->loop))
+      GST_WARNING_OBJECT (sink, "could not configure the socket: %s",
+          g_strerror (errno));
+  }
+
+  g_atomic_int_set (&sink->gso_state, GSO_UNKNOWN);
+#ifdef USE_GSO
+  {
+    gint segment_size = 0;
+    socklen_t len = sizeof (segment_size);
+
+    if (getsockopt (fd, IPPROTO_UDP, UDP_SEGMENT, &segment_size, &len) < 0) {
+      GST_INFO_OBJECT (sink, "no segmentation offload: %s",
+          g_strerror (errno));
+      g_atomic_int_set (&sink->gso_state, GSO_UNSUPPORTED);
+    }
+  }
+#endif
+}
+#endif
+
+static gboolean
+gst_rtsp_udp_sink_start (GstBaseSink * bsink)
+{
+  GstRTSPUDPSink *sink = GST_RTSP_UDP_SINK (bsink);
+
+  if (sink->socket == NULL)
+    goto no_socket;
+
+#ifdef G_OS_UNIX
+  configure_socket (sink);
+#endif
+
+  /* cancelled when the sink was stopped */
+  g_cancellable_reset (sink->cancellable);
+  configure_shards (sink);
+
+  return TRUE;
+
+  /* ERRORS */
+no_socket:
+  {
+    GST_ELEMENT_ERROR (sink, RESOURCE, OPEN_WRITE, (NULL),
+        ("no socket configured"));
+    return FALSE;
+  }
+}
+
+static gboolean
+gst_rtsp_udp_sink_stop (GstBaseSink * bsink)
+{
+  GstRTSPUDPSink *sink = GST_RTSP_UDP_SINK (bsink);
+
+  /* the sender threads can be waiting for room in the send buffer */
+  g_cancellable_cancel (sink->cancellable);
+  stop_threads (sink);
+
+  return TRUE;
+}
+
+/* wake up the streaming thread waiting for a sender thread or for room in
+ * the send buffer of the socket */
+static gboolean
+gst_rtsp_udp_sink_unlock (GstBaseSink * bsink)
+{
+  GstRTSPUDPSink *sink = GST_RTSP_UDP_SINK (bsink);
+
+  set_flushing (sink, TRUE);
+  g_cancellable_cancel (sink->cancellable);
+
+  return TRUE;
+}
+
+static gboolean
+gst_rtsp_udp_sink_unlock_stop (GstBaseSink * bsink)
+{
+  GstRTSPUDPSink *sink = GST_RTSP_UDP_SINK (bsink);
+
+  set_flushing (sink, FALSE);
+  g_cancellable_reset (sink->cancellable);
+
+  return TRUE;
+}
+
+/* find the destination with @native in @dests */
+static gint
+find_dest (GPtrArray * dests, gconstpointer native, gsize native_len)
+{
+  guint i;
+
+  for (i = 0; i < dests->len; i++) {
+    UDPDest *dest = g_ptr_array_index (dests, i);
+
+    if (dest->native_len == native_len &&
+        memcmp (dest->native, native, native_len) == 0)
+      return i;
+  }
+  return -1;
+}
+
+static gpointer
+address_to_native (GSocketAddress * address, gsize * native_len)
+{
+  gpointer native;
+
+  *native_len = g_socket_address_get_native_size (address);
+  native = g_malloc0 (*native_len);
+  if (!g_socket_address_to_native (address, native, *native_len, NULL)) {
+    g_free (native);
+    return NULL;
+  }
+  return native;
+}
+
+/* IPv4 destinations are sent to as mapped addresses from an IPv6 socket */
+static GSocketAddress *
+map_address (GstRTSPUDPSink * sink, GSocketAddress * address)
+{
+  GInetAddress *inet;
+  const guint8 *bytes;
+  guint8 mapped[16] = { 0, };
+  GSocketAddress *result;
+
+  if (sink->socket == NULL ||
+      g_socket_get_family (sink->socket) != G_SOCKET_FAMILY_IPV6 ||
+      g_socket_address_get_family (address) != G_SOCKET_FAMILY_IPV4)
+    return g_object_ref (address);
+
+  bytes = g_inet_address_to_bytes (g_inet_socket_address_get_address
+      (G_INET_SOCKET_ADDRESS (address)));
+  mapped[10] = mapped[11] = 0xff;
+  memcpy (&mapped[12], bytes, 4);
+
+  inet = g_inet_address_new_from_bytes (mapped, G_SOCKET_FAMILY_IPV6);
+  result = g_inet_socket_address_new (inet,
+      g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (address)));
+  g_object_unref (inet);
+
+  return result;
+}
+
+/* the shard of a destination, called with the lock */
+static SendShard *
+find_shard (GstRTSPUDPSink * sink, gconstpointer native, gsize native_len)
+{
+  const guint8 *bytes = native;
+  guint32 hash = 2166136261u;
+  gsize i;
+
+  for (i = 0; i < native_len; i++)
+    hash = (hash ^ bytes[i]) * 16777619u;
+
+  return g_ptr_array_index (sink->shards, hash % sink->shards->len);
+}
+
+/* the destinations of @shard to change, copied from the ones being sent to
+ * on first use, called with the lock */
+static GPtrArray *
+shard_edit (SendShard * shard)
+{
+  if (shard->edit == NULL) {
+    g_mutex_lock (&shard->lock);
+    shard->edit = copy_dests (shard->destinations);
+    g_mutex_unlock (&shard->lock);
+  }
+  return shard->edit;
+}
+
+/* start sending to the changed destinations of all shards, called with the
+ * lock */
+static void
+commit_shards (GstRTSPUDPSink * sink)
+{
+  guint i;
+
+  for (i = 0; i < sink->shards->len; i++) {
+    SendShard *shard = g_ptr_array_index (sink->shards, i);
+    GPtrArray *old;
+
+    if (shard->edit == NULL)
+      continue;
+
+    g_mutex_lock (&shard->lock);
+    old = shard->destinations;
+    shard->destinations = shard->edit;
+    g_mutex_unlock (&shard->lock);
+    shard->edit = NULL;
+
+    g_ptr_array_unref (old);
+  }
+}
+
+/* the destinations to send to, unref after use */
+static GPtrArray *
+shard_get_dests (SendShard * shard)
+{
+  GPtrArray *dests;
+
+  g_mutex_lock (&shard->lock);
+  dests = g_ptr_array_ref (shard->destinations);
+  g_mutex_unlock (&shard->lock);
+
+  return dests;
+}
+
+/* add @address or count it again when it exists, called with the lock.
+ * Returns %TRUE when @address is a new destination. */
+static gboolean
+add_address (GstRTSPUDPSink * sink, GSocketAddress * address)
+{
+  GPtrArray *dests;
+  UDPDest *dest;
+  gpointer native;
+  gsize native_len;
+  gint idx;
+
+  address = map_address (sink, address);
+  native = address_to_native (address, &native_len);
+  if (native == NULL)
+    goto not_added;
+
+  dests = shard_edit (find_shard (sink, native, native_len));
+  idx = find_dest (dests, native, native_len);
+  if (idx >= 0) {
+    ((UDPDest *) g_ptr_array_index (dests, idx))->count++;
+    g_free (native);
+    goto not_added;
+  }
+
+  dest = g_slice_new (UDPDest);
+  dest->refcount = 1;
+  dest->address = address;
+  dest->native = native;
+  dest->native_len = native_len;
+  dest->count = 1;
+  g_ptr_array_add (dests, dest);
+
+  return TRUE;
+
+not_added:
+  {
+    g_object_unref (address);
+    return FALSE;
+  }
+}
+
+/* remove @address when it was added as many times as it is removed, called
+ * with the lock. Returns %TRUE when the destination is removed. */
+static gboolean
+remove_address (GstRTSPUDPSink * sink, GSocketAddress * address)
+{
+  GPtrArray *dests;
+  UDPDest *dest;
+  gpointer native;
+  gsize native_len;
+  gint idx;
+  gboolean res = FALSE;
+
+  address = map_address (sink, address);
+  native = address_to_native (address, &native_len);
+  g_object_unref (address);
+  if (native == NULL)
+    return FALSE;
+
+  dests = shard_edit (find_shard (sink, native, native_len));
+  idx = find_dest (dests, native, native_len);
+  if (idx >= 0) {
+    dest = g_ptr_array_index (dests, idx);
+    if (--dest->count == 0) {
+      g_ptr_array_remove_index_fast (dests, idx);
+      res = TRUE;
+    }
+  }
+  g_free (native);
+
+  return res;
+}
+
+static GSocketAddress *
+resolve_address (const gchar * host, gint port)
+{
+  GInetAddress *addr;
+  GSocketAddress *result;
+
+  addr = g_inet_address_new_from_string (host);
+  if (addr == NULL) {
+    GResolver *resolver;
+    GList *results;
+    GError *err = NULL;
+
+    resolver = g_resolver_get_default ();
+    results = g_resolver_lookup_by_name (resolver, host, NULL, &err);
+    g_object_unref (resolver);
+    if (results == NULL)
+      goto resolve_failed;
+
+    addr = g_object_ref (results->data);
+    g_resolver_free_addresses (results);
+  }
+  result = g_inet_socket_address_new (addr, port);
+  g_object_unref (addr);
+
+  return result;
+
+  /* ERRORS */
+resolve_failed:
+  {
+    GST_WARNING ("failed to resolve %s: %s", host, err->message);
+    g_error_free (err);
+    return NULL;
+  }
+}
+
+/**
+ * gst_rtsp_udp_sink_add:
+ * @sink: a #GstRTSPUDPSink
+ * @host: the destination host
+ * @port: the destination port
+ *
+ * Send to @host and @port. @host is resolved once, when it is added. A
+ * destination that is added multiple times is only sent to once and must be
+ * removed as many times.
+ *
+ * Returns: %TRUE when @host could be resolved.
+ */
+gboolean
+gst_rtsp_udp_sink_add (GstRTSPUDPSink * sink, const gchar * host, gint port)
+{
+  GSocketAddress *address;
+
+  g_return_val_if_fail (GST_IS_RTSP_UDP_SINK (sink), FALSE);
+  g_return_val_if_fail (host != NULL, FALSE);
+
+  if (!(address = resolve_address (host, port)))
+    return FALSE;
+
+  GST_INFO_OBJECT (sink, "adding %s:%d", host, port);
+  gst_rtsp_udp_sink_add_addresses (sink, &address, 1);
+  g_object_unref (address);
+
+  return TRUE;
+}
+
+/**
+ * gst_rtsp_udp_sink_remove:
+ * @sink: a #GstRTSPUDPSink
+ * @host: the destination host
+ * @port: the destination port
+ *
+ * Remove a destination added with gst_rtsp_udp_sink_add().
+ */
+void
+gst_rtsp_udp_sink_remove (GstRTSPUDPSink * sink, const gchar * host, gint port)
+{
+  GSocketAddress *address;
+
+  g_return_if_fail (GST_IS_RTSP_UDP_SINK (sink));
+  g_return_if_fail (host != NULL);
+
+  if (!(address = resolve_address (host, port)))
+    return;
+
+  GST_INFO_OBJECT (sink, "removing %s:%d", host, port);
+  gst_rtsp_udp_sink_remove_addresses (sink, &address, 1);
+  g_object_unref (address);
+}
+
+/**
+ * gst_rtsp_udp_sink_add_addresses:
+ * @sink: a #GstRTSPUDPSink
+ * @addresses: (array length=n_addresses): the destinations
+ * @n_addresses: the number of @addresses
+ *
+ * Add all destinations in @addresses at once.
+ *
+ * Returns: the number of new destinations.
+ */
+guint
+gst_rtsp_udp_sink_add_addresses (GstRTSPUDPSink * sink,
+    GSocketAddress ** addresses, guint n_addresses)
+{
+  guint i, res = 0;
+
+  g_return_val_if_fail (GST_IS_RTSP_UDP_SINK (sink), 0);
+  g_return_val_if_fail (addresses != NULL || n_addresses == 0, 0);
+
+  g_mutex_lock (&sink->lock);
+  for (i = 0; i < n_addresses; i++) {
+    if (add_address (sink, addresses[i]))
+      res++;
+  }
+  commit_shards (sink);
+  g_mutex_unlock (&sink->lock);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_udp_sink_remove_addresses:
+ * @sink: a #GstRTSPUDPSink
+ * @addresses: (array length=n_addresses): the destinations
+ * @n_addresses: the number of @addresses
+ *
+ * Remove all destinations in @addresses at once.
+ *
+ * Returns: the number of removed destinations.
+ */
+guint
+gst_rtsp_udp_sink_remove_addresses (GstRTSPUDPSink * sink,
+    GSocketAddress ** addresses, guint n_addresses)
+{
+  guint i, res = 0;
+
+  g_return_val_if_fail (GST_IS_RTSP_UDP_SINK (sink), 0);
+  g_return_val_if_fail (addresses != NULL || n_addresses == 0, 0);
+
+  g_mutex_lock (&sink->lock);
+  for (i = 0; i < n_addresses; i++) {
+    if (remove_address (sink, addresses[i]))
+      res++;
+  }
+  commit_shards (sink);
+  g_mutex_unlock (&sink->lock);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_udp_sink_n_destinations:
+ * @sink: a #GstRTSPUDPSink
+ *
+ * Get the number of destinations of @sink.
+ *
+ * Returns: the number of destinations.
+ */
+guint
+gst_rtsp_udp_sink_n_destinations (GstRTSPUDPSink * sink)
+{
+  guint i, res = 0;
+
+  g_return_val_if_fail (GST_IS_RTSP_UDP_SINK (sink), 0);
+
+  g_mutex_lock (&sink->lock);
+  for (i = 0; i < sink->shards->len; i++) {
+    SendShard *shard = g_ptr_array_index (sink->shards, i);
+
+    g_mutex_lock (&shard->lock);
+    res += shard->destinations->len;
+    g_mutex_unlock (&shard->lock);
+  }
+  g_mutex_unlock (&sink->lock);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_udp_sink_clear:
+ * @sink: a #GstRTSPUDPSink
+ *
+ * Remove all destinations of @sink.
+ */
+void
+gst_rtsp_udp_sink_clear (GstRTSPUDPSink * sink)
+{
+  guint i;
+
+  g_return_if_fail (GST_IS_RTSP_UDP_SINK (sink));
+
+  g_mutex_lock (&sink->lock);
+  for (i = 0; i < sink->shards->len; i++) {
+    SendShard *shard = g_ptr_array_index (sink->shards, i);
+
+    shard->edit = g_ptr_array_new_with_free_func ((GDestroyNotify)
+        udp_dest_unref);
+  }
+  commit_shards (sink);
+  g_mutex_unlock (&sink->lock);
+}
+
+static void
+vectors_init (Vectors * v)
+{
+  v->n_vec = 0;
+  v->size = 0;
+  v->merged = NULL;
+}
+
+static void
+vectors_clear (Vectors * v)
+{
+  guint i;
+
+  for (i = 0; i < v->n_vec; i++)
+    gst_memory_unmap (v->map[i].memory, &v->map[i]);
+  if (v->merged)
+    gst_memory_unref (v->merged);
+  v->merged = NULL;
+  v->n_vec = 0;
+  v->size = 0;
+}
+
+static gboolean
+vectors_add_memory (Vectors * v, GstMemory * mem)
+{
+  GstMapInfo *map = &v->map[v->n_vec];
+
+  if (!gst_memory_map (mem, map, GST_MAP_READ))
+    return FALSE;
+
+  v->vec[v->n_vec].buffer = map->data;
+  v->vec[v->n_vec].size = map->size;
+  v->size += map->size;
+  v->n_vec++;
+
+  return TRUE;
+}
+
+/* map the memory of @buffer after the memory already in @v */
+static gboolean
+vectors_add_buffer (Vectors * v, GstBuffer * buffer)
+{
+  guint i, n_mem;
+
+  n_mem = gst_buffer_n_memory (buffer);
+
+  if (v->n_vec + n_mem > MAX_VECS) {
+    /* only a message of one buffer can be merged */
+    if (v->n_vec > 0)
+      return FALSE;
+    v->merged = gst_buffer_get_all_memory (buffer);
+    return vectors_add_memory (v, v->merged);
+  }
+
+  for (i = 0; i < n_mem; i++) {
+    if (!vectors_add_memory (v, gst_buffer_peek_memory (buffer, i)))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+#ifdef HAVE_SENDMMSG
+G_STATIC_ASSERT (sizeof (GOutputVector) == sizeof (struct iovec));
+
+/* send the message in @v to the destinations in @dests from @first on.
+ * Returns the index of the first destination that did not get @v, this is
+ * before the end of @dests when the kernel refused to segment @v or when
+ * sending was cancelled. */
+static guint
+send_vectors (GstRTSPUDPSink * sink, GPtrArray * dests, guint first,
+    Vectors * v, guint segment_size)
+{
+  struct mmsghdr msgs[BATCH_SIZE];
+#ifdef USE_GSO
+  union
+  {
+    gchar buf[CMSG_SPACE (sizeof (guint16))];
+    struct cmsghdr align;
+  } control[BATCH_SIZE];
+#endif
+  guint i, n, done, n_dest;
+  gint fd, sent;
+
+  fd = g_socket_get_fd (sink->socket);
+  n_dest = dests->len;
+
+  for (done = first; done < n_dest;) {
+    n = MIN (n_dest - done, BATCH_SIZE);
+
+    memset (msgs, 0, n * sizeof (struct mmsghdr));
+    for (i = 0; i < n; i++) {
+      UDPDest *dest = g_ptr_array_index (dests, done + i);
+      struct msghdr *hdr = &msgs[i].msg_hdr;
+
+      hdr->msg_name = dest->native;
+      hdr->msg_namelen = dest->native_len;
+      hdr->msg_iov = (struct iovec *) v->vec;
+      hdr->msg_iovlen = v->n_vec;
+#ifdef USE_GSO
+      if (segment_size > 0) {
+        struct cmsghdr *cmsg;
+
+        hdr->msg_control = control[i].buf;
+        hdr->msg_controllen = sizeof (control[i].buf);
+        cmsg = CMSG_FIRSTHDR (hdr);
+        cmsg->cmsg_level = IPPROTO_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN (sizeof (guint16));
+        *((guint16 *) CMSG_DATA (cmsg)) = segment_size;
+      }
+#endif
+    }
+
+    sent = sendmmsg (fd, msgs, n, 0);
+    if (sent < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        /* the socket is non-blocking, wait for room in the send buffer */
+        if (!g_socket_condition_wait (sink->socket, G_IO_OUT,
+                sink->cancellable, NULL))
+          break;
+        continue;
+      }
+      if (segment_size > 0 && (errno == EIO || errno == EINVAL ||
+              errno == ENOPROTOOPT || errno == EOPNOTSUPP))
+        break;
+
+      /* sending to the first destination of the batch failed, skip it */
+      GST_DEBUG_OBJECT (sink, "send failed: %s", g_strerror (errno));
+      done++;
+      continue;
+    }
+    done += sent;
+  }
+  return done;
+}
+#else
+static guint
+send_vectors (GstRTSPUDPSink * sink, GPtrArray * dests, guint first,
+    Vectors * v, guint segment_size)
+{
+  guint i;
+
+  for (i = first; i < dests->len; i++) {
+    UDPDest *dest = g_ptr_array_index (dests, i);
+    GError *err = NULL;
+
+    if (g_socket_send_message (sink->socket, dest->address, v->vec, v->n_vec,
+            NULL, 0, 0, sink->cancellable, &err) < 0) {
+      if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_error_free (err);
+        break;
+      }
+      GST_DEBUG_OBJECT (sink, "send failed: %s", err->message);
+      g_clear_error (&err);
+    }
+  }
+  return i;
+}
+#endif
+
+/* send @buffer to the destinations in @dests from @first on */
+static void
+send_buffer (GstRTSPUDPSink * sink, GPtrArray * dests, guint first,
+    GstBuffer * buffer)
+{
+  Vectors v;
+
+  if (first >= dests->len)
+    return;
+
+  vectors_init (&v);
+  if (vectors_add_buffer (&v, buffer))
+    send_vectors (sink, dests, first, &v, 0);
+  vectors_clear (&v);
+}
+
+#ifdef USE_GSO
+/* send all buffers of @list as one segmented message per destination.
+ * Returns the index of the first destination in @dests that did not get the
+ * list, 0 when the list can not be segmented. */
+static guint
+send_list_gso (GstRTSPUDPSink * sink, GPtrArray * dests, GstBufferList * list)
+{
+  Vectors v;
+  guint i, n, segment_size;
+  guint res = 0;
+
+  vectors_init (&v);
+
+  n = gst_buffer_list_length (list);
+  if (n < 2 || n > GSO_MAX_SEGMENTS)
+    return 0;
+
+  /* all packets but the last must have the segment size */
+  segment_size = gst_buffer_get_size (gst_buffer_list_get (list, 0));
+  if (segment_size == 0)
+    return 0;
+
+  for (i = 0; i < n; i++) {
+    GstBuffer *buffer = gst_buffer_list_get (list, i);
+    gsize size = gst_buffer_get_size (buffer);
+
+    if (size > segment_size || (size < segment_size && i < n - 1))
+      goto done;
+    if (!vectors_add_buffer (&v, buffer))
+      goto done;
+  }
+  if (v.size > GSO_MAX_SIZE)
+    goto done;
+
+  res = send_vectors (sink, dests, 0, &v, segment_size);
+  if (res > 0) {
+    g_atomic_int_compare_and_exchange (&sink->gso_state, GSO_UNKNOWN,
+        GSO_SUPPORTED);
+  } else if (res < dests->len &&
+      !g_cancellable_is_cancelled (sink->cancellable) &&
+      g_atomic_int_compare_and_exchange (&sink->gso_state, GSO_UNKNOWN,
+          GSO_UNSUPPORTED)) {
+    /* the first segmented message failed, the kernel or the network device
+     * can not segment */
+    GST_INFO_OBJECT (sink, "segmentation offload not supported, disabling");
+  }
+  if (res < dests->len)
+    GST_DEBUG_OBJECT (sink, "sending to %u destinations without segmentation",
+        dests->len - res);
+
+done:
+  vectors_clear (&v);
+
+  return res;
+}
+#endif
+
+static void
+send_list (GstRTSPUDPSink * sink, GPtrArray * dests, GstBufferList * list)
+{
+  guint i, n, first = 0;
+
+  if (dests->len == 0)
+    return;
+
+#ifdef USE_GSO
+  if (sink->gso && g_atomic_int_get (&sink->gso_state) != GSO_UNSUPPORTED)
+    first = send_list_gso (sink, dests, list);
+#endif
+
+  /* one by one to the destinations that did not get the segmented message */
+  n = gst_buffer_list_length (list);
+  for (i = 0; i < n && first < dests->len; i++) {
+    if (g_cancellable_is_cancelled (sink->cancellable))
+      break;
+    send_buffer (sink, dests, first, gst_buffer_list_get (list, i));
+  }
+}
+
+static gpointer
+shard_loop (SendShard * shard)
+{
+  GstRTSPUDPSink *sink = shard->sink;
+  GstMiniObject *obj;
+  GPtrArray *dests;
+
+  g_mutex_lock (&shard->queue_lock);
+  while (shard->running) {
+    if (!(obj = g_queue_pop_head (&shard->queue))) {
+      g_cond_wait (&shard->queue_cond, &shard->queue_lock);
+      continue;
+    }
+    /* there is room for the streaming thread again */
+    g_cond_broadcast (&shard->queue_cond);
+    g_mutex_unlock (&shard->queue_lock);
+
+    dests = shard_get_dests (shard);
+    if (GST_IS_BUFFER_LIST (obj))
+      send_list (sink, dests, GST_BUFFER_LIST_CAST (obj));
+    else
+      send_buffer (sink, dests, 0, GST_BUFFER_CAST (obj));
+    g_ptr_array_unref (dests);
+    gst_mini_object_unref (obj);
+
+    g_mutex_lock (&shard->queue_lock);
+  }
+  g_mutex_unlock (&shard->queue_lock);
+
+  return NULL;
+}
+
+/* drop the buffers waiting for the sender thread, called with the queue lock
+ * or when the thread is stopped */
+static void
+clear_queue (SendShard * shard)
+{
+  GstMiniObject *obj;
+
+  while ((obj = g_queue_pop_head (&shard->queue)))
+    gst_mini_object_unref (obj);
+}
+
+static void
+stop_threads (GstRTSPUDPSink * sink)
+{
+  guint i;
+
+  /* stop all threads before waiting for the first one */
+  for (i = 0; i < sink->shards->len; i++) {
+    SendShard *shard = g_ptr_array_index (sink->shards, i);
+
+    g_mutex_lock (&shard->queue_lock);
+    shard->running = FALSE;
+    g_cond_broadcast (&shard->queue_cond);
+    g_mutex_unlock (&shard->queue_lock);
+  }
+
+  for (i = 0; i < sink->shards->len; i++) {
+    SendShard *shard = g_ptr_array_index (sink->shards, i);
+
+    if (shard->thread == NULL)
+      continue;
+
+    g_thread_join (shard->thread);
+    shard->thread = NULL;
+    clear_queue (shard);
+  }
+}
+
+/* make a shard for each sender thread and spread the destinations over them,
+ * called when the sink is started */
+static void
+configure_shards (GstRTSPUDPSink * sink)
+{
+  GPtrArray *dests;
+  guint i, j, n_shards;
+
+  n_shards = MAX (sink->send_threads, 1);
+
+  g_mutex_lock (&sink->lock);
+  if (n_shards != sink->shards->len) {
+    dests = g_ptr_array_new_with_free_func ((GDestroyNotify) udp_dest_unref);
+    for (i = 0; i < sink->shards->len; i++) {
+      SendShard *shard = g_ptr_array_index (sink->shards, i);
+
+      for (j = 0; j < shard->destinations->len; j++)
+        g_ptr_array_add (dests,
+            udp_dest_ref (g_ptr_array_index (shard->destinations, j)));
+      shard_free (shard);
+    }
+    g_ptr_array_set_size (sink->shards, 0);
+    for (i = 0; i < n_shards; i++)
+      g_ptr_array_add (sink->shards, shard_new (sink));
+
+    for (i = 0; i < dests->len; i++) {
+      UDPDest *dest = g_ptr_array_index (dests, i);
+      SendShard *shard = find_shard (sink, dest->native, dest->native_len);
+
+      g_ptr_array_add (shard_edit (shard), udp_dest_ref (dest));
+    }
+    commit_shards (sink);
+    g_ptr_array_unref (dests);
+  }
+
+  if (sink->send_threads > 0) {
+    for (i = 0; i < n_shards; i++) {
+      SendShard *shard = g_ptr_array_index (sink->shards, i);
+
+      shard->running = TRUE;
+      shard->thread = g_thread_new ("rtspudpsink", (GThreadFunc) shard_loop,
+          shard);
+    }
+  }
+  g_mutex_unlock (&sink->lock);
+
+  GST_DEBUG_OBJECT (sink, "sending with %u threads", sink->send_threads);
+}
+
+static void
+set_flushing (GstRTSPUDPSink * sink, gboolean flushing)
+{
+  guint i;
+
+  for (i = 0; i < sink->shards->len; i++) {
+    SendShard *shard = g_ptr_array_index (sink->shards, i);
+
+    g_mutex_lock (&shard->queue_lock);
+    sink->flushing = flushing;
+    /* the queued data is not sent anymore after a flush */
+    if (flushing)
+      clear_queue (shard);
+    g_cond_broadcast (&shard->queue_cond);
+    g_mutex_unlock (&shard->queue_lock);
+  }
+}
+
+/* give a ref of @obj to each sender thread */
+static GstFlowReturn
+queue_object (GstRTSPUDPSink * sink, GstMiniObject * obj)
+{
+  guint i;
+
+  for (i = 0; i < sink->shards->len; i++) {
+    SendShard *shard = g_ptr_array_index (sink->shards, i);
+
+    g_mutex_lock (&shard->queue_lock);
+    while (shard->running && !sink->flushing &&
+        shard->queue.length >= MAX_QUEUED)
+      g_cond_wait (&shard->queue_cond, &shard->queue_lock);
+    if (!shard->running || sink->flushing)
+      goto flushing;
+
+    g_queue_push_tail (&shard->queue, gst_mini_object_ref (obj));
+    g_cond_broadcast (&shard->queue_cond);
+    g_mutex_unlock (&shard->queue_lock);
+  }
+  return GST_FLOW_OK;
+
+  /* ERRORS */
+flushing:
+  {
+    g_mutex_unlock (&shard->queue_lock);
+    return GST_FLOW_FLUSHING;
+  }
+}
+
+static GstFlowReturn
+gst_rtsp_udp_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
+{
+  GstRTSPUDPSink *sink = GST_RTSP_UDP_SINK (bsink);
+  SendShard *shard;
+  GPtrArray *dests;
+
+  shard = g_ptr_array_index (sink->shards, 0);
+  if (shard->thread)
+    return queue_object (sink, GST_MINI_OBJECT_CAST (buffer));
+
+  dests = shard_get_dests (shard);
+  send_buffer (sink, dests, 0, buffer);
+  g_ptr_array_unref (dests);
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_rtsp_udp_sink_render_list (GstBaseSink * bsink, GstBufferList * list)
+{
+  GstRTSPUDPSink *sink = GST_RTSP_UDP_SINK (bsink);
+  SendShard *shard;
+  GPtrArray *dests;
+
+  shard = g_ptr_array_index (sink->shards, 0);
+  if (shard->thread)
+    return queue_object (sink, GST_MINI_OBJECT_CAST (list));
+
+  dests = shard_get_dests (shard);
+  send_list (sink, dests, list);
+  g_ptr_array_unref (dests);
+
+  return GST_FLOW_OK;
+}
@@ -0,0 +1,115 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent at local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <gio/gio.h>
+
+#ifndef __GST_RTSP_UDP_SINK_H__
+#define __GST_RTSP_UDP_SINK_H__
+
+G_BEGIN_DECLS
+
+typedef struct _GstRTSPUDPSink GstRTSPUDPSink;
+typedef struct _GstRTSPUDPSinkClass GstRTSPUDPSinkClass;
+
+#define GST_TYPE_RTSP_UDP_SINK              (gst_rtsp_udp_sink_get_type ())
+#define GST_IS_RTSP_UDP_SINK(obj)           (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_RTSP_UDP_SINK))
+#define GST_IS_RTSP_UDP_SINK_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_RTSP_UDP_SINK))
+#define GST_RTSP_UDP_SINK_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_RTSP_UDP_SINK, GstRTSPUDPSinkClass))
+#define GST_RTSP_UDP_SINK(obj)              (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_RTSP_UDP_SINK, GstRTSPUDPSink))
+#define GST_RTSP_UDP_SINK_CLASS(klass)      (G_TYPE_CHECK_CLASS_CAST ((klass), GST_TYPE_RTSP_UDP_SINK, GstRTSPUDPSinkClass))
+#define GST_RTSP_UDP_SINK_CAST(obj)         ((GstRTSPUDPSink*)(obj))
+#define GST_RTSP_UDP_SINK_CLASS_CAST(klass) ((GstRTSPUDPSinkClass*)(klass))
+
+/**
+ * GstRTSPUDPSink:
+ * @lock: lock protecting the layout of @shards
+ * @socket: the socket to send from
+ * @buffer_size: the send buffer size of @socket or 0 to keep the default
+ * @gso: if UDP segmentation offload may be used
+ * @send_threads: the number of sender threads, 0 to send from the streaming
+ *   thread
+ * @shards: the destinations, spread over the sender threads
+ * @flushing: if the streaming thread should stop waiting for the sender threads
+ * @loop: if multicast packets are delivered to the local host
+ * @ttl: the time to live of unicast packets
+ * @ttl_mc: the time to live of multicast packets
+ * @gso_state: if the kernel was found to segment messages
+ * @cancellable: cancels waiting for room in the send buffer when flushing
+ *
+ * A sink that sends each buffer to all of its destinations from one socket.
+ *
+ * The destinations are resolved when they are added. Where the platform has
+ * sendmmsg() the packets for many destinations are sent with one system call
+ * and, with UDP segmentation offload, a buffer list of equally sized packets
+ * is given to the kernel in one message per destination.
+ *
+ * With sender threads, each destination belongs to one thread that sends the
+ * packets to it in order. The threads share the socket and get a ref of each
+ * buffer, they are started with the sink.
+ *
+ * Like multiudpsink in the pipelines of #GstRTSPMedia, multicast packets are
+ * not looped back by default.
+ */
+struct _GstRTSPUDPSink {
+  GstBaseSink   parent;
+
+  GMutex        lock;
+  GSocket      *socket;
+  gint          buffer_size;
+  gboolean      gso;
+  guint         send_threads;
+
+  GPtrArray    *shards;
+  gboolean      flushing;
+
+  gboolean      loop;
+  gint          ttl;
+  gint          ttl_mc;
+  gint          gso_state;
+  GCancellable *cancellable;
+};
+
+struct _GstRTSPUDPSinkClass {
+  GstBaseSinkClass  parent_class;
+};
+
+GType                 gst_rtsp_udp_sink_get_type           (void);
+
+GstElement *          gst_rtsp_udp_sink_new                (GSocket *socket);
+
+gboolean              gst_rtsp_udp_sink_add                (GstRTSPUDPSink *sink,
+                                                            const gchar *host, gint port);
+void                  gst_rtsp_udp_sink_remove             (GstRTSPUDPSink *sink,
+                                                            const gchar *host, gint port);
+
+guint                 gst_rtsp_udp_sink_add_addresses      (GstRTSPUDPSink *sink,
+                                                            GSocketAddress **addresses,
+                                                            guint n_addresses);
+guint                 gst_rtsp_udp_sink_remove_addresses   (GstRTSPUDPSink *sink,
+                                                            GSocketAddress **addresses,
+                                                            guint n_addresses);
+
+guint                 gst_rtsp_udp_sink_n_destinations     (GstRTSPUDPSink *sink);
+void                  gst_rtsp_udp_sink_clear              (GstRTSPUDPSink *sink);
+
+G_END_DECLS
+
+#endif /* __GST_RTSP_UDP_SINK_H__ */
@@ -0,0 +1,394 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent at local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/net/gstnetaddressmeta.h>
+
+#include "rtsp-udp-src.h"
+
+#ifdef G_OS_UNIX
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#endif
+
+enum
+{
+  PROP_0,
+  PROP_SOCKET,
+  PROP_RECEIVER,
+  PROP_LAST
+};
+
+GST_DEBUG_CATEGORY_STATIC (rtsp_udp_src_debug);
+#define GST_CAT_DEFAULT rtsp_udp_src_debug
+
+/* the largest UDP payload */
+#define MAX_PACKET_SIZE         65536
+/* the packets read in one wakeup, so that the other sockets of the poll thread
+ * get their turn */
+#define MAX_PACKETS             32
+
+/* the memory the packets are received in, one per poll thread */
+static GPrivate scratch_key = G_PRIVATE_INIT (g_free);
+
+/* the user data of one add to the receiver. The callback of an earlier add
+ * can still run after the socket was added again, @generation tells it
+ * apart. */
+typedef struct
+{
+  GstRTSPUDPSrc *src;
+  guint generation;
+} ReceiveData;
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static void gst_rtsp_udp_src_get_property (GObject * object, guint propid,
+    GValue * value, GParamSpec * pspec);
+static void gst_rtsp_udp_src_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec);
+static void gst_rtsp_udp_src_finalize (GObject * object);
+
+static GstStateChangeReturn gst_rtsp_udp_src_change_state (GstElement *
+    element, GstStateChange transition);
+
+G_DEFINE_TYPE (GstRTSPUDPSrc, gst_rtsp_udp_src, GST_TYPE_ELEMENT);
+
+static void
+gst_rtsp_udp_src_class_init (GstRTSPUDPSrcClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *element_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->get_property = gst_rtsp_udp_src_get_property;
+  gobject_class->set_property = gst_rtsp_udp_src_set_property;
+  gobject_class->finalize = gst_rtsp_udp_src_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_SOCKET,
+      g_param_spec_object ("socket", "Socket",
+          "The socket to receive from", G_TYPE_SOCKET,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RECEIVER,
+      g_param_spec_object ("receiver", "Receiver",
+          "The receiver polling the socket", GST_TYPE_RTSP_UDP_RECEIVER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+  gst_element_class_set_static_metadata (element_class,
+      "RTSP UDP source", "Source/Network",
+      "Push the packets received on a UDP socket",
+      "agent <agent@local>");
+
+  element_class->change_state = gst_rtsp_udp_src_change_state;
+
+  GST_DEBUG_CATEGORY_INIT (rtsp_udp_src_debug, "rtspudpsrc", 0,
+      "GstRTSPUDPSrc");
+}
+
+static void
+gst_rtsp_udp_src_init (GstRTSPUDPSrc * src)
+{
+  src->srcpad = gst_pad_new_from_static_template (&src_template, "src");
+  gst_pad_use_fixed_caps (src->srcpad);
+  gst_element_add_pad (GST_ELEMENT_CAST (src), src->srcpad);
+
+  GST_OBJECT_FLAG_SET (src, GST_ELEMENT_FLAG_SOURCE);
+}
+
+static void
+gst_rtsp_udp_src_finalize (GObject * object)
+{
+  GstRTSPUDPSrc *src = GST_RTSP_UDP_SRC (object);
+
+  if (src->socket)
+    g_object_unref (src->socket);
+  if (src->receiver)
+    g_object_unref (src->receiver);
+
+  G_OBJECT_CLASS (gst_rtsp_udp_src_parent_class)->finalize (object);
+}
+
+static void
+gst_rtsp_udp_src_get_property (GObject * object, guint propid,
+    GValue * value, GParamSpec * pspec)
+{
+  GstRTSPUDPSrc *src = GST_RTSP_UDP_SRC (object);
+
+  switch (propid) {
+    case PROP_SOCKET:
+      g_value_set_object (value, src->socket);
+      break;
+    case PROP_RECEIVER:
+      g_value_set_object (value, src->receiver);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+      break;
+  }
+}
+
+/* the properties can only be changed in the NULL and READY state */
+static void
+gst_rtsp_udp_src_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstRTSPUDPSrc *src = GST_RTSP_UDP_SRC (object);
+
+  switch (propid) {
+    case PROP_SOCKET:
+      if (src->socket)
+        g_object_unref (src->socket);
+      src->socket = g_value_dup_object (value);
+      break;
+    case PROP_RECEIVER:
+      if (src->receiver)
+        g_object_unref (src->receiver);
+      src->receiver = g_value_dup_object (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+      break;
+  }
+}
+
+/**
+ * gst_rtsp_udp_src_new:
+ * @receiver: a #GstRTSPUDPReceiver
+ * @socket: a #GSocket
+ *
+ * Create a new #GstRTSPUDPSrc that pushes the packets received on @socket
+ * from a thread of @receiver. @socket is not closed by the source.
+ *
+ * Returns: A new #GstRTSPUDPSrc.
+ */
+GstElement *
+gst_rtsp_udp_src_new (GstRTSPUDPReceiver * receiver, GSocket * socket)
+{
+  GstElement *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_UDP_RECEIVER (receiver), NULL);
+  g_return_val_if_fail (G_IS_SOCKET (socket), NULL);
+
+  result = g_object_new (GST_TYPE_RTSP_UDP_SRC, "receiver", receiver,
+      "socket", socket, NULL);
+
+  return result;
+}
+
+/* called with the stream lock */
+static GstFlowReturn
+push_packet (GstRTSPUDPSrc * src, GstBuffer * buffer)
+{
+  GstClock *clock;
+
+  if (src->need_segment) {
+    GstSegment segment;
+
+    gst_pad_push_event (src->srcpad,
+        gst_event_new_stream_start (GST_ELEMENT_NAME (src)));
+    gst_segment_init (&segment, GST_FORMAT_TIME);
+    gst_pad_push_event (src->srcpad, gst_event_new_segment (&segment));
+    src->need_segment = FALSE;
+  }
+
+  /* timestamp with the running time of arrival, like udpsrc */
+  if ((clock = gst_element_get_clock (GST_ELEMENT_CAST (src)))) {
+    GstClockTime now, base_time;
+
+    now = gst_clock_get_time (clock);
+    base_time = gst_element_get_base_time (GST_ELEMENT_CAST (src));
+    GST_BUFFER_PTS (buffer) = now > base_time ? now - base_time : 0;
+    GST_BUFFER_DTS (buffer) = GST_BUFFER_PTS (buffer);
+    gst_object_unref (clock);
+  }
+
+  return gst_pad_push (src->srcpad, buffer);
+}
+
+/* called with the object lock */
+static ReceiveData *
+receive_data_new (GstRTSPUDPSrc * src)
+{
+  ReceiveData *data;
+
+  data = g_slice_new (ReceiveData);
+  data->src = gst_object_ref (src);
+  data->generation = ++src->generation;
+
+  return data;
+}
+
+static void
+receive_data_free (ReceiveData * data)
+{
+  gst_object_unref (data->src);
+  g_slice_free (ReceiveData, data);
+}
+
+/* called from a poll thread of the receiver when the socket has data */
+static void
+receive_packets (GSocket * socket, ReceiveData * rdata)
+{
+#ifdef G_OS_UNIX
+  GstRTSPUDPSrc *src = rdata->src;
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint8 *data;
+  gint fd;
+  guint i;
+
+  if (!(data = g_private_get (&scratch_key))) {
+    data = g_malloc (MAX_PACKET_SIZE);
+    g_private_set (&scratch_key, data);
+  }
+  fd = g_socket_get_fd (socket);
+
+  /* deactivating the pad waits for the packets being pushed */
+  GST_PAD_STREAM_LOCK (src->srcpad);
+  for (i = 0; i < MAX_PACKETS && ret == GST_FLOW_OK; i++) {
+    struct sockaddr_storage from;
+    socklen_t from_len = sizeof (from);
+    GSocketAddress *address;
+    GstBuffer *buffer;
+    gssize len;
+
+    len = recvfrom (fd, data, MAX_PACKET_SIZE, MSG_DONTWAIT,
+        (struct sockaddr *) &from, &from_len);
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        GST_DEBUG_OBJECT (src, "receive failed: %s", g_strerror (errno));
+      break;
+    }
+
+    buffer = gst_buffer_new_allocate (NULL, len, NULL);
+    gst_buffer_fill (buffer, 0, data, len);
+    if ((address = g_socket_address_new_from_native (&from, from_len))) {
+      gst_buffer_add_net_address_meta (buffer, address);
+      g_object_unref (address);
+    }
+    ret = push_packet (src, buffer);
+  }
+  GST_PAD_STREAM_UNLOCK (src->srcpad);
+
+  if (ret == GST_FLOW_OK)
+    return;
+
+  /* like the task of a basesrc, stop receiving when flushing or not linked
+   * and post an error for the fatal flows */
+  GST_OBJECT_LOCK (src);
+  if (rdata->generation != src->generation)
+    goto stale;
+  GST_DEBUG_OBJECT (src, "stop receiving, reason %s", gst_flow_get_name (ret));
+  gst_rtsp_udp_receiver_remove (src->receiver, socket);
+  GST_OBJECT_UNLOCK (src);
+
+  if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS) {
+    GST_ELEMENT_ERROR (src, STREAM, FAILED,
+        ("Internal data flow error."),
+        ("streaming task paused, reason %s (%d)", gst_flow_get_name (ret),
+            ret));
+  }
+  return;
+
+  /* ERRORS */
+stale:
+  {
+    /* the source was stopped and started again since this callback began,
+     * the socket is polled for the new start */
+    GST_DEBUG_OBJECT (src, "stale callback, reason %s",
+        gst_flow_get_name (ret));
+    GST_OBJECT_UNLOCK (src);
+    return;
+  }
+#endif
+}
+
+static GstStateChangeReturn
+gst_rtsp_udp_src_change_state (GstElement * element, GstStateChange transition)
+{
+  GstRTSPUDPSrc *src = GST_RTSP_UDP_SRC (element);
+  GstStateChangeReturn ret;
+  gboolean added;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      if (src->socket == NULL || src->receiver == NULL)
+        goto not_configured;
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      /* stop receiving, deactivating the pad waits for a push in progress */
+      gst_rtsp_udp_receiver_remove (src->receiver, src->socket);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (gst_rtsp_udp_src_parent_class)->change_state
+      (element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      src->need_segment = TRUE;
+      /* the receiver keeps a ref while it can call us */
+      GST_OBJECT_LOCK (src);
+      added = gst_rtsp_udp_receiver_add (src->receiver, src->socket,
+          (GstRTSPUDPReceiveFunc) receive_packets, receive_data_new (src),
+          (GDestroyNotify) receive_data_free);
+      GST_OBJECT_UNLOCK (src);
+      if (!added)
+        goto add_failed;
+      /* live source */
+      ret = GST_STATE_CHANGE_NO_PREROLL;
+      break;
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      ret = GST_STATE_CHANGE_NO_PREROLL;
+      break;
+    default:
+      break;
+  }
+  return ret;
+
+  /* ERRORS */
+not_configured:
+  {
+    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
+        ("no socket or receiver configured"));
+    return GST_STATE_CHANGE_FAILURE;
+  }
+add_failed:
+  {
+    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
+        ("could not receive on the socket"));
+    return GST_STATE_CHANGE_FAILURE;
+  }
+}
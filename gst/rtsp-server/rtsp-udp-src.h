@@ -0,0 +1,75 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent at local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+
+#ifndef __GST_RTSP_UDP_SRC_H__
+#define __GST_RTSP_UDP_SRC_H__
+
+#include "rtsp-udp-receiver.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GstRTSPUDPSrc GstRTSPUDPSrc;
+typedef struct _GstRTSPUDPSrcClass GstRTSPUDPSrcClass;
+
+#define GST_TYPE_RTSP_UDP_SRC              (gst_rtsp_udp_src_get_type ())
+#define GST_IS_RTSP_UDP_SRC(obj)           (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_RTSP_UDP_SRC))
+#define GST_IS_RTSP_UDP_SRC_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_RTSP_UDP_SRC))
+#define GST_RTSP_UDP_SRC_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_RTSP_UDP_SRC, GstRTSPUDPSrcClass))
+#define GST_RTSP_UDP_SRC(obj)              (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_RTSP_UDP_SRC, GstRTSPUDPSrc))
+#define GST_RTSP_UDP_SRC_CLASS(klass)      (G_TYPE_CHECK_CLASS_CAST ((klass), GST_TYPE_RTSP_UDP_SRC, GstRTSPUDPSrcClass))
+#define GST_RTSP_UDP_SRC_CAST(obj)         ((GstRTSPUDPSrc*)(obj))
+#define GST_RTSP_UDP_SRC_CLASS_CAST(klass) ((GstRTSPUDPSrcClass*)(klass))
+
+/**
+ * GstRTSPUDPSrc:
+ * @srcpad: the source pad
+ * @socket: the socket to receive from
+ * @receiver: the receiver polling @socket
+ * @need_segment: if the stream-start and segment events must be pushed
+ * @generation: counts the times @socket was added to @receiver
+ *
+ * A live source that pushes the packets received on a socket. It has no
+ * streaming thread of its own, the packets are read and pushed from a thread
+ * of @receiver while the source is PAUSED or PLAYING.
+ */
+struct _GstRTSPUDPSrc {
+  GstElement          parent;
+
+  GstPad             *srcpad;
+  GSocket            *socket;
+  GstRTSPUDPReceiver *receiver;
+  gboolean            need_segment;
+  guint               generation;
+};
+
+struct _GstRTSPUDPSrcClass {
+  GstElementClass  parent_class;
+};
+
+GType                 gst_rtsp_udp_src_get_type            (void);
+
+GstElement *          gst_rtsp_udp_src_new                 (GstRTSPUDPReceiver *receiver,
+                                                            GSocket *socket);
+
+G_END_DECLS
+
+#endif /* __GST_RTSP_UDP_SRC_H__ */
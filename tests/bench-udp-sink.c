@@ -0,0 +1,208 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent at local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* Compare the packets per second sent by multiudpsink and GstRTSPUDPSink to
+ * many destinations on localhost.
+ *
+ *   bench-udp-sink [destinations] [packets] [packets-per-list]
+ */
+
+#include <stdlib.h>
+
+#include <gst/gst.h>
+
+#include <gst/rtsp-server/rtsp-server.h>
+
+#define DEFAULT_DESTINATIONS    2000
+#define DEFAULT_PACKETS         2000
+#define DEFAULT_LIST_SIZE       16
+#define PACKET_SIZE             1400
+#define BASE_PORT               40000
+
+static GSocket *
+make_socket (void)
+{
+  GSocket *socket;
+  GInetAddress *any;
+  GSocketAddress *addr;
+
+  socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  any = g_inet_address_new_any (G_SOCKET_FAMILY_IPV4);
+  addr = g_inet_socket_address_new (any, 0);
+  g_socket_bind (socket, addr, FALSE, NULL);
+  g_object_unref (addr);
+  g_object_unref (any);
+
+  return socket;
+}
+
+static void
+start_sink (GstElement * sink)
+{
+  GstPad *pad;
+  GstSegment segment;
+
+  g_object_set (sink, "sync", FALSE, "async", FALSE, NULL);
+  gst_element_set_state (sink, GST_STATE_PLAYING);
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_send_event (pad, gst_event_new_stream_start ("bench"));
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_send_event (pad, gst_event_new_segment (&segment));
+  gst_object_unref (pad);
+}
+
+/* push @n_packets to @sink in lists of @list_size and return the number of
+ * packets sent per second */
+static gdouble
+run (GstElement * sink, guint n_dests, guint n_packets, guint list_size)
+{
+  GstPad *pad;
+  GstBuffer *packet;
+  GTimer *timer;
+  guint i, j, n;
+  gdouble elapsed;
+
+  packet = gst_buffer_new_allocate (NULL, PACKET_SIZE, NULL);
+  gst_buffer_memset (packet, 0, 0, PACKET_SIZE);
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  timer = g_timer_new ();
+
+  for (i = 0; i < n_packets; i += n) {
+    /* the last list has the packets that are left */
+    n = MIN (list_size, n_packets - i);
+
+    if (n > 1) {
+      GstBufferList *list = gst_buffer_list_new_sized (n);
+
+      for (j = 0; j < n; j++)
+        gst_buffer_list_add (list, gst_buffer_ref (packet));
+      gst_pad_chain_list (pad, list);
+    } else {
+      gst_pad_chain (pad, gst_buffer_ref (packet));
+    }
+  }
+  elapsed = g_timer_elapsed (timer, NULL);
+
+  g_timer_destroy (timer);
+  gst_object_unref (pad);
+  gst_buffer_unref (packet);
+
+  return (gdouble) n_packets *n_dests / elapsed;
+}
+
+static gdouble
+bench_multiudpsink (guint n_dests, guint n_packets, guint list_size)
+{
+  GstElement *sink;
+  GSocket *socket;
+  gdouble res;
+  guint i;
+
+  sink = gst_element_factory_make ("multiudpsink", NULL);
+  if (sink == NULL)
+    return 0.0;
+  gst_object_ref_sink (sink);
+
+  socket = make_socket ();
+  g_object_set (sink, "socket", socket, "close-socket", FALSE, NULL);
+  for (i = 0; i < n_dests; i++)
+    g_signal_emit_by_name (sink, "add", "127.0.0.1", BASE_PORT + i, NULL);
+
+  start_sink (sink);
+  res = run (sink, n_dests, n_packets, list_size);
+
+  gst_element_set_state (sink, GST_STATE_NULL);
+  gst_object_unref (sink);
+  g_object_unref (socket);
+
+  return res;
+}
+
+static gdouble
+bench_rtsp_udp_sink (guint n_dests, guint n_packets, guint list_size,
+    gboolean gso)
+{
+  GstElement *sink;
+  GSocket *socket;
+  GSocketAddress **addrs;
+  GInetAddress *local;
+  gdouble res;
+  guint i;
+
+  socket = make_socket ();
+  sink = gst_rtsp_udp_sink_new (socket);
+  g_object_set (sink, "gso", gso, NULL);
+
+  local = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  addrs = g_new (GSocketAddress *, n_dests);
+  for (i = 0; i < n_dests; i++)
+    addrs[i] = g_inet_socket_address_new (local, BASE_PORT + i);
+  gst_rtsp_udp_sink_add_addresses (GST_RTSP_UDP_SINK (sink), addrs, n_dests);
+  for (i = 0; i < n_dests; i++)
+    g_object_unref (addrs[i]);
+  g_free (addrs);
+  g_object_unref (local);
+
+  gst_object_ref_sink (sink);
+  start_sink (sink);
+  res = run (sink, n_dests, n_packets, list_size);
+
+  gst_element_set_state (sink, GST_STATE_NULL);
+  gst_object_unref (sink);
+  g_object_unref (socket);
+
+  return res;
+}
+
+int
+main (int argc, char *argv[])
+{
+  guint n_dests, n_packets, list_size;
+
+  gst_init (&argc, &argv);
+
+  n_dests = argc > 1 ? atoi (argv[1]) : DEFAULT_DESTINATIONS;
+  n_packets = argc > 2 ? atoi (argv[2]) : DEFAULT_PACKETS;
+  list_size = argc > 3 ? atoi (argv[3]) : DEFAULT_LIST_SIZE;
+  if (n_dests == 0 || n_packets == 0 || list_size == 0)
+    goto usage;
+
+  g_print ("%u destinations, %u packets of %u bytes in lists of %u\n",
+      n_dests, n_packets, PACKET_SIZE, list_size);
+
+  g_print ("multiudpsink:          %12.0f packets/s\n",
+      bench_multiudpsink (n_dests, n_packets, list_size));
+  g_print ("GstRTSPUDPSink:        %12.0f packets/s\n",
+      bench_rtsp_udp_sink (n_dests, n_packets, list_size, FALSE));
+  g_print ("GstRTSPUDPSink (gso):  %12.0f packets/s\n",
+      bench_rtsp_udp_sink (n_dests, n_packets, list_size, TRUE));
+
+  return 0;
+
+  /* ERRORS */
+usage:
+  {
+    g_print ("usage: %s [destinations] [packets] [packets-per-list]\n",
+        argv[0]);
+    return -1;
+  }
+}
@@ -0,0 +1,383 @@
+/* GStreamer
+ *
+ * unit test for GstRTSPMedia
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include "rtsp-media-factory.h"
+
+#define VIDEO_PIPELINE "videotestsrc ! " \
+  "video/x-raw,width=352,height=288 ! " \
+  "rtpgstpay name=pay0 pt=96"
+#define LIVE_VIDEO_PIPELINE "videotestsrc is-live=true ! " \
+  "video/x-raw,width=352,height=288 ! " \
+  "rtpgstpay name=pay0 pt=96"
+
+typedef struct
+{
+  GMutex lock;
+  GCond cond;
+  gint called;
+  gboolean seeked;
+  gint notified;
+} SeekResult;
+
+static void
+seek_done (GstRTSPMedia * media, gboolean seeked, SeekResult * result)
+{
+  g_mutex_lock (&result->lock);
+  result->called++;
+  result->seeked = seeked;
+  g_cond_signal (&result->cond);
+  g_mutex_unlock (&result->lock);
+}
+
+static void
+seek_notify (SeekResult * result)
+{
+  g_mutex_lock (&result->lock);
+  result->notified++;
+  g_mutex_unlock (&result->lock);
+}
+
+/* make and prepare the media of @launch with @threads TCP send threads */
+static GstRTSPMedia *
+prepare_media (const gchar * launch, guint threads)
+{
+  GstRTSPMediaFactory *factory;
+  GstRTSPMedia *media;
+  GstRTSPUrl *url;
+
+  factory = gst_rtsp_media_factory_new ();
+  gst_rtsp_media_factory_set_launch (factory, launch);
+
+  fail_unless (gst_rtsp_url_parse ("rtsp://localhost:8554/test",
+          &url) == GST_RTSP_OK);
+  media = gst_rtsp_media_factory_construct (factory, url);
+  fail_unless (GST_IS_RTSP_MEDIA (media));
+  gst_rtsp_media_set_tcp_send_threads (media, threads);
+  fail_unless (gst_rtsp_media_prepare (media));
+
+  gst_rtsp_url_free (url);
+  g_object_unref (factory);
+
+  return media;
+}
+
+/* seek @media to @rangestr, returns the result of gst_rtsp_media_seek_async() */
+static gboolean
+seek_media (GstRTSPMedia * media, const gchar * rangestr, SeekResult * result)
+{
+  GstRTSPTimeRange *range;
+  gboolean res;
+
+  fail_unless (gst_rtsp_range_parse (rangestr, &range) == GST_RTSP_OK);
+  res = gst_rtsp_media_seek_async (media, range,
+      (GstRTSPMediaSeekFunc) seek_done, result, (GDestroyNotify) seek_notify);
+  gst_rtsp_range_free (range);
+
+  return res;
+}
+
+GST_START_TEST (test_seek_async)
+{
+  GstRTSPMedia *media;
+  SeekResult result = { {0}, };
+  gint64 end_time;
+
+  g_mutex_init (&result.lock);
+  g_cond_init (&result.cond);
+
+  media = prepare_media ("( " VIDEO_PIPELINE " )", 0);
+  fail_unless (media->seekable);
+
+  /* the media starts at 0, nothing to seek */
+  fail_if (seek_media (media, "npt=0-", &result));
+  fail_unless (result.called == 0);
+  fail_unless (result.notified == 1);
+
+  /* a real seek completes with the ASYNC_DONE of the seek */
+  fail_unless (seek_media (media, "npt=5-", &result));
+
+  end_time = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+  g_mutex_lock (&result.lock);
+  while (result.called == 0)
+    if (!g_cond_wait_until (&result.cond, &result.lock, end_time))
+      break;
+  g_mutex_unlock (&result.lock);
+
+  fail_unless (result.called == 1);
+  fail_unless (result.seeked);
+  fail_unless (media->range.min.seconds == 5.0);
+
+  fail_unless (gst_rtsp_media_unprepare (media));
+  g_object_unref (media);
+
+  fail_unless (result.notified == 2);
+  g_mutex_clear (&result.lock);
+  g_cond_clear (&result.cond);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_seek_async_not_seekable)
+{
+  GstRTSPMedia *media;
+  SeekResult result = { {0}, };
+
+  g_mutex_init (&result.lock);
+  g_cond_init (&result.cond);
+
+  media = prepare_media ("( " LIVE_VIDEO_PIPELINE " )", 0);
+  fail_if (media->seekable);
+
+  /* live media is not seeked, the callback is never called */
+  fail_if (seek_media (media, "npt=5-", &result));
+  fail_unless (result.called == 0);
+  fail_unless (result.notified == 1);
+
+  fail_unless (gst_rtsp_media_unprepare (media));
+  g_object_unref (media);
+
+  fail_unless (result.called == 0);
+  g_mutex_clear (&result.lock);
+  g_cond_clear (&result.cond);
+}
+
+GST_END_TEST;
+
+typedef struct
+{
+  GMutex lock;
+  GCond cond;
+  gboolean blocked;
+  gboolean removed;
+  guint sent;
+  guint sent_after_remove;
+  guint passed;
+} SendResult;
+
+static gboolean
+send_rtp (GstBuffer * buffer, guint8 channel, SendResult * result)
+{
+  g_mutex_lock (&result->lock);
+  result->sent++;
+  if (result->removed)
+    result->sent_after_remove++;
+  while (result->blocked)
+    g_cond_wait (&result->cond, &result->lock);
+  g_mutex_unlock (&result->lock);
+
+  /* keep some packets queued for the send thread */
+  g_usleep (100);
+
+  return TRUE;
+}
+
+static gboolean
+send_rtcp (GstBuffer * buffer, guint8 channel, SendResult * result)
+{
+  return TRUE;
+}
+
+static gboolean
+count_list_buffer (GstBuffer ** buffer, guint idx, guint * count)
+{
+  (*count)++;
+  return TRUE;
+}
+
+/* count the RTP packets reaching the TCP sink of the stream */
+static GstPadProbeReturn
+count_packets (GstPad * pad, GstPadProbeInfo * info, SendResult * result)
+{
+  guint count = 0;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+    gst_buffer_list_foreach (GST_PAD_PROBE_INFO_BUFFER_LIST (info),
+        (GstBufferListFunc) count_list_buffer, &count);
+  else
+    count = 1;
+
+  g_mutex_lock (&result->lock);
+  result->passed += count;
+  g_cond_signal (&result->cond);
+  g_mutex_unlock (&result->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* make a TCP transport for the first stream of @media and start sending */
+static GstRTSPMediaTrans *
+play_tcp_transport (GstRTSPMedia * media, SendResult * result)
+{
+  GstRTSPMediaTrans *tr;
+  GstRTSPMediaStream *stream;
+  GArray *transports;
+  GstPad *pad;
+
+  tr = g_new0 (GstRTSPMediaTrans, 1);
+  tr->idx = 0;
+  tr->send_rtp = (GstRTSPSendFunc) send_rtp;
+  tr->send_rtcp = (GstRTSPSendFunc) send_rtcp;
+  tr->user_data = result;
+  fail_unless (gst_rtsp_transport_new (&tr->transport) == GST_RTSP_OK);
+  tr->transport->lower_transport = GST_RTSP_LOWER_TRANS_TCP;
+  tr->transport->interleaved.min = 0;
+  tr->transport->interleaved.max = 1;
+
+  fail_unless (gst_rtsp_media_acquire_transport (media, 0,
+          GST_RTSP_LOWER_TRANS_TCP, &tr->branch_generation));
+
+  stream = gst_rtsp_media_get_stream (media, 0);
+  pad = gst_element_get_static_pad (stream->appsink[0], "sink");
+  gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) count_packets, result, NULL);
+  gst_object_unref (pad);
+
+  transports = g_array_new (FALSE, FALSE, sizeof (GstRTSPMediaTrans *));
+  g_array_append_val (transports, tr);
+  fail_unless (gst_rtsp_media_set_state (media, GST_STATE_PLAYING,
+          transports));
+  g_array_free (transports, TRUE);
+
+  return tr;
+}
+
+/* stop sending to @tr and free it */
+static void
+stop_tcp_transport (GstRTSPMedia * media, GstRTSPMediaTrans * tr)
+{
+  GArray *transports;
+
+  transports = g_array_new (FALSE, FALSE, sizeof (GstRTSPMediaTrans *));
+  g_array_append_val (transports, tr);
+  fail_unless (gst_rtsp_media_set_state (media, GST_STATE_PAUSED,
+          transports));
+  g_array_free (transports, TRUE);
+}
+
+static void
+free_tcp_transport (GstRTSPMedia * media, GstRTSPMediaTrans * tr)
+{
+  gst_rtsp_media_release_transport (media, 0, GST_RTSP_LOWER_TRANS_TCP,
+      tr->branch_generation);
+  gst_rtsp_transport_free (tr->transport);
+  g_free (tr);
+}
+
+GST_START_TEST (test_tcp_send_queue_full)
+{
+  GstRTSPMedia *media;
+  GstRTSPMediaTrans *tr;
+  SendResult result = { {0}, };
+  gint64 end_time;
+
+  g_mutex_init (&result.lock);
+  g_cond_init (&result.cond);
+
+  media = prepare_media ("( " VIDEO_PIPELINE " )", 2);
+
+  /* the send thread blocks in the first packet, the streaming thread must
+   * not wait for it once its queue is full */
+  result.blocked = TRUE;
+  tr = play_tcp_transport (media, &result);
+
+  end_time = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+  g_mutex_lock (&result.lock);
+  while (result.passed < 1024)
+    if (!g_cond_wait_until (&result.cond, &result.lock, end_time))
+      break;
+  fail_unless (result.passed >= 1024);
+  fail_unless (result.sent == 1);
+  result.blocked = FALSE;
+  g_cond_broadcast (&result.cond);
+  g_mutex_unlock (&result.lock);
+
+  stop_tcp_transport (media, tr);
+  fail_unless (result.sent < result.passed);
+
+  fail_unless (gst_rtsp_media_unprepare (media));
+  free_tcp_transport (media, tr);
+  g_object_unref (media);
+
+  g_mutex_clear (&result.lock);
+  g_cond_clear (&result.cond);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_tcp_send_remove)
+{
+  GstRTSPMedia *media;
+  GstRTSPMediaTrans *tr;
+  SendResult result = { {0}, };
+  gint64 end_time;
+
+  g_mutex_init (&result.lock);
+  g_cond_init (&result.cond);
+
+  media = prepare_media ("( " VIDEO_PIPELINE " )", 2);
+  tr = play_tcp_transport (media, &result);
+
+  end_time = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+  g_mutex_lock (&result.lock);
+  while (result.sent < 100)
+    if (!g_cond_wait_until (&result.cond, &result.lock, end_time))
+      break;
+  fail_unless (result.sent >= 100);
+  g_mutex_unlock (&result.lock);
+
+  /* once removed, the send threads must not use the transport anymore */
+  stop_tcp_transport (media, tr);
+  g_mutex_lock (&result.lock);
+  result.removed = TRUE;
+  g_mutex_unlock (&result.lock);
+
+  g_usleep (G_USEC_PER_SEC / 10);
+  fail_unless (result.sent_after_remove == 0);
+
+  fail_unless (gst_rtsp_media_unprepare (media));
+  free_tcp_transport (media, tr);
+  g_object_unref (media);
+
+  g_mutex_clear (&result.lock);
+  g_cond_clear (&result.cond);
+}
+
+GST_END_TEST;
+
+static Suite *
+rtspmedia_suite (void)
+{
+  Suite *s = suite_create ("rtspmedia");
+  TCase *tc = tcase_create ("general");
+
+  suite_add_tcase (s, tc);
+  tcase_set_timeout (tc, 20);
+  tcase_add_test (tc, test_seek_async);
+  tcase_add_test (tc, test_seek_async_not_seekable);
+  tcase_add_test (tc, test_tcp_send_queue_full);
+  tcase_add_test (tc, test_tcp_send_remove);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtspmedia);
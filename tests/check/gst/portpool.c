@@ -0,0 +1,125 @@
+/* GStreamer
+ *
+ * unit test for GstRTSPPortPool
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include "rtsp-port-pool.h"
+
+/* returns an even UDP port that is free, together with the next port */
+static guint
+get_free_pair (void)
+{
+  GSocket *socket;
+  GInetAddress *any;
+  GSocketAddress *addr, *bound;
+  guint port;
+
+  do {
+    socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+        G_SOCKET_PROTOCOL_UDP, NULL);
+    fail_unless (socket != NULL);
+
+    any = g_inet_address_new_any (G_SOCKET_FAMILY_IPV4);
+    addr = g_inet_socket_address_new (any, 0);
+    fail_unless (g_socket_bind (socket, addr, FALSE, NULL));
+    bound = g_socket_get_local_address (socket, NULL);
+    port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (bound));
+
+    g_object_unref (bound);
+    g_object_unref (addr);
+    g_object_unref (any);
+    g_socket_close (socket, NULL);
+    g_object_unref (socket);
+  } while (port % 2 != 0 || port >= 65535);
+
+  return port;
+}
+
+static void
+close_socket (GSocket * socket)
+{
+  g_socket_close (socket, NULL);
+  g_object_unref (socket);
+}
+
+/* acquire a pair from @pool and close its sockets right away, returns the
+ * RTP port or 0 */
+static guint
+acquire_and_close (GstRTSPPortPool * pool)
+{
+  GSocket *rtp, *rtcp;
+  guint port;
+
+  if (!gst_rtsp_port_pool_acquire (pool, G_SOCKET_FAMILY_IPV4, &port, &rtp,
+          &rtcp))
+    return 0;
+
+  close_socket (rtp);
+  close_socket (rtcp);
+
+  return port;
+}
+
+GST_START_TEST (test_release_after_set_range)
+{
+  GstRTSPPortPool *pool;
+  guint port;
+
+  port = get_free_pair ();
+
+  pool = gst_rtsp_port_pool_new ();
+  gst_rtsp_port_pool_set_warm_pairs (pool, 0);
+  gst_rtsp_port_pool_set_range (pool, port, port + 1);
+
+  /* the pair of the old range is closed but not released yet */
+  fail_unless (acquire_and_close (pool) == port);
+  gst_rtsp_port_pool_set_range (pool, port, port + 1);
+
+  /* the same port is handed out again in the new range */
+  fail_unless (acquire_and_close (pool) == port);
+
+  /* giving back the old pair does not free the new one */
+  gst_rtsp_port_pool_release (pool, port);
+  fail_unless (acquire_and_close (pool) == 0);
+
+  /* giving back the new pair does */
+  gst_rtsp_port_pool_release (pool, port);
+  fail_unless (acquire_and_close (pool) == port);
+  gst_rtsp_port_pool_release (pool, port);
+
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
+static Suite *
+rtspportpool_suite (void)
+{
+  Suite *s = suite_create ("rtspportpool");
+  TCase *tc = tcase_create ("general");
+
+  suite_add_tcase (s, tc);
+  tcase_set_timeout (tc, 20);
+  tcase_add_test (tc, test_release_after_set_range);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtspportpool);
@@ -23,6 +23,7 @@
 
 #include <gst/check/gstcheck.h>
 #include <gst/sdp/gstsdpmessage.h>
+#include <gst/rtp/gstrtpbuffer.h>
 
 #include <stdio.h>
 #include <netinet/in.h>
@@ -59,6 +60,20 @@ iterate (void)
   }
 }
 
+/* iterate the default main loop until there is a response to read on @conn,
+ * the server can delay the response until the media is prepared */
+static void
+iterate_until_response (GstRTSPConnection * conn)
+{
+  GSocket *socket;
+
+  socket = gst_rtsp_connection_get_read_socket (conn);
+  while (!(g_socket_condition_check (socket, G_IO_IN) & G_IO_IN)) {
+    GST_DEBUG ("iteration");
+    g_main_context_iteration (NULL, TRUE);
+  }
+}
+
 /* returns an unused port that can be used by the test */
 static int
 get_unused_port (gint type)
@@ -276,7 +291,7 @@ do_request (GstRTSPConnection * conn, GstRTSPMethod method,
   fail_unless (send_request (conn, request));
   gst_rtsp_message_free (request);
 
-  iterate ();
+  iterate_until_response (conn);
 
   /* read response */
   response = read_response (conn);
@@ -410,6 +425,46 @@ do_setup (GstRTSPConnection * conn, const gchar * control,
   return code;
 }
 
+/* receive the next message on @conn, interleaved data included. Only use this
+ * when the clients are handled by worker threads so that the server makes
+ * progress while we block. The message must be freed by the caller */
+static GstRTSPMessage *
+receive_message (GstRTSPConnection * conn)
+{
+  GstRTSPMessage *message = NULL;
+  GTimeVal timeout = { 5, 0 };
+
+  fail_unless (gst_rtsp_message_new (&message) == GST_RTSP_OK);
+  fail_unless (gst_rtsp_connection_receive (conn, message,
+          &timeout) == GST_RTSP_OK);
+
+  return message;
+}
+
+/* get the url of the test mount point and its factory, both must be freed by
+ * the caller */
+static GstRTSPMediaFactory *
+get_test_factory (GstRTSPUrl ** url)
+{
+  GstRTSPMediaMapping *mapping;
+  GstRTSPMediaFactory *factory;
+  gchar *address, *uri_string;
+
+  address = gst_rtsp_server_get_address (server);
+  uri_string = g_strdup_printf ("rtsp://%s:%d" TEST_MOUNT_POINT, address,
+      test_port);
+  fail_unless (gst_rtsp_url_parse (uri_string, url) == GST_RTSP_OK);
+  g_free (uri_string);
+  g_free (address);
+
+  mapping = gst_rtsp_server_get_media_mapping (server);
+  factory = gst_rtsp_media_mapping_find_factory (mapping, *url);
+  fail_unless (factory != NULL);
+  g_object_unref (mapping);
+
+  return factory;
+}
+
 /* fixture setup function */
 static void
 setup (void)
@@ -504,6 +559,52 @@ GST_START_TEST (test_describe)
 
 GST_END_TEST;
 
+GST_START_TEST (test_describe_after_set_launch)
+{
+  GstRTSPConnection *conn;
+  GstRTSPMediaFactory *factory;
+  GstSDPMessage *sdp_message;
+  GstRTSPUrl *url;
+  GBytes *stale, *cached;
+  const gchar *stale_sdp = "v=0\r\n"
+      "o=- 0 0 IN IP4 127.0.0.1\r\n" "s=stale\r\n" "t=0 0\r\n";
+
+  start_server ();
+
+  factory = get_test_factory (&url);
+
+  /* only shared media is described from the cache */
+  gst_rtsp_media_factory_set_shared (factory, TRUE);
+  stale = g_bytes_new_static (stale_sdp, strlen (stale_sdp));
+  gst_rtsp_media_factory_set_sdp_cache (factory, url, stale);
+  g_bytes_unref (stale);
+  cached = gst_rtsp_media_factory_get_sdp_cache (factory, url);
+  fail_unless (cached != NULL);
+  g_bytes_unref (cached);
+
+  /* a new pipeline makes the stored SDP invalid */
+  gst_rtsp_media_factory_set_launch (factory, "( " VIDEO_PIPELINE " )");
+  fail_unless (gst_rtsp_media_factory_get_sdp_cache (factory, url) == NULL);
+
+  conn = connect_to_server (test_port, TEST_MOUNT_POINT);
+
+  /* the SDP describes the new pipeline */
+  sdp_message = do_describe (conn, TEST_MOUNT_POINT);
+  fail_if (!g_strcmp0 (gst_sdp_message_get_session_name (sdp_message),
+          "stale"));
+  fail_unless (gst_sdp_message_medias_len (sdp_message) == 1);
+
+  /* clean up and iterate so the clean-up can finish */
+  gst_sdp_message_free (sdp_message);
+  gst_rtsp_connection_free (conn);
+  gst_rtsp_url_free (url);
+  g_object_unref (factory);
+  stop_server ();
+  iterate ();
+}
+
+GST_END_TEST;
+
 GST_START_TEST (test_describe_non_existing_mount_point)
 {
   GstRTSPConnection *conn;
@@ -585,6 +686,170 @@ GST_START_TEST (test_setup)
 
 GST_END_TEST;
 
+static void
+media_constructed (GstRTSPMediaFactory * factory, GstRTSPMedia * media,
+    GstRTSPMedia ** result)
+{
+  *result = g_object_ref (media);
+}
+
+GST_START_TEST (test_describe_from_cache)
+{
+  GstRTSPConnection *conn;
+  GstRTSPMediaFactory *factory;
+  GstRTSPMedia *media = NULL;
+  GstSDPMessage *sdp_message;
+  const GstSDPMedia *sdp_media;
+  const gchar *video_control;
+  GstRTSPRange client_ports;
+  GstRTSPTransport *transport = NULL;
+  GstRTSPUrl *url;
+  GBytes *cache;
+  gchar *session = NULL;
+  /* the SDP as the client stores it, with the marks for the protocol, the
+   * address and the range */
+  const gchar *cached_sdp = "v=0\r\n"
+      "o=- 0 0 IN \001 \002\r\n" "s=cached\r\n" "t=0 0\r\n"
+      "a=range:\003\r\n" "m=video 0 " TEST_PROTO " 96\r\n"
+      "c=IN \001 \002\r\n" "a=rtpmap:96 " TEST_ENCODING "/"
+      TEST_CLOCK_RATE "\r\n" "a=control:stream=0\r\n";
+
+  start_server ();
+
+  factory = get_test_factory (&url);
+  gst_rtsp_media_factory_set_shared (factory, TRUE);
+  g_signal_connect (factory, "media-constructed",
+      (GCallback) media_constructed, &media);
+  cache = g_bytes_new_static (cached_sdp, strlen (cached_sdp));
+  gst_rtsp_media_factory_set_sdp_cache (factory, url, cache);
+  g_bytes_unref (cache);
+
+  conn = connect_to_server (test_port, TEST_MOUNT_POINT);
+
+  /* the new media is not prepared yet, the DESCRIBE is answered from the
+   * cache right away */
+  sdp_message = do_describe (conn, TEST_MOUNT_POINT);
+  fail_unless (media != NULL);
+  fail_unless (!g_strcmp0 (gst_sdp_message_get_session_name (sdp_message),
+          "cached"));
+  fail_unless (!g_strcmp0 (gst_sdp_message_get_attribute_val (sdp_message,
+              "range"), "npt=now-"));
+  fail_unless (gst_sdp_message_medias_len (sdp_message) == 1);
+  sdp_media = gst_sdp_message_get_media (sdp_message, 0);
+  video_control = gst_sdp_media_get_attribute_val (sdp_media, "control");
+
+  /* the SETUP waits until the media that was prepared in the background is
+   * ready and finds the same media */
+  get_client_ports (&client_ports);
+  fail_unless (do_setup (conn, video_control, &client_ports, &session,
+          &transport) == GST_RTSP_STS_OK);
+  fail_unless (transport->lower_transport == GST_RTSP_LOWER_TRANS_UDP);
+  gst_rtsp_transport_free (transport);
+  fail_unless (gst_rtsp_media_is_prepared (media));
+
+  /* clean up and iterate so the clean-up can finish */
+  g_free (session);
+  gst_sdp_message_free (sdp_message);
+  gst_rtsp_connection_free (conn);
+  g_object_unref (media);
+  gst_rtsp_url_free (url);
+  g_object_unref (factory);
+  stop_server ();
+  iterate ();
+}
+
+GST_END_TEST;
+
+/* check the transport elements of @stream */
+static void
+check_branches (GstRTSPMedia * media, GstRTSPMediaStream * stream,
+    guint n_udp, guint n_tcp)
+{
+  g_mutex_lock (&media->branch_lock);
+  fail_unless_equals_int (stream->n_udp, n_udp);
+  fail_unless_equals_int (stream->n_tcp, n_tcp);
+  fail_unless ((stream->udpsink[0] != NULL) == (n_udp > 0));
+  fail_unless ((stream->udpsrc[0] != NULL) == (n_udp > 0));
+  fail_unless ((stream->appsink[0] != NULL) == (n_tcp > 0));
+  fail_unless ((stream->appsrc[0] != NULL) == (n_tcp > 0));
+  g_mutex_unlock (&media->branch_lock);
+}
+
+GST_START_TEST (test_setup_teardown_branches)
+{
+  GstRTSPConnection *conn;
+  GstRTSPMediaFactory *factory;
+  GstRTSPMedia *media = NULL;
+  GstRTSPMediaStream *stream;
+  GstSDPMessage *sdp_message;
+  const gchar *video_control;
+  GstRTSPRange client_ports;
+  GstRTSPTransport *transport = NULL;
+  GstRTSPUrl *url;
+  gchar *session = NULL;
+  gint64 end_time;
+
+  start_server ();
+
+  factory = get_test_factory (&url);
+  g_signal_connect (factory, "media-constructed",
+      (GCallback) media_constructed, &media);
+
+  conn = connect_to_server (test_port, TEST_MOUNT_POINT);
+
+  /* the prepared media has no transport elements yet */
+  sdp_message = do_describe (conn, TEST_MOUNT_POINT);
+  fail_unless (media != NULL);
+  stream = gst_rtsp_media_get_stream (media, 0);
+  check_branches (media, stream, 0, 0);
+
+  video_control = gst_sdp_media_get_attribute_val (gst_sdp_message_get_media
+      (sdp_message, 0), "control");
+
+  /* SETUP over UDP makes the UDP elements */
+  get_client_ports (&client_ports);
+  fail_unless (do_setup (conn, video_control, &client_ports, &session,
+          &transport) == GST_RTSP_STS_OK);
+  gst_rtsp_transport_free (transport);
+  check_branches (media, stream, 1, 0);
+
+  /* changing the transport to TCP replaces the UDP elements */
+  fail_unless (do_request (conn, GST_RTSP_SETUP, video_control, session,
+          TEST_PROTO "/TCP;unicast;interleaved=0-1", NULL, NULL, NULL, NULL,
+          NULL) == GST_RTSP_STS_OK);
+  check_branches (media, stream, 0, 1);
+
+  /* TEARDOWN gives back the TCP elements */
+  fail_unless (do_simple_request (conn, GST_RTSP_TEARDOWN,
+          session) == GST_RTSP_STS_OK);
+
+  end_time = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+  do {
+    gboolean removed;
+
+    iterate ();
+    g_mutex_lock (&media->branch_lock);
+    removed = stream->n_tcp == 0 && stream->appsink[0] == NULL;
+    g_mutex_unlock (&media->branch_lock);
+    if (removed)
+      break;
+    g_usleep (10000);
+  } while (g_get_monotonic_time () < end_time);
+  check_branches (media, stream, 0, 0);
+
+  /* clean up and iterate so the clean-up can finish */
+  g_free (session);
+  gst_sdp_message_free (sdp_message);
+  gst_rtsp_connection_free (conn);
+  g_object_unref (media);
+  gst_rtsp_url_free (url);
+  g_object_unref (factory);
+  stop_server ();
+  iterate ();
+}
+
+GST_END_TEST;
+
 GST_START_TEST (test_setup_non_existing_stream)
 {
   GstRTSPConnection *conn;
@@ -721,6 +986,191 @@ GST_START_TEST (test_bind_already_in_use)
 GST_END_TEST;
 
 
+GST_START_TEST (test_port_pool)
+{
+  GstRTSPPortPool *pool;
+  GSocket *rtp[3], *rtcp[3];
+  guint port[3], base;
+  gint i;
+
+  base = get_unused_port (SOCK_DGRAM) & ~1;
+
+  pool = gst_rtsp_port_pool_new ();
+  gst_rtsp_port_pool_set_warm_pairs (pool, 0);
+  gst_rtsp_port_pool_set_range (pool, base, base + 3);
+
+  /* the range has room for 2 pairs */
+  for (i = 0; i < 2; i++) {
+    fail_unless (gst_rtsp_port_pool_acquire (pool, G_SOCKET_FAMILY_IPV4,
+            &port[i], &rtp[i], &rtcp[i]));
+    fail_unless (port[i] == base || port[i] == base + 2);
+    fail_if (port_is_unused (port[i], SOCK_DGRAM));
+    fail_if (port_is_unused (port[i] + 1, SOCK_DGRAM));
+  }
+  fail_unless (port[0] != port[1]);
+  fail_if (gst_rtsp_port_pool_acquire (pool, G_SOCKET_FAMILY_IPV4,
+          &port[2], &rtp[2], &rtcp[2]));
+
+  /* give back the first pair, it can be acquired again */
+  g_socket_close (rtp[0], NULL);
+  g_socket_close (rtcp[0], NULL);
+  g_object_unref (rtp[0]);
+  g_object_unref (rtcp[0]);
+  gst_rtsp_port_pool_release (pool, port[0]);
+
+  fail_unless (gst_rtsp_port_pool_acquire (pool, G_SOCKET_FAMILY_IPV4,
+          &port[2], &rtp[2], &rtcp[2]));
+  fail_unless (port[2] == port[0]);
+
+  for (i = 1; i < 3; i++) {
+    g_socket_close (rtp[i], NULL);
+    g_socket_close (rtcp[i], NULL);
+    g_object_unref (rtp[i]);
+    g_object_unref (rtcp[i]);
+  }
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
+static void
+limit_send_queue (GstRTSPServer * server, GstRTSPClient * client,
+    GstRTSPClient ** result)
+{
+  gst_rtsp_client_set_send_budget (client, 128 * 1024, 0);
+  *result = g_object_ref (client);
+}
+
+GST_START_TEST (test_send_budget_default)
+{
+  GstRTSPClient *client;
+  guint max_bytes, max_time;
+
+  /* dropping data is opt-in */
+  client = gst_rtsp_client_new ();
+  gst_rtsp_client_get_send_budget (client, &max_bytes, &max_time);
+  fail_unless (max_bytes == 0);
+  fail_unless (max_time == 0);
+  g_object_unref (client);
+}
+
+GST_END_TEST;
+
+static guint64
+get_dropped_frames (GstRTSPClient * client)
+{
+  GstStructure *stats;
+  guint64 dropped = 0;
+
+  stats = gst_rtsp_client_get_send_stats (client);
+  fail_unless (gst_structure_get (stats, "dropped-frames", G_TYPE_UINT64,
+          &dropped, NULL));
+  gst_structure_free (stats);
+
+  return dropped;
+}
+
+GST_START_TEST (test_send_queue_drop)
+{
+  GstRTSPConnection *conn;
+  GstSDPMessage *sdp_message;
+  const GstSDPMedia *sdp_media;
+  const gchar *video_control;
+  GstRTSPMessage *request;
+  GstRTSPClient *client = NULL;
+  gchar *session = NULL;
+  gboolean got_response = FALSE, have_prev = FALSE;
+  guint16 prev_seq = 0;
+  guint32 prev_rtptime = 0;
+  gint64 end_time;
+  guint i, gaps = 0;
+
+  /* handle the client in a worker thread so that we can block on reading */
+  g_object_set (server, "worker-threads", 1, NULL);
+  g_signal_connect (server, "client-connected",
+      (GCallback) limit_send_queue, &client);
+  start_server ();
+
+  conn = connect_to_server (test_port, TEST_MOUNT_POINT);
+
+  sdp_message = do_describe (conn, TEST_MOUNT_POINT);
+  sdp_media = gst_sdp_message_get_media (sdp_message, 0);
+  video_control = gst_sdp_media_get_attribute_val (sdp_media, "control");
+
+  fail_unless (do_request (conn, GST_RTSP_SETUP, video_control, NULL,
+          TEST_PROTO "/TCP;unicast;interleaved=0-1", NULL, NULL, NULL,
+          &session, NULL) == GST_RTSP_STS_OK);
+  fail_unless (client != NULL);
+
+  request = create_request (conn, GST_RTSP_PLAY, NULL);
+  gst_rtsp_message_add_header (request, GST_RTSP_HDR_SESSION, session);
+  fail_unless (send_request (conn, request));
+  gst_rtsp_message_free (request);
+
+  /* don't read until the client dropped data, the raw video does not fit in
+   * the socket buffers and the send queue of the client */
+  end_time = g_get_monotonic_time () + 10 * G_TIME_SPAN_SECOND;
+  while (get_dropped_frames (client) == 0 &&
+      g_get_monotonic_time () < end_time)
+    g_usleep (10000);
+  fail_unless (get_dropped_frames (client) > 0);
+
+  /* after a gap in the RTP packets, sending resumes at the start of a frame.
+   * All packets of a frame have the same timestamp. */
+  for (i = 0; i < 20000 && gaps < 3; i++) {
+    GstRTSPMessage *message;
+    GstRTSPStatusCode code;
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+    GstBuffer *buffer;
+    guint8 channel, *data;
+    guint size;
+    guint16 seq;
+    guint32 rtptime;
+
+    message = receive_message (conn);
+
+    if (gst_rtsp_message_get_type (message) == GST_RTSP_MESSAGE_RESPONSE) {
+      gst_rtsp_message_parse_response (message, &code, NULL, NULL);
+      fail_unless (code == GST_RTSP_STS_OK);
+      got_response = TRUE;
+    } else if (gst_rtsp_message_get_type (message) == GST_RTSP_MESSAGE_DATA) {
+      gst_rtsp_message_parse_data (message, &channel);
+      gst_rtsp_message_steal_body (message, &data, &size);
+      buffer = gst_buffer_new_wrapped (data, size);
+
+      if (channel == 0) {
+        fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp));
+        seq = gst_rtp_buffer_get_seq (&rtp);
+        rtptime = gst_rtp_buffer_get_timestamp (&rtp);
+        gst_rtp_buffer_unmap (&rtp);
+
+        if (have_prev && seq != (guint16) (prev_seq + 1)) {
+          GST_DEBUG ("gap from %u to %u", prev_seq, seq);
+          fail_unless (rtptime != prev_rtptime);
+          gaps++;
+        }
+        prev_seq = seq;
+        prev_rtptime = rtptime;
+        have_prev = TRUE;
+      }
+      gst_buffer_unref (buffer);
+    }
+    gst_rtsp_message_free (message);
+  }
+  fail_unless (got_response);
+  fail_unless (gaps > 0);
+
+  /* clean up and iterate so the clean-up can finish */
+  g_object_unref (client);
+  g_free (session);
+  gst_sdp_message_free (sdp_message);
+  gst_rtsp_connection_free (conn);
+  stop_server ();
+  iterate ();
+}
+
+GST_END_TEST;
+
 static Suite *
 rtspserver_suite (void)
 {
@@ -732,12 +1182,18 @@ rtspserver_suite (void)
   tcase_set_timeout (tc, 20);
   tcase_add_test (tc, test_connect);
   tcase_add_test (tc, test_describe);
+  tcase_add_test (tc, test_describe_after_set_launch);
+  tcase_add_test (tc, test_describe_from_cache);
   tcase_add_test (tc, test_describe_non_existing_mount_point);
   tcase_add_test (tc, test_setup);
+  tcase_add_test (tc, test_setup_teardown_branches);
   tcase_add_test (tc, test_setup_non_existing_stream);
   tcase_add_test (tc, test_play);
   tcase_add_test (tc, test_play_without_session);
   tcase_add_test (tc, test_bind_already_in_use);
+  tcase_add_test (tc, test_port_pool);
+  tcase_add_test (tc, test_send_budget_default);
+  tcase_add_test (tc, test_send_queue_drop);
 
   return s;
 }
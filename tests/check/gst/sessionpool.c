@@ -0,0 +1,164 @@
+/* GStreamer
+ *
+ * unit test for GstRTSPSessionPool
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include "rtsp-session-pool.h"
+
+/* returns TRUE when a session with @sessionid is in @pool */
+static gboolean
+has_session (GstRTSPSessionPool * pool, const gchar * sessionid)
+{
+  GstRTSPSession *sess;
+
+  if (!(sess = gst_rtsp_session_pool_find (pool, sessionid)))
+    return FALSE;
+
+  g_object_unref (sess);
+  return TRUE;
+}
+
+/* the milliseconds until the watch of a pool in @context is dispatched, which
+ * is when the session that is first in the schedule expires */
+static gint
+get_watch_timeout (GMainContext * context)
+{
+  GPollFD fds[8];
+  gint priority, timeout, n_fds;
+
+  fail_unless (g_main_context_acquire (context));
+  g_main_context_prepare (context, &priority);
+  n_fds = g_main_context_query (context, priority, &timeout, fds,
+      G_N_ELEMENTS (fds));
+  g_main_context_check (context, priority, fds, n_fds);
+  g_main_context_release (context);
+
+  return timeout;
+}
+
+/* check that the watch is dispatched when a session with @timeout seconds
+ * that was just accessed expires. The sessions expire 5 seconds after their
+ * timeout, we allow 500 milliseconds for the time since the access. */
+static void
+check_watch_timeout (GMainContext * context, guint timeout)
+{
+  gint expire = (timeout + 5) * 1000;
+  gint res;
+
+  res = get_watch_timeout (context);
+  fail_unless (res <= expire && res > expire - 500,
+      "watch timeout %d, expected %d", res, expire);
+}
+
+GST_START_TEST (test_expire_after_set_timeout)
+{
+  GstRTSPSessionPool *pool;
+  GstRTSPSession *sess[3];
+  GMainContext *context;
+  GSource *source;
+  gchar *id[3];
+  guint i;
+
+  pool = gst_rtsp_session_pool_new ();
+  context = g_main_context_new ();
+  source = gst_rtsp_session_pool_create_watch (pool);
+  g_source_attach (source, context);
+
+  for (i = 0; i < 3; i++) {
+    sess[i] = gst_rtsp_session_pool_create (pool);
+    fail_unless (sess[i] != NULL);
+    id[i] = g_strdup (gst_rtsp_session_get_sessionid (sess[i]));
+  }
+  fail_unless (gst_rtsp_session_pool_get_n_sessions (pool) == 3);
+
+  /* all sessions have the default timeout */
+  check_watch_timeout (context, gst_rtsp_session_get_timeout (sess[0]));
+
+  /* the session in the middle is scheduled with the long timeout, shortening
+   * it must move it to the front */
+  gst_rtsp_session_touch (sess[1]);
+  gst_rtsp_session_set_timeout (sess[1], 1);
+  check_watch_timeout (context, 1);
+  fail_unless (gst_rtsp_session_pool_cleanup (pool) == 0);
+
+  /* once it is gone, the others keep the long timeout */
+  fail_unless (gst_rtsp_session_pool_remove (pool, sess[1]));
+  check_watch_timeout (context, gst_rtsp_session_get_timeout (sess[0]));
+
+  /* again for the last session, the first keeps its timeout */
+  gst_rtsp_session_touch (sess[2]);
+  gst_rtsp_session_set_timeout (sess[2], 2);
+  check_watch_timeout (context, 2);
+  fail_unless (gst_rtsp_session_pool_cleanup (pool) == 0);
+
+  fail_unless (gst_rtsp_session_pool_remove (pool, sess[2]));
+  check_watch_timeout (context, gst_rtsp_session_get_timeout (sess[0]));
+  fail_unless (gst_rtsp_session_pool_get_n_sessions (pool) == 1);
+  fail_unless (has_session (pool, id[0]));
+
+  for (i = 0; i < 3; i++) {
+    g_object_unref (sess[i]);
+    g_free (id[i]);
+  }
+  g_source_destroy (source);
+  g_source_unref (source);
+  g_main_context_unref (context);
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_set_timeout_after_remove)
+{
+  GstRTSPSessionPool *pool;
+  GstRTSPSession *sess;
+
+  pool = gst_rtsp_session_pool_new ();
+
+  sess = gst_rtsp_session_pool_create (pool);
+  fail_unless (sess != NULL);
+  fail_unless (gst_rtsp_session_pool_remove (pool, sess));
+
+  /* the pool no longer follows the session */
+  gst_rtsp_session_set_timeout (sess, 1);
+  fail_unless (gst_rtsp_session_pool_cleanup (pool) == 0);
+  fail_unless (gst_rtsp_session_pool_get_n_sessions (pool) == 0);
+
+  g_object_unref (sess);
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
+static Suite *
+rtspsessionpool_suite (void)
+{
+  Suite *s = suite_create ("rtspsessionpool");
+  TCase *tc = tcase_create ("general");
+
+  suite_add_tcase (s, tc);
+  tcase_set_timeout (tc, 20);
+  tcase_add_test (tc, test_expire_after_set_timeout);
+  tcase_add_test (tc, test_set_timeout_after_remove);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtspsessionpool);
@@ -0,0 +1,391 @@
+/* GStreamer
+ *
+ * unit test for GstRTSPUDPReceiver
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include "rtsp-udp-receiver.h"
+
+#define PACKET_SIZE     100
+/* the time to wait for something that should happen */
+#define WAIT_TIMEOUT    (5 * G_TIME_SPAN_SECOND)
+
+typedef struct
+{
+  GMutex lock;
+  GCond cond;
+  GstRTSPUDPReceiver *receiver;
+  /* the callback removes the socket */
+  gboolean remove;
+  /* the notify drops the ref of the receiver */
+  gboolean unref;
+  /* the callback drops the ref of the receiver, once */
+  gboolean unref_receive;
+  guint received;
+  guint calls;
+  guint calls_after_notify;
+  guint notified;
+  guint finalized;
+} Counter;
+
+/* sends packets to a port until stopped */
+typedef struct
+{
+  GSocket *socket;
+  GSocketAddress *dest;
+  volatile gint running;
+  GThread *thread;
+} Sender;
+
+/* a non-blocking socket on a free port of localhost */
+static GSocket *
+make_socket (void)
+{
+  GSocket *socket;
+  GInetAddress *local;
+  GSocketAddress *addr;
+
+  socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  fail_unless (socket != NULL);
+  g_socket_set_blocking (socket, FALSE);
+  local = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  addr = g_inet_socket_address_new (local, 0);
+  fail_unless (g_socket_bind (socket, addr, FALSE, NULL));
+  g_object_unref (addr);
+  g_object_unref (local);
+
+  return socket;
+}
+
+static gpointer
+send_loop (Sender * sender)
+{
+  gchar data[PACKET_SIZE] = { 0, };
+
+  while (g_atomic_int_get (&sender->running)) {
+    g_socket_send_to (sender->socket, sender->dest, data, sizeof (data),
+        NULL, NULL);
+    g_usleep (100);
+  }
+  return NULL;
+}
+
+static Sender *
+start_sender (GSocket * socket)
+{
+  Sender *sender;
+
+  sender = g_new0 (Sender, 1);
+  sender->socket = make_socket ();
+  sender->dest = g_socket_get_local_address (socket, NULL);
+  sender->running = TRUE;
+  sender->thread = g_thread_new ("sender", (GThreadFunc) send_loop, sender);
+
+  return sender;
+}
+
+static void
+stop_sender (Sender * sender)
+{
+  g_atomic_int_set (&sender->running, FALSE);
+  g_thread_join (sender->thread);
+  g_object_unref (sender->dest);
+  g_object_unref (sender->socket);
+  g_free (sender);
+}
+
+static void
+receive (GSocket * socket, Counter * counter)
+{
+  GstRTSPUDPReceiver *receiver = NULL;
+  gchar data[PACKET_SIZE];
+
+  g_mutex_lock (&counter->lock);
+  counter->calls++;
+  if (counter->notified)
+    counter->calls_after_notify++;
+  while (g_socket_receive (socket, data, sizeof (data), NULL, NULL) > 0)
+    counter->received++;
+  if (counter->unref_receive) {
+    receiver = counter->receiver;
+    counter->unref_receive = FALSE;
+  }
+  g_cond_broadcast (&counter->cond);
+  g_mutex_unlock (&counter->lock);
+
+  if (counter->remove)
+    gst_rtsp_udp_receiver_remove (counter->receiver, socket);
+  if (receiver)
+    g_object_unref (receiver);
+}
+
+static void
+notify (Counter * counter)
+{
+  GstRTSPUDPReceiver *receiver = NULL;
+
+  g_mutex_lock (&counter->lock);
+  counter->notified = TRUE;
+  if (counter->unref)
+    receiver = counter->receiver;
+  g_cond_broadcast (&counter->cond);
+  g_mutex_unlock (&counter->lock);
+
+  if (receiver)
+    g_object_unref (receiver);
+}
+
+static void
+finalized (Counter * counter, GObject * object)
+{
+  g_mutex_lock (&counter->lock);
+  counter->finalized = TRUE;
+  g_cond_broadcast (&counter->cond);
+  g_mutex_unlock (&counter->lock);
+}
+
+static void
+counter_init (Counter * counter, GstRTSPUDPReceiver * receiver)
+{
+  memset (counter, 0, sizeof (Counter));
+  g_mutex_init (&counter->lock);
+  g_cond_init (&counter->cond);
+  counter->receiver = receiver;
+}
+
+static void
+counter_clear (Counter * counter)
+{
+  g_mutex_clear (&counter->lock);
+  g_cond_clear (&counter->cond);
+}
+
+/* wait until @field of @counter is not 0 */
+static gboolean
+counter_wait (Counter * counter, guint * field)
+{
+  gint64 end_time = g_get_monotonic_time () + WAIT_TIMEOUT;
+  gboolean res;
+
+  g_mutex_lock (&counter->lock);
+  while (*field == 0)
+    if (!g_cond_wait_until (&counter->cond, &counter->lock, end_time))
+      break;
+  res = *field != 0;
+  g_mutex_unlock (&counter->lock);
+
+  return res;
+}
+
+GST_START_TEST (test_add_remove)
+{
+  GstRTSPUDPReceiver *receiver;
+  GSocket *socket;
+  Sender *sender;
+  Counter counter;
+  guint i;
+
+  /* without epoll there is no receiver */
+  if (!(receiver = gst_rtsp_udp_receiver_new (2)))
+    return;
+
+  socket = make_socket ();
+  sender = start_sender (socket);
+
+  /* the callback is not called anymore once the notify ran, while data keeps
+   * arriving */
+  for (i = 0; i < 20; i++) {
+    counter_init (&counter, receiver);
+    fail_unless (gst_rtsp_udp_receiver_add (receiver, socket,
+            (GstRTSPUDPReceiveFunc) receive, &counter,
+            (GDestroyNotify) notify));
+    fail_unless (counter_wait (&counter, &counter.received));
+
+    gst_rtsp_udp_receiver_remove (receiver, socket);
+    fail_unless (counter_wait (&counter, &counter.notified));
+    g_usleep (G_USEC_PER_SEC / 100);
+    fail_unless (counter.calls_after_notify == 0);
+    counter_clear (&counter);
+  }
+
+  stop_sender (sender);
+  g_object_unref (socket);
+  g_object_unref (receiver);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_add_twice)
+{
+  GstRTSPUDPReceiver *receiver;
+  GSocket *socket;
+  Counter counter[2];
+
+  if (!(receiver = gst_rtsp_udp_receiver_new (1)))
+    return;
+
+  socket = make_socket ();
+  counter_init (&counter[0], receiver);
+  counter_init (&counter[1], receiver);
+
+  fail_unless (gst_rtsp_udp_receiver_add (receiver, socket,
+          (GstRTSPUDPReceiveFunc) receive, &counter[0],
+          (GDestroyNotify) notify));
+  /* the data of a socket that is not added is released right away */
+  fail_if (gst_rtsp_udp_receiver_add (receiver, socket,
+          (GstRTSPUDPReceiveFunc) receive, &counter[1],
+          (GDestroyNotify) notify));
+  fail_unless (counter[1].notified);
+
+  gst_rtsp_udp_receiver_remove (receiver, socket);
+  fail_unless (counter_wait (&counter[0], &counter[0].notified));
+  /* removing again does nothing */
+  gst_rtsp_udp_receiver_remove (receiver, socket);
+
+  counter_clear (&counter[0]);
+  counter_clear (&counter[1]);
+  g_object_unref (socket);
+  g_object_unref (receiver);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_remove_from_callback)
+{
+  GstRTSPUDPReceiver *receiver;
+  GSocket *socket;
+  Sender *sender;
+  Counter counter;
+
+  if (!(receiver = gst_rtsp_udp_receiver_new (1)))
+    return;
+
+  socket = make_socket ();
+  counter_init (&counter, receiver);
+  counter.remove = TRUE;
+
+  fail_unless (gst_rtsp_udp_receiver_add (receiver, socket,
+          (GstRTSPUDPReceiveFunc) receive, &counter, (GDestroyNotify) notify));
+  sender = start_sender (socket);
+
+  fail_unless (counter_wait (&counter, &counter.notified));
+  g_usleep (G_USEC_PER_SEC / 100);
+  fail_unless (counter.calls == 1);
+
+  stop_sender (sender);
+  counter_clear (&counter);
+  g_object_unref (socket);
+  g_object_unref (receiver);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_unref_from_callback)
+{
+  GstRTSPUDPReceiver *receiver;
+  GSocket *socket;
+  Sender *sender;
+  Counter counter;
+
+  if (!(receiver = gst_rtsp_udp_receiver_new (1)))
+    return;
+
+  socket = make_socket ();
+  counter_init (&counter, receiver);
+  counter.remove = TRUE;
+  counter.unref = TRUE;
+  g_object_weak_ref (G_OBJECT (receiver), (GWeakNotify) finalized, &counter);
+
+  /* the notify drops the last ref, from the thread of the receiver */
+  fail_unless (gst_rtsp_udp_receiver_add (receiver, socket,
+          (GstRTSPUDPReceiveFunc) receive, &counter, (GDestroyNotify) notify));
+  sender = start_sender (socket);
+
+  fail_unless (counter_wait (&counter, &counter.finalized));
+
+  stop_sender (sender);
+  counter_clear (&counter);
+  g_object_unref (socket);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_unref_in_callback)
+{
+  GstRTSPUDPReceiver *receiver;
+  GSocket *socket[2];
+  Sender *sender[2];
+  Counter counter[2];
+  guint i;
+
+  if (!(receiver = gst_rtsp_udp_receiver_new (1)))
+    return;
+
+  /* both sockets are handled by the one thread, the other watch is freed
+   * while the callback of the first is running */
+  for (i = 0; i < 2; i++) {
+    socket[i] = make_socket ();
+    counter_init (&counter[i], receiver);
+    fail_unless (gst_rtsp_udp_receiver_add (receiver, socket[i],
+            (GstRTSPUDPReceiveFunc) receive, &counter[i],
+            (GDestroyNotify) notify));
+  }
+  counter[0].unref_receive = TRUE;
+  g_object_weak_ref (G_OBJECT (receiver), (GWeakNotify) finalized,
+      &counter[0]);
+
+  /* the callback drops the last ref, from the thread of the receiver */
+  for (i = 0; i < 2; i++)
+    sender[i] = start_sender (socket[i]);
+
+  fail_unless (counter_wait (&counter[0], &counter[0].finalized));
+  for (i = 0; i < 2; i++)
+    fail_unless (counter_wait (&counter[i], &counter[i].notified));
+  g_usleep (G_USEC_PER_SEC / 100);
+  for (i = 0; i < 2; i++)
+    fail_unless (counter[i].calls_after_notify == 0);
+
+  for (i = 0; i < 2; i++) {
+    stop_sender (sender[i]);
+    counter_clear (&counter[i]);
+    g_object_unref (socket[i]);
+  }
+}
+
+GST_END_TEST;
+
+static Suite *
+rtspudpreceiver_suite (void)
+{
+  Suite *s = suite_create ("rtspudpreceiver");
+  TCase *tc = tcase_create ("general");
+
+  suite_add_tcase (s, tc);
+  tcase_set_timeout (tc, 20);
+  tcase_add_test (tc, test_add_remove);
+  tcase_add_test (tc, test_add_twice);
+  tcase_add_test (tc, test_remove_from_callback);
+  tcase_add_test (tc, test_unref_from_callback);
+  tcase_add_test (tc, test_unref_in_callback);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtspudpreceiver);
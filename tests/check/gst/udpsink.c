@@ -0,0 +1,421 @@
+/* GStreamer
+ *
+ * unit test for GstRTSPUDPSink
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include "rtsp-udp-sink.h"
+
+#define PACKET_SIZE     1000
+/* the time to wait for a packet that is not sent */
+#define NO_PACKET_TIMEOUT  (200 * G_TIME_SPAN_MILLISECOND)
+#define N_DESTS         16
+
+/* a socket on a free port of localhost */
+static GSocket *
+make_socket (void)
+{
+  GSocket *socket;
+  GInetAddress *local;
+  GSocketAddress *addr;
+
+  socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  fail_unless (socket != NULL);
+  local = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  addr = g_inet_socket_address_new (local, 0);
+  fail_unless (g_socket_bind (socket, addr, FALSE, NULL));
+  g_object_unref (addr);
+  g_object_unref (local);
+
+  return socket;
+}
+
+static gint
+get_port (GSocket * socket)
+{
+  GSocketAddress *addr;
+  gint port;
+
+  addr = g_socket_get_local_address (socket, NULL);
+  port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (addr));
+  g_object_unref (addr);
+
+  return port;
+}
+
+/* the number of packets of @size waiting on @socket */
+static guint
+count_packets (GSocket * socket, gsize size)
+{
+  gchar data[PACKET_SIZE * 2];
+  guint res = 0;
+
+  while (g_socket_condition_timed_wait (socket, G_IO_IN, NO_PACKET_TIMEOUT,
+          NULL, NULL)) {
+    gssize len = g_socket_receive (socket, data, sizeof (data), NULL, NULL);
+
+    fail_unless (len == (gssize) size);
+    res++;
+  }
+  return res;
+}
+
+/* receive @n_packets from @socket, in the order they were sent */
+static void
+check_packets (GSocket * socket, guint n_packets)
+{
+  guint8 data[PACKET_SIZE];
+  guint i;
+
+  for (i = 0; i < n_packets; i++) {
+    fail_unless (g_socket_condition_timed_wait (socket, G_IO_IN,
+            NO_PACKET_TIMEOUT, NULL, NULL));
+    fail_unless (g_socket_receive (socket, (gchar *) data, sizeof (data),
+            NULL, NULL) == PACKET_SIZE);
+    fail_unless (GST_READ_UINT32_BE (data) == i);
+  }
+  fail_unless (count_packets (socket, PACKET_SIZE) == 0);
+}
+
+static GstElement *
+make_sink (GSocket * socket)
+{
+  GstElement *sink;
+
+  sink = gst_rtsp_udp_sink_new (socket);
+  gst_object_ref_sink (sink);
+
+  return sink;
+}
+
+static void
+start_sink (GstElement * sink)
+{
+  GstPad *pad;
+  GstSegment segment;
+
+  fail_unless (gst_element_set_state (sink, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_send_event (pad, gst_event_new_stream_start ("udpsink"));
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_send_event (pad, gst_event_new_segment (&segment));
+  gst_object_unref (pad);
+}
+
+static void
+stop_sink (GstElement * sink)
+{
+  fail_unless (gst_element_set_state (sink, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  gst_object_unref (sink);
+}
+
+/* a packet starting with @seq */
+static GstBuffer *
+make_packet (guint32 seq)
+{
+  GstBuffer *buffer;
+  guint8 data[4];
+
+  buffer = gst_buffer_new_allocate (NULL, PACKET_SIZE, NULL);
+  gst_buffer_memset (buffer, 0, 0xaa, PACKET_SIZE);
+  GST_WRITE_UINT32_BE (data, seq);
+  gst_buffer_fill (buffer, 0, data, sizeof (data));
+
+  return buffer;
+}
+
+static void
+push_buffer (GstElement * sink, guint32 seq)
+{
+  GstPad *pad;
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  fail_unless (gst_pad_chain (pad, make_packet (seq)) == GST_FLOW_OK);
+  gst_object_unref (pad);
+}
+
+static GstBufferList *
+make_list (guint32 first, guint n_packets)
+{
+  GstBufferList *list;
+  guint i;
+
+  list = gst_buffer_list_new_sized (n_packets);
+  for (i = 0; i < n_packets; i++)
+    gst_buffer_list_add (list, make_packet (first + i));
+
+  return list;
+}
+
+static void
+push_list (GstElement * sink, guint32 first, guint n_packets)
+{
+  GstPad *pad;
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  fail_unless (gst_pad_chain_list (pad, make_list (first,
+              n_packets)) == GST_FLOW_OK);
+  gst_object_unref (pad);
+}
+
+GST_START_TEST (test_add_remove)
+{
+  GSocket *socket, *recv[2];
+  GstElement *sink;
+  GstRTSPUDPSink *udpsink;
+  gint port[2];
+
+  socket = make_socket ();
+  recv[0] = make_socket ();
+  recv[1] = make_socket ();
+  port[0] = get_port (recv[0]);
+  port[1] = get_port (recv[1]);
+
+  sink = make_sink (socket);
+  start_sink (sink);
+  udpsink = GST_RTSP_UDP_SINK (sink);
+
+  /* a destination added twice is sent to once */
+  fail_unless (gst_rtsp_udp_sink_add (udpsink, "127.0.0.1", port[0]));
+  fail_unless (gst_rtsp_udp_sink_add (udpsink, "127.0.0.1", port[0]));
+  fail_unless (gst_rtsp_udp_sink_add (udpsink, "127.0.0.1", port[1]));
+  fail_unless (gst_rtsp_udp_sink_n_destinations (udpsink) == 2);
+
+  push_buffer (sink, 0);
+  fail_unless (count_packets (recv[0], PACKET_SIZE) == 1);
+  fail_unless (count_packets (recv[1], PACKET_SIZE) == 1);
+
+  /* and must be removed twice */
+  gst_rtsp_udp_sink_remove (udpsink, "127.0.0.1", port[0]);
+  fail_unless (gst_rtsp_udp_sink_n_destinations (udpsink) == 2);
+
+  push_buffer (sink, 0);
+  fail_unless (count_packets (recv[0], PACKET_SIZE) == 1);
+  fail_unless (count_packets (recv[1], PACKET_SIZE) == 1);
+
+  gst_rtsp_udp_sink_remove (udpsink, "127.0.0.1", port[0]);
+  fail_unless (gst_rtsp_udp_sink_n_destinations (udpsink) == 1);
+
+  push_buffer (sink, 0);
+  fail_unless (count_packets (recv[0], PACKET_SIZE) == 0);
+  fail_unless (count_packets (recv[1], PACKET_SIZE) == 1);
+
+  /* removing an unknown destination does nothing */
+  gst_rtsp_udp_sink_remove (udpsink, "127.0.0.1", port[0]);
+  fail_unless (gst_rtsp_udp_sink_n_destinations (udpsink) == 1);
+
+  gst_rtsp_udp_sink_clear (udpsink);
+  fail_unless (gst_rtsp_udp_sink_n_destinations (udpsink) == 0);
+
+  push_buffer (sink, 0);
+  fail_unless (count_packets (recv[1], PACKET_SIZE) == 0);
+
+  stop_sink (sink);
+  g_object_unref (recv[0]);
+  g_object_unref (recv[1]);
+  g_object_unref (socket);
+}
+
+GST_END_TEST;
+
+/* each destination gets every packet of a list once, with and without
+ * segmentation offload */
+static void
+check_send_list (gboolean gso)
+{
+  GSocket *socket, *recv[3];
+  GstElement *sink;
+  guint i;
+
+  socket = make_socket ();
+  sink = make_sink (socket);
+  g_object_set (sink, "gso", gso, NULL);
+  start_sink (sink);
+
+  for (i = 0; i < G_N_ELEMENTS (recv); i++) {
+    recv[i] = make_socket ();
+    fail_unless (gst_rtsp_udp_sink_add (GST_RTSP_UDP_SINK (sink), "127.0.0.1",
+            get_port (recv[i])));
+  }
+
+  push_list (sink, 0, 8);
+  for (i = 0; i < G_N_ELEMENTS (recv); i++)
+    check_packets (recv[i], 8);
+
+  /* a single packet is not segmented */
+  push_list (sink, 0, 1);
+  for (i = 0; i < G_N_ELEMENTS (recv); i++)
+    check_packets (recv[i], 1);
+
+  stop_sink (sink);
+  for (i = 0; i < G_N_ELEMENTS (recv); i++)
+    g_object_unref (recv[i]);
+  g_object_unref (socket);
+}
+
+GST_START_TEST (test_send_list)
+{
+  check_send_list (FALSE);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_send_list_gso)
+{
+  check_send_list (TRUE);
+}
+
+GST_END_TEST;
+
+/* with sender threads, each destination gets all packets in order, also the
+ * destinations that were added before the threads were started */
+GST_START_TEST (test_send_threads)
+{
+  GSocket *socket, *recv[N_DESTS];
+  GstElement *sink;
+  guint i;
+
+  socket = make_socket ();
+  sink = make_sink (socket);
+  g_object_set (sink, "send-threads", 4, NULL);
+
+  for (i = 0; i < N_DESTS; i++) {
+    if (i == N_DESTS / 2)
+      start_sink (sink);
+    recv[i] = make_socket ();
+    fail_unless (gst_rtsp_udp_sink_add (GST_RTSP_UDP_SINK (sink), "127.0.0.1",
+            get_port (recv[i])));
+  }
+  fail_unless (gst_rtsp_udp_sink_n_destinations (GST_RTSP_UDP_SINK (sink)) ==
+      N_DESTS);
+
+  for (i = 0; i < 8; i++)
+    push_buffer (sink, i);
+  push_list (sink, 8, 8);
+  for (i = 0; i < N_DESTS; i++)
+    check_packets (recv[i], 16);
+
+  stop_sink (sink);
+  for (i = 0; i < N_DESTS; i++)
+    g_object_unref (recv[i]);
+  g_object_unref (socket);
+}
+
+GST_END_TEST;
+
+typedef struct
+{
+  GstElement *sink;
+  gint stop;
+  gboolean flushed;
+} Pusher;
+
+static gpointer
+push_loop (Pusher * pusher)
+{
+  GstPad *pad;
+  guint32 seq = 0;
+
+  pad = gst_element_get_static_pad (pusher->sink, "sink");
+  while (!g_atomic_int_get (&pusher->stop)) {
+    if (gst_pad_chain_list (pad, make_list (seq, 16)) == GST_FLOW_FLUSHING)
+      pusher->flushed = TRUE;
+    seq += 16;
+  }
+  gst_object_unref (pad);
+
+  return NULL;
+}
+
+/* stopping the sink while the streaming thread and the sender threads are
+ * busy does not hang, the sink sends again when it is started again */
+GST_START_TEST (test_stop_while_sending)
+{
+  GSocket *socket, *recv[N_DESTS];
+  GstElement *sink;
+  GThread *thread;
+  Pusher pusher = { NULL, };
+  guint i, round;
+
+  socket = make_socket ();
+  sink = make_sink (socket);
+  g_object_set (sink, "send-threads", 2, NULL);
+
+  for (i = 0; i < N_DESTS; i++) {
+    recv[i] = make_socket ();
+    fail_unless (gst_rtsp_udp_sink_add (GST_RTSP_UDP_SINK (sink), "127.0.0.1",
+            get_port (recv[i])));
+  }
+
+  for (round = 0; round < 2; round++) {
+    start_sink (sink);
+
+    pusher.sink = sink;
+    pusher.stop = FALSE;
+    pusher.flushed = FALSE;
+    thread = g_thread_new ("push", (GThreadFunc) push_loop, &pusher);
+    g_usleep (100 * G_TIME_SPAN_MILLISECOND);
+
+    fail_unless (gst_element_set_state (sink, GST_STATE_NULL) ==
+        GST_STATE_CHANGE_SUCCESS);
+    g_usleep (10 * G_TIME_SPAN_MILLISECOND);
+    g_atomic_int_set (&pusher.stop, TRUE);
+    g_thread_join (thread);
+    fail_unless (pusher.flushed);
+
+    /* drop what was received */
+    for (i = 0; i < N_DESTS; i++)
+      count_packets (recv[i], PACKET_SIZE);
+  }
+
+  start_sink (sink);
+  push_buffer (sink, 0);
+  for (i = 0; i < N_DESTS; i++)
+    check_packets (recv[i], 1);
+
+  stop_sink (sink);
+  for (i = 0; i < N_DESTS; i++)
+    g_object_unref (recv[i]);
+  g_object_unref (socket);
+}
+
+GST_END_TEST;
+
+static Suite *
+rtspudpsink_suite (void)
+{
+  Suite *s = suite_create ("rtspudpsink");
+  TCase *tc = tcase_create ("general");
+
+  suite_add_tcase (s, tc);
+  tcase_set_timeout (tc, 20);
+  tcase_add_test (tc, test_add_remove);
+  tcase_add_test (tc, test_send_list);
+  tcase_add_test (tc, test_send_list_gso);
+  tcase_add_test (tc, test_send_threads);
+  tcase_add_test (tc, test_stop_while_sending);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtspudpsink);
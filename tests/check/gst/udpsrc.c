@@ -0,0 +1,355 @@
+/* GStreamer
+ *
+ * unit test for GstRTSPUDPSrc
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/net/gstnetaddressmeta.h>
+#include <gst/rtp/gstrtcpbuffer.h>
+
+#include "rtsp-udp-src.h"
+
+#define PACKET_SIZE     100
+/* the time to wait for something that should happen */
+#define WAIT_TIMEOUT    (5 * G_TIME_SPAN_SECOND)
+
+typedef struct
+{
+  GMutex lock;
+  GCond cond;
+  guint received;
+  GstBuffer *last;
+} Received;
+
+/* a socket on a free port of localhost */
+static GSocket *
+make_socket (void)
+{
+  GSocket *socket;
+  GInetAddress *local;
+  GSocketAddress *addr;
+
+  socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  fail_unless (socket != NULL);
+  local = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  addr = g_inet_socket_address_new (local, 0);
+  fail_unless (g_socket_bind (socket, addr, FALSE, NULL));
+  g_object_unref (addr);
+  g_object_unref (local);
+
+  return socket;
+}
+
+static gint
+get_port (GSocket * socket)
+{
+  GSocketAddress *addr;
+  gint port;
+
+  addr = g_socket_get_local_address (socket, NULL);
+  port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (addr));
+  g_object_unref (addr);
+
+  return port;
+}
+
+/* send @size bytes of @data from @from to the port of @to */
+static void
+send_packet (GSocket * from, GSocket * to, gconstpointer data, gsize size)
+{
+  GSocketAddress *dest;
+
+  dest = g_socket_get_local_address (to, NULL);
+  fail_unless (g_socket_send_to (from, dest, data, size, NULL,
+          NULL) == (gssize) size);
+  g_object_unref (dest);
+}
+
+static void
+handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    Received * received)
+{
+  g_mutex_lock (&received->lock);
+  received->received++;
+  gst_buffer_replace (&received->last, buffer);
+  g_cond_broadcast (&received->cond);
+  g_mutex_unlock (&received->lock);
+}
+
+/* wait until more than @count packets were received */
+static gboolean
+wait_received (Received * received, guint count)
+{
+  gint64 end_time = g_get_monotonic_time () + WAIT_TIMEOUT;
+  gboolean res;
+
+  g_mutex_lock (&received->lock);
+  while (received->received <= count)
+    if (!g_cond_wait_until (&received->cond, &received->lock, end_time))
+      break;
+  res = received->received > count;
+  g_mutex_unlock (&received->lock);
+
+  return res;
+}
+
+static guint
+get_received (Received * received)
+{
+  guint res;
+
+  g_mutex_lock (&received->lock);
+  res = received->received;
+  g_mutex_unlock (&received->lock);
+
+  return res;
+}
+
+/* a pipeline with a source for @socket and a fakesink passing the packets to
+ * @received */
+static GstElement *
+make_pipeline (GstRTSPUDPReceiver * receiver, GSocket * socket,
+    Received * received)
+{
+  GstElement *pipeline, *src, *sink;
+
+  pipeline = gst_pipeline_new (NULL);
+  src = gst_rtsp_udp_src_new (receiver, socket);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  fail_unless (sink != NULL);
+  g_object_set (sink, "sync", FALSE, "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (handoff), received);
+
+  gst_bin_add_many (GST_BIN (pipeline), src, sink, NULL);
+  fail_unless (gst_element_link (src, sink));
+
+  return pipeline;
+}
+
+/* sends packets to a port until stopped */
+typedef struct
+{
+  GSocket *from;
+  GSocket *to;
+  volatile gint running;
+  GThread *thread;
+} Sender;
+
+static gpointer
+send_loop (Sender * sender)
+{
+  gchar data[PACKET_SIZE] = { 0, };
+  GSocketAddress *dest;
+
+  dest = g_socket_get_local_address (sender->to, NULL);
+  while (g_atomic_int_get (&sender->running)) {
+    g_socket_send_to (sender->from, dest, data, sizeof (data), NULL, NULL);
+    g_usleep (100);
+  }
+  g_object_unref (dest);
+
+  return NULL;
+}
+
+GST_START_TEST (test_rtcp_address)
+{
+  GstRTSPUDPReceiver *receiver;
+  GSocket *socket, *from;
+  GstElement *pipeline;
+  GstBuffer *rtcp;
+  GstRTCPBuffer buf = GST_RTCP_BUFFER_INIT;
+  GstRTCPPacket packet;
+  GstNetAddressMeta *meta;
+  GstMapInfo map;
+  Received received = { {0}, };
+
+  /* without epoll there is no receiver */
+  if (!(receiver = gst_rtsp_udp_receiver_new (1)))
+    return;
+
+  g_mutex_init (&received.lock);
+  g_cond_init (&received.cond);
+  socket = make_socket ();
+  from = make_socket ();
+
+  pipeline = make_pipeline (receiver, socket, &received);
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  /* a receiver report like the clients send */
+  rtcp = gst_rtcp_buffer_new (1500);
+  gst_rtcp_buffer_map (rtcp, GST_MAP_READWRITE, &buf);
+  fail_unless (gst_rtcp_buffer_add_packet (&buf, GST_RTCP_TYPE_RR, &packet));
+  gst_rtcp_packet_rr_set_ssrc (&packet, 0x12345678);
+  gst_rtcp_buffer_unmap (&buf);
+
+  gst_buffer_map (rtcp, &map, GST_MAP_READ);
+  send_packet (from, socket, map.data, map.size);
+  gst_buffer_unmap (rtcp, &map);
+  gst_buffer_unref (rtcp);
+
+  fail_unless (wait_received (&received, 0));
+
+  /* the packet has the arrival time and the address of the client, which
+   * rtpbin reports as rtcp-from */
+  g_mutex_lock (&received.lock);
+  fail_unless (gst_rtcp_buffer_validate (received.last));
+  fail_unless (GST_BUFFER_PTS_IS_VALID (received.last));
+  fail_unless (GST_BUFFER_DTS (received.last) ==
+      GST_BUFFER_PTS (received.last));
+  meta = gst_buffer_get_net_address_meta (received.last);
+  fail_unless (meta != NULL);
+  fail_unless (g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS
+          (meta->addr)) == get_port (from));
+  g_mutex_unlock (&received.lock);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_NULL) == GST_STATE_CHANGE_SUCCESS);
+  gst_object_unref (pipeline);
+
+  gst_buffer_replace (&received.last, NULL);
+  g_mutex_clear (&received.lock);
+  g_cond_clear (&received.cond);
+  g_object_unref (from);
+  g_object_unref (socket);
+  g_object_unref (receiver);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_start_stop_flowing)
+{
+  GstRTSPUDPReceiver *receiver;
+  GSocket *socket;
+  GstElement *pipeline;
+  Received received = { {0}, };
+  Sender sender = { 0, };
+  guint i, count;
+
+  if (!(receiver = gst_rtsp_udp_receiver_new (2)))
+    return;
+
+  g_mutex_init (&received.lock);
+  g_cond_init (&received.cond);
+  socket = make_socket ();
+
+  sender.from = make_socket ();
+  sender.to = socket;
+  sender.running = TRUE;
+  sender.thread = g_thread_new ("sender", (GThreadFunc) send_loop, &sender);
+
+  pipeline = make_pipeline (receiver, socket, &received);
+
+  /* the source is added to and removed from the receiver while the packets
+   * arrive, nothing is pushed once it is stopped */
+  for (i = 0; i < 20; i++) {
+    count = get_received (&received);
+    fail_unless (gst_element_set_state (pipeline,
+            GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+    fail_unless (wait_received (&received, count));
+
+    fail_unless (gst_element_set_state (pipeline,
+            GST_STATE_NULL) == GST_STATE_CHANGE_SUCCESS);
+    count = get_received (&received);
+    g_usleep (G_USEC_PER_SEC / 100);
+    fail_unless (get_received (&received) == count);
+  }
+
+  g_atomic_int_set (&sender.running, FALSE);
+  g_thread_join (sender.thread);
+  g_object_unref (sender.from);
+
+  gst_object_unref (pipeline);
+  gst_buffer_replace (&received.last, NULL);
+  g_mutex_clear (&received.lock);
+  g_cond_clear (&received.cond);
+  g_object_unref (socket);
+  g_object_unref (receiver);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_restart_flowing)
+{
+  GstRTSPUDPReceiver *receiver;
+  GSocket *socket;
+  GstElement *pipeline;
+  Received received = { {0}, };
+  Sender sender = { 0, };
+  guint i, count;
+
+  if (!(receiver = gst_rtsp_udp_receiver_new (1)))
+    return;
+
+  g_mutex_init (&received.lock);
+  g_cond_init (&received.cond);
+  socket = make_socket ();
+
+  sender.from = make_socket ();
+  sender.to = socket;
+  sender.running = TRUE;
+  sender.thread = g_thread_new ("sender", (GThreadFunc) send_loop, &sender);
+
+  pipeline = make_pipeline (receiver, socket, &received);
+
+  /* a callback that is flushing when the source goes to READY must not stop
+   * the receiving that was started again after it */
+  for (i = 0; i < 20; i++) {
+    fail_unless (gst_element_set_state (pipeline,
+            GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+    count = get_received (&received);
+    g_usleep (G_USEC_PER_SEC / 100);
+    fail_unless (wait_received (&received, count));
+
+    fail_unless (gst_element_set_state (pipeline,
+            GST_STATE_READY) == GST_STATE_CHANGE_SUCCESS);
+  }
+
+  g_atomic_int_set (&sender.running, FALSE);
+  g_thread_join (sender.thread);
+  g_object_unref (sender.from);
+
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_NULL) == GST_STATE_CHANGE_SUCCESS);
+  gst_object_unref (pipeline);
+  gst_buffer_replace (&received.last, NULL);
+  g_mutex_clear (&received.lock);
+  g_cond_clear (&received.cond);
+  g_object_unref (socket);
+  g_object_unref (receiver);
+}
+
+GST_END_TEST;
+
+static Suite *
+rtspudpsrc_suite (void)
+{
+  Suite *s = suite_create ("rtspudpsrc");
+  TCase *tc = tcase_create ("general");
+
+  suite_add_tcase (s, tc);
+  tcase_set_timeout (tc, 20);
+  tcase_add_test (tc, test_rtcp_address);
+  tcase_add_test (tc, test_start_stop_flowing);
+  tcase_add_test (tc, test_restart_flowing);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtspudpsrc);